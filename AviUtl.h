@@ -106,7 +106,9 @@ namespace AviUtl
 	}
 
 #ifndef _WIN64 // x86環境のみ利用可能
+#ifndef AU_HOST_TEST // ホスト環境でのテストビルドでは構造体のサイズを検査しない
 static_assert(sizeof(void*) == 4, "Error: Architecture not targeted for build.");
+#endif
 
 	/// <summary>
 	/// Filter プラグイン
@@ -2266,12 +2268,14 @@ static_assert(sizeof(void*) == 4, "Error: Architecture not targeted for build.")
 		// Size check
 		static_assert(sizeof(Pixel_YC) == Pixel_YC::Size, "Error: Pixel_YC size does not fit.");
 		static_assert(sizeof(Pixel) == Pixel::Size, "Error: Pixel size does not fit.");
+#ifndef AU_HOST_TEST
 		static_assert(sizeof(FilterProcInfo) == FilterProcInfo::Size, "Error: FilterProcInfo size does not fit.");
 		static_assert(sizeof(FrameStatus) == FrameStatus::Size, "Error: FrameStatus size does not fit.");
 		static_assert(sizeof(FileInfo) == FileInfo::Size, "Error: FileInfo size does not fit.");
 		static_assert(sizeof(SystemInfo) == SystemInfo::Size, "Error: SystemInfo size does not fit.");
 		static_assert(sizeof(CallbackFunctionSet) == CallbackFunctionSet::Size, "Error: CallbackFunctionSet size does not fit.");
 		static_assert(sizeof(FilterPluginTable) == FilterPluginTable::Size, "Error: FilterPluginTable size does not fit.");
+#endif
 	}
 
 	/// <summary>
@@ -2626,8 +2630,10 @@ static_assert(sizeof(void*) == 4, "Error: Architecture not targeted for build.")
 		static_assert(std::is_pod<InputPluginTable>::value, "Error: InputPluginTable is non-POD.");
 
 		// Size check
+#ifndef AU_HOST_TEST
 		static_assert(sizeof(InputInfo) == InputInfo::Size, "Error: InputInfo size does not fit.");
 		static_assert(sizeof(InputPluginTable) == InputPluginTable::Size, "Error: InputPluginTable size does not fit.");
+#endif
 	}
 
 	/// <summary>
@@ -2917,8 +2923,10 @@ static_assert(sizeof(void*) == 4, "Error: Architecture not targeted for build.")
 		static_assert(std::is_pod<OutputPluginTable>::value, "Error: OutputPluginTable is non-POD.");
 
 		// Size check
+#ifndef AU_HOST_TEST
 		static_assert(sizeof(OutputInfo) == OutputInfo::Size, "Error: OutputInfo size does not fit.");
 		static_assert(sizeof(OutputPluginTable) == OutputPluginTable::Size, "Error: OutputPluginTable size does not fit.");
+#endif
 	}
 
 	/// <summary>
@@ -3095,8 +3103,10 @@ static_assert(sizeof(void*) == 4, "Error: Architecture not targeted for build.")
 		static_assert(std::is_pod<ColorPluginTable>::value, "Error: ColorPluginTable is non-POD.");
 
 		// Size check
+#ifndef AU_HOST_TEST
 		static_assert(sizeof(ColorInfo) == ColorInfo::Size, "Error: ColorInfo size does not fit.");
 		static_assert(sizeof(ColorPluginTable) == ColorPluginTable::Size, "Error: ColorPluginTable size does not fit.");
+#endif
 	}
 
 #endif
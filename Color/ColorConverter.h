@@ -0,0 +1,1076 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Filter/MultiThread.h"
+#include "../Utility/BlueNoise.h"
+#include "../Utility/FourCC.h"
+#include "../Utility/Simd.h"
+#include <algorithm>    // std::fill, std::min
+#include <array>        // std::array
+#include <cmath>        // std::lround
+#include <cstddef>      // std::ptrdiff_t
+#include <cstring>      // std::memcpy
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Color プラグイン
+	/// </summary>
+	namespace Color
+	{
+		/// <summary>
+		/// SIMD 色変換プラグイン (BT.601 / BT.709)
+		/// <para>DIB (RGB24 / YUY2) と Pixel_YC の変換を SSSE3 / AVX2 で行い、ExecMultiThread() で行単位に並列化します。</para>
+		/// <para>マトリクスは RGB と Pixel_YC の変換に、レンジは YUY2 と Pixel_YC の変換に使用します。</para>
+		/// <para>BT.601 とリミテッドレンジの組み合わせが AviUtl の既定の変換に相当します。</para>
+		/// <para>Pixel_YC から RGB への変換では、バンディングを避けるための順序ディザ / 誤差拡散を変換と同じ走査で行えます。</para>
+		/// <para>RGB32 はホストから要求されないため、ToYC() / FromYC() を直接呼び出して使用してください。</para>
+		/// </summary>
+		namespace ColorConverter
+		{
+			/// <summary>
+			/// プラグイン名
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(PluginName, "SIMD Color Converter");
+
+			/// <summary>
+			/// プラグインの情報
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(PluginInformation, "SIMD Color Converter version 1.00");
+
+			/// <summary>
+			/// RGB と Pixel_YC の変換に使用するマトリクス
+			/// </summary>
+			enum class ColorMatrix : int {
+				/// <summary>
+				/// BT.601 (AviUtl の既定)
+				/// </summary>
+				Bt601,
+
+				/// <summary>
+				/// BT.709
+				/// </summary>
+				Bt709,
+			};
+
+			/// <summary>
+			/// YUY2 の値の範囲
+			/// </summary>
+			enum class ColorRange : int {
+				/// <summary>
+				/// リミテッドレンジ (Y 16～235, C 16～240、AviUtl の既定)
+				/// </summary>
+				Limited,
+
+				/// <summary>
+				/// フルレンジ (0～255)
+				/// </summary>
+				Full,
+			};
+
+			/// <summary>
+			/// DIB 形式データのフォーマット
+			/// </summary>
+			enum class PixelFormat : int {
+				/// <summary>
+				/// RGB24bit (B, G, R の順)
+				/// </summary>
+				RGB24,
+
+				/// <summary>
+				/// RGB32bit (B, G, R, 予約 の順、予約は 0 で出力します)
+				/// </summary>
+				RGB32,
+
+				/// <summary>
+				/// YUY2 (Y0, U, Y1, V の順)
+				/// </summary>
+				YUY2,
+			};
+
+			/// <summary>
+			/// Pixel_YC から 8bit RGB への変換で使用するディザ
+			/// <para>YUY2 への変換では使用しません。</para>
+			/// </summary>
+			enum class DitherMode : int {
+				/// <summary>
+				/// ディザなし (四捨五入)
+				/// </summary>
+				None,
+
+				/// <summary>
+				/// ブルーノイズの順序ディザ (変換と同じ 1 回の走査で、SIMD で処理します)
+				/// </summary>
+				Ordered,
+
+				/// <summary>
+				/// 誤差拡散 (Floyd-Steinberg、蛇行走査)
+				/// <para>画像を一定の行数のバンドに分けて並列に処理し、各バンドの先頭行の誤差をブルーノイズで初期化して継ぎ目を目立たなくします。</para>
+				/// <para>バンドの分け方はスレッド数によらないため、結果は常に同じです。</para>
+				/// </summary>
+				ErrorDiffusion,
+			};
+
+			/// <summary>
+			/// 動作設定
+			/// <para>GetPluginTable() を返す前に変更してください。</para>
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// RGB と Pixel_YC の変換に使用するマトリクス
+				/// </summary>
+				ColorMatrix Matrix = ColorMatrix::Bt601;
+
+				/// <summary>
+				/// YUY2 の値の範囲
+				/// </summary>
+				ColorRange Range = ColorRange::Limited;
+
+				/// <summary>
+				/// Pixel_YC から RGB への変換で使用するディザ
+				/// </summary>
+				DitherMode Dither = DitherMode::None;
+
+				/// <summary>
+				/// AVX2 を使用する (false なら SSSE3 まで)
+				/// </summary>
+				bool UseAVX2 = true;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			inline Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// RGB と Pixel_YC の変換係数
+				/// <para>RGB -> YC は (R, G), (B, 丸め) の組で 11bit 固定小数点、YC -> RGB は (Y, Cb), (Cr, 丸め値) の組で 13bit 固定小数点です (丸め値は四捨五入なら 4096、順序ディザなら閾値)。</para>
+				/// </summary>
+				struct MatrixCoefficient final
+				{
+					std::array<short, 4> ToY;
+					std::array<short, 4> ToCb;
+					std::array<short, 4> ToCr;
+					std::array<short, 4> ToR;
+					std::array<short, 4> ToG;
+					std::array<short, 4> ToB;
+				};
+
+				/// <summary>
+				/// YUY2 と Pixel_YC の変換係数
+				/// <para>YUY2 -> YC は (乗数, 加算値) の組で、輝度は 6bit、色差は 8bit 右シフトします。</para>
+				/// <para>YC -> YUY2 は 15bit 固定小数点の乗数です (色差は 2 画素の和に掛けます)。</para>
+				/// </summary>
+				struct RangeCoefficient final
+				{
+					std::array<short, 2> ToY;
+					std::array<short, 2> ToC;
+					short FromY;
+					short FromYOffset;
+					short FromC;
+				};
+
+				/// <summary>
+				/// Kr, Kb から変換係数を作成します
+				/// </summary>
+				inline MatrixCoefficient MakeMatrixCoefficient(double kr, double kb)
+				{
+					const double kg = 1.0 - kr - kb;
+					const double toYC = 4096.0 / 255.0 * 2048.0;
+					const double toRGB = 255.0 / 4096.0 * 8192.0;
+					const auto q = [](double value) { return static_cast<short>(std::lround(value)); };
+
+					MatrixCoefficient c = {};
+					c.ToY = { q(kr * toYC), q(kg * toYC), q(kb * toYC), 1024 };
+					c.ToCb = { q(-kr / (2.0 * (1.0 - kb)) * toYC), q(-kg / (2.0 * (1.0 - kb)) * toYC), q(0.5 * toYC), 1024 };
+					c.ToCr = { q(0.5 * toYC), q(-kg / (2.0 * (1.0 - kr)) * toYC), q(-kb / (2.0 * (1.0 - kr)) * toYC), 1024 };
+					c.ToR = { q(toRGB), 0, q(2.0 * (1.0 - kr) * toRGB), 1 };
+					c.ToG = { q(toRGB), q(-2.0 * (1.0 - kb) * kb / kg * toRGB), q(-2.0 * (1.0 - kr) * kr / kg * toRGB), 1 };
+					c.ToB = { q(toRGB), q(2.0 * (1.0 - kb) * toRGB), 0, 1 };
+					return c;
+				}
+
+				/// <summary>
+				/// マトリクスの変換係数を取得します
+				/// </summary>
+				inline const MatrixCoefficient& GetMatrixCoefficient(ColorMatrix matrix)
+				{
+					static const MatrixCoefficient bt601 = MakeMatrixCoefficient(0.299, 0.114);
+					static const MatrixCoefficient bt709 = MakeMatrixCoefficient(0.2126, 0.0722);
+					return matrix == ColorMatrix::Bt709 ? bt709 : bt601;
+				}
+
+				/// <summary>
+				/// レンジの変換係数を取得します
+				/// <para>リミテッドレンジの YUY2 -> YC は AviUtl の既定の変換と同じ値になります。</para>
+				/// </summary>
+				inline const RangeCoefficient& GetRangeCoefficient(ColorRange range)
+				{
+					// (y * 1197 - 299 * 64) >> 6, ((c - 128) * 4681 + 164) >> 8, Y * 219 / 4096 + 16, C * 224 / 4096 + 128
+					static const RangeCoefficient limited = { { 1197, -19136 }, { 4681, 164 }, 1752, 16, 896 };
+					// (y * 1028 + 32) >> 6, ((c - 128) * 4112 + 128) >> 8, Y * 255 / 4096, C * 255 / 4096 + 128
+					static const RangeCoefficient full = { { 1028, 32 }, { 4112, 128 }, 2040, 0, 1020 };
+					return range == ColorRange::Full ? full : limited;
+				}
+
+				/// <summary>
+				/// 値を 0～255 に丸めます
+				/// </summary>
+				inline unsigned char Saturate8(int value)
+				{
+					return static_cast<unsigned char>(value < 0 ? 0 : value > 255 ? 255 : value);
+				}
+
+				/// <summary>
+				/// 値を short の範囲に丸めます
+				/// </summary>
+				inline int Saturate16(int value)
+				{
+					return value < -32768 ? -32768 : value > 32767 ? 32767 : value;
+				}
+
+				/// <summary>
+				/// _mm_mulhrs_epi16 と同じ丸めで乗算します
+				/// </summary>
+				inline int MulHighRound(int value, int coefficient)
+				{
+					return (value * coefficient + 16384) >> 15;
+				}
+
+				/// <summary>
+				/// SSSE3 の演算 (1 レーン = 8 画素)
+				/// </summary>
+				struct Ssse3 final
+				{
+					using Vector = __m128i;
+					enum : int { Lanes = 1 };
+
+					static Vector Broadcast(__m128i v) { return v; }
+					static Vector Set16(short v) { return _mm_set1_epi16(v); }
+					static Vector Set32(int v) { return _mm_set1_epi32(v); }
+					static Vector Zero() { return _mm_setzero_si128(); }
+					static Vector Load(const unsigned char* p, std::ptrdiff_t) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+					static Vector Load32(const unsigned char* p, std::ptrdiff_t)
+					{
+						int value;
+						std::memcpy(&value, p, sizeof(value));
+						return _mm_cvtsi32_si128(value);
+					}
+					static void Store(unsigned char* p, std::ptrdiff_t, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+					static void Store64(unsigned char* p, std::ptrdiff_t, Vector v) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), v); }
+					static void LoadYC(const Pixel_YC* p, Vector& y, Vector& cb, Vector& cr) { Utility::Simd::LoadYC8(p, y, cb, cr); }
+					static void StoreYC(Pixel_YC* p, Vector y, Vector cb, Vector cr) { Utility::Simd::StoreYC8(p, y, cb, cr); }
+					static Vector Add16(Vector a, Vector b) { return _mm_add_epi16(a, b); }
+					static Vector Sub16(Vector a, Vector b) { return _mm_sub_epi16(a, b); }
+					static Vector Add32(Vector a, Vector b) { return _mm_add_epi32(a, b); }
+					static Vector Madd(Vector a, Vector b) { return _mm_madd_epi16(a, b); }
+					static Vector Mulhrs(Vector a, Vector b) { return _mm_mulhrs_epi16(a, b); }
+					static Vector Avg16(Vector a, Vector b) { return _mm_avg_epu16(a, b); }
+					static Vector Packs32(Vector a, Vector b) { return _mm_packs_epi32(a, b); }
+					static Vector Packus16(Vector a, Vector b) { return _mm_packus_epi16(a, b); }
+					static Vector Shuffle8(Vector a, Vector mask) { return _mm_shuffle_epi8(a, mask); }
+					static Vector Unpacklo8(Vector a, Vector b) { return _mm_unpacklo_epi8(a, b); }
+					static Vector Unpacklo16(Vector a, Vector b) { return _mm_unpacklo_epi16(a, b); }
+					static Vector Unpackhi16(Vector a, Vector b) { return _mm_unpackhi_epi16(a, b); }
+					static Vector And(Vector a, Vector b) { return _mm_and_si128(a, b); }
+					static Vector AndNot(Vector a, Vector b) { return _mm_andnot_si128(a, b); }
+					static Vector Or(Vector a, Vector b) { return _mm_or_si128(a, b); }
+					template<int N> static Vector Srai32(Vector a) { return _mm_srai_epi32(a, N); }
+					template<int N> static Vector Srli16(Vector a) { return _mm_srli_epi16(a, N); }
+					template<int N> static Vector Srli32(Vector a) { return _mm_srli_epi32(a, N); }
+					template<int N> static Vector Slli32(Vector a) { return _mm_slli_epi32(a, N); }
+					template<int N> static Vector ShiftBytesRight(Vector a) { return _mm_srli_si128(a, N); }
+					template<int N> static Vector ShiftBytesLeft(Vector a) { return _mm_slli_si128(a, N); }
+				};
+
+				/// <summary>
+				/// AVX2 の演算 (2 レーン = 16 画素)
+				/// <para>各 128bit レーンに 8 画素ずつ読み込み、レーン内の演算だけで SSSE3 版と同じ結果を求めます。</para>
+				/// </summary>
+				struct Avx2 final
+				{
+					using Vector = __m256i;
+					enum : int { Lanes = 2 };
+
+					static Vector Combine(__m128i lo, __m128i hi) { return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1); }
+					static Vector Broadcast(__m128i v) { return _mm256_broadcastsi128_si256(v); }
+					static Vector Set16(short v) { return _mm256_set1_epi16(v); }
+					static Vector Set32(int v) { return _mm256_set1_epi32(v); }
+					static Vector Zero() { return _mm256_setzero_si256(); }
+					static Vector Load(const unsigned char* p, std::ptrdiff_t stride) { return Combine(Ssse3::Load(p, 0), Ssse3::Load(p + stride, 0)); }
+					static Vector Load32(const unsigned char* p, std::ptrdiff_t stride) { return Combine(Ssse3::Load32(p, 0), Ssse3::Load32(p + stride, 0)); }
+					static void Store(unsigned char* p, std::ptrdiff_t stride, Vector v)
+					{
+						Ssse3::Store(p, 0, _mm256_castsi256_si128(v));
+						Ssse3::Store(p + stride, 0, _mm256_extracti128_si256(v, 1));
+					}
+					static void Store64(unsigned char* p, std::ptrdiff_t stride, Vector v)
+					{
+						Ssse3::Store64(p, 0, _mm256_castsi256_si128(v));
+						Ssse3::Store64(p + stride, 0, _mm256_extracti128_si256(v, 1));
+					}
+					static void LoadYC(const Pixel_YC* p, Vector& y, Vector& cb, Vector& cr)
+					{
+						__m128i y0, cb0, cr0, y1, cb1, cr1;
+						Utility::Simd::LoadYC8(p, y0, cb0, cr0);
+						Utility::Simd::LoadYC8(p + 8, y1, cb1, cr1);
+						y = Combine(y0, y1);
+						cb = Combine(cb0, cb1);
+						cr = Combine(cr0, cr1);
+					}
+					static void StoreYC(Pixel_YC* p, Vector y, Vector cb, Vector cr)
+					{
+						Utility::Simd::StoreYC8(p, _mm256_castsi256_si128(y), _mm256_castsi256_si128(cb), _mm256_castsi256_si128(cr));
+						Utility::Simd::StoreYC8(p + 8, _mm256_extracti128_si256(y, 1), _mm256_extracti128_si256(cb, 1), _mm256_extracti128_si256(cr, 1));
+					}
+					static Vector Add16(Vector a, Vector b) { return _mm256_add_epi16(a, b); }
+					static Vector Sub16(Vector a, Vector b) { return _mm256_sub_epi16(a, b); }
+					static Vector Add32(Vector a, Vector b) { return _mm256_add_epi32(a, b); }
+					static Vector Madd(Vector a, Vector b) { return _mm256_madd_epi16(a, b); }
+					static Vector Mulhrs(Vector a, Vector b) { return _mm256_mulhrs_epi16(a, b); }
+					static Vector Avg16(Vector a, Vector b) { return _mm256_avg_epu16(a, b); }
+					static Vector Packs32(Vector a, Vector b) { return _mm256_packs_epi32(a, b); }
+					static Vector Packus16(Vector a, Vector b) { return _mm256_packus_epi16(a, b); }
+					static Vector Shuffle8(Vector a, Vector mask) { return _mm256_shuffle_epi8(a, mask); }
+					static Vector Unpacklo8(Vector a, Vector b) { return _mm256_unpacklo_epi8(a, b); }
+					static Vector Unpacklo16(Vector a, Vector b) { return _mm256_unpacklo_epi16(a, b); }
+					static Vector Unpackhi16(Vector a, Vector b) { return _mm256_unpackhi_epi16(a, b); }
+					static Vector And(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+					static Vector AndNot(Vector a, Vector b) { return _mm256_andnot_si256(a, b); }
+					static Vector Or(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+					template<int N> static Vector Srai32(Vector a) { return _mm256_srai_epi32(a, N); }
+					template<int N> static Vector Srli16(Vector a) { return _mm256_srli_epi16(a, N); }
+					template<int N> static Vector Srli32(Vector a) { return _mm256_srli_epi32(a, N); }
+					template<int N> static Vector Slli32(Vector a) { return _mm256_slli_epi32(a, N); }
+					template<int N> static Vector ShiftBytesRight(Vector a) { return _mm256_srli_si256(a, N); }
+					template<int N> static Vector ShiftBytesLeft(Vector a) { return _mm256_slli_si256(a, N); }
+				};
+
+				/// <summary>
+				/// 2 つの 16bit 要素の組を掛けて足し、右シフトします
+				/// </summary>
+				template<class Isa, int Shift>
+				inline typename Isa::Vector Dot(typename Isa::Vector ab, typename Isa::Vector cd, typename Isa::Vector k0, typename Isa::Vector k1)
+				{
+					return Isa::template Srai32<Shift>(Isa::Add32(Isa::Madd(ab, k0), Isa::Madd(cd, k1)));
+				}
+
+				/// <summary>
+				/// 16bit 要素を係数の組 (乗数, 加算値) で変換して右シフトします
+				/// </summary>
+				template<class Isa, int Shift>
+				inline typename Isa::Vector MulAddShift(typename Isa::Vector value, typename Isa::Vector coefficient)
+				{
+					const typename Isa::Vector one = Isa::Set16(1);
+					return Isa::Packs32(
+						Isa::template Srai32<Shift>(Isa::Madd(Isa::Unpacklo16(value, one), coefficient)),
+						Isa::template Srai32<Shift>(Isa::Madd(Isa::Unpackhi16(value, one), coefficient)));
+				}
+
+				/// <summary>
+				/// 係数の組をベクトルに展開します
+				/// </summary>
+				template<class Isa>
+				inline typename Isa::Vector Pair(short a, short b)
+				{
+					return Isa::Set32(static_cast<int>(static_cast<unsigned short>(a) | (static_cast<unsigned int>(static_cast<unsigned short>(b)) << 16)));
+				}
+
+				/// <summary>
+				/// 1 行の RGB24 / RGB32 を Pixel_YC に変換します (スカラー版)
+				/// </summary>
+				template<int Bytes>
+				inline void RowRGBToYC_Scalar(const unsigned char* pSrc, Pixel_YC* pDst, int begin, int width, const MatrixCoefficient& c)
+				{
+					for (int x = begin; x < width; ++x) {
+						const int b = pSrc[x * Bytes + 0];
+						const int g = pSrc[x * Bytes + 1];
+						const int r = pSrc[x * Bytes + 2];
+						pDst[x].Y = static_cast<short>((r * c.ToY[0] + g * c.ToY[1] + b * c.ToY[2] + c.ToY[3]) >> 11);
+						pDst[x].Cb = static_cast<short>((r * c.ToCb[0] + g * c.ToCb[1] + b * c.ToCb[2] + c.ToCb[3]) >> 11);
+						pDst[x].Cr = static_cast<short>((r * c.ToCr[0] + g * c.ToCr[1] + b * c.ToCr[2] + c.ToCr[3]) >> 11);
+					}
+				}
+
+				/// <summary>
+				/// 1 行の RGB24 / RGB32 を Pixel_YC に変換します
+				/// </summary>
+				/// <returns>
+				/// 変換しなかった先頭の画素位置
+				/// </returns>
+				template<class Isa, int Bytes>
+				inline int RowRGBToYC(const unsigned char* pSrc, Pixel_YC* pDst, int begin, int width, const MatrixCoefficient& c)
+				{
+					using Vector = typename Isa::Vector;
+					// 8 画素を前半 4 画素 (lo) と後半 4 画素 (hi) に分けて読み込む (RGB24 は 8byte 目から読み込み、その 4byte 目から後半)
+					const int hiLoad = Bytes == 3 ? 8 : 16;
+					const int o = Bytes == 3 ? 4 : 0;
+					const int s = Bytes;
+					const Vector rgLoMask = Isa::Broadcast(_mm_setr_epi8(
+						2, -1, 1, -1, s + 2, -1, s + 1, -1, 2 * s + 2, -1, 2 * s + 1, -1, 3 * s + 2, -1, 3 * s + 1, -1));
+					const Vector bLoMask = Isa::Broadcast(_mm_setr_epi8(
+						0, -1, -1, -1, s, -1, -1, -1, 2 * s, -1, -1, -1, 3 * s, -1, -1, -1));
+					const Vector rgHiMask = Isa::Broadcast(_mm_setr_epi8(
+						o + 2, -1, o + 1, -1, o + s + 2, -1, o + s + 1, -1, o + 2 * s + 2, -1, o + 2 * s + 1, -1, o + 3 * s + 2, -1, o + 3 * s + 1, -1));
+					const Vector bHiMask = Isa::Broadcast(_mm_setr_epi8(
+						o, -1, -1, -1, o + s, -1, -1, -1, o + 2 * s, -1, -1, -1, o + 3 * s, -1, -1, -1));
+					const Vector one = Isa::Set32(0x00010000);
+					const Vector y0 = Pair<Isa>(c.ToY[0], c.ToY[1]), y1 = Pair<Isa>(c.ToY[2], c.ToY[3]);
+					const Vector cb0 = Pair<Isa>(c.ToCb[0], c.ToCb[1]), cb1 = Pair<Isa>(c.ToCb[2], c.ToCb[3]);
+					const Vector cr0 = Pair<Isa>(c.ToCr[0], c.ToCr[1]), cr1 = Pair<Isa>(c.ToCr[2], c.ToCr[3]);
+					const std::ptrdiff_t stride = 8 * Bytes;
+
+					int x = begin;
+					for (; x + 8 * Isa::Lanes <= width; x += 8 * Isa::Lanes) {
+						const unsigned char* p = pSrc + static_cast<std::ptrdiff_t>(x) * Bytes;
+						const Vector lo = Isa::Load(p, stride);
+						const Vector hi = Isa::Load(p + hiLoad, stride);
+						const Vector rgLo = Isa::Shuffle8(lo, rgLoMask);
+						const Vector bLo = Isa::Or(Isa::Shuffle8(lo, bLoMask), one);
+						const Vector rgHi = Isa::Shuffle8(hi, rgHiMask);
+						const Vector bHi = Isa::Or(Isa::Shuffle8(hi, bHiMask), one);
+						Isa::StoreYC(pDst + x,
+							Isa::Packs32(Dot<Isa, 11>(rgLo, bLo, y0, y1), Dot<Isa, 11>(rgHi, bHi, y0, y1)),
+							Isa::Packs32(Dot<Isa, 11>(rgLo, bLo, cb0, cb1), Dot<Isa, 11>(rgHi, bHi, cb0, cb1)),
+							Isa::Packs32(Dot<Isa, 11>(rgLo, bLo, cr0, cr1), Dot<Isa, 11>(rgHi, bHi, cr0, cr1)));
+					}
+					return x;
+				}
+
+				/// <summary>
+				/// 順序ディザの閾値テーブルを取得します
+				/// <para>ブルーノイズの順位を 13bit 固定小数点の丸め値 (1 ～ 8191) にしたもので、各行は BlueNoise と同じく横に 2 回繰り返しています。</para>
+				/// </summary>
+				inline const std::vector<short>& GetDitherThreshold()
+				{
+					static const std::vector<short> threshold = []() {
+						const Utility::BlueNoise& noise = Utility::BlueNoise::Get();
+						std::vector<short> t(static_cast<std::size_t>(Utility::BlueNoise::Count) * 2);
+						for (std::size_t i = 0; i < t.size(); ++i) {
+							t[i] = static_cast<short>(noise.GetRow(0)[i] * 2 + 1);
+						}
+						return t;
+					}();
+					return threshold;
+				}
+
+				/// <summary>
+				/// 1 行分の順序ディザの閾値 (チャンネルごとに別の行を使用して相関を避けます)
+				/// </summary>
+				struct DitherRow final
+				{
+					const short* pR;
+					const short* pG;
+					const short* pB;
+				};
+
+				/// <summary>
+				/// y 行目の順序ディザの閾値を取得します
+				/// </summary>
+				inline DitherRow GetDitherRow(int y)
+				{
+					const short* pTable = GetDitherThreshold().data();
+					const auto row = [pTable](int v) { return pTable + static_cast<std::ptrdiff_t>(v & (Utility::BlueNoise::Size - 1)) * Utility::BlueNoise::Size * 2; };
+					return { row(y), row(y + 21), row(y + 42) };
+				}
+
+				/// <summary>
+				/// 1 行の Pixel_YC を RGB24 / RGB32 に変換します (スカラー版)
+				/// </summary>
+				/// <param name="pDither">順序ディザの閾値 (nullptr なら四捨五入)</param>
+				template<int Bytes>
+				inline void RowYCToRGB_Scalar(const Pixel_YC* pSrc, unsigned char* pDst, int begin, int width, const MatrixCoefficient& c, const DitherRow* pDither)
+				{
+					for (int x = begin; x < width; ++x) {
+						const int y = pSrc[x].Y;
+						const int cb = pSrc[x].Cb;
+						const int cr = pSrc[x].Cr;
+						const int column = x & (Utility::BlueNoise::Size - 1);
+						const int tr = pDither != nullptr ? pDither->pR[column] : 4096;
+						const int tg = pDither != nullptr ? pDither->pG[column] : 4096;
+						const int tb = pDither != nullptr ? pDither->pB[column] : 4096;
+						pDst[x * Bytes + 0] = Saturate8((y * c.ToB[0] + cb * c.ToB[1] + cr * c.ToB[2] + tb * c.ToB[3]) >> 13);
+						pDst[x * Bytes + 1] = Saturate8((y * c.ToG[0] + cb * c.ToG[1] + cr * c.ToG[2] + tg * c.ToG[3]) >> 13);
+						pDst[x * Bytes + 2] = Saturate8((y * c.ToR[0] + cb * c.ToR[1] + cr * c.ToR[2] + tr * c.ToR[3]) >> 13);
+						if (Bytes == 4) {
+							pDst[x * Bytes + 3] = 0;
+						}
+					}
+				}
+
+				/// <summary>
+				/// 1 行の Pixel_YC を RGB24 / RGB32 に変換します
+				/// <para>Ordered が true なら、四捨五入の代わりに pDither の閾値で丸めます (変換と同じ 1 回の走査で行います)。</para>
+				/// </summary>
+				/// <returns>
+				/// 変換しなかった先頭の画素位置
+				/// </returns>
+				template<class Isa, int Bytes, bool Ordered>
+				inline int RowYCToRGB(const Pixel_YC* pSrc, unsigned char* pDst, int begin, int width, const MatrixCoefficient& c, const DitherRow* pDither)
+				{
+					using Vector = typename Isa::Vector;
+					const Vector half = Isa::Set16(4096);
+					const Vector r0 = Pair<Isa>(c.ToR[0], c.ToR[1]), r1 = Pair<Isa>(c.ToR[2], c.ToR[3]);
+					const Vector g0 = Pair<Isa>(c.ToG[0], c.ToG[1]), g1 = Pair<Isa>(c.ToG[2], c.ToG[3]);
+					const Vector b0 = Pair<Isa>(c.ToB[0], c.ToB[1]), b1 = Pair<Isa>(c.ToB[2], c.ToB[3]);
+					// rb = R0..R7 B0..B7, gg = G0..G7 G0..G7 から B, G, R の順に並べ替える
+					const Vector rbMask0 = Isa::Broadcast(_mm_setr_epi8(8, -1, 0, 9, -1, 1, 10, -1, 2, 11, -1, 3, 12, -1, 4, 13));
+					const Vector gMask0 = Isa::Broadcast(_mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1));
+					const Vector rbMask1 = Isa::Broadcast(_mm_setr_epi8(-1, 5, 14, -1, 6, 15, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1));
+					const Vector gMask1 = Isa::Broadcast(_mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+					const std::ptrdiff_t stride = 8 * Bytes;
+					const auto threshold = [&half](const short* pRow, int x) {
+						// x は 8 の倍数のため、行の繰り返しを越えずに 16 画素まで連続して読める
+						return Ordered ? Isa::Load(reinterpret_cast<const unsigned char*>(pRow + (x & (Utility::BlueNoise::Size - 1))), 16) : half;
+					};
+
+					int x = begin;
+					for (; x + 8 * Isa::Lanes <= width; x += 8 * Isa::Lanes) {
+						Vector y, cb, cr;
+						Isa::LoadYC(pSrc + x, y, cb, cr);
+						const Vector tr = threshold(Ordered ? pDither->pR : nullptr, x);
+						const Vector tg = threshold(Ordered ? pDither->pG : nullptr, x);
+						const Vector tb = threshold(Ordered ? pDither->pB : nullptr, x);
+						const Vector ycbLo = Isa::Unpacklo16(y, cb), ycbHi = Isa::Unpackhi16(y, cb);
+						const Vector r = Isa::Packs32(
+							Dot<Isa, 13>(ycbLo, Isa::Unpacklo16(cr, tr), r0, r1), Dot<Isa, 13>(ycbHi, Isa::Unpackhi16(cr, tr), r0, r1));
+						const Vector g = Isa::Packs32(
+							Dot<Isa, 13>(ycbLo, Isa::Unpacklo16(cr, tg), g0, g1), Dot<Isa, 13>(ycbHi, Isa::Unpackhi16(cr, tg), g0, g1));
+						const Vector b = Isa::Packs32(
+							Dot<Isa, 13>(ycbLo, Isa::Unpacklo16(cr, tb), b0, b1), Dot<Isa, 13>(ycbHi, Isa::Unpackhi16(cr, tb), b0, b1));
+						const Vector rb = Isa::Packus16(r, b);
+						const Vector gg = Isa::Packus16(g, g);
+
+						unsigned char* p = pDst + static_cast<std::ptrdiff_t>(x) * Bytes;
+						if (Bytes == 3) {
+							Isa::Store(p, stride, Isa::Or(Isa::Shuffle8(rb, rbMask0), Isa::Shuffle8(gg, gMask0)));
+							Isa::Store64(p + 16, stride, Isa::Or(Isa::Shuffle8(rb, rbMask1), Isa::Shuffle8(gg, gMask1)));
+						}
+						else {
+							const Vector bg = Isa::Unpacklo8(Isa::template ShiftBytesRight<8>(rb), gg);
+							const Vector ra = Isa::Unpacklo8(rb, Isa::Zero());
+							Isa::Store(p, stride, Isa::Unpacklo16(bg, ra));
+							Isa::Store(p + 16, stride, Isa::Unpackhi16(bg, ra));
+						}
+					}
+					return x;
+				}
+
+				/// <summary>
+				/// 1 行の Pixel_YC を丸める前の RGB (13bit 固定小数点) に変換します (スカラー版)
+				/// </summary>
+				inline void RowYCToLinear_Scalar(const Pixel_YC* pSrc, int* pR, int* pG, int* pB, int begin, int width, const MatrixCoefficient& c)
+				{
+					for (int x = begin; x < width; ++x) {
+						const int y = pSrc[x].Y;
+						const int cb = pSrc[x].Cb;
+						const int cr = pSrc[x].Cr;
+						pR[x] = y * c.ToR[0] + cb * c.ToR[1] + cr * c.ToR[2];
+						pG[x] = y * c.ToG[0] + cb * c.ToG[1] + cr * c.ToG[2];
+						pB[x] = y * c.ToB[0] + cb * c.ToB[1] + cr * c.ToB[2];
+					}
+				}
+
+				/// <summary>
+				/// 1 行の Pixel_YC を丸める前の RGB (13bit 固定小数点) に変換します
+				/// </summary>
+				/// <returns>
+				/// 変換しなかった先頭の画素位置
+				/// </returns>
+				template<class Isa>
+				inline int RowYCToLinear(const Pixel_YC* pSrc, int* pR, int* pG, int* pB, int begin, int width, const MatrixCoefficient& c)
+				{
+					using Vector = typename Isa::Vector;
+					const Vector zero = Isa::Zero();
+					const Vector r0 = Pair<Isa>(c.ToR[0], c.ToR[1]), r1 = Pair<Isa>(c.ToR[2], 0);
+					const Vector g0 = Pair<Isa>(c.ToG[0], c.ToG[1]), g1 = Pair<Isa>(c.ToG[2], 0);
+					const Vector b0 = Pair<Isa>(c.ToB[0], c.ToB[1]), b1 = Pair<Isa>(c.ToB[2], 0);
+					const auto store = [](int* p, Vector lo, Vector hi) {
+						Isa::Store(reinterpret_cast<unsigned char*>(p), 32, lo);
+						Isa::Store(reinterpret_cast<unsigned char*>(p + 4), 32, hi);
+					};
+
+					int x = begin;
+					for (; x + 8 * Isa::Lanes <= width; x += 8 * Isa::Lanes) {
+						Vector y, cb, cr;
+						Isa::LoadYC(pSrc + x, y, cb, cr);
+						const Vector ycbLo = Isa::Unpacklo16(y, cb), ycbHi = Isa::Unpackhi16(y, cb);
+						const Vector crLo = Isa::Unpacklo16(cr, zero), crHi = Isa::Unpackhi16(cr, zero);
+						store(pR + x, Isa::Add32(Isa::Madd(ycbLo, r0), Isa::Madd(crLo, r1)), Isa::Add32(Isa::Madd(ycbHi, r0), Isa::Madd(crHi, r1)));
+						store(pG + x, Isa::Add32(Isa::Madd(ycbLo, g0), Isa::Madd(crLo, g1)), Isa::Add32(Isa::Madd(ycbHi, g0), Isa::Madd(crHi, g1)));
+						store(pB + x, Isa::Add32(Isa::Madd(ycbLo, b0), Isa::Madd(crLo, b1)), Isa::Add32(Isa::Madd(ycbHi, b0), Isa::Madd(crHi, b1)));
+					}
+					return x;
+				}
+
+				/// <summary>
+				/// 丸める前の 1 チャンネル 1 行を誤差拡散 (Floyd-Steinberg) で 8bit にします
+				/// <para>pCurrent / pNext は 1 画素ずらした width + 2 要素の誤差で、direction が -1 なら右から左へ処理します (蛇行走査)。</para>
+				/// </summary>
+				inline void DiffuseRow(const int* pValue, int* pCurrent, int* pNext, unsigned char* pDst, int bytes, int width, int direction)
+				{
+					const int maxValue = 255 << 13;
+					const int first = direction > 0 ? 0 : width - 1;
+					for (int i = 0, x = first; i < width; ++i, x += direction) {
+						int value = pValue[x] + pCurrent[x + 1];
+						value = value < 0 ? 0 : value > maxValue ? maxValue : value;
+						const int quantized = (value + 4096) >> 13;
+						const int error = value - (quantized << 13);
+						const int e7 = (error * 7) >> 4;
+						const int e3 = (error * 3) >> 4;
+						const int e5 = (error * 5) >> 4;
+						pCurrent[x + 1 + direction] += e7;
+						pNext[x + 1 - direction] += e3;
+						pNext[x + 1] += e5;
+						pNext[x + 1 + direction] += error - e7 - e3 - e5;
+						pDst[x * bytes] = static_cast<unsigned char>(quantized);
+					}
+				}
+
+				/// <summary>
+				/// 1 行の YUY2 を Pixel_YC に変換します (スカラー版)
+				/// <para>奇数画素の色差は前後の偶数画素の平均です (行末は直前の値を使用します)。</para>
+				/// </summary>
+				inline void RowYUY2ToYC_Scalar(const unsigned char* pSrc, Pixel_YC* pDst, int begin, int width, const RangeCoefficient& c)
+				{
+					const auto toY = [&c](int y) { return static_cast<short>((y * c.ToY[0] + c.ToY[1]) >> 6); };
+					const auto toC = [&c](int v) { return static_cast<short>(((v - 128) * c.ToC[0] + c.ToC[1]) >> 8); };
+					for (int x = begin; x + 1 < width; x += 2) {
+						const unsigned char* p = pSrc + x * 2;
+						const bool last = x + 2 >= width;
+						const int u = p[1];
+						const int v = p[3];
+						const int nextU = last ? u : p[5];
+						const int nextV = last ? v : p[7];
+						pDst[x].Y = toY(p[0]);
+						pDst[x].Cb = toC(u);
+						pDst[x].Cr = toC(v);
+						pDst[x + 1].Y = toY(p[2]);
+						pDst[x + 1].Cb = toC((u + nextU + 1) >> 1);
+						pDst[x + 1].Cr = toC((v + nextV + 1) >> 1);
+					}
+				}
+
+				/// <summary>
+				/// 1 行の YUY2 を Pixel_YC に変換します
+				/// <para>奇数画素の補間で次の 2 画素の色差を読むため、行末の 2 画素は変換しません。</para>
+				/// </summary>
+				/// <returns>
+				/// 変換しなかった先頭の画素位置
+				/// </returns>
+				template<class Isa>
+				inline int RowYUY2ToYC(const unsigned char* pSrc, Pixel_YC* pDst, int begin, int width, const RangeCoefficient& c)
+				{
+					using Vector = typename Isa::Vector;
+					const Vector lowMask = Isa::Set16(0x00FF);
+					const Vector lowWord = Isa::Set32(0x0000FFFF);
+					const Vector bias = Isa::Set16(128);
+					const Vector yCoefficient = Pair<Isa>(c.ToY[0], c.ToY[1]);
+					const Vector cCoefficient = Pair<Isa>(c.ToC[0], c.ToC[1]);
+
+					int x = begin;
+					for (; x + 8 * Isa::Lanes < width; x += 8 * Isa::Lanes) {
+						const unsigned char* p = pSrc + static_cast<std::ptrdiff_t>(x) * 2;
+						const Vector v = Isa::Load(p, 16);
+						const Vector uv = Isa::template Srli16<8>(v);                            // U0 V0 U1 V1 U2 V2 U3 V3
+						const Vector nextUV = Isa::template Srli16<8>(Isa::Load32(p + 16, 16)); // U4 V4
+						const Vector odd = Isa::Avg16(uv, Isa::Or(Isa::template ShiftBytesRight<4>(uv), Isa::template ShiftBytesLeft<12>(nextUV)));
+						const Vector cb = Isa::Or(Isa::And(uv, lowWord), Isa::template Slli32<16>(odd));
+						const Vector cr = Isa::Or(Isa::template Srli32<16>(uv), Isa::AndNot(lowWord, odd));
+						Isa::StoreYC(pDst + x,
+							MulAddShift<Isa, 6>(Isa::And(v, lowMask), yCoefficient),
+							MulAddShift<Isa, 8>(Isa::Sub16(cb, bias), cCoefficient),
+							MulAddShift<Isa, 8>(Isa::Sub16(cr, bias), cCoefficient));
+					}
+					return x;
+				}
+
+				/// <summary>
+				/// 1 行の Pixel_YC を YUY2 に変換します (スカラー版)
+				/// <para>色差は 2 画素の平均です。</para>
+				/// </summary>
+				inline void RowYCToYUY2_Scalar(const Pixel_YC* pSrc, unsigned char* pDst, int begin, int width, const RangeCoefficient& c)
+				{
+					for (int x = begin; x + 1 < width; x += 2) {
+						unsigned char* p = pDst + x * 2;
+						p[0] = Saturate8(MulHighRound(pSrc[x].Y, c.FromY) + c.FromYOffset);
+						p[1] = Saturate8(MulHighRound(Saturate16(pSrc[x].Cb + pSrc[x + 1].Cb), c.FromC) + 128);
+						p[2] = Saturate8(MulHighRound(pSrc[x + 1].Y, c.FromY) + c.FromYOffset);
+						p[3] = Saturate8(MulHighRound(Saturate16(pSrc[x].Cr + pSrc[x + 1].Cr), c.FromC) + 128);
+					}
+				}
+
+				/// <summary>
+				/// 1 行の Pixel_YC を YUY2 に変換します
+				/// </summary>
+				/// <returns>
+				/// 変換しなかった先頭の画素位置
+				/// </returns>
+				template<class Isa>
+				inline int RowYCToYUY2(const Pixel_YC* pSrc, unsigned char* pDst, int begin, int width, const RangeCoefficient& c)
+				{
+					using Vector = typename Isa::Vector;
+					const Vector one = Isa::Set16(1);
+					const Vector fromY = Isa::Set16(c.FromY);
+					const Vector offsetY = Isa::Set16(c.FromYOffset);
+					const Vector fromC = Isa::Set16(c.FromC);
+					const Vector bias = Isa::Set16(128);
+
+					int x = begin;
+					for (; x + 8 * Isa::Lanes <= width; x += 8 * Isa::Lanes) {
+						Vector y, cb, cr;
+						Isa::LoadYC(pSrc + x, y, cb, cr);
+						const Vector yy = Isa::Add16(Isa::Mulhrs(y, fromY), offsetY);
+						const Vector sum = Isa::Packs32(Isa::Madd(cb, one), Isa::Madd(cr, one)); // U0 U1 U2 U3 V0 V1 V2 V3
+						const Vector uv = Isa::Add16(Isa::Mulhrs(Isa::Unpacklo16(sum, Isa::template ShiftBytesRight<8>(sum)), fromC), bias);
+						Isa::Store(pDst + static_cast<std::ptrdiff_t>(x) * 2, 16, Isa::Packus16(Isa::Unpacklo16(yy, uv), Isa::Unpackhi16(yy, uv)));
+					}
+					return x;
+				}
+
+				/// <summary>
+				/// 1 行を Pixel_YC に変換します
+				/// </summary>
+				template<class Isa>
+				inline int RowToYC(PixelFormat format, const unsigned char* pSrc, Pixel_YC* pDst, int begin, int width, const MatrixCoefficient& matrix, const RangeCoefficient& range)
+				{
+					switch (format) {
+					case PixelFormat::RGB24: return RowRGBToYC<Isa, 3>(pSrc, pDst, begin, width, matrix);
+					case PixelFormat::RGB32: return RowRGBToYC<Isa, 4>(pSrc, pDst, begin, width, matrix);
+					default: return RowYUY2ToYC<Isa>(pSrc, pDst, begin, width, range);
+					}
+				}
+
+				/// <summary>
+				/// 1 行を Pixel_YC から変換します
+				/// </summary>
+				template<class Isa>
+				inline int RowFromYC(PixelFormat format, const Pixel_YC* pSrc, unsigned char* pDst, int begin, int width, const MatrixCoefficient& matrix, const RangeCoefficient& range, const DitherRow* pDither)
+				{
+					switch (format) {
+					case PixelFormat::RGB24:
+						return pDither != nullptr ? RowYCToRGB<Isa, 3, true>(pSrc, pDst, begin, width, matrix, pDither) : RowYCToRGB<Isa, 3, false>(pSrc, pDst, begin, width, matrix, nullptr);
+					case PixelFormat::RGB32:
+						return pDither != nullptr ? RowYCToRGB<Isa, 4, true>(pSrc, pDst, begin, width, matrix, pDither) : RowYCToRGB<Isa, 4, false>(pSrc, pDst, begin, width, matrix, nullptr);
+					default: return RowYCToYUY2<Isa>(pSrc, pDst, begin, width, range);
+					}
+				}
+
+				/// <summary>
+				/// 使用する命令セット
+				/// </summary>
+				enum class Path : int {
+					Scalar,
+					Ssse3,
+					Avx2,
+				};
+
+				/// <summary>
+				/// ColorInfo のフラグと CPU から使用する命令セットを選択します
+				/// <para>AviUtl が SSE2 の使用を許可している場合のみ SIMD を使用します。</para>
+				/// </summary>
+				inline Path SelectPath(const ColorInfo& info)
+				{
+					if ((info.Flag & ColorInfo::InfoFlag::UseSSE2) != ColorInfo::InfoFlag::UseSSE2 || !Utility::Simd::Has(Utility::Simd::Feature::SSSE3)) {
+						return Path::Scalar;
+					}
+					if (GetSettings().UseAVX2 && Utility::Simd::Has(Utility::Simd::Feature::AVX2)) {
+						return Path::Avx2;
+					}
+					return Path::Ssse3;
+				}
+
+				/// <summary>
+				/// DIB 形式データの 1 行のバイト数を取得します (4byte 境界)
+				/// </summary>
+				inline std::ptrdiff_t GetPixelLineSize(PixelFormat format, int width)
+				{
+					const int bits = format == PixelFormat::RGB24 ? 24 : format == PixelFormat::RGB32 ? 32 : 16;
+					return (static_cast<std::ptrdiff_t>(width) * bits + 31) / 32 * 4;
+				}
+
+				/// <summary>
+				/// 変換の前提条件を確認します
+				/// </summary>
+				inline bool IsConvertible(const ColorInfo& info, PixelFormat format)
+				{
+					if (info.pYC == nullptr || info.pPixel == nullptr || info.Width <= 0 || info.Height <= 0) {
+						return false;
+					}
+					if (info.YC_Size != static_cast<int>(sizeof(Pixel_YC)) || info.Line_Size < info.Width * info.YC_Size) {
+						return false;
+					}
+					// YUY2 は 2 画素単位
+					return format != PixelFormat::YUY2 || (info.Width & 1) == 0;
+				}
+
+				/// <summary>
+				/// DIB 形式データの y 行目 (Pixel_YC の行番号) のアドレスを取得します
+				/// </summary>
+				inline unsigned char* GetPixelLine(const ColorInfo& info, std::ptrdiff_t lineSize, int y)
+				{
+					const bool invert = (info.Flag & ColorInfo::InfoFlag::InvertHeight) == ColorInfo::InfoFlag::InvertHeight;
+					return static_cast<unsigned char*>(info.pPixel) + lineSize * (invert ? info.Height - 1 - y : y);
+				}
+
+				/// <summary>
+				/// Pixel_YC の y 行目のアドレスを取得します
+				/// </summary>
+				inline Pixel_YC* GetYCLine(const ColorInfo& info, int y)
+				{
+					return reinterpret_cast<Pixel_YC*>(reinterpret_cast<unsigned char*>(info.pYC) + static_cast<std::ptrdiff_t>(info.Line_Size) * y);
+				}
+
+				/// <summary>
+				/// 誤差拡散で並列に処理する 1 バンドの行数
+				/// </summary>
+				enum : int { DiffusionBandHeight = 32 };
+
+				/// <summary>
+				/// 誤差拡散で 1 バンド (begin ～ end-1 行) を RGB24 / RGB32 に変換します
+				/// <para>1 行ずつ丸める前の RGB を SIMD で求め、キャッシュに載った作業領域の上で誤差を拡散します。</para>
+				/// </summary>
+				inline void DiffuseBand(const ColorInfo& info, PixelFormat format, std::ptrdiff_t lineSize, Path path, const MatrixCoefficient& m, int begin, int end, std::vector<int>& work)
+				{
+					const int width = info.Width;
+					const int stride = width + 2;
+					const int bytes = format == PixelFormat::RGB32 ? 4 : 3;
+					work.assign(static_cast<std::size_t>(width) * 3 + static_cast<std::size_t>(stride) * 6, 0);
+
+					// R, G, B の順
+					int* pValue[3];
+					int* pError[2][3];
+					for (int ch = 0; ch < 3; ++ch) {
+						pValue[ch] = work.data() + static_cast<std::size_t>(width) * ch;
+						pError[0][ch] = work.data() + static_cast<std::size_t>(width) * 3 + static_cast<std::size_t>(stride) * ch;
+						pError[1][ch] = work.data() + static_cast<std::size_t>(width) * 3 + static_cast<std::size_t>(stride) * (ch + 3);
+					}
+
+					// 先頭行には直前のバンドから誤差が届かないため、ブルーノイズ (±0.5) を誤差として与える
+					const DitherRow seed = GetDitherRow(begin);
+					const short* pSeed[3] = { seed.pR, seed.pG, seed.pB };
+					for (int ch = 0; ch < 3; ++ch) {
+						for (int x = 0; x < width; ++x) {
+							pError[0][ch][x + 1] = pSeed[ch][x & (Utility::BlueNoise::Size - 1)] - 4096;
+						}
+					}
+
+					for (int y = begin; y < end; ++y) {
+						const Pixel_YC* pSrc = GetYCLine(info, y);
+						unsigned char* pDst = GetPixelLine(info, lineSize, y);
+						int x = 0;
+						if (path == Path::Avx2) {
+							x = RowYCToLinear<Avx2>(pSrc, pValue[0], pValue[1], pValue[2], x, width, m);
+						}
+						if (path != Path::Scalar) {
+							x = RowYCToLinear<Ssse3>(pSrc, pValue[0], pValue[1], pValue[2], x, width, m);
+						}
+						RowYCToLinear_Scalar(pSrc, pValue[0], pValue[1], pValue[2], x, width, m);
+
+						const int parity = (y - begin) & 1;
+						for (int ch = 0; ch < 3; ++ch) {
+							std::fill(pError[parity ^ 1][ch], pError[parity ^ 1][ch] + stride, 0);
+							DiffuseRow(pValue[ch], pError[parity][ch], pError[parity ^ 1][ch], pDst + (2 - ch), bytes, width, parity == 0 ? 1 : -1);
+						}
+						if (bytes == 4) {
+							for (x = 0; x < width; ++x) {
+								pDst[x * 4 + 3] = 0;
+							}
+						}
+					}
+				}
+			}
+
+			/// <summary>
+			/// DIB 形式データを Pixel_YC 形式に変換します
+			/// <para>pColorInfo->Format は参照せず、format の形式として読み込みます。</para>
+			/// </summary>
+			/// <param name="pColorInfo">色情報構造体のポインタ</param>
+			/// <param name="format">DIB 形式データのフォーマット</param>
+			/// <param name="matrix">RGB と Pixel_YC の変換に使用するマトリクス</param>
+			/// <param name="range">YUY2 の値の範囲</param>
+			/// <returns>
+			/// true なら成功 (false なら何もしていません)
+			/// </returns>
+			inline bool ToYC(ColorInfo* pColorInfo, PixelFormat format, ColorMatrix matrix, ColorRange range)
+			{
+				if (!Detail::IsConvertible(*pColorInfo, format)) {
+					return false;
+				}
+				const ColorInfo& info = *pColorInfo;
+				const Detail::MatrixCoefficient& m = Detail::GetMatrixCoefficient(matrix);
+				const Detail::RangeCoefficient& r = Detail::GetRangeCoefficient(range);
+				const Detail::Path path = Detail::SelectPath(info);
+				const std::ptrdiff_t lineSize = Detail::GetPixelLineSize(format, info.Width);
+
+				return Filter::MultiThread::ForEachRange(info.ExecMultiThread, info.Height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						const unsigned char* pSrc = Detail::GetPixelLine(info, lineSize, y);
+						Pixel_YC* pDst = Detail::GetYCLine(info, y);
+						int x = 0;
+						if (path == Detail::Path::Avx2) {
+							x = Detail::RowToYC<Detail::Avx2>(format, pSrc, pDst, x, info.Width, m, r);
+						}
+						if (path != Detail::Path::Scalar) {
+							x = Detail::RowToYC<Detail::Ssse3>(format, pSrc, pDst, x, info.Width, m, r);
+						}
+						switch (format) {
+						case PixelFormat::RGB24: Detail::RowRGBToYC_Scalar<3>(pSrc, pDst, x, info.Width, m); break;
+						case PixelFormat::RGB32: Detail::RowRGBToYC_Scalar<4>(pSrc, pDst, x, info.Width, m); break;
+						default: Detail::RowYUY2ToYC_Scalar(pSrc, pDst, x, info.Width, r); break;
+						}
+					}
+				});
+			}
+
+			/// <summary>
+			/// Pixel_YC 形式を DIB 形式データに変換します
+			/// <para>pColorInfo->Format は参照せず、format の形式で書き込みます。</para>
+			/// </summary>
+			/// <param name="pColorInfo">色情報構造体のポインタ</param>
+			/// <param name="format">DIB 形式データのフォーマット</param>
+			/// <param name="matrix">RGB と Pixel_YC の変換に使用するマトリクス</param>
+			/// <param name="range">YUY2 の値の範囲</param>
+			/// <param name="dither">RGB24 / RGB32 への変換で使用するディザ</param>
+			/// <returns>
+			/// true なら成功 (false なら何もしていません)
+			/// </returns>
+			inline bool FromYC(ColorInfo* pColorInfo, PixelFormat format, ColorMatrix matrix, ColorRange range, DitherMode dither = DitherMode::None)
+			{
+				if (!Detail::IsConvertible(*pColorInfo, format)) {
+					return false;
+				}
+				const ColorInfo& info = *pColorInfo;
+				const Detail::MatrixCoefficient& m = Detail::GetMatrixCoefficient(matrix);
+				const Detail::RangeCoefficient& r = Detail::GetRangeCoefficient(range);
+				const Detail::Path path = Detail::SelectPath(info);
+				const std::ptrdiff_t lineSize = Detail::GetPixelLineSize(format, info.Width);
+				if (format == PixelFormat::YUY2) {
+					dither = DitherMode::None;
+				}
+				if (dither != DitherMode::None) {
+					// 閾値テーブルはスレッドに分ける前に作成しておく
+					Detail::GetDitherThreshold();
+				}
+
+				if (dither == DitherMode::ErrorDiffusion) {
+					const int bands = (info.Height + Detail::DiffusionBandHeight - 1) / Detail::DiffusionBandHeight;
+					return Filter::MultiThread::ForEachRange(info.ExecMultiThread, bands, [&](int begin, int end) {
+						std::vector<int> work;
+						for (int band = begin; band < end; ++band) {
+							const int top = band * Detail::DiffusionBandHeight;
+							Detail::DiffuseBand(info, format, lineSize, path, m, top, (std::min)(top + static_cast<int>(Detail::DiffusionBandHeight), info.Height), work);
+						}
+					});
+				}
+
+				return Filter::MultiThread::ForEachRange(info.ExecMultiThread, info.Height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						const Pixel_YC* pSrc = Detail::GetYCLine(info, y);
+						unsigned char* pDst = Detail::GetPixelLine(info, lineSize, y);
+						const Detail::DitherRow ditherRow = dither == DitherMode::Ordered ? Detail::GetDitherRow(y) : Detail::DitherRow();
+						const Detail::DitherRow* pDither = dither == DitherMode::Ordered ? &ditherRow : nullptr;
+						int x = 0;
+						if (path == Detail::Path::Avx2) {
+							x = Detail::RowFromYC<Detail::Avx2>(format, pSrc, pDst, x, info.Width, m, r, pDither);
+						}
+						if (path != Detail::Path::Scalar) {
+							x = Detail::RowFromYC<Detail::Ssse3>(format, pSrc, pDst, x, info.Width, m, r, pDither);
+						}
+						switch (format) {
+						case PixelFormat::RGB24: Detail::RowYCToRGB_Scalar<3>(pSrc, pDst, x, info.Width, m, pDither); break;
+						case PixelFormat::RGB32: Detail::RowYCToRGB_Scalar<4>(pSrc, pDst, x, info.Width, m, pDither); break;
+						default: Detail::RowYCToYUY2_Scalar(pSrc, pDst, x, info.Width, r); break;
+						}
+					}
+				});
+			}
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// ColorInfo::Format を PixelFormat に変換します
+				/// </summary>
+				inline bool GetPixelFormat(unsigned long format, PixelFormat* pFormat)
+				{
+					if (format == Utility::FourCC::RGB) {
+						*pFormat = PixelFormat::RGB24;
+						return true;
+					}
+					if (format == Utility::FourCC::YUY2) {
+						*pFormat = PixelFormat::YUY2;
+						return true;
+					}
+					return false;
+				}
+
+				inline int PixelToYC(ColorInfo* pColorInfo)
+				{
+					PixelFormat format;
+					if (!GetPixelFormat(pColorInfo->Format, &format)) {
+						return 0;
+					}
+					return ToYC(pColorInfo, format, GetSettings().Matrix, GetSettings().Range) ? 1 : 0;
+				}
+
+				inline int YCToPixel(ColorInfo* pColorInfo)
+				{
+					PixelFormat format;
+					if (!GetPixelFormat(pColorInfo->Format, &format)) {
+						return 0;
+					}
+					return FromYC(pColorInfo, format, GetSettings().Matrix, GetSettings().Range, GetSettings().Dither) ? 1 : 0;
+				}
+			}
+
+			/// <summary>
+			/// 色プラグインテーブルを取得します
+			/// <para>GetColorPluginTable() からこの参照を返してください。</para>
+			/// <para>対応しない形式 (Pixel_YC など) は 0 を返し、AviUtl 側の既定の変換に任せます。</para>
+			/// </summary>
+			/// <returns>
+			/// 色プラグインテーブル構造体の参照
+			/// </returns>
+			inline ColorPluginTable& GetPluginTable()
+			{
+				static ColorPluginTable table = []() {
+					ColorPluginTable t = {};
+					t.pName = const_cast<char*>(PluginNameA);
+					t.pInformation = const_cast<char*>(PluginInformationA);
+					t.PixelToYC = Detail::PixelToYC;
+					t.YCToPixel = Detail::YCToPixel;
+					return t;
+				}();
+				return table;
+			}
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,407 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AudioBlockCache.h"
+#include "../Utility/File.h"
+#include "../Utility/FrameCache.h"
+#include <cstring>      // std::memcpy
+#include <iterator>     // std::next
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr, std::weak_ptr, std::unique_ptr, std::make_shared
+#include <mutex>        // std::mutex, std::lock_guard
+#include <string>       // std::string
+#include <tuple>        // std::tuple, std::get
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// AviFileReadAudioSample() の読み込みをブロック単位でキャッシュします
+		/// <para>音声フィルタやタイムラインのように、少しずつ重なった範囲を繰り返し読む場合のデコードとシークを減らします。</para>
+		/// <para>外部関数はメインスレッドから呼び出す必要があるため、先読みは読み込みの続きとして同じスレッドで行います。</para>
+		/// </summary>
+		class AviFileAudioReader final
+		{
+		public:
+			/// <summary>
+			/// 読み込みを開始します
+			/// <para>ハンドルの所有権は移りません。このオブジェクトを破棄してから AviFileClose() を呼び出してください。</para>
+			/// </summary>
+			/// <param name="pFunctions">外部関数構造体へのポインタ</param>
+			/// <param name="hAvi">AviFileOpen() で取得したハンドル</param>
+			/// <param name="fileInfo">AviFileOpen() で取得したファイル情報</param>
+			AviFileAudioReader(CallbackFunctionSet* pFunctions, AviFileHandle hAvi, const FileInfo& fileInfo)
+				: m_pFunctions(pFunctions), m_hAvi(hAvi)
+			{
+				Reset(fileInfo.Audio_Channel, fileInfo.Audio_Total);
+			}
+
+			AviFileAudioReader(const AviFileAudioReader&) = delete;
+			AviFileAudioReader& operator=(const AviFileAudioReader&) = delete;
+
+			/// <summary>
+			/// 読み込む音声のサンプリングレートとチャンネル数を変更します (キャッシュは破棄されます)
+			/// </summary>
+			/// <param name="audioRate">サンプリングレート</param>
+			/// <param name="audioChannel">チャンネル数</param>
+			/// <returns>
+			/// 変更後の総サンプル数
+			/// </returns>
+			int SetSampleRate(int audioRate, int audioChannel)
+			{
+				const int total = m_pFunctions->AviFileSetAudioSampleRate(m_hAvi, audioRate, audioChannel);
+				Reset(audioChannel, total);
+				return total;
+			}
+
+			/// <summary>
+			/// 総サンプル数を取得します
+			/// </summary>
+			int GetTotalSamples() const { return m_pCache != nullptr ? static_cast<int>(m_pCache->GetTotalSamples()) : 0; }
+
+			/// <summary>
+			/// 音声 (PCM16) を読み込みます
+			/// </summary>
+			/// <param name="start">読み込み開始サンプル番号</param>
+			/// <param name="length">読み込むサンプル数</param>
+			/// <param name="pBuffer">読み込み先 (サンプル数 × チャンネル数 の short)</param>
+			/// <returns>
+			/// 読み込んだサンプル数
+			/// </returns>
+			int Read(int start, int length, void* pBuffer)
+			{
+				return m_pCache != nullptr ? m_pCache->Read(start, length, pBuffer) : 0;
+			}
+
+		private:
+			void Reset(int channels, int total)
+			{
+				m_pCache.reset();
+				if (channels <= 0 || total <= 0) {
+					return;
+				}
+				CallbackFunctionSet* pFunctions = m_pFunctions;
+				AviFileHandle hAvi = m_hAvi;
+				m_pCache.reset(new Utility::AudioBlockCache(channels, total,
+					[pFunctions, hAvi](long long start, int length, short* pBuffer) {
+						return pFunctions->AviFileReadAudioSample(hAvi, static_cast<int>(start), length, pBuffer);
+					}));
+			}
+
+			CallbackFunctionSet* m_pFunctions;
+			AviFileHandle m_hAvi;
+			std::unique_ptr<Utility::AudioBlockCache> m_pCache;
+		};
+
+		/// <summary>
+		/// AviFileOpen() で開いたファイルのフレームキャッシュ付き読み込み
+		/// <para>同じファイルを同じフラグと 1 行の Pixel_YC 数で開く場合は、フィルタをまたいで 1 つのハンドルを共有します (Open() で取得します)。</para>
+		/// <para>読み込んだフレームは FrameCache に保持し、連続したフレームを読んでいる間は ReadAhead フレーム先までまとめて読み込みます。</para>
+		/// <para>共有した読み手同士が離れた位置を読んでも、まとめ読みによってデコーダーのシークはまとめ読みの回数分に抑えられます。</para>
+		/// <para>通常は読み手ごとに AviFileClip を使用してください。</para>
+		/// </summary>
+		class AviFileReader final
+		{
+		public:
+			/// <summary>
+			/// 動作設定
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// 連続したフレームを読んでいる間に、まとめて読み込むフレーム数 (0 なら先読みしない)
+				/// </summary>
+				int ReadAhead = 8;
+
+				/// <summary>
+				/// ファイルごとのフレームキャッシュの容量
+				/// </summary>
+				std::size_t CacheSize = Utility::FrameCache::DefaultCapacity;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			static Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// ファイルを開きます (既に同じファイルを同じフラグと 1 行の Pixel_YC 数で開いていれば、そのハンドルを共有します)
+			/// </summary>
+			/// <param name="pFunctions">外部関数構造体へのポインタ</param>
+			/// <param name="pFileName">ファイル名</param>
+			/// <param name="flag">読み込みフラグ</param>
+			/// <param name="lineStride">1 行の Pixel_YC 数 (0 ならファイルの幅)</param>
+			/// <returns>
+			/// 読み込みオブジェクト (失敗した場合は nullptr)
+			/// </returns>
+			static std::shared_ptr<AviFileReader> Open(CallbackFunctionSet* pFunctions, const char* pFileName,
+				CallbackFunctionSet::AviFileOpenFlag flag = CallbackFunctionSet::AviFileOpenFlag::Video_Only, int lineStride = 0)
+			{
+				const std::string fileKey = Utility::GetFileKey(pFileName);
+				const int flagValue = static_cast<int>(flag);
+
+				std::lock_guard<std::mutex> lock(GetPoolMutex());
+				auto& pool = GetPool();
+				for (auto it = pool.begin(); it != pool.end();) {
+					it = it->second.expired() ? pool.erase(it) : std::next(it);
+				}
+
+				// 1 行の Pixel_YC 数 (0 ならファイルの幅) が一致する場合のみ共有します
+				for (auto it = pool.lower_bound(Key(fileKey, flagValue, 0)); it != pool.end()
+					&& std::get<0>(it->first) == fileKey && std::get<1>(it->first) == flagValue; ++it) {
+					std::shared_ptr<AviFileReader> pReader = it->second.lock();
+					if (pReader != nullptr && pReader->m_lineStride == (lineStride > 0 ? lineStride : pReader->m_fileInfo.Width)) {
+						return pReader;
+					}
+				}
+
+				FileInfo fileInfo = {};
+				AviFileHandle hAvi = pFunctions->AviFileOpen(const_cast<char*>(pFileName), &fileInfo, flag);
+				if (hAvi == nullptr) {
+					return nullptr;
+				}
+				std::shared_ptr<AviFileReader> pReader(new AviFileReader(pFunctions, hAvi, fileInfo, lineStride));
+
+				// 同じキーの読み込みオブジェクトは上で共有しているため、既存のものを置き換えることはありません
+				pool.emplace(Key(fileKey, flagValue, pReader->m_lineStride), pReader);
+				return pReader;
+			}
+
+			~AviFileReader()
+			{
+				m_pFunctions->AviFileClose(m_hAvi);
+			}
+
+			AviFileReader(const AviFileReader&) = delete;
+			AviFileReader& operator=(const AviFileReader&) = delete;
+
+			/// <summary>
+			/// AviFileOpen() で取得したファイル情報を取得します
+			/// </summary>
+			const FileInfo& GetFileInfo() const { return m_fileInfo; }
+
+			/// <summary>
+			/// 1 行の Pixel_YC 数を取得します
+			/// </summary>
+			int GetLineStride() const { return m_lineStride; }
+
+			/// <summary>
+			/// AviFileOpen() で取得したハンドルを取得します
+			/// </summary>
+			AviFileHandle GetHandle() const { return m_hAvi; }
+
+			/// <summary>
+			/// 読み手のカーソルを追加します
+			/// </summary>
+			int AddCursor()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_cache.AddCursor();
+			}
+
+			/// <summary>
+			/// 読み手のカーソルを削除します
+			/// </summary>
+			void RemoveCursor(int cursor)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_cache.RemoveCursor(cursor);
+			}
+
+			/// <summary>
+			/// フレームを読み込みます
+			/// </summary>
+			/// <param name="cursor">読み手のカーソル</param>
+			/// <param name="frame">フレーム番号</param>
+			/// <param name="pYC">読み込み先 (1 行 GetLineStride() 個 × 高さ の Pixel_YC)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool ReadVideo(int cursor, int frame, Pixel_YC* pYC)
+			{
+				if (frame < 0 || frame >= m_fileInfo.Frame_Total) {
+					return false;
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const int previous = m_cache.GetCursor(cursor);
+				m_cache.SetCursor(cursor, frame);
+
+				Utility::FrameCache::Frame data = m_cache.Find(frame);
+				if (data == nullptr) {
+					data = Decode(frame);
+					if (data == nullptr) {
+						return false;
+					}
+					m_cache.Insert(frame, data);
+
+					// 連続して読んでいる間は、デコーダーの位置が続いているうちに先までまとめて読み込みます (キャッシュしない場合は読み込まない)
+					if (previous >= 0 && frame == previous + 1 && m_cache.GetCapacity() > 0) {
+						const int readAhead = GetSettings().ReadAhead;
+						for (int next = frame + 1; next <= frame + readAhead && next < m_fileInfo.Frame_Total; ++next) {
+							if (m_cache.Find(next) != nullptr) {
+								continue;
+							}
+							Utility::FrameCache::Frame ahead = Decode(next);
+							if (ahead == nullptr) {
+								break;
+							}
+							m_cache.Insert(next, ahead);
+						}
+					}
+				}
+				std::memcpy(pYC, data->data(), data->size());
+				return true;
+			}
+
+		private:
+			/// <summary>
+			/// 共有のキー (ファイル, 読み込みフラグ, 1 行の Pixel_YC 数)
+			/// </summary>
+			using Key = std::tuple<std::string, int, int>;
+
+			AviFileReader(CallbackFunctionSet* pFunctions, AviFileHandle hAvi, const FileInfo& fileInfo, int lineStride)
+				: m_pFunctions(pFunctions), m_hAvi(hAvi), m_fileInfo(fileInfo), m_cache(GetSettings().CacheSize)
+			{
+				m_lineStride = lineStride > 0 ? lineStride : m_fileInfo.Width;
+				m_frameSize = static_cast<std::size_t>(m_lineStride) * m_fileInfo.Height * sizeof(Pixel_YC);
+			}
+
+			static std::map<Key, std::weak_ptr<AviFileReader>>& GetPool()
+			{
+				static std::map<Key, std::weak_ptr<AviFileReader>> pool;
+				return pool;
+			}
+
+			static std::mutex& GetPoolMutex()
+			{
+				static std::mutex mutex;
+				return mutex;
+			}
+
+			Utility::FrameCache::Frame Decode(int frame)
+			{
+				if (m_frameSize == 0) {
+					return nullptr;
+				}
+				auto pData = std::make_shared<std::vector<unsigned char>>(m_frameSize);
+				if (!m_pFunctions->AviFileReadVideo(m_hAvi, reinterpret_cast<Pixel_YC*>(pData->data()), frame)) {
+					return nullptr;
+				}
+				return pData;
+			}
+
+			CallbackFunctionSet* m_pFunctions;
+			AviFileHandle m_hAvi;
+			FileInfo m_fileInfo;
+			int m_lineStride = 0;
+			std::size_t m_frameSize = 0;
+			Utility::FrameCache m_cache;
+			std::mutex m_mutex;
+		};
+
+		/// <summary>
+		/// フィルタから別のファイルを読み込むためのクリップ
+		/// <para>AviFileReader を共有し、読み手ごとのカーソルを持ちます。</para>
+		/// </summary>
+		class AviFileClip final
+		{
+		public:
+			AviFileClip() = default;
+			~AviFileClip() { Close(); }
+
+			AviFileClip(const AviFileClip&) = delete;
+			AviFileClip& operator=(const AviFileClip&) = delete;
+
+			/// <summary>
+			/// ファイルを開きます
+			/// </summary>
+			/// <param name="pFunctions">外部関数構造体へのポインタ</param>
+			/// <param name="pFileName">ファイル名</param>
+			/// <param name="flag">読み込みフラグ</param>
+			/// <param name="lineStride">1 行の Pixel_YC 数 (0 ならファイルの幅)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Open(CallbackFunctionSet* pFunctions, const char* pFileName,
+				CallbackFunctionSet::AviFileOpenFlag flag = CallbackFunctionSet::AviFileOpenFlag::Video_Only, int lineStride = 0)
+			{
+				Close();
+				m_pReader = AviFileReader::Open(pFunctions, pFileName, flag, lineStride);
+				if (m_pReader == nullptr) {
+					return false;
+				}
+				m_cursor = m_pReader->AddCursor();
+				return true;
+			}
+
+			/// <summary>
+			/// ファイルを閉じます (最後の読み手ならハンドルも閉じます)
+			/// </summary>
+			void Close()
+			{
+				if (m_pReader != nullptr) {
+					m_pReader->RemoveCursor(m_cursor);
+					m_pReader.reset();
+				}
+			}
+
+			bool IsOpen() const { return m_pReader != nullptr; }
+
+			/// <summary>
+			/// AviFileOpen() で取得したファイル情報を取得します
+			/// <para>開いていない場合は全て 0 の情報を返します。</para>
+			/// </summary>
+			const FileInfo& GetFileInfo() const
+			{
+				static const FileInfo empty = {};
+				return m_pReader != nullptr ? m_pReader->GetFileInfo() : empty;
+			}
+
+			/// <summary>
+			/// フレームを読み込みます
+			/// </summary>
+			/// <param name="frame">フレーム番号</param>
+			/// <param name="pYC">読み込み先 (1 行 GetLineStride() 個 × 高さ の Pixel_YC)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool ReadVideo(int frame, Pixel_YC* pYC)
+			{
+				return m_pReader != nullptr && m_pReader->ReadVideo(m_cursor, frame, pYC);
+			}
+
+			/// <summary>
+			/// 1 行の Pixel_YC 数を取得します
+			/// </summary>
+			int GetLineStride() const { return m_pReader != nullptr ? m_pReader->GetLineStride() : 0; }
+
+		private:
+			std::shared_ptr<AviFileReader> m_pReader;
+			int m_cursor = 0;
+		};
+	}
+
+#endif
+}
@@ -0,0 +1,387 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "MultiThread.h"
+#include <algorithm>    // std::min, std::max
+#include <cstring>      // std::memcpy
+#include <emmintrin.h>  // SSE2 intrinsics
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 合成モードの定数
+		/// <para>Pixel_YC は RGB と線形の関係にあるため、加算と減算は RGB で合成した場合と同じ結果になります。</para>
+		/// </summary>
+		enum class BlendMode : int {
+			/// <summary>
+			/// 通常
+			/// </summary>
+			Normal = 0,
+
+			/// <summary>
+			/// 加算
+			/// </summary>
+			Add = 1,
+
+			/// <summary>
+			/// 減算
+			/// </summary>
+			Subtract = 2,
+		};
+
+		/// <summary>
+		/// 合成する 1 枚の画像
+		/// </summary>
+		struct BlitItem
+		{
+			/// <summary>
+			/// コピー元の画像へのポインタ
+			/// </summary>
+			const Pixel_YC* pSrc;
+
+			/// <summary>
+			/// コピー元の 1 行のバイト数
+			/// </summary>
+			int SrcLineSize;
+
+			/// <summary>
+			/// コピー元の左上の X 座標
+			/// </summary>
+			int SrcX;
+
+			/// <summary>
+			/// コピー元の左上の Y 座標
+			/// </summary>
+			int SrcY;
+
+			/// <summary>
+			/// コピーする幅
+			/// </summary>
+			int Width;
+
+			/// <summary>
+			/// コピーする高さ
+			/// </summary>
+			int Height;
+
+			/// <summary>
+			/// コピー先の左上の X 座標
+			/// </summary>
+			int X;
+
+			/// <summary>
+			/// コピー先の左上の Y 座標
+			/// </summary>
+			int Y;
+
+			/// <summary>
+			/// コピー元の透明度 (0 ～ 4096、CopyYC() と同じ)
+			/// </summary>
+			int Transparent;
+
+			/// <summary>
+			/// 合成モード
+			/// </summary>
+			BlendMode Mode;
+
+			/// <summary>
+			/// 画素ごとの不透明度 (0 ～ 4096、nullptr なら全画素 4096)
+			/// <para>コピー元と同じ座標系で参照します。</para>
+			/// </summary>
+			const short* pAlpha;
+
+			/// <summary>
+			/// 不透明度の 1 行の要素数
+			/// </summary>
+			int AlphaStride;
+		};
+
+		/// <summary>
+		/// CallbackFunctionSet::CopyYC() 互換の画像合成をまとめて行います
+		/// <para>Add() で登録した順に重ねて、Draw() で一度に合成します。クリッピングは Draw() の開始時に 1 回だけ行います。</para>
+		/// <para>出力の行を ExecMultiThread() で分割し、各行ですべての画像を順番に合成します。</para>
+		/// <para>不透明度が 0 の区間は読み飛ばし、完全に不透明な通常合成の区間は単純なコピーになります。</para>
+		/// </summary>
+		class Blitter final
+		{
+		public:
+			enum : int {
+				/// <summary>
+				/// 不透明度の最大値
+				/// </summary>
+				AlphaMax = 4096,
+			};
+
+			/// <summary>
+			/// 登録した画像をすべて破棄します
+			/// </summary>
+			void Clear() { m_items.clear(); }
+
+			/// <summary>
+			/// 合成する画像を登録します
+			/// </summary>
+			/// <param name="item">合成する画像</param>
+			void Add(const BlitItem& item) { m_items.push_back(item); }
+
+			/// <summary>
+			/// CopyYC() と同じ引数で合成する画像を登録します
+			/// </summary>
+			/// <param name="x">コピー先の左上の X 座標</param>
+			/// <param name="y">コピー先の左上の Y 座標</param>
+			/// <param name="pSrc">コピー元の画像へのポインタ</param>
+			/// <param name="srcLineSize">コピー元の 1 行のバイト数</param>
+			/// <param name="srcX">コピー元の左上の X 座標</param>
+			/// <param name="srcY">コピー元の左上の Y 座標</param>
+			/// <param name="srcWidth">幅</param>
+			/// <param name="srcHeight">高さ</param>
+			/// <param name="transparent">コピー元の透明度 (0 ～ 4096)</param>
+			void Add(int x, int y, const Pixel_YC* pSrc, int srcLineSize, int srcX, int srcY, int srcWidth, int srcHeight, int transparent)
+			{
+				Add(BlitItem{ pSrc, srcLineSize, srcX, srcY, srcWidth, srcHeight, x, y, transparent, BlendMode::Normal, nullptr, 0 });
+			}
+
+			/// <summary>
+			/// 登録した画像を合成します
+			/// <para>コピー元とコピー先の領域は重ならないようにしてください。</para>
+			/// </summary>
+			/// <param name="pDst">コピー先の画像へのポインタ</param>
+			/// <param name="dstLineSize">コピー先の 1 行のバイト数</param>
+			/// <param name="width">コピー先の幅 (この範囲にクリッピングします)</param>
+			/// <param name="height">コピー先の高さ (この範囲にクリッピングします)</param>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr なら呼び出し元のスレッドで処理)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Draw(Pixel_YC* pDst, int dstLineSize, int width, int height, MultiThread::Exec_Func pExec = nullptr)
+			{
+				Clip(width, height);
+				if (m_layers.empty()) {
+					return true;
+				}
+
+				int top = height;
+				int bottom = 0;
+				for (const Layer& layer : m_layers) {
+					top = (std::min)(top, layer.Top);
+					bottom = (std::max)(bottom, layer.Bottom);
+				}
+
+				unsigned char* pDstBase = reinterpret_cast<unsigned char*>(pDst);
+				const std::vector<Layer>& layers = m_layers;
+				return MultiThread::ForEachRange(pExec, bottom - top, [&](int begin, int end) {
+					for (int y = top + begin; y < top + end; ++y) {
+						Pixel_YC* pRow = reinterpret_cast<Pixel_YC*>(pDstBase + static_cast<std::size_t>(y) * dstLineSize);
+						for (const Layer& layer : layers) {
+							if (y >= layer.Top && y < layer.Bottom) {
+								DrawRow(layer, y, pRow);
+							}
+						}
+					}
+				});
+			}
+
+		private:
+			/// <summary>
+			/// クリッピング済みの画像
+			/// </summary>
+			struct Layer
+			{
+				const unsigned char* pSrc;
+				int SrcLineSize;
+				const short* pAlpha;
+				int AlphaStride;
+				int Left;
+				int Top;
+				int Right;
+				int Bottom;
+				int Opacity;
+				BlendMode Mode;
+			};
+
+			/// <summary>
+			/// 登録した画像をコピー先の範囲でクリッピングします
+			/// <para>pSrc と pAlpha はコピー先の (Left, Top) に対応する位置を指すように調整します。</para>
+			/// </summary>
+			void Clip(int width, int height)
+			{
+				m_layers.clear();
+				for (const BlitItem& item : m_items) {
+					const int opacity = AlphaMax - (std::max)(0, (std::min)(item.Transparent, static_cast<int>(AlphaMax)));
+					if (opacity == 0 || item.pSrc == nullptr) {
+						continue;
+					}
+					const int left = (std::max)(item.X, 0);
+					const int top = (std::max)(item.Y, 0);
+					const int right = (std::min)(item.X + item.Width, width);
+					const int bottom = (std::min)(item.Y + item.Height, height);
+					if (left >= right || top >= bottom) {
+						continue;
+					}
+
+					const int srcX = item.SrcX + left - item.X;
+					const int srcY = item.SrcY + top - item.Y;
+					Layer layer;
+					layer.pSrc = reinterpret_cast<const unsigned char*>(item.pSrc)
+						+ static_cast<std::ptrdiff_t>(srcY) * item.SrcLineSize + static_cast<std::ptrdiff_t>(srcX) * Pixel_YC::Size;
+					layer.SrcLineSize = item.SrcLineSize;
+					layer.pAlpha = item.pAlpha != nullptr ? item.pAlpha + static_cast<std::ptrdiff_t>(srcY) * item.AlphaStride + srcX : nullptr;
+					layer.AlphaStride = item.AlphaStride;
+					layer.Left = left;
+					layer.Top = top;
+					layer.Right = right;
+					layer.Bottom = bottom;
+					layer.Opacity = opacity;
+					layer.Mode = item.Mode;
+					m_layers.push_back(layer);
+				}
+			}
+
+			/// <summary>
+			/// 1 行分を合成します
+			/// </summary>
+			static void DrawRow(const Layer& layer, int y, Pixel_YC* pDstRow)
+			{
+				const int row = y - layer.Top;
+				const short* pSrc = reinterpret_cast<const short*>(layer.pSrc + static_cast<std::size_t>(row) * layer.SrcLineSize);
+				short* pDst = reinterpret_cast<short*>(pDstRow + layer.Left);
+				const int count = layer.Right - layer.Left;
+
+				if (layer.pAlpha == nullptr) {
+					if (layer.Opacity == AlphaMax && layer.Mode == BlendMode::Normal) {
+						std::memcpy(pDst, pSrc, static_cast<std::size_t>(count) * Pixel_YC::Size);
+						return;
+					}
+					BlendSpan(pSrc, pDst, count, nullptr, layer.Opacity, layer.Mode);
+					return;
+				}
+
+				const short* pAlpha = layer.pAlpha + static_cast<std::size_t>(row) * layer.AlphaStride;
+				BlendSpan(pSrc, pDst, count, pAlpha, layer.Opacity, layer.Mode);
+			}
+
+			/// <summary>
+			/// 合成モードを適用したコピー元の値を求めます
+			/// </summary>
+			static __m128i ApplyMode(__m128i src, __m128i dst, BlendMode mode)
+			{
+				switch (mode) {
+				case BlendMode::Add:
+					return _mm_adds_epi16(dst, src);
+				case BlendMode::Subtract:
+					return _mm_subs_epi16(dst, src);
+				default:
+					return src;
+				}
+			}
+
+			/// <summary>
+			/// 合成モードを適用したコピー元の値を求めます
+			/// <para>_mm_adds_epi16() / _mm_subs_epi16() と同じく、short の範囲の両端で飽和させます。</para>
+			/// </summary>
+			static int ApplyMode(int src, int dst, BlendMode mode)
+			{
+				switch (mode) {
+				case BlendMode::Add:
+					return (std::max)((std::min)(dst + src, 32767), -32768);
+				case BlendMode::Subtract:
+					return (std::max)((std::min)(dst - src, 32767), -32768);
+				default:
+					return src;
+				}
+			}
+
+			/// <summary>
+			/// 不透明度で dst と src の間を補間します
+			/// </summary>
+			/// <param name="dst">コピー先 8 要素</param>
+			/// <param name="src">コピー元 8 要素</param>
+			/// <param name="alpha">要素ごとの不透明度 8 要素 (0 ～ 4096)</param>
+			static __m128i Lerp(__m128i dst, __m128i src, __m128i alpha)
+			{
+				const __m128i round = _mm_set1_epi32(AlphaMax / 2);
+				const __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(AlphaMax), alpha);
+				__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(dst, src), _mm_unpacklo_epi16(inverse, alpha));
+				__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(dst, src), _mm_unpackhi_epi16(inverse, alpha));
+				lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 12);
+				hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 12);
+				return _mm_packs_epi32(lo, hi);
+			}
+
+			/// <summary>
+			/// 1 行の区間を合成します
+			/// <para>8 画素 (24 要素) 単位で処理し、不透明度が全て 0 の 8 画素は読み飛ばします。</para>
+			/// </summary>
+			static void BlendSpan(const short* pSrc, short* pDst, int count, const short* pAlpha, int opacity, BlendMode mode)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				alignas(16) short alpha3[24];
+				if (pAlpha == nullptr) {
+					for (int i = 0; i < 24; ++i) {
+						alpha3[i] = static_cast<short>(opacity);
+					}
+				}
+
+				int x = 0;
+				for (; x + 8 <= count; x += 8) {
+					if (pAlpha != nullptr) {
+						const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAlpha + x));
+						if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero)) == 0xffff) {
+							continue;
+						}
+						if (opacity == AlphaMax && mode == BlendMode::Normal
+							&& _mm_movemask_epi8(_mm_cmpeq_epi16(a, _mm_set1_epi16(AlphaMax))) == 0xffff) {
+							std::memcpy(pDst + x * 3, pSrc + x * 3, 8 * Pixel_YC::Size);
+							continue;
+						}
+						for (int p = 0; p < 8; ++p) {
+							const short value = static_cast<short>((pAlpha[x + p] * opacity + AlphaMax / 2) >> 12);
+							alpha3[p * 3 + 0] = value;
+							alpha3[p * 3 + 1] = value;
+							alpha3[p * 3 + 2] = value;
+						}
+					}
+
+					const short* s = pSrc + x * 3;
+					short* d = pDst + x * 3;
+					for (int i = 0; i < 24; i += 8) {
+						const __m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+						const __m128i src = ApplyMode(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)), dst, mode);
+						const __m128i alpha = _mm_load_si128(reinterpret_cast<const __m128i*>(alpha3 + i));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), Lerp(dst, src, alpha));
+					}
+				}
+				for (; x < count; ++x) {
+					const int alpha = pAlpha != nullptr ? (pAlpha[x] * opacity + AlphaMax / 2) >> 12 : opacity;
+					if (alpha == 0) {
+						continue;
+					}
+					for (int c = 0; c < 3; ++c) {
+						const int dst = pDst[x * 3 + c];
+						const int src = ApplyMode(pSrc[x * 3 + c], dst, mode);
+						pDst[x * 3 + c] = static_cast<short>((dst * (AlphaMax - alpha) + src * alpha + AlphaMax / 2) >> 12);
+					}
+				}
+			}
+
+			std::vector<BlitItem> m_items;
+			std::vector<Layer> m_layers;
+		};
+	}
+
+#endif
+}
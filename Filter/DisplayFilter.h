@@ -0,0 +1,423 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/FourCC.h"
+#include <algorithm>    // std::min, std::max, std::fill, std::max_element
+#include <array>        // std::array
+#include <cstring>      // std::memcmp, std::memcpy
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 表示フィルタ (FilterFlag::DispFilter) で表示中の画像を解析するための補助
+		/// <para>GetPixelFilteredEX() で再度フィルタ処理をせずに、GetDispPixelPtr() で表示済みの画像を取得します。</para>
+		/// <para>前回の画像とタイル単位で比較し、変化したタイルだけを解析器 (DisplayAnalyzer) に渡します。</para>
+		/// </summary>
+		namespace DisplayFilter
+		{
+			/// <summary>
+			/// 表示画像 (上から下の順に並んだ DIB 形式の行)
+			/// </summary>
+			struct DisplayImage
+			{
+				/// <summary>
+				/// 画像データへのポインタ
+				/// </summary>
+				const unsigned char* pData;
+
+				/// <summary>
+				/// 画像の幅
+				/// </summary>
+				int Width;
+
+				/// <summary>
+				/// 画像の高さ
+				/// </summary>
+				int Height;
+
+				/// <summary>
+				/// 1 行のバイト数
+				/// </summary>
+				int Stride;
+
+				/// <summary>
+				/// 画像フォーマット (Utility::FourCC::RGB = RGB24bit / Utility::FourCC::YUY2 = YUY2)
+				/// </summary>
+				unsigned long Format;
+
+				/// <summary>
+				/// 指定した行の先頭へのポインタを取得します
+				/// </summary>
+				/// <param name="y">行番号 (0 が画像の上端)</param>
+				const unsigned char* GetRow(int y) const { return pData + static_cast<std::size_t>(y) * Stride; }
+			};
+
+			/// <summary>
+			/// 画像上の矩形領域 (Right, Bottom は含まない)
+			/// </summary>
+			struct Region
+			{
+				int Left;
+				int Top;
+				int Right;
+				int Bottom;
+			};
+
+			/// <summary>
+			/// 表示画像の解析器 (スコープやオーバーレイの元データ)
+			/// <para>変化した領域ごとに、古い内容で Remove() が、新しい内容で Add() が呼ばれます。</para>
+			/// <para>ヒストグラムのような加算できる集計は、変化した領域の差分だけで更新できます。</para>
+			/// </summary>
+			class DisplayAnalyzer
+			{
+			public:
+				virtual ~DisplayAnalyzer() = default;
+
+				/// <summary>
+				/// 集計をすべて破棄します
+				/// <para>画像サイズやフォーマットが変わった場合に呼ばれ、続けて画像全体で Add() が呼ばれます。</para>
+				/// </summary>
+				/// <param name="width">画像の幅</param>
+				/// <param name="height">画像の高さ</param>
+				/// <param name="format">画像フォーマット</param>
+				virtual void Reset(int width, int height, unsigned long format) = 0;
+
+				/// <summary>
+				/// 領域の古い内容を集計から取り除きます
+				/// </summary>
+				/// <param name="image">変更前の画像</param>
+				/// <param name="region">変化した領域</param>
+				virtual void Remove(const DisplayImage& image, const Region& region) = 0;
+
+				/// <summary>
+				/// 領域の新しい内容を集計に加えます
+				/// </summary>
+				/// <param name="image">変更後の画像</param>
+				/// <param name="region">変化した領域</param>
+				virtual void Add(const DisplayImage& image, const Region& region) = 0;
+			};
+
+			/// <summary>
+			/// 輝度ヒストグラム (0 ～ 255 の 256 段階)
+			/// <para>RGB24bit は BT.601 の係数で輝度を求め、YUY2 は Y の値をそのまま使用します。</para>
+			/// </summary>
+			class LumaHistogram final : public DisplayAnalyzer
+			{
+			public:
+				enum : int { BinCount = 256 };
+
+				LumaHistogram() { m_bins.fill(0); }
+
+				void Reset(int, int, unsigned long format) override
+				{
+					m_bins.fill(0);
+					m_total = 0;
+					m_format = format;
+				}
+
+				void Remove(const DisplayImage& image, const Region& region) override { Accumulate(image, region, -1); }
+
+				void Add(const DisplayImage& image, const Region& region) override { Accumulate(image, region, 1); }
+
+				/// <summary>
+				/// 指定した段階の画素数を取得します
+				/// </summary>
+				/// <param name="index">段階 (0 ～ 255)</param>
+				unsigned int GetBin(int index) const { return m_bins[index]; }
+
+				/// <summary>
+				/// 最も多い段階の画素数を取得します
+				/// </summary>
+				unsigned int GetPeak() const { return *std::max_element(m_bins.begin(), m_bins.end()); }
+
+				/// <summary>
+				/// 集計した画素数を取得します
+				/// </summary>
+				unsigned long long GetTotal() const { return m_total; }
+
+			private:
+				/// <summary>
+				/// 領域の輝度を集計します
+				/// </summary>
+				/// <param name="image">画像</param>
+				/// <param name="region">領域</param>
+				/// <param name="sign">加える場合は 1、取り除く場合は -1</param>
+				void Accumulate(const DisplayImage& image, const Region& region, int sign)
+				{
+					const unsigned int delta = static_cast<unsigned int>(sign);
+					for (int y = region.Top; y < region.Bottom; ++y) {
+						const unsigned char* pRow = image.GetRow(y);
+						if (m_format == Utility::FourCC::YUY2) {
+							for (int x = region.Left; x < region.Right; ++x) {
+								m_bins[pRow[x * 2]] += delta;
+							}
+						}
+						else {
+							for (int x = region.Left; x < region.Right; ++x) {
+								const unsigned char* p = pRow + x * 3;
+								m_bins[(p[0] * 29 + p[1] * 150 + p[2] * 77 + 128) >> 8] += delta;
+							}
+						}
+					}
+					m_total += static_cast<long long>(sign) * (region.Right - region.Left) * (region.Bottom - region.Top);
+				}
+
+				std::array<unsigned int, BinCount> m_bins;
+				unsigned long long m_total = 0;
+				unsigned long m_format = Utility::FourCC::RGB;
+			};
+
+			/// <summary>
+			/// 表示画像の変化を監視します
+			/// <para>表示フィルタの func_proc から Update() を呼び出してください。</para>
+			/// <para>
+			/// FilterFlag::ReDraw を指定したフィルタでは、WndProc の戻り値を HandleMessage() の戻り値にすると、
+			/// 表示に影響する変更があった時だけ全体が再描画されます。
+			/// </para>
+			/// </summary>
+			class DisplayMonitor final
+			{
+			public:
+				enum : int {
+					/// <summary>
+					/// タイルの既定の幅
+					/// </summary>
+					DefaultTileWidth = 64,
+
+					/// <summary>
+					/// タイルの既定の高さ
+					/// </summary>
+					DefaultTileHeight = 16,
+				};
+
+				/// <summary>
+				/// 監視を開始します
+				/// </summary>
+				/// <param name="format">取得する画像フォーマット (Utility::FourCC::RGB または Utility::FourCC::YUY2)</param>
+				/// <param name="tileWidth">比較するタイルの幅 (YUY2 では偶数に切り上げます)</param>
+				/// <param name="tileHeight">比較するタイルの高さ</param>
+				explicit DisplayMonitor(unsigned long format = Utility::FourCC::RGB, int tileWidth = DefaultTileWidth, int tileHeight = DefaultTileHeight)
+					: m_format(format), m_tileWidth((std::max)(tileWidth, 2)), m_tileHeight((std::max)(tileHeight, 1))
+				{
+					if (m_format == Utility::FourCC::YUY2) {
+						m_tileWidth = (m_tileWidth + 1) & ~1;
+					}
+				}
+
+				DisplayMonitor(const DisplayMonitor&) = delete;
+				DisplayMonitor& operator=(const DisplayMonitor&) = delete;
+
+				/// <summary>
+				/// 解析器を追加します (所有権は移りません)
+				/// </summary>
+				/// <param name="pAnalyzer">解析器へのポインタ</param>
+				void AddAnalyzer(DisplayAnalyzer* pAnalyzer)
+				{
+					m_analyzers.push_back(pAnalyzer);
+					Invalidate();
+				}
+
+				/// <summary>
+				/// 表示画像を取得して、変化した領域を解析器に渡します
+				/// <para>表示フィルタの func_proc からのみ呼び出せます。</para>
+				/// </summary>
+				/// <param name="pFilter">フィルタ構造体へのポインタ</param>
+				/// <param name="pInfo">フィルタプロシージャ用構造体へのポインタ</param>
+				/// <returns>
+				/// true なら表示画像が変化した (GetDirtyRegions() に変化した領域が入ります)
+				/// </returns>
+				bool Update(FilterPluginTable* pFilter, FilterProcInfo* pInfo)
+				{
+					m_dirtyRegions.clear();
+
+					const unsigned char* pSrc = static_cast<const unsigned char*>(
+						pFilter->pCallbackFunctionSet->GetDispPixelPtr(pInfo->Edit_Handle, static_cast<int>(m_format)));
+					if (pSrc == nullptr || pInfo->Width <= 0 || pInfo->Height <= 0) {
+						return false;
+					}
+
+					const int width = pInfo->Width;
+					const int height = pInfo->Height;
+					const int bytesPerPixel = (m_format == Utility::FourCC::YUY2) ? 2 : 3;
+					const int stride = (width * bytesPerPixel + 3) & ~3;
+
+					// 画像サイズが変わった場合は全体を取り直す
+					const bool reset = m_invalid || width != m_image.Width || height != m_image.Height;
+					if (reset) {
+						m_frame.resize(static_cast<std::size_t>(stride) * height);
+						m_image = DisplayImage{ m_frame.data(), width, height, stride, m_format };
+					}
+
+					// RGB24bit の DIB は下から上の順に並んでいるため、上から下の順に並べ替えて比較する
+					auto getSourceRow = [&](int y) {
+						const int row = (m_format == Utility::FourCC::YUY2) ? y : height - 1 - y;
+						return pSrc + static_cast<std::size_t>(row) * stride;
+					};
+
+					if (reset) {
+						for (int y = 0; y < height; ++y) {
+							std::memcpy(m_frame.data() + static_cast<std::size_t>(y) * stride, getSourceRow(y), static_cast<std::size_t>(width) * bytesPerPixel);
+						}
+						const Region all = { 0, 0, width, height };
+						for (DisplayAnalyzer* pAnalyzer : m_analyzers) {
+							pAnalyzer->Reset(width, height, m_format);
+							pAnalyzer->Add(m_image, all);
+						}
+						m_dirtyRegions.push_back(all);
+						m_invalid = false;
+						return true;
+					}
+
+					// GetDispPixelPtr() のポインタは外部関数を呼ぶと無効になるため、比較と複製はこのスレッドで行う
+					const int tileColumns = (width + m_tileWidth - 1) / m_tileWidth;
+					m_dirtyTiles.resize(tileColumns);
+					for (int top = 0; top < height; top += m_tileHeight) {
+						const int bottom = (std::min)(top + m_tileHeight, height);
+						std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), static_cast<char>(0));
+
+						bool anyDirty = false;
+						for (int y = top; y < bottom; ++y) {
+							const unsigned char* pNew = getSourceRow(y);
+							const unsigned char* pOld = m_image.GetRow(y);
+							if (std::memcmp(pNew, pOld, static_cast<std::size_t>(width) * bytesPerPixel) == 0) {
+								continue;
+							}
+							for (int column = 0; column < tileColumns; ++column) {
+								if (m_dirtyTiles[column] != 0) {
+									continue;
+								}
+								const int offset = column * m_tileWidth * bytesPerPixel;
+								const int size = ((std::min)((column + 1) * m_tileWidth, width) - column * m_tileWidth) * bytesPerPixel;
+								if (std::memcmp(pNew + offset, pOld + offset, size) != 0) {
+									m_dirtyTiles[column] = 1;
+									anyDirty = true;
+								}
+							}
+						}
+						if (!anyDirty) {
+							continue;
+						}
+
+						// 隣接する変化したタイルをまとめて 1 つの領域にする
+						for (int column = 0; column < tileColumns;) {
+							if (m_dirtyTiles[column] == 0) {
+								++column;
+								continue;
+							}
+							int last = column;
+							while (last + 1 < tileColumns && m_dirtyTiles[last + 1] != 0) {
+								++last;
+							}
+							const Region region = { column * m_tileWidth, top, (std::min)((last + 1) * m_tileWidth, width), bottom };
+							UpdateRegion(region, bytesPerPixel, getSourceRow);
+							column = last + 1;
+						}
+					}
+					return !m_dirtyRegions.empty();
+				}
+
+				/// <summary>
+				/// 次の Update() で画像全体を取り直します
+				/// <para>解析器の設定を変更した場合などに呼び出してください。</para>
+				/// </summary>
+				void Invalidate() { m_invalid = true; }
+
+				/// <summary>
+				/// 表示全体の再描画を要求します
+				/// <para>次の HandleMessage() が 1 を返します。オーバーレイの設定を変更した場合などに呼び出してください。</para>
+				/// </summary>
+				void RequestRedraw() { m_redraw = true; }
+
+				/// <summary>
+				/// WndProc に送られたメッセージを処理します
+				/// </summary>
+				/// <param name="message">ウィンドウメッセージ</param>
+				/// <returns>
+				/// WndProc の戻り値 (1 なら全体を再描画)
+				/// </returns>
+				int HandleMessage(unsigned int message)
+				{
+					using WindowMessage = FilterPluginTable::WindowMessage;
+					switch (static_cast<WindowMessage>(message)) {
+					case WindowMessage::FileOpen:
+					case WindowMessage::FileClose:
+					case WindowMessage::ChangeEdit:
+						Invalidate();
+						break;
+					case WindowMessage::ChangeParam:
+						RequestRedraw();
+						break;
+					default:
+						break;
+					}
+					if (m_redraw) {
+						m_redraw = false;
+						return 1;
+					}
+					return 0;
+				}
+
+				/// <summary>
+				/// 直前の Update() で変化した領域を取得します
+				/// <para>スコープのウィンドウを部分的に再描画する場合に使用します。</para>
+				/// </summary>
+				const std::vector<Region>& GetDirtyRegions() const { return m_dirtyRegions; }
+
+				/// <summary>
+				/// 直前の Update() で取得した表示画像を取得します
+				/// <para>GetDispPixelPtr() のポインタとは異なり、次の Update() まで有効です。</para>
+				/// </summary>
+				const DisplayImage& GetImage() const { return m_image; }
+
+			private:
+				/// <summary>
+				/// 変化した領域を解析器に渡して、保持している画像を更新します
+				/// </summary>
+				template<class GetSourceRow>
+				void UpdateRegion(const Region& region, int bytesPerPixel, GetSourceRow& getSourceRow)
+				{
+					for (DisplayAnalyzer* pAnalyzer : m_analyzers) {
+						pAnalyzer->Remove(m_image, region);
+					}
+					const std::size_t offset = static_cast<std::size_t>(region.Left) * bytesPerPixel;
+					const std::size_t size = static_cast<std::size_t>(region.Right - region.Left) * bytesPerPixel;
+					for (int y = region.Top; y < region.Bottom; ++y) {
+						std::memcpy(m_frame.data() + static_cast<std::size_t>(y) * m_image.Stride + offset, getSourceRow(y) + offset, size);
+					}
+					for (DisplayAnalyzer* pAnalyzer : m_analyzers) {
+						pAnalyzer->Add(m_image, region);
+					}
+					m_dirtyRegions.push_back(region);
+				}
+
+				unsigned long m_format;
+				int m_tileWidth;
+				int m_tileHeight;
+				bool m_invalid = true;
+				bool m_redraw = false;
+				std::vector<unsigned char> m_frame;
+				DisplayImage m_image = {};
+				std::vector<char> m_dirtyTiles;
+				std::vector<Region> m_dirtyRegions;
+				std::vector<DisplayAnalyzer*> m_analyzers;
+			};
+		}
+	}
+
+#endif
+}
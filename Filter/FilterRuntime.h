@@ -0,0 +1,439 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AlignedBuffer.h"
+#include "../Utility/FrameCache.h"
+#include "../Utility/ThreadPool.h"
+#include "MultiThread.h"
+#include <algorithm>    // std::find_if, std::max, std::min
+#include <atomic>       // std::atomic
+#include <map>          // std::map
+#include <memory>       // std::unique_ptr
+#include <mutex>        // std::mutex, std::lock_guard
+#include <new>          // std::bad_alloc
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 1 つの DLL から複数のフィルタを公開する場合の共有ランタイム
+		/// <para>DLL 内の全てのフィルタで、画像バッファのプール・ワーカースレッド・ExecMultiThread 用の作業領域・フレームキャッシュの容量を共有します。</para>
+		/// <para>フレームキャッシュの容量は有効なフィルタの重みに応じて配分するため、フィルタの数が増えても合計の使用量は変わりません。</para>
+		/// <para>※ GetFrameCache() と作業領域の準備はメインスレッド (FilterProc など) から呼び出してください。</para>
+		/// </summary>
+		class FilterRuntime final
+		{
+		public:
+			/// <summary>
+			/// 動作設定
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// プールに保持しておく、使用していない画像バッファの合計バイト数
+				/// </summary>
+				std::size_t FramePoolCapacity = 128 * 1024 * 1024;
+
+				/// <summary>
+				/// 全てのフィルタのフレームキャッシュの合計容量
+				/// </summary>
+				std::size_t FrameCacheCapacity = Utility::FrameCache::DefaultCapacity;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			static Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// DLL 内で共有するランタイムを取得します
+			/// </summary>
+			static FilterRuntime& GetInstance()
+			{
+				static FilterRuntime runtime;
+				return runtime;
+			}
+
+			FilterRuntime(const FilterRuntime&) = delete;
+			FilterRuntime& operator=(const FilterRuntime&) = delete;
+
+			/// <summary>
+			/// プールから借りた画像バッファ
+			/// <para>破棄時にプールへ返却されます。コピーは出来ず、ムーブのみ可能です。</para>
+			/// </summary>
+			class FrameBuffer final
+			{
+			public:
+				FrameBuffer() = default;
+				FrameBuffer(const FrameBuffer&) = delete;
+				FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+				FrameBuffer(FrameBuffer&& other) noexcept
+					: m_buffer(std::move(other.m_buffer)), m_pOwner(other.m_pOwner)
+				{
+					other.m_pOwner = nullptr;
+				}
+
+				FrameBuffer& operator=(FrameBuffer&& other) noexcept
+				{
+					if (this != &other) {
+						Release();
+						m_buffer = std::move(other.m_buffer);
+						m_pOwner = other.m_pOwner;
+						other.m_pOwner = nullptr;
+					}
+					return *this;
+				}
+
+				~FrameBuffer() { Release(); }
+
+				/// <summary>
+				/// プールへ返却します
+				/// </summary>
+				void Release()
+				{
+					if (m_pOwner != nullptr && m_buffer.GetData() != nullptr) {
+						GetInstance().ReturnFrame(m_pOwner, std::move(m_buffer));
+					}
+					m_buffer.Free();
+					m_pOwner = nullptr;
+				}
+
+				Pixel_YC* GetData() { return m_buffer.GetData(); }
+				const Pixel_YC* GetData() const { return m_buffer.GetData(); }
+
+				/// <summary>
+				/// 画素数を取得します (要求した画素数以上)
+				/// </summary>
+				std::size_t GetCount() const { return m_buffer.GetCount(); }
+
+				/// <summary>
+				/// 確保済みか
+				/// </summary>
+				bool IsValid() const { return m_buffer.GetData() != nullptr; }
+
+			private:
+				friend class FilterRuntime;
+
+				Utility::AlignedBuffer<Pixel_YC> m_buffer;
+				FilterPluginTable* m_pOwner = nullptr;
+			};
+
+			/// <summary>
+			/// フィルタを登録します
+			/// <para>GetFilterTableList() で返すテーブルを、返す順に全て登録してください。</para>
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			/// <param name="weight">フレームキャッシュの容量を配分する際の重み (0 ならキャッシュを使用しない)</param>
+			void Register(FilterPluginTable* pFilter, int weight = 1)
+			{
+				if (FindState(pFilter) != nullptr) {
+					return;
+				}
+				std::unique_ptr<State> pState(new State());
+				pState->pFilter = pFilter;
+				pState->Weight = (std::max)(weight, 0);
+				m_states.push_back(std::move(pState));
+
+				m_tableList.clear();
+				for (const auto& state : m_states) {
+					m_tableList.push_back(state->pFilter);
+				}
+				m_tableList.push_back(nullptr);
+			}
+
+			/// <summary>
+			/// 登録したフィルタの一覧を取得します
+			/// <para>GetFilterTableList() の戻り値としてそのまま返せます (末尾は nullptr)。</para>
+			/// </summary>
+			FilterPluginTable** GetTableList()
+			{
+				if (m_tableList.empty()) {
+					m_tableList.push_back(nullptr);
+				}
+				return m_tableList.data();
+			}
+
+			/// <summary>
+			/// プールから画像バッファを借ります
+			/// <para>要求以上で 2 倍以内の大きさの空きがあればそれを使用し、無ければ確保します。</para>
+			/// </summary>
+			/// <param name="pFilter">使用するフィルタ</param>
+			/// <param name="count">画素数</param>
+			/// <returns>
+			/// 画像バッファ (確保に失敗した場合は IsValid() が false)
+			/// </returns>
+			FrameBuffer AcquireFrame(FilterPluginTable* pFilter, std::size_t count)
+			{
+				FrameBuffer result;
+				result.m_pOwner = pFilter;
+				{
+					std::lock_guard<std::mutex> lock(m_poolMutex);
+					auto best = m_idleFrames.end();
+					for (auto it = m_idleFrames.begin(); it != m_idleFrames.end(); ++it) {
+						const std::size_t size = it->GetCount();
+						if (size >= count && size / 2 <= count && (best == m_idleFrames.end() || size < best->GetCount())) {
+							best = it;
+						}
+					}
+					if (best != m_idleFrames.end()) {
+						m_idleBytes -= best->GetSize();
+						result.m_buffer = std::move(*best);
+						m_idleFrames.erase(best);
+						m_usedBytes[pFilter] += result.m_buffer.GetSize();
+						return result;
+					}
+				}
+
+				try {
+					result.m_buffer.Allocate(count);
+				}
+				catch (const std::bad_alloc&) {
+					// 空きを全て解放してから確保し直す
+					TrimFrames(0);
+					try {
+						result.m_buffer.Allocate(count);
+					}
+					catch (const std::bad_alloc&) {
+						result.m_pOwner = nullptr;
+						return result;
+					}
+				}
+				std::lock_guard<std::mutex> lock(m_poolMutex);
+				m_usedBytes[pFilter] += result.m_buffer.GetSize();
+				return result;
+			}
+
+			/// <summary>
+			/// 使用していない画像バッファを、指定したバイト数以下になるまで解放します
+			/// </summary>
+			void TrimFrames(std::size_t capacity)
+			{
+				std::lock_guard<std::mutex> lock(m_poolMutex);
+				while (m_idleBytes > capacity && !m_idleFrames.empty()) {
+					m_idleBytes -= m_idleFrames.front().GetSize();
+					m_idleFrames.erase(m_idleFrames.begin());
+				}
+			}
+
+			/// <summary>
+			/// フィルタが借りている画像バッファのバイト数を取得します
+			/// </summary>
+			std::size_t GetFrameUsage(FilterPluginTable* pFilter)
+			{
+				std::lock_guard<std::mutex> lock(m_poolMutex);
+				const auto it = m_usedBytes.find(pFilter);
+				return it != m_usedBytes.end() ? it->second : 0;
+			}
+
+			/// <summary>
+			/// 共有のワーカースレッドを取得します
+			/// <para>FilterProc 内の分割処理には ExecMultiThread を使用し、こちらは先読みなどのバックグラウンド処理に使用します。</para>
+			/// </summary>
+			Utility::ThreadPool& GetWorkerPool() { return Utility::ThreadPool::GetDefault(); }
+
+			/// <summary>
+			/// ExecMultiThread のスレッドごとの作業領域を準備します
+			/// <para>ExecMultiThread の中ではメモリを確保できないため、呼び出す前にメインスレッドで準備してください。</para>
+			/// <para>作業領域は全てのフィルタで共有します (フィルタは順番に処理されるため、同時には使用されません)。</para>
+			/// </summary>
+			/// <param name="pExec">CallbackFunctionSet::ExecMultiThread</param>
+			/// <param name="size">スレッドごとのバイト数</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool PrepareScratch(MultiThread::Exec_Func pExec, std::size_t size)
+			{
+				if (m_threadNum <= 0 || m_recount.exchange(false)) {
+					int threadNum = 1;
+					MultiThread::Exec(pExec, [&threadNum](int threadId, int num) {
+						if (threadId == 0) {
+							threadNum = num;
+						}
+					});
+					m_threadNum = (std::max)(threadNum, 1);
+				}
+
+				if (m_scratch.size() < static_cast<std::size_t>(m_threadNum)) {
+					m_scratch.resize(m_threadNum);
+				}
+				try {
+					for (auto& scratch : m_scratch) {
+						if (scratch.GetCount() < size) {
+							scratch.Allocate(size);
+						}
+					}
+				}
+				catch (const std::bad_alloc&) {
+					return false;
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// スレッドごとの作業領域を取得します (ExecMultiThread の中から呼び出せます)
+			/// </summary>
+			/// <param name="threadId">スレッド番号</param>
+			/// <returns>
+			/// 作業領域 (準備していないスレッド番号なら nullptr)
+			/// </returns>
+			void* GetScratch(int threadId)
+			{
+				if (threadId < 0 || static_cast<std::size_t>(threadId) >= m_scratch.size()) {
+					// スレッド数の設定が変わった場合は、次の PrepareScratch() で数え直す
+					m_recount = true;
+					return nullptr;
+				}
+				return m_scratch[threadId].GetData();
+			}
+
+			/// <summary>
+			/// フィルタのフレームキャッシュを取得します
+			/// <para>呼び出すたびに、有効なフィルタの重みで全体の容量を配分し直します。無効なフィルタのキャッシュは解放されます。</para>
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス (Register() 済みのもの)</param>
+			Utility::FrameCache& GetFrameCache(FilterPluginTable* pFilter)
+			{
+				State* pState = FindState(pFilter);
+				if (pState == nullptr) {
+					Register(pFilter);
+					pState = FindState(pFilter);
+				}
+				Rebalance();
+				return pState->Cache;
+			}
+
+			/// <summary>
+			/// フレームキャッシュの容量を配分し直します
+			/// </summary>
+			void Rebalance()
+			{
+				long long totalWeight = 0;
+				for (const auto& pState : m_states) {
+					totalWeight += IsActive(pState->pFilter) ? pState->Weight : 0;
+				}
+
+				const std::size_t capacity = GetSettings().FrameCacheCapacity;
+				for (const auto& pState : m_states) {
+					const int weight = IsActive(pState->pFilter) ? pState->Weight : 0;
+					const std::size_t share = (totalWeight > 0) ? static_cast<std::size_t>(static_cast<unsigned long long>(capacity) * weight / totalWeight) : 0;
+					// 容量が 0 になったキャッシュは SetCapacity() で空になる
+					if (pState->Cache.GetCapacity() != share) {
+						pState->Cache.SetCapacity(share);
+					}
+				}
+			}
+
+			/// <summary>
+			/// フィルタの終了処理を行います
+			/// <para>各フィルタの FilterExit から呼び出してください。全てのフィルタが終了すると、共有のワーカースレッドを終了してメモリを解放します。</para>
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			void Exit(FilterPluginTable* pFilter)
+			{
+				State* pState = FindState(pFilter);
+				if (pState != nullptr) {
+					pState->Exited = true;
+					pState->Cache.Clear();
+				}
+
+				for (const auto& state : m_states) {
+					if (!state->Exited) {
+						return;
+					}
+				}
+				GetWorkerPool().Shutdown();
+				TrimFrames(0);
+				m_scratch.clear();
+				m_threadNum = 0;
+			}
+
+		private:
+			FilterRuntime() = default;
+
+			/// <summary>
+			/// フィルタごとの状態
+			/// </summary>
+			struct State final
+			{
+				FilterPluginTable* pFilter = nullptr;
+				int Weight = 1;
+				bool Exited = false;
+				Utility::FrameCache Cache{ 0 };
+			};
+
+			State* FindState(FilterPluginTable* pFilter)
+			{
+				const auto it = std::find_if(m_states.begin(), m_states.end(), [pFilter](const std::unique_ptr<State>& pState) {
+					return pState->pFilter == pFilter;
+				});
+				return it != m_states.end() ? it->get() : nullptr;
+			}
+
+			/// <summary>
+			/// フィルタが有効か調べます (判定できない場合は有効とみなします)
+			/// </summary>
+			static bool IsActive(FilterPluginTable* pFilter)
+			{
+				if (pFilter == nullptr || pFilter->pCallbackFunctionSet == nullptr || pFilter->pCallbackFunctionSet->IsFilterActive == nullptr) {
+					return true;
+				}
+				return pFilter->pCallbackFunctionSet->IsFilterActive(pFilter) != 0;
+			}
+
+			/// <summary>
+			/// 返却された画像バッファをプールに戻します (容量を超えた分は古いものから解放します)
+			/// </summary>
+			void ReturnFrame(FilterPluginTable* pFilter, Utility::AlignedBuffer<Pixel_YC>&& buffer)
+			{
+				std::lock_guard<std::mutex> lock(m_poolMutex);
+				std::size_t& used = m_usedBytes[pFilter];
+				used -= (std::min)(used, buffer.GetSize());
+
+				m_idleBytes += buffer.GetSize();
+				m_idleFrames.push_back(std::move(buffer));
+				const std::size_t capacity = GetSettings().FramePoolCapacity;
+				while (m_idleBytes > capacity && !m_idleFrames.empty()) {
+					m_idleBytes -= m_idleFrames.front().GetSize();
+					m_idleFrames.erase(m_idleFrames.begin());
+				}
+			}
+
+			std::vector<std::unique_ptr<State>> m_states;
+			std::vector<FilterPluginTable*> m_tableList;
+
+			std::mutex m_poolMutex;
+			std::vector<Utility::AlignedBuffer<Pixel_YC>> m_idleFrames;
+			std::size_t m_idleBytes = 0;
+			std::map<FilterPluginTable*, std::size_t> m_usedBytes;
+
+			std::vector<Utility::AlignedBuffer<unsigned char>> m_scratch;
+			int m_threadNum = 0;
+			std::atomic<bool> m_recount{ false };
+		};
+	}
+
+#endif
+}
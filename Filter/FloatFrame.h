@@ -0,0 +1,709 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AlignedBuffer.h"
+#include "../Utility/Simd.h"
+#include "FilterRuntime.h"
+#include "MultiThread.h"
+#include <atomic>       // std::atomic
+#include <cstddef>      // std::size_t
+#include <cstring>      // std::memcpy
+#include <new>          // std::bad_alloc
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// FloatFrame の画素の保持形式
+		/// </summary>
+		enum class FloatStorage : int {
+			/// <summary>
+			/// 単精度 (float)
+			/// </summary>
+			Float32,
+
+			/// <summary>
+			/// 半精度 (16bit、メモリ帯域が半分になる代わりに Y が 0.5 以上の範囲では Pixel_YC の 2 単位の精度になります)
+			/// </summary>
+			Float16,
+		};
+
+		/// <summary>
+		/// 内部実装
+		/// </summary>
+		namespace FloatFrameDetail
+		{
+			/// <summary>
+			/// Pixel_YC の値から float への倍率 (Y 4096 が 1.0、Cb/Cr ±2048 が ±0.5)
+			/// <para>2 の累乗のため、Pixel_YC -> float -> Pixel_YC は元の値に戻ります。</para>
+			/// </summary>
+			const float ToFloatScale = 1.0f / 4096.0f;
+
+			/// <summary>
+			/// float から Pixel_YC の値への倍率
+			/// </summary>
+			const float FromFloatScale = 4096.0f;
+
+			/// <summary>
+			/// float を半精度に変換します (最近接偶数への丸め、F16C と同じ結果)
+			/// </summary>
+			inline unsigned short FloatToHalf(float value)
+			{
+				unsigned int bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+				const unsigned int sign = (bits >> 16) & 0x8000;
+				bits &= 0x7FFFFFFF;
+				if (bits >= 0x7F800000) {
+					// 無限大 / NaN (NaN は quiet にする)
+					return static_cast<unsigned short>(sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 | ((bits >> 13) & 0x3FF) : 0));
+				}
+				if (bits >= 0x477FF000) {
+					// 65520 以上は丸めると無限大
+					return static_cast<unsigned short>(sign | 0x7C00);
+				}
+				if (bits < 0x38800000) {
+					// 非正規化数 (2^-14 未満)
+					if (bits < 0x33000000) {
+						return static_cast<unsigned short>(sign);
+					}
+					const unsigned int mantissa = (bits & 0x7FFFFF) | 0x800000;
+					const unsigned int shift = 126 - (bits >> 23);
+					unsigned int half = mantissa >> shift;
+					const unsigned int rest = mantissa & ((1u << shift) - 1);
+					const unsigned int halfway = 1u << (shift - 1);
+					if (rest > halfway || (rest == halfway && (half & 1) != 0)) {
+						++half;
+					}
+					return static_cast<unsigned short>(sign | half);
+				}
+				// 指数を付け替え、仮数の下位 13bit を丸める (繰り上がりは指数に伝わる)
+				unsigned int half = (bits >> 13) - ((127 - 15) << 10);
+				const unsigned int rest = bits & 0x1FFF;
+				if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0)) {
+					++half;
+				}
+				return static_cast<unsigned short>(sign | half);
+			}
+
+			/// <summary>
+			/// 半精度を float に変換します (F16C と同じ結果)
+			/// </summary>
+			inline float HalfToFloat(unsigned short half)
+			{
+				const unsigned int sign = static_cast<unsigned int>(half & 0x8000) << 16;
+				const unsigned int exponent = (half >> 10) & 0x1F;
+				const unsigned int mantissa = half & 0x3FF;
+				if (exponent == 0) {
+					const float value = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+					return sign != 0 ? -value : value;
+				}
+				const unsigned int bits = exponent == 0x1F
+					? sign | 0x7F800000 | (mantissa << 13) | (mantissa != 0 ? 0x400000u : 0u)
+					: sign | ((exponent + 112) << 23) | (mantissa << 13);
+				float value;
+				std::memcpy(&value, &bits, sizeof(value));
+				return value;
+			}
+
+			/// <summary>
+			/// float を Pixel_YC の値に変換します (飽和・最近接偶数への丸め、NaN は -32768)
+			/// </summary>
+			inline short FromFloat(float value)
+			{
+				float scaled = value * FromFloatScale;
+				scaled = scaled > -32768.0f ? scaled : -32768.0f;
+				scaled = scaled < 32767.0f ? scaled : 32767.0f;
+				return static_cast<short>(_mm_cvtss_si32(_mm_set_ss(scaled)));
+			}
+
+			/// <summary>
+			/// 8 要素を float の平面から読み込みます
+			/// </summary>
+			inline void LoadPlane8(const float* pSrc, bool, __m128& lo, __m128& hi)
+			{
+				lo = _mm_load_ps(pSrc);
+				hi = _mm_load_ps(pSrc + 4);
+			}
+
+			/// <summary>
+			/// 8 要素を半精度の平面から読み込みます
+			/// </summary>
+			inline void LoadPlane8(const unsigned short* pSrc, bool f16c, __m128& lo, __m128& hi)
+			{
+				if (f16c) {
+					const __m128i halves = _mm_load_si128(reinterpret_cast<const __m128i*>(pSrc));
+					lo = _mm_cvtph_ps(halves);
+					hi = _mm_cvtph_ps(_mm_unpackhi_epi64(halves, halves));
+					return;
+				}
+				alignas(16) float values[8];
+				for (int i = 0; i < 8; ++i) {
+					values[i] = HalfToFloat(pSrc[i]);
+				}
+				lo = _mm_load_ps(values);
+				hi = _mm_load_ps(values + 4);
+			}
+
+			/// <summary>
+			/// 8 要素を float の平面に書き込みます
+			/// </summary>
+			inline void StorePlane8(float* pDst, bool, __m128 lo, __m128 hi)
+			{
+				_mm_store_ps(pDst, lo);
+				_mm_store_ps(pDst + 4, hi);
+			}
+
+			/// <summary>
+			/// 8 要素を半精度の平面に書き込みます
+			/// </summary>
+			inline void StorePlane8(unsigned short* pDst, bool f16c, __m128 lo, __m128 hi)
+			{
+				if (f16c) {
+					_mm_store_si128(reinterpret_cast<__m128i*>(pDst), _mm_unpacklo_epi64(_mm_cvtps_ph(lo, 0), _mm_cvtps_ph(hi, 0)));
+					return;
+				}
+				alignas(16) float values[8];
+				_mm_store_ps(values, lo);
+				_mm_store_ps(values + 4, hi);
+				for (int i = 0; i < 8; ++i) {
+					pDst[i] = FloatToHalf(values[i]);
+				}
+			}
+
+			inline float LoadValue(const float* pSrc) { return *pSrc; }
+			inline float LoadValue(const unsigned short* pSrc) { return HalfToFloat(*pSrc); }
+			inline void StoreValue(float* pDst, float value) { *pDst = value; }
+			inline void StoreValue(unsigned short* pDst, float value) { *pDst = FloatToHalf(value); }
+
+			/// <summary>
+			/// 符号付き 16bit 8 要素を float に変換して倍率をかけます
+			/// </summary>
+			inline void ToFloat8(__m128i value, __m128& lo, __m128& hi)
+			{
+				const __m128 scale = _mm_set1_ps(ToFloatScale);
+				lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16)), scale);
+				hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(value, value), 16)), scale);
+			}
+
+			/// <summary>
+			/// float 8 要素を符号付き 16bit に変換します (FromFloat と同じ結果)
+			/// </summary>
+			inline __m128i FromFloat8(__m128 lo, __m128 hi)
+			{
+				const __m128 scale = _mm_set1_ps(FromFloatScale);
+				const __m128 minimum = _mm_set1_ps(-32768.0f);
+				const __m128 maximum = _mm_set1_ps(32767.0f);
+				// _mm_max_ps は NaN の場合に第 2 引数を返す
+				lo = _mm_min_ps(_mm_max_ps(_mm_mul_ps(lo, scale), minimum), maximum);
+				hi = _mm_min_ps(_mm_max_ps(_mm_mul_ps(hi, scale), minimum), maximum);
+				return _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+			}
+
+			/// <summary>
+			/// Pixel_YC 1 行を平面に変換します
+			/// </summary>
+			template<class T>
+			inline void ImportRow(const Pixel_YC* pSrc, int width, T* pY, T* pCb, T* pCr, bool simd, bool f16c)
+			{
+				int x = 0;
+				if (simd) {
+					for (; x + 8 <= width; x += 8) {
+						__m128i y, cb, cr;
+						__m128 lo, hi;
+						Utility::Simd::LoadYC8(pSrc + x, y, cb, cr);
+						ToFloat8(y, lo, hi);
+						StorePlane8(pY + x, f16c, lo, hi);
+						ToFloat8(cb, lo, hi);
+						StorePlane8(pCb + x, f16c, lo, hi);
+						ToFloat8(cr, lo, hi);
+						StorePlane8(pCr + x, f16c, lo, hi);
+					}
+				}
+				for (; x < width; ++x) {
+					StoreValue(pY + x, pSrc[x].Y * ToFloatScale);
+					StoreValue(pCb + x, pSrc[x].Cb * ToFloatScale);
+					StoreValue(pCr + x, pSrc[x].Cr * ToFloatScale);
+				}
+			}
+
+			/// <summary>
+			/// 平面の 1 行を Pixel_YC に変換します
+			/// </summary>
+			template<class T>
+			inline void ExportRow(const T* pY, const T* pCb, const T* pCr, int width, Pixel_YC* pDst, bool simd, bool f16c)
+			{
+				int x = 0;
+				if (simd) {
+					for (; x + 8 <= width; x += 8) {
+						__m128 lo, hi;
+						LoadPlane8(pY + x, f16c, lo, hi);
+						const __m128i y = FromFloat8(lo, hi);
+						LoadPlane8(pCb + x, f16c, lo, hi);
+						const __m128i cb = FromFloat8(lo, hi);
+						LoadPlane8(pCr + x, f16c, lo, hi);
+						const __m128i cr = FromFloat8(lo, hi);
+						Utility::Simd::StoreYC8(pDst + x, y, cb, cr);
+					}
+				}
+				for (; x < width; ++x) {
+					pDst[x].Y = FromFloat(LoadValue(pY + x));
+					pDst[x].Cb = FromFloat(LoadValue(pCb + x));
+					pDst[x].Cr = FromFloat(LoadValue(pCr + x));
+				}
+			}
+
+			/// <summary>
+			/// 半精度の 1 行を float に変換します
+			/// </summary>
+			inline void HalfToFloatRow(const unsigned short* pSrc, float* pDst, int count, bool f16c)
+			{
+				int i = 0;
+				for (; i + 8 <= count; i += 8) {
+					__m128 lo, hi;
+					LoadPlane8(pSrc + i, f16c, lo, hi);
+					StorePlane8(pDst + i, false, lo, hi);
+				}
+				for (; i < count; ++i) {
+					pDst[i] = HalfToFloat(pSrc[i]);
+				}
+			}
+
+			/// <summary>
+			/// float の 1 行を半精度に変換します
+			/// </summary>
+			inline void FloatToHalfRow(const float* pSrc, unsigned short* pDst, int count, bool f16c)
+			{
+				int i = 0;
+				for (; i + 8 <= count; i += 8) {
+					__m128 lo, hi;
+					LoadPlane8(pSrc + i, false, lo, hi);
+					StorePlane8(pDst + i, f16c, lo, hi);
+				}
+				for (; i < count; ++i) {
+					pDst[i] = FloatToHalf(pSrc[i]);
+				}
+			}
+
+			/// <summary>
+			/// 64bit の値を混ぜます (MurmurHash3 の fmix64)
+			/// </summary>
+			inline unsigned long long MixHash(unsigned long long h)
+			{
+				h ^= h >> 33;
+				h *= 0xFF51AFD7ED558CCDull;
+				h ^= h >> 33;
+				h *= 0xC4CEB9FE1A85EC53ull;
+				h ^= h >> 33;
+				return h;
+			}
+
+			/// <summary>
+			/// 1 行のハッシュを求めます (フレームの受け渡しで、途中のフィルタが画像を変更していないかの確認用)
+			/// <para>8byte ごとに xor・乗算・xorshift で混ぜる非線形のハッシュのため、離れた位置の増減が打ち消し合って一致することはありません。</para>
+			/// <para>乗算の待ち時間を隠すため 32byte を 4 系列に分けて並列に計算します。端数のバイトは 0 で埋め、最後に行のバイト数と共に混ぜます。</para>
+			/// </summary>
+			inline unsigned long long HashRow(const void* pRow, std::size_t size)
+			{
+				const unsigned long long multiplier = 0x9E3779B97F4A7C15ull;
+				const auto step = [multiplier](unsigned long long h, unsigned long long word) {
+					h = (h ^ word) * multiplier;
+					return h ^ (h >> 29);
+				};
+				const unsigned char* p = static_cast<const unsigned char*>(pRow);
+				unsigned long long h[4] = { 0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull };
+				std::size_t i = 0;
+				for (; i + 32 <= size; i += 32) {
+					unsigned long long words[4];
+					std::memcpy(words, p + i, sizeof(words));
+					h[0] = step(h[0], words[0]);
+					h[1] = step(h[1], words[1]);
+					h[2] = step(h[2], words[2]);
+					h[3] = step(h[3], words[3]);
+				}
+				if (i < size) {
+					unsigned long long words[4] = {};
+					std::memcpy(words, p + i, size - i);
+					h[0] = step(h[0], words[0]);
+					h[1] = step(h[1], words[1]);
+					h[2] = step(h[2], words[2]);
+					h[3] = step(h[3], words[3]);
+				}
+				return MixHash(h[0] ^ MixHash(h[1] ^ MixHash(h[2] ^ MixHash(h[3] ^ size))));
+			}
+		}
+
+		/// <summary>
+		/// float の平面 (Y, Cb, Cr) で保持する画像
+		/// <para>Y は 4096 を 1.0、Cb/Cr は ±2048 を ±0.5 とする値で保持します。Pixel_YC との変換は SSSE3 (半精度は F16C) で行います。</para>
+		/// <para>各行は 64byte 境界から始まり、GetPitch() 要素ごとに並びます。コピーは出来ず、ムーブのみ可能です。</para>
+		/// </summary>
+		class FloatFrame final
+		{
+		public:
+			FloatFrame() = default;
+			FloatFrame(const FloatFrame&) = delete;
+			FloatFrame& operator=(const FloatFrame&) = delete;
+			FloatFrame(FloatFrame&& other) noexcept
+				: m_buffer(std::move(other.m_buffer)), m_width(other.m_width), m_height(other.m_height), m_pitch(other.m_pitch), m_storage(other.m_storage)
+			{
+				other.m_width = other.m_height = other.m_pitch = 0;
+			}
+
+			FloatFrame& operator=(FloatFrame&& other) noexcept
+			{
+				if (this != &other) {
+					m_buffer = std::move(other.m_buffer);
+					m_width = other.m_width;
+					m_height = other.m_height;
+					m_pitch = other.m_pitch;
+					m_storage = other.m_storage;
+					other.m_width = other.m_height = other.m_pitch = 0;
+				}
+				return *this;
+			}
+
+			/// <summary>
+			/// 画像領域を確保します (内容は初期化しません)
+			/// <para>同じ形式で容量が足りる場合は、確保済みの領域をそのまま使用します。</para>
+			/// </summary>
+			/// <param name="width">画像の幅</param>
+			/// <param name="height">画像の高さ</param>
+			/// <param name="storage">画素の保持形式</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Allocate(int width, int height, FloatStorage storage)
+			{
+				if (width <= 0 || height <= 0) {
+					return false;
+				}
+				// 1 行を 16 要素 (float で 64byte) 単位に揃える
+				const int pitch = (width + 15) & ~15;
+				const std::size_t bytes = static_cast<std::size_t>(pitch) * height * 3 * (storage == FloatStorage::Float16 ? 2 : 4);
+				try {
+					if (m_buffer.GetCount() < bytes) {
+						m_buffer.Allocate(bytes);
+					}
+				}
+				catch (const std::bad_alloc&) {
+					m_width = m_height = m_pitch = 0;
+					return false;
+				}
+				m_width = width;
+				m_height = height;
+				m_pitch = pitch;
+				m_storage = storage;
+				return true;
+			}
+
+			/// <summary>
+			/// 確保済みか
+			/// </summary>
+			bool IsValid() const { return m_width > 0; }
+
+			int GetWidth() const { return m_width; }
+			int GetHeight() const { return m_height; }
+
+			/// <summary>
+			/// 1 行の要素数を取得します
+			/// </summary>
+			int GetPitch() const { return m_pitch; }
+
+			/// <summary>
+			/// 画素の保持形式を取得します
+			/// </summary>
+			FloatStorage GetStorage() const { return m_storage; }
+
+			/// <summary>
+			/// float の行を取得します (FloatStorage::Float32 のみ)
+			/// </summary>
+			/// <param name="plane">平面 (0: Y, 1: Cb, 2: Cr)</param>
+			/// <param name="y">行</param>
+			float* GetRow(int plane, int y) { return reinterpret_cast<float*>(m_buffer.GetData()) + GetOffset(plane, y); }
+			const float* GetRow(int plane, int y) const { return reinterpret_cast<const float*>(m_buffer.GetData()) + GetOffset(plane, y); }
+
+			/// <summary>
+			/// 半精度の行を取得します (FloatStorage::Float16 のみ)
+			/// </summary>
+			/// <param name="plane">平面 (0: Y, 1: Cb, 2: Cr)</param>
+			/// <param name="y">行</param>
+			unsigned short* GetHalfRow(int plane, int y) { return reinterpret_cast<unsigned short*>(m_buffer.GetData()) + GetOffset(plane, y); }
+			const unsigned short* GetHalfRow(int plane, int y) const { return reinterpret_cast<const unsigned short*>(m_buffer.GetData()) + GetOffset(plane, y); }
+
+			/// <summary>
+			/// Pixel_YC 形式の画像を読み込みます (画像の大きさに合わせて確保し直します)
+			/// </summary>
+			/// <param name="pSrc">Pixel_YC 形式の画像</param>
+			/// <param name="lineSize">pSrc の 1 行のバイト数</param>
+			/// <param name="width">画像の幅</param>
+			/// <param name="height">画像の高さ</param>
+			/// <param name="storage">画素の保持形式</param>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr 可)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Import(const Pixel_YC* pSrc, int lineSize, int width, int height, FloatStorage storage, MultiThread::Exec_Func pExec)
+			{
+				if (pSrc == nullptr || !Allocate(width, height, storage)) {
+					return false;
+				}
+				const bool simd = Utility::Simd::Has(Utility::Simd::Feature::SSSE3);
+				const bool f16c = Utility::Simd::Has(Utility::Simd::Feature::F16C);
+				return MultiThread::ForEachRange(pExec, height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						const Pixel_YC* pRow = reinterpret_cast<const Pixel_YC*>(reinterpret_cast<const unsigned char*>(pSrc) + static_cast<std::size_t>(lineSize) * y);
+						if (m_storage == FloatStorage::Float16) {
+							FloatFrameDetail::ImportRow(pRow, width, GetHalfRow(0, y), GetHalfRow(1, y), GetHalfRow(2, y), simd, f16c);
+						}
+						else {
+							FloatFrameDetail::ImportRow(pRow, width, GetRow(0, y), GetRow(1, y), GetRow(2, y), simd, f16c);
+						}
+					}
+				});
+			}
+
+			/// <summary>
+			/// Pixel_YC 形式の画像に書き出します (値は飽和させて丸めます)
+			/// </summary>
+			/// <param name="pDst">Pixel_YC 形式の出力先 (GetWidth() x GetHeight())</param>
+			/// <param name="lineSize">pDst の 1 行のバイト数</param>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr 可)</param>
+			/// <param name="pRowHashes">書き出した各行のハッシュの格納先 (GetHeight() 個、nullptr 可)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Export(Pixel_YC* pDst, int lineSize, MultiThread::Exec_Func pExec, unsigned long long* pRowHashes = nullptr) const
+			{
+				if (pDst == nullptr || !IsValid()) {
+					return false;
+				}
+				const bool simd = Utility::Simd::Has(Utility::Simd::Feature::SSSE3);
+				const bool f16c = Utility::Simd::Has(Utility::Simd::Feature::F16C);
+				return MultiThread::ForEachRange(pExec, m_height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						Pixel_YC* pRow = reinterpret_cast<Pixel_YC*>(reinterpret_cast<unsigned char*>(pDst) + static_cast<std::size_t>(lineSize) * y);
+						if (m_storage == FloatStorage::Float16) {
+							FloatFrameDetail::ExportRow(GetHalfRow(0, y), GetHalfRow(1, y), GetHalfRow(2, y), m_width, pRow, simd, f16c);
+						}
+						else {
+							FloatFrameDetail::ExportRow(GetRow(0, y), GetRow(1, y), GetRow(2, y), m_width, pRow, simd, f16c);
+						}
+						if (pRowHashes != nullptr) {
+							// 書き出した直後の行は L1 に残っているため、読み直しても負荷は小さい
+							pRowHashes[y] = FloatFrameDetail::HashRow(pRow, static_cast<std::size_t>(m_width) * sizeof(Pixel_YC));
+						}
+					}
+				});
+			}
+
+			/// <summary>
+			/// 各行を float で処理します
+			/// <para>FloatStorage::Float32 は画像の行をそのまま渡します。Float16 は作業領域に float で展開して渡し、呼び出し後に半精度へ戻します。</para>
+			/// <para>作業領域は FilterRuntime のスレッドごとの作業領域を使用するため、メインスレッド (FilterProc など) から呼び出してください。</para>
+			/// </summary>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr 可)</param>
+			/// <param name="func">void(int y, float* pY, float* pCb, float* pCr) の関数オブジェクト (各行 GetWidth() 要素)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			template<class Func>
+			bool ForEachRow(MultiThread::Exec_Func pExec, Func&& func)
+			{
+				if (!IsValid()) {
+					return false;
+				}
+				if (m_storage == FloatStorage::Float32) {
+					return MultiThread::ForEachRange(pExec, m_height, [this, &func](int begin, int end) {
+						for (int y = begin; y < end; ++y) {
+							func(y, GetRow(0, y), GetRow(1, y), GetRow(2, y));
+						}
+					});
+				}
+
+				FilterRuntime& runtime = FilterRuntime::GetInstance();
+				if (!runtime.PrepareScratch(pExec, static_cast<std::size_t>(m_pitch) * 3 * sizeof(float))) {
+					return false;
+				}
+				const bool f16c = Utility::Simd::Has(Utility::Simd::Feature::F16C);
+				std::atomic<bool> failed{ false };
+				const bool result = MultiThread::Exec(pExec, [&](int threadId, int threadNum) {
+					const int begin = static_cast<int>(static_cast<long long>(m_height) * threadId / threadNum);
+					const int end = static_cast<int>(static_cast<long long>(m_height) * (threadId + 1) / threadNum);
+					float* pScratch = static_cast<float*>(runtime.GetScratch(threadId));
+					if (begin < end && pScratch == nullptr) {
+						failed = true;
+						return;
+					}
+					float* pRows[3] = { pScratch, pScratch + m_pitch, pScratch + m_pitch * 2 };
+					for (int y = begin; y < end; ++y) {
+						for (int plane = 0; plane < 3; ++plane) {
+							FloatFrameDetail::HalfToFloatRow(GetHalfRow(plane, y), pRows[plane], m_width, f16c);
+						}
+						func(y, pRows[0], pRows[1], pRows[2]);
+						for (int plane = 0; plane < 3; ++plane) {
+							FloatFrameDetail::FloatToHalfRow(pRows[plane], GetHalfRow(plane, y), m_width, f16c);
+						}
+					}
+				});
+				return result && !failed;
+			}
+
+		private:
+			std::size_t GetOffset(int plane, int y) const
+			{
+				return (static_cast<std::size_t>(plane) * m_height + y) * m_pitch;
+			}
+
+			Utility::AlignedBuffer<unsigned char> m_buffer;
+			int m_width = 0;
+			int m_height = 0;
+			int m_pitch = 0;
+			FloatStorage m_storage = FloatStorage::Float32;
+		};
+
+		/// <summary>
+		/// 同じ DLL 内のフィルタ間で、FloatFrame を Pixel_YC に丸めずに受け渡します
+		/// <para>Commit() は pYC_Edit に書き出した上で FloatFrame を保持し、次のフィルタの Acquire() は pYC_Edit が書き出した時のままであればそれを受け取ります。</para>
+		/// <para>間に別のフィルタが入って画像を変更した場合や、フレーム・画像の大きさが変わった場合は、行ごとのハッシュの不一致で検出して pYC_Edit から読み込み直します。</para>
+		/// <para>※ FilterProc (メインスレッド) から呼び出してください。</para>
+		/// </summary>
+		class FloatPipeline final
+		{
+		public:
+			/// <summary>
+			/// DLL 内で共有するインスタンスを取得します
+			/// </summary>
+			static FloatPipeline& GetInstance()
+			{
+				static FloatPipeline pipeline;
+				return pipeline;
+			}
+
+			FloatPipeline(const FloatPipeline&) = delete;
+			FloatPipeline& operator=(const FloatPipeline&) = delete;
+
+			/// <summary>
+			/// フィルタ処理する画像を FloatFrame で取得します
+			/// <para>直前に同じ DLL のフィルタが Commit() した画像があればそれを受け取り、無ければ pYC_Edit から読み込みます。</para>
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			/// <param name="pInfo">フィルタプロシージャ用構造体へのポインタ</param>
+			/// <param name="pFrame">画像の格納先</param>
+			/// <param name="storage">読み込む場合の画素の保持形式 (受け取った画像は前のフィルタの形式のままです)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Acquire(FilterPluginTable* pFilter, const FilterProcInfo* pInfo, FloatFrame* pFrame, FloatStorage storage = FloatStorage::Float32)
+			{
+				MultiThread::Exec_Func pExec = pFilter->pCallbackFunctionSet->ExecMultiThread;
+				if (IsUnchanged(pInfo, pExec)) {
+					*pFrame = std::move(m_frame);
+					m_pEdit = nullptr;
+					return true;
+				}
+				// 受け渡せない場合も確保済みの領域は再利用する
+				if (!pFrame->IsValid() && m_frame.IsValid()) {
+					*pFrame = std::move(m_frame);
+				}
+				m_pEdit = nullptr;
+				return pFrame->Import(pInfo->pYC_Edit, pInfo->Line_Size, pInfo->Width, pInfo->Height, storage, pExec);
+			}
+
+			/// <summary>
+			/// 処理した画像を pYC_Edit に書き出し、次のフィルタへ受け渡せるように保持します
+			/// <para>pInfo の Width / Height を画像の大きさに更新します。画像は Width_Max / Height_Max 以下にしてください。</para>
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			/// <param name="pInfo">フィルタプロシージャ用構造体へのポインタ</param>
+			/// <param name="frame">処理した画像</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Commit(FilterPluginTable* pFilter, FilterProcInfo* pInfo, FloatFrame&& frame)
+			{
+				m_pEdit = nullptr;
+				if (!frame.IsValid() || frame.GetWidth() > pInfo->Width_Max || frame.GetHeight() > pInfo->Height_Max) {
+					return false;
+				}
+				try {
+					m_rowHashes.resize(frame.GetHeight());
+				}
+				catch (const std::bad_alloc&) {
+					return false;
+				}
+				if (!frame.Export(pInfo->pYC_Edit, pInfo->Line_Size, pFilter->pCallbackFunctionSet->ExecMultiThread, m_rowHashes.data())) {
+					return false;
+				}
+				pInfo->Width = frame.GetWidth();
+				pInfo->Height = frame.GetHeight();
+
+				m_frame = std::move(frame);
+				m_pEdit = pInfo->pYC_Edit;
+				m_editHandle = pInfo->Edit_Handle;
+				m_frameNumber = pInfo->Frame;
+				m_lineSize = pInfo->Line_Size;
+				return true;
+			}
+
+			/// <summary>
+			/// 保持している画像を解放します (FilterExit などから呼び出してください)
+			/// </summary>
+			void Clear()
+			{
+				m_frame = FloatFrame();
+				m_pEdit = nullptr;
+				m_rowHashes.clear();
+				m_rowHashes.shrink_to_fit();
+			}
+
+		private:
+			FloatPipeline() = default;
+
+			/// <summary>
+			/// 保持している画像が pInfo の pYC_Edit と一致するか調べます
+			/// </summary>
+			bool IsUnchanged(const FilterProcInfo* pInfo, MultiThread::Exec_Func pExec) const
+			{
+				if (m_pEdit == nullptr || m_pEdit != pInfo->pYC_Edit || m_editHandle != pInfo->Edit_Handle || m_frameNumber != pInfo->Frame
+					|| m_lineSize != pInfo->Line_Size || m_frame.GetWidth() != pInfo->Width || m_frame.GetHeight() != pInfo->Height) {
+					return false;
+				}
+				const std::size_t rowSize = static_cast<std::size_t>(pInfo->Width) * sizeof(Pixel_YC);
+				std::atomic<bool> changed{ false };
+				const bool result = MultiThread::ForEachRange(pExec, pInfo->Height, [&](int begin, int end) {
+					for (int y = begin; y < end && !changed; ++y) {
+						const unsigned char* pRow = reinterpret_cast<const unsigned char*>(pInfo->pYC_Edit) + static_cast<std::size_t>(pInfo->Line_Size) * y;
+						if (FloatFrameDetail::HashRow(pRow, rowSize) != m_rowHashes[y]) {
+							changed = true;
+						}
+					}
+				});
+				return result && !changed;
+			}
+
+			FloatFrame m_frame;
+			std::vector<unsigned long long> m_rowHashes;
+			const Pixel_YC* m_pEdit = nullptr;
+			void* m_editHandle = nullptr;
+			int m_frameNumber = -1;
+			int m_lineSize = 0;
+		};
+	}
+
+#endif
+}
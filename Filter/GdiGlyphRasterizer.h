@@ -0,0 +1,149 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "TextRenderer.h"
+#include <windows.h>
+#include <algorithm>    // std::min
+#include <memory>       // std::shared_ptr, std::unique_ptr
+#include <string>       // std::wstring, std::to_wstring
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// GDI の GetGlyphOutlineW() によるラスタライザ
+		/// </summary>
+		class GdiGlyphRasterizer final : public GlyphRasterizer
+		{
+		public:
+			/// <summary>
+			/// フォントを作成します
+			/// </summary>
+			/// <param name="pFaceName">フォント名</param>
+			/// <param name="size">文字の高さ (ピクセル)</param>
+			/// <param name="weight">太さ (FW_NORMAL, FW_BOLD など)</param>
+			/// <param name="italic">斜体にするか</param>
+			GdiGlyphRasterizer(const wchar_t* pFaceName, int size, int weight = FW_NORMAL, bool italic = false)
+			{
+				m_hDC = ::CreateCompatibleDC(nullptr);
+				m_hFont = ::CreateFontW(-size, 0, 0, 0, weight, italic ? TRUE : FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+					OUT_TT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH, pFaceName);
+				if (m_hDC == nullptr || m_hFont == nullptr) {
+					return;
+				}
+				m_hOldFont = ::SelectObject(m_hDC, m_hFont);
+
+				TEXTMETRICW metric = {};
+				if (::GetTextMetricsW(m_hDC, &metric)) {
+					m_ascent = metric.tmAscent;
+					m_lineHeight = metric.tmHeight + metric.tmExternalLeading;
+				}
+			}
+
+			~GdiGlyphRasterizer()
+			{
+				if (m_hOldFont != nullptr) {
+					::SelectObject(m_hDC, m_hOldFont);
+				}
+				if (m_hFont != nullptr) {
+					::DeleteObject(m_hFont);
+				}
+				if (m_hDC != nullptr) {
+					::DeleteDC(m_hDC);
+				}
+			}
+
+			GdiGlyphRasterizer(const GdiGlyphRasterizer&) = delete;
+			GdiGlyphRasterizer& operator=(const GdiGlyphRasterizer&) = delete;
+
+			bool Rasterize(unsigned int codepoint, Glyph* pGlyph) override
+			{
+				if (m_hOldFont == nullptr) {
+					return false;
+				}
+				const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+				GLYPHMETRICS metrics = {};
+				const DWORD size = ::GetGlyphOutlineW(m_hDC, codepoint, GGO_GRAY8_BITMAP, &metrics, 0, nullptr, &identity);
+				if (size == GDI_ERROR) {
+					return false;
+				}
+
+				pGlyph->Advance = metrics.gmCellIncX;
+				pGlyph->OffsetX = metrics.gmptGlyphOrigin.x;
+				pGlyph->OffsetY = metrics.gmptGlyphOrigin.y;
+				pGlyph->Coverage.clear();
+				if (size == 0) {
+					// 空白文字
+					pGlyph->Width = 0;
+					pGlyph->Height = 0;
+					return true;
+				}
+
+				std::vector<unsigned char> buffer(size);
+				if (::GetGlyphOutlineW(m_hDC, codepoint, GGO_GRAY8_BITMAP, &metrics, size, buffer.data(), &identity) == GDI_ERROR) {
+					return false;
+				}
+
+				// GGO_GRAY8_BITMAP は 0 ～ 64 の 65 階調で、行は 4 バイト境界に揃えられている
+				const int width = static_cast<int>(metrics.gmBlackBoxX);
+				const int height = static_cast<int>(metrics.gmBlackBoxY);
+				const int stride = (width + 3) & ~3;
+				pGlyph->Width = width;
+				pGlyph->Height = height;
+				pGlyph->Coverage.resize(static_cast<std::size_t>(width) * height);
+				for (int y = 0; y < height; ++y) {
+					for (int x = 0; x < width; ++x) {
+						const int value = (std::min)(static_cast<int>(buffer[y * stride + x]), 64);
+						pGlyph->Coverage[y * width + x] = static_cast<unsigned char>((value * 255 + 32) / 64);
+					}
+				}
+				return true;
+			}
+
+			int GetAscent() const override { return m_ascent; }
+
+			int GetLineHeight() const override { return m_lineHeight; }
+
+		private:
+			HDC m_hDC = nullptr;
+			HFONT m_hFont = nullptr;
+			HGDIOBJ m_hOldFont = nullptr;
+			int m_ascent = 0;
+			int m_lineHeight = 0;
+		};
+
+		inline std::shared_ptr<TextFont> TextFont::Get(const wchar_t* pFaceName, int size, int weight, bool italic)
+		{
+			std::wstring key = pFaceName;
+			key += L'|' + std::to_wstring(size) + L'|' + std::to_wstring(weight) + (italic ? L"|i" : L"");
+			return GetShared(key, [&]() { return new GdiGlyphRasterizer(pFaceName, size, weight, italic); });
+		}
+
+		inline void TextFont::Draw(Pixel_YC* pDst, int dstLineSize, int width, int height, int x, int y, const char* pText,
+			const Pixel_YC& color, int transparent, int* pWidth, int* pHeight)
+		{
+			const int length = ::MultiByteToWideChar(CP_ACP, 0, pText, -1, nullptr, 0);
+			std::wstring text(length > 0 ? length - 1 : 0, L'\0');
+			if (length > 1) {
+				::MultiByteToWideChar(CP_ACP, 0, pText, -1, &text[0], length);
+			}
+			Draw(pDst, dstLineSize, width, height, x, y, text, color, transparent, pWidth, pHeight);
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,410 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/File.h"
+#include "../Utility/ImageFile.h"
+#include "../Utility/ThreadPool.h"
+#include <chrono>       // std::chrono::seconds
+#include <future>       // std::promise, std::shared_future
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr, std::make_shared, std::unique_ptr
+#include <mutex>        // std::mutex, std::lock_guard
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 画像のアルファの形式の定数
+		/// </summary>
+		enum class ImageAlphaFormat : int {
+			/// <summary>
+			/// ストレート (Blitter の画素ごとの不透明度としてそのまま使用できます)
+			/// </summary>
+			Straight = 0,
+
+			/// <summary>
+			/// 乗算済み (Y, Cb, Cr に不透明度を掛けた値)
+			/// </summary>
+			Premultiplied = 1,
+		};
+
+		/// <summary>
+		/// Pixel_YC に変換した画像
+		/// </summary>
+		struct YCImage final
+		{
+			/// <summary>
+			/// 幅
+			/// </summary>
+			int Width = 0;
+
+			/// <summary>
+			/// 高さ
+			/// </summary>
+			int Height = 0;
+
+			/// <summary>
+			/// 画素 (上の行から順に隙間なく格納)
+			/// </summary>
+			std::vector<Pixel_YC> Pixels;
+
+			/// <summary>
+			/// 画素ごとの不透明度 (0 ～ 4096、HasAlpha が false なら空)
+			/// </summary>
+			std::vector<short> Alpha;
+
+			/// <summary>
+			/// true なら有効なアルファ値を持つ
+			/// </summary>
+			bool HasAlpha = false;
+
+			/// <summary>
+			/// アルファの形式
+			/// </summary>
+			ImageAlphaFormat Format = ImageAlphaFormat::Straight;
+		};
+
+		/// <summary>
+		/// LoadImageFile() の代わりに使用する、デコード済み画像のキャッシュ
+		/// <para>ファイル名、ファイルサイズ、最終更新日時、アルファの形式をキーとして、Pixel_YC に変換した画像を保持します。</para>
+		/// <para>GetInstance() で DLL 内のフィルタ間で 1 つのキャッシュを共有します。BMP / TGA / PNG に対応します。</para>
+		/// <para>※ FilterExit から Shutdown() を呼んでください。</para>
+		/// </summary>
+		class ImageCache final
+		{
+		public:
+			/// <summary>
+			/// 動作設定
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// キャッシュの容量 (バイト数)
+				/// </summary>
+				std::size_t Capacity = 256 * 1024 * 1024;
+
+				/// <summary>
+				/// 非同期読み込みのスレッド数
+				/// </summary>
+				int ThreadNum = 2;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// <para>GetInstance() を初めて呼び出す前に変更してください。</para>
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			static Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// DLL 内で共有するキャッシュを取得します
+			/// </summary>
+			static ImageCache& GetInstance()
+			{
+				static ImageCache cache;
+				return cache;
+			}
+
+			ImageCache(const ImageCache&) = delete;
+			ImageCache& operator=(const ImageCache&) = delete;
+
+			/// <summary>
+			/// 画像を取得します
+			/// <para>キャッシュに無い場合は、バックグラウンドで読み込みを開始して空の画像 (Width = 0) を返します。</para>
+			/// <para>読み込み中は空の画像が返るため、次のフレームや再描画で改めて取得してください。</para>
+			/// </summary>
+			/// <param name="pFileName">ファイル名</param>
+			/// <param name="format">アルファの形式</param>
+			/// <returns>
+			/// 画像 (読み込み中や読み込みに失敗した場合は空の画像)
+			/// </returns>
+			std::shared_ptr<const YCImage> Get(const char* pFileName, ImageAlphaFormat format = ImageAlphaFormat::Straight)
+			{
+				return Find(pFileName, format, false);
+			}
+
+			/// <summary>
+			/// 画像を取得します (キャッシュに無い場合は読み込み終わるまで待機します)
+			/// </summary>
+			/// <param name="pFileName">ファイル名</param>
+			/// <param name="format">アルファの形式</param>
+			/// <returns>
+			/// 画像 (読み込みに失敗した場合は nullptr)
+			/// </returns>
+			std::shared_ptr<const YCImage> Load(const char* pFileName, ImageAlphaFormat format = ImageAlphaFormat::Straight)
+			{
+				std::shared_ptr<const YCImage> image = Find(pFileName, format, true);
+				return image != GetPlaceholder() ? image : nullptr;
+			}
+
+			/// <summary>
+			/// 読み込み中の画像が無いか調べます
+			/// </summary>
+			/// <returns>
+			/// true なら読み込み中の画像がある
+			/// </returns>
+			bool IsLoading()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (const auto& entry : m_entries) {
+					if (entry.second.Image == nullptr) {
+						return true;
+					}
+				}
+				return false;
+			}
+
+			/// <summary>
+			/// 読み込み中のものを除いて、キャッシュを全て破棄します
+			/// </summary>
+			void Clear()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (auto it = m_entries.begin(); it != m_entries.end();) {
+					it = (it->second.Image != nullptr) ? m_entries.erase(it) : std::next(it);
+				}
+				m_usage = 0;
+			}
+
+			/// <summary>
+			/// 非同期読み込みのスレッドを終了します
+			/// <para>FilterExit から呼び出してください。以降の読み込みは呼び出し元のスレッドで行われます。</para>
+			/// </summary>
+			void Shutdown()
+			{
+				if (m_pPool != nullptr) {
+					m_pPool->Shutdown();
+				}
+			}
+
+			/// <summary>
+			/// BGRA (8bit) の画像を Pixel_YC に変換します
+			/// </summary>
+			/// <param name="decoded">デコードした画像</param>
+			/// <param name="format">アルファの形式</param>
+			/// <param name="pImage">変換した画像を格納するポインタ</param>
+			static void Convert(const Utility::DecodedImage& decoded, ImageAlphaFormat format, YCImage* pImage)
+			{
+				const std::size_t count = static_cast<std::size_t>(decoded.Width) * decoded.Height;
+				pImage->Width = decoded.Width;
+				pImage->Height = decoded.Height;
+				pImage->HasAlpha = decoded.HasAlpha;
+				pImage->Format = format;
+				pImage->Pixels.resize(count);
+				pImage->Alpha.resize(decoded.HasAlpha ? count : 0);
+
+				const unsigned char* p = decoded.Pixels.data();
+				for (std::size_t i = 0; i < count; ++i, p += 4) {
+					// AviUtl と同じ係数で RGB (8bit) を YCbCr に変換する
+					const int b = p[0];
+					const int g = p[1];
+					const int r = p[2];
+					int y = ((4918 * r + 354) >> 10) + ((9655 * g + 585) >> 10) + ((1875 * b + 523) >> 10);
+					int cb = ((-2775 * r + 240) >> 10) + ((-5449 * g + 515) >> 10) + ((8224 * b + 256) >> 10);
+					int cr = ((8224 * r + 256) >> 10) + ((-6887 * g + 110) >> 10) + ((-1337 * b + 646) >> 10);
+
+					if (decoded.HasAlpha) {
+						const int alpha = (p[3] * 4096 + 127) / 255;
+						pImage->Alpha[i] = static_cast<short>(alpha);
+						if (format == ImageAlphaFormat::Premultiplied) {
+							y = (y * alpha + 2048) >> 12;
+							cb = (cb * alpha + 2048) >> 12;
+							cr = (cr * alpha + 2048) >> 12;
+						}
+					}
+					Pixel_YC& pixel = pImage->Pixels[i];
+					pixel.Y = static_cast<short>(y);
+					pixel.Cb = static_cast<short>(cb);
+					pixel.Cr = static_cast<short>(cr);
+				}
+			}
+
+		private:
+			ImageCache() = default;
+
+			/// <summary>
+			/// キャッシュの 1 項目
+			/// </summary>
+			struct Entry
+			{
+				/// <summary>
+				/// 読み込んだ時点のファイル情報
+				/// </summary>
+				Utility::FileStamp Stamp;
+
+				/// <summary>
+				/// 画像 (読み込み中は nullptr)
+				/// </summary>
+				std::shared_ptr<const YCImage> Image;
+
+				/// <summary>
+				/// 読み込みの完了を待つための future
+				/// </summary>
+				std::shared_future<std::shared_ptr<const YCImage>> Loading;
+
+				/// <summary>
+				/// 最後に参照した順番 (大きいほど新しい)
+				/// </summary>
+				unsigned long long Tick;
+
+				/// <summary>
+				/// 画像のバイト数
+				/// </summary>
+				std::size_t Size;
+			};
+
+			/// <summary>
+			/// 読み込み中や失敗時に返す空の画像を取得します
+			/// </summary>
+			static const std::shared_ptr<const YCImage>& GetPlaceholder()
+			{
+				static const std::shared_ptr<const YCImage> placeholder = std::make_shared<YCImage>();
+				return placeholder;
+			}
+
+			/// <summary>
+			/// ファイルを読み込んで変換します
+			/// </summary>
+			static std::shared_ptr<const YCImage> Decode(const std::string& fileName, ImageAlphaFormat format)
+			{
+				try {
+					Utility::DecodedImage decoded;
+					if (!Utility::ImageDecoder::LoadFile(fileName.c_str(), &decoded)) {
+						return GetPlaceholder();
+					}
+					auto image = std::make_shared<YCImage>();
+					Convert(decoded, format, image.get());
+					return image;
+				}
+				catch (...) {
+					return GetPlaceholder();
+				}
+			}
+
+			/// <summary>
+			/// キャッシュを検索し、無ければ読み込みを開始します
+			/// </summary>
+			std::shared_ptr<const YCImage> Find(const char* pFileName, ImageAlphaFormat format, bool wait)
+			{
+				Utility::FileStamp stamp = {};
+				if (!Utility::GetFileStamp(pFileName, &stamp)) {
+					return GetPlaceholder();
+				}
+				const std::string key = Utility::GetFileKey(pFileName) + (format == ImageAlphaFormat::Premultiplied ? "|p" : "|s");
+
+				std::shared_future<std::shared_ptr<const YCImage>> loading;
+				std::shared_ptr<std::promise<std::shared_ptr<const YCImage>>> pPromise;
+				Utility::ThreadPool* pPool = nullptr;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					auto it = m_entries.find(key);
+					if (it != m_entries.end() && it->second.Stamp != stamp && it->second.Image != nullptr) {
+						// ファイルが更新されたので読み込み直す
+						m_usage -= it->second.Size;
+						m_entries.erase(it);
+						it = m_entries.end();
+					}
+					if (it == m_entries.end()) {
+						pPromise = std::make_shared<std::promise<std::shared_ptr<const YCImage>>>();
+						Entry entry = {};
+						entry.Stamp = stamp;
+						entry.Loading = pPromise->get_future().share();
+						it = m_entries.emplace(key, entry).first;
+						pPool = &GetPool();
+					}
+
+					it->second.Tick = ++m_tick;
+					if (it->second.Image != nullptr) {
+						return it->second.Image;
+					}
+					loading = it->second.Loading;
+				}
+
+				if (pPool != nullptr) {
+					// Shutdown() 後は呼び出し元のスレッドで実行されるため、ロックの外で登録する
+					pPool->Submit([this, key, fileName = std::string(pFileName), format, pPromise]() {
+						std::shared_ptr<const YCImage> image = Decode(fileName, format);
+						Complete(key, image);
+						pPromise->set_value(image);
+					});
+				}
+
+				if (!wait && loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+					return GetPlaceholder();
+				}
+				return loading.get();
+			}
+
+			/// <summary>
+			/// 読み込みが完了した画像をキャッシュに登録します
+			/// </summary>
+			void Complete(const std::string& key, const std::shared_ptr<const YCImage>& image)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const auto it = m_entries.find(key);
+				if (it == m_entries.end()) {
+					return;
+				}
+				it->second.Image = image;
+				it->second.Size = image->Pixels.size() * sizeof(Pixel_YC) + image->Alpha.size() * sizeof(short);
+				m_usage += it->second.Size;
+
+				// 容量を超えた分を、参照が古いものから破棄する (読み込み中のものと今回のものは除く)
+				while (m_usage > GetSettings().Capacity) {
+					auto oldest = m_entries.end();
+					for (auto candidate = m_entries.begin(); candidate != m_entries.end(); ++candidate) {
+						if (candidate->second.Image != nullptr && candidate != it
+							&& (oldest == m_entries.end() || candidate->second.Tick < oldest->second.Tick)) {
+							oldest = candidate;
+						}
+					}
+					if (oldest == m_entries.end()) {
+						break;
+					}
+					m_usage -= oldest->second.Size;
+					m_entries.erase(oldest);
+				}
+			}
+
+			/// <summary>
+			/// 非同期読み込み用のスレッドプールを取得します
+			/// </summary>
+			Utility::ThreadPool& GetPool()
+			{
+				if (m_pPool == nullptr) {
+					m_pPool.reset(new Utility::ThreadPool(GetSettings().ThreadNum));
+				}
+				return *m_pPool;
+			}
+
+			std::mutex m_mutex;
+			std::map<std::string, Entry> m_entries;
+			std::size_t m_usage = 0;
+			unsigned long long m_tick = 0;
+			std::unique_ptr<Utility::ThreadPool> m_pPool;
+		};
+	}
+
+#endif
+}
@@ -0,0 +1,299 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include <windows.h>
+#include <cstdlib>      // std::atoi, std::strtol
+#include <cstring>      // std::strchr, std::strlen, std::strrchr
+#include <string>       // std::string, std::to_string
+#include <unordered_map> // std::unordered_map
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// IniLoadInt / IniLoadStr の読み込み結果をメモリに保持し、IniSaveInt / IniSaveStr の書き込みをまとめるキャッシュ
+		/// <para>一度読み込んだキーは INI ファイルにアクセスせずに返し、書き込みは Flush() を呼ぶまで保留します。</para>
+		/// <para>※ CallbackFunctionSet の関数を使用するため、メインスレッド (FilterInit / FilterProc / WndProc など) から呼び出してください。</para>
+		/// <para>※ 保留中の書き込みを失わないよう、WndProc で HandleMessage() を呼ぶか、FilterExit から Flush() を呼んでください。</para>
+		/// </summary>
+		class IniCache final
+		{
+		public:
+			enum : std::size_t {
+				/// <summary>
+				/// IniLoadStr で読み込む文字列のバッファサイズ
+				/// </summary>
+				StringBufferSize = 1024,
+			};
+
+			/// <summary>
+			/// フィルタごとのキャッシュを取得します
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			/// <returns>
+			/// キャッシュの参照
+			/// </returns>
+			static IniCache& Get(FilterPluginTable* pFilter)
+			{
+				auto& caches = GetCaches();
+				auto it = caches.find(pFilter);
+				if (it == caches.end()) {
+					it = caches.emplace(pFilter, IniCache(pFilter)).first;
+				}
+				return it->second;
+			}
+
+			/// <summary>
+			/// 全てのフィルタの保留中の書き込みを INI ファイルに反映します
+			/// </summary>
+			static void FlushAll()
+			{
+				for (auto& cache : GetCaches()) {
+					cache.second.Flush();
+				}
+			}
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			explicit IniCache(FilterPluginTable* pFilter) : m_pFilter(pFilter) {}
+
+			IniCache(IniCache&&) = default;
+			IniCache& operator=(IniCache&&) = default;
+
+			/// <summary>
+			/// INI ファイルのフィルタのセクションをまとめて読み込みます
+			/// <para>キー毎に IniLoadInt / IniLoadStr を呼ぶ代わりに、起動時に一度だけ呼び出してください。</para>
+			/// <para>セクションに無いキーは、初めて読み込む時に IniLoadInt / IniLoadStr で取得します。</para>
+			/// </summary>
+			/// <param name="pIniFileName">INI ファイル名 (nullptr ならホストの実行ファイルと同名の INI ファイル)</param>
+			/// <returns>
+			/// 1 つ以上のキーを読み込めたら true
+			/// </returns>
+			bool LoadSection(const char* pIniFileName = nullptr)
+			{
+				if (m_pFilter == nullptr || m_pFilter->pName == nullptr) {
+					return false;
+				}
+
+				std::string iniFileName = (pIniFileName != nullptr) ? pIniFileName : "";
+				if (pIniFileName == nullptr) {
+					char moduleFileName[MAX_PATH] = {};
+					const DWORD length = ::GetModuleFileNameA(nullptr, moduleFileName, MAX_PATH);
+					const char* pExtension = std::strrchr(moduleFileName, '.');
+					if (length == 0 || length >= MAX_PATH || pExtension == nullptr) {
+						return false;
+					}
+					iniFileName.assign(moduleFileName, pExtension - moduleFileName).append(".ini");
+				}
+
+				// バッファが足りない間は広げて読み直す
+				std::vector<char> buffer(32 * 1024);
+				DWORD length = 0;
+				for (;;) {
+					length = ::GetPrivateProfileSectionA(m_pFilter->pName, buffer.data(), static_cast<DWORD>(buffer.size()), iniFileName.c_str());
+					if (length + 2 < buffer.size()) {
+						break;
+					}
+					buffer.resize(buffer.size() * 2);
+				}
+
+				bool loaded = false;
+				for (const char* p = buffer.data(); p < buffer.data() + length && *p != '\0'; p += std::strlen(p) + 1) {
+					const char* pSeparator = std::strchr(p, '=');
+					if (pSeparator == nullptr) {
+						continue;
+					}
+					const std::string key(p, pSeparator);
+					if (m_entries.find(key) == m_entries.end()) {
+						m_entries[key].Value = pSeparator + 1;
+						loaded = true;
+					}
+				}
+				return loaded;
+			}
+
+			/// <summary>
+			/// 数値を読み込みます
+			/// </summary>
+			/// <param name="pKey">キーの名前</param>
+			/// <param name="defaultNum">デフォルトの数値</param>
+			/// <returns>
+			/// 読み込んだ数値
+			/// </returns>
+			int LoadInt(const char* pKey, int defaultNum)
+			{
+				auto it = m_entries.find(pKey);
+				if (it == m_entries.end()) {
+					const int value = m_pFilter->pCallbackFunctionSet->IniLoadInt(m_pFilter, const_cast<char*>(pKey), defaultNum);
+					it = m_entries.emplace(pKey, Entry{ std::to_string(value) }).first;
+				}
+
+				const std::string& value = it->second.Value;
+				char* pEnd = nullptr;
+				const long num = std::strtol(value.c_str(), &pEnd, 10);
+				return (pEnd != value.c_str()) ? static_cast<int>(num) : defaultNum;
+			}
+
+			/// <summary>
+			/// 文字列を読み込みます
+			/// </summary>
+			/// <param name="pKey">キーの名前</param>
+			/// <param name="pDefaultStr">デフォルトの文字列</param>
+			/// <returns>
+			/// 読み込んだ文字列
+			/// </returns>
+			const std::string& LoadStr(const char* pKey, const char* pDefaultStr)
+			{
+				auto it = m_entries.find(pKey);
+				if (it == m_entries.end()) {
+					char buffer[StringBufferSize] = {};
+					std::string value = (pDefaultStr != nullptr) ? pDefaultStr : "";
+					if (m_pFilter->pCallbackFunctionSet->IniLoadStr(m_pFilter, const_cast<char*>(pKey), buffer, const_cast<char*>(value.c_str())) != 0) {
+						buffer[StringBufferSize - 1] = '\0';
+						value = buffer;
+					}
+					it = m_entries.emplace(pKey, Entry{ std::move(value) }).first;
+				}
+				return it->second.Value;
+			}
+
+			/// <summary>
+			/// 数値を書き込みます (Flush() を呼ぶまで INI ファイルには反映されません)
+			/// </summary>
+			/// <param name="pKey">キーの名前</param>
+			/// <param name="num">書き込む数値</param>
+			void SaveInt(const char* pKey, int num)
+			{
+				Save(pKey, std::to_string(num), true);
+			}
+
+			/// <summary>
+			/// 文字列を書き込みます (Flush() を呼ぶまで INI ファイルには反映されません)
+			/// </summary>
+			/// <param name="pKey">キーの名前</param>
+			/// <param name="pStr">書き込む文字列</param>
+			void SaveStr(const char* pKey, const char* pStr)
+			{
+				Save(pKey, pStr, false);
+			}
+
+			/// <summary>
+			/// 保留中の書き込みがあるか調べます
+			/// </summary>
+			bool IsDirty() const { return m_dirty; }
+
+			/// <summary>
+			/// 保留中の書き込みを INI ファイルに反映します
+			/// </summary>
+			void Flush()
+			{
+				if (!m_dirty) {
+					return;
+				}
+				for (auto& entry : m_entries) {
+					if (entry.second.State == EntryState::DirtyInt) {
+						m_pFilter->pCallbackFunctionSet->IniSaveInt(m_pFilter, const_cast<char*>(entry.first.c_str()), std::atoi(entry.second.Value.c_str()));
+					}
+					else if (entry.second.State == EntryState::DirtyStr) {
+						m_pFilter->pCallbackFunctionSet->IniSaveStr(m_pFilter, const_cast<char*>(entry.first.c_str()), const_cast<char*>(entry.second.Value.c_str()));
+					}
+					entry.second.State = EntryState::Clean;
+				}
+				m_dirty = false;
+			}
+
+			/// <summary>
+			/// WndProc に送られたメッセージを処理します
+			/// <para>終了時やファイルを閉じた時、出力の終了時、ウィンドウの表示状態が変わった時など、編集の手が止まる時点で Flush() します。</para>
+			/// </summary>
+			/// <param name="message">ウィンドウメッセージ</param>
+			void HandleMessage(unsigned int message)
+			{
+				using WindowMessage = FilterPluginTable::WindowMessage;
+				switch (static_cast<WindowMessage>(message)) {
+				case WindowMessage::Exit:
+				case WindowMessage::FileClose:
+				case WindowMessage::SaveEnd:
+				case WindowMessage::ChangeWindow:
+					Flush();
+					break;
+				default:
+					break;
+				}
+			}
+
+		private:
+			/// <summary>
+			/// 項目の書き込み状態
+			/// </summary>
+			enum class EntryState : int {
+				Clean = 0,
+				DirtyInt = 1,
+				DirtyStr = 2,
+			};
+
+			/// <summary>
+			/// キャッシュの 1 項目
+			/// </summary>
+			struct Entry
+			{
+				/// <summary>
+				/// 値 (数値も文字列として保持)
+				/// </summary>
+				std::string Value;
+
+				/// <summary>
+				/// 書き込み状態
+				/// </summary>
+				EntryState State = EntryState::Clean;
+			};
+
+			/// <summary>
+			/// フィルタごとのキャッシュの一覧を取得します
+			/// </summary>
+			static std::unordered_map<FilterPluginTable*, IniCache>& GetCaches()
+			{
+				static std::unordered_map<FilterPluginTable*, IniCache> caches;
+				return caches;
+			}
+
+			/// <summary>
+			/// 値を更新し、変化があれば書き込みを保留します
+			/// </summary>
+			void Save(const char* pKey, std::string value, bool isInt)
+			{
+				const auto result = m_entries.emplace(pKey, Entry{});
+				Entry& entry = result.first->second;
+				if (!result.second && entry.State == EntryState::Clean && entry.Value == value) {
+					return;
+				}
+				entry.Value = std::move(value);
+				entry.State = isInt ? EntryState::DirtyInt : EntryState::DirtyStr;
+				m_dirty = true;
+			}
+
+			FilterPluginTable* m_pFilter;
+			std::unordered_map<std::string, Entry> m_entries;
+			bool m_dirty = false;
+		};
+	}
+
+#endif
+}
@@ -0,0 +1,114 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/LoudnessMeter.h"
+#include "../Utility/ThreadPool.h"
+#include <algorithm>    // std::max
+#include <functional>   // std::function
+#include <future>       // std::future
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 自分のフィルタの直前までフィルタした音声 (GetAudioFiltering) のラウドネスを測定します
+		/// <para>WAV に出力せずに、統合ラウドネス・ラウドネスレンジ・トゥルーピークを求めるために使用します。</para>
+		/// <para>音声は batchSamples サンプル以上ずつまとめて LoudnessMeter に渡します。pPool を指定すると、次のまとまりを読み込む間に前のまとまりを測定します。</para>
+		/// <para>外部関数を使用するため、メインスレッド (WndProc など) から呼び出してください。</para>
+		/// </summary>
+		/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+		/// <param name="pEdit">エディットハンドル</param>
+		/// <param name="startFrame">開始フレーム番号</param>
+		/// <param name="endFrame">終了フレーム番号 (このフレームを含みます)</param>
+		/// <param name="pMeter">測定先 (GetFileInfo() の Audio_Rate と Audio_Channel で作成してください)</param>
+		/// <param name="progress">フレームごとに呼び出す関数 (false を返すと中断します、nullptr 可)</param>
+		/// <param name="pPool">測定に使用するスレッドプール (nullptr なら読み込みと測定を交互に行います)</param>
+		/// <param name="batchSamples">まとめて測定するサンプル数</param>
+		/// <returns>
+		/// true なら最後まで測定した
+		/// </returns>
+		inline bool MeasureLoudness(FilterPluginTable* pFilter, void* pEdit, int startFrame, int endFrame, Utility::LoudnessMeter* pMeter,
+			const std::function<bool(int frame)>& progress = nullptr, Utility::ThreadPool* pPool = nullptr, int batchSamples = 1 << 18)
+		{
+			CallbackFunctionSet* pFunctions = pFilter->pCallbackFunctionSet;
+			if (pFunctions == nullptr || pFunctions->GetAudioFiltering == nullptr) {
+				return false;
+			}
+			FileInfo fileInfo = {};
+			if (!pFunctions->GetFileInfo(pEdit, &fileInfo) || fileInfo.Audio_Channel <= 0) {
+				return false;
+			}
+			const int channels = fileInfo.Audio_Channel;
+			batchSamples = (std::max)(batchSamples, 1);
+
+			// 1 フレームの最大サンプル数 (端数の丸めに備えて 2 倍の余裕を持たせます)
+			// フレームごとに大きさを問い合わせずに済むよう、まとまりの末尾に 1 フレーム分を確保しておきます
+			const int rate = (std::max)(fileInfo.Audio_Rate, 1);
+			const long long frameSamples = fileInfo.Video_Rate > 0 && fileInfo.Video_Scale > 0
+				? (static_cast<long long>(rate) * fileInfo.Video_Scale + fileInfo.Video_Rate - 1) / fileInfo.Video_Rate * 2 + 16
+				: rate;
+			const std::size_t bufferSize = static_cast<std::size_t>(batchSamples + frameSamples) * channels;
+
+			// 読み込み中のまとまりと測定中のまとまりを交互に使う
+			std::vector<short> buffers[2] = { std::vector<short>(bufferSize), std::vector<short>(bufferSize) };
+			int current = 0;
+			int filled = 0;
+			std::future<void> pending;
+			const auto flush = [&]() {
+				if (pending.valid()) {
+					pending.get();
+				}
+				if (filled == 0) {
+					return;
+				}
+				const short* pSamples = buffers[current].data();
+				const int frames = filled;
+				if (pPool != nullptr) {
+					pending = pPool->Submit([pMeter, pSamples, frames]() { pMeter->Add(pSamples, frames); });
+				}
+				else {
+					pMeter->Add(pSamples, frames);
+				}
+				current ^= 1;
+				filled = 0;
+			};
+
+			bool completed = true;
+			for (int frame = startFrame; frame <= endFrame; ++frame) {
+				if (progress && !progress(frame)) {
+					completed = false;
+					break;
+				}
+				const int samples = pFunctions->GetAudioFiltering(pFilter, pEdit, frame, buffers[current].data() + static_cast<std::size_t>(filled) * channels);
+				if (samples <= 0) {
+					continue;
+				}
+				filled += samples;
+				if (filled >= batchSamples) {
+					flush();
+				}
+			}
+			flush();
+			if (pending.valid()) {
+				pending.get();
+			}
+			return completed;
+		}
+	}
+
+#endif
+}
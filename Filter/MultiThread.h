@@ -0,0 +1,83 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include <type_traits>  // std::remove_reference
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// AviUtl の ExecMultiThread() で関数オブジェクトを呼び出すための補助
+		/// <para>CallbackFunctionSet::ExecMultiThread と ColorInfo::ExecMultiThread のどちらも使用できます。</para>
+		/// <para>呼び出される関数内からは Win32 API や外部関数を使用しないでください。</para>
+		/// </summary>
+		namespace MultiThread
+		{
+			/// <summary>
+			/// ExecMultiThread() の関数ポインタ型
+			/// </summary>
+			using Exec_Func = int(*)(MultiThread_Func pFunc, void* pParam1, void* pParam2);
+
+			/// <summary>
+			/// 関数オブジェクトを AviUtl のスレッド数で呼び出します
+			/// <para>pExec が nullptr の場合は、呼び出し元のスレッドで 1 回だけ呼び出します。</para>
+			/// </summary>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr 可)</param>
+			/// <param name="func">void(int threadId, int threadNum) の関数オブジェクト</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			template<class Func>
+			inline bool Exec(Exec_Func pExec, Func&& func)
+			{
+				if (pExec == nullptr) {
+					func(0, 1);
+					return true;
+				}
+				MultiThread_Func thunk = [](int threadId, int threadNum, void* pParam1, void*) {
+					(*static_cast<typename std::remove_reference<Func>::type*>(pParam1))(threadId, threadNum);
+				};
+				return pExec(thunk, &func, nullptr) != 0;
+			}
+
+			/// <summary>
+			/// 0 ～ count-1 をスレッド数で等分し、各スレッドで範囲を処理します
+			/// </summary>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr 可)</param>
+			/// <param name="count">処理する要素数 (行数など)</param>
+			/// <param name="func">void(int begin, int end) の関数オブジェクト</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			template<class Func>
+			inline bool ForEachRange(Exec_Func pExec, int count, Func&& func)
+			{
+				if (count <= 0) {
+					return true;
+				}
+				return Exec(pExec, [count, &func](int threadId, int threadNum) {
+					const int begin = static_cast<int>(static_cast<long long>(count) * threadId / threadNum);
+					const int end = static_cast<int>(static_cast<long long>(count) * (threadId + 1) / threadNum);
+					if (begin < end) {
+						func(begin, end);
+					}
+				});
+			}
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,511 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/Simd.h"
+#include "MultiThread.h"
+#include <cstddef>      // std::size_t
+#include <cstring>      // std::memcpy
+#include <tuple>        // std::tuple, std::apply
+#include <type_traits>  // std::is_arithmetic
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 画素ごとの処理 (レベル補正・トーンカーブ・チャンネルミキサー・クランプなど) を式テンプレートで記述し、1 回の走査にまとめて実行します
+		/// <para>Assign(Y, Clamp((Y - Constant&lt;256&gt;()) * Param(gain), Constant&lt;0&gt;(), Constant&lt;4096&gt;())) のように式を組み立て、Fuse() で連結して Apply() に渡します。</para>
+		/// <para>式はコンパイル時に 1 つのループへ展開され、4 画素ずつ float (SSE) で評価します。Constant は定数として畳み込まれ、Param は式を作成するときに 1 回だけ展開されます。</para>
+		/// <para>連結した処理の間は float のまま受け渡すため、個別に pYC_Edit を往復させる場合と異なり途中で丸めません。</para>
+		/// </summary>
+		namespace PixelExpr
+		{
+			/// <summary>
+			/// 4 画素分の Y, Cb, Cr (Pixel_YC と同じ単位の float)
+			/// </summary>
+			struct Lanes final
+			{
+				__m128 Y;
+				__m128 Cb;
+				__m128 Cr;
+			};
+
+			/// <summary>
+			/// 式の基底 (演算子の対象を式に限定するための CRTP)
+			/// </summary>
+			/// <typeparam name="Derived">派生した式の型</typeparam>
+			template<class Derived>
+			struct Expr
+			{
+				const Derived& Self() const { return static_cast<const Derived&>(*this); }
+			};
+
+			/// <summary>
+			/// チャンネルの値 (0: Y, 1: Cb, 2: Cr)
+			/// </summary>
+			template<int Index>
+			struct Channel final : Expr<Channel<Index>>
+			{
+				static_assert(Index >= 0 && Index < 3, "Error: Channel index must be 0 (Y), 1 (Cb) or 2 (Cr).");
+
+				__m128 Eval(const Lanes& v) const
+				{
+					if constexpr (Index == 0) {
+						return v.Y;
+					}
+					else if constexpr (Index == 1) {
+						return v.Cb;
+					}
+					else {
+						return v.Cr;
+					}
+				}
+
+				static void Store(Lanes& v, __m128 value)
+				{
+					if constexpr (Index == 0) {
+						v.Y = value;
+					}
+					else if constexpr (Index == 1) {
+						v.Cb = value;
+					}
+					else {
+						v.Cr = value;
+					}
+				}
+			};
+
+			/// <summary>
+			/// 輝度
+			/// </summary>
+			inline constexpr Channel<0> Y{};
+
+			/// <summary>
+			/// 色差(青)
+			/// </summary>
+			inline constexpr Channel<1> Cb{};
+
+			/// <summary>
+			/// 色差(赤)
+			/// </summary>
+			inline constexpr Channel<2> Cr{};
+
+			/// <summary>
+			/// コンパイル時の定数 (Num / Den)
+			/// </summary>
+			template<int Num, int Den = 1>
+			struct Constant final : Expr<Constant<Num, Den>>
+			{
+				static_assert(Den != 0, "Error: Constant denominator must not be zero.");
+
+				static constexpr float Value = static_cast<float>(Num) / static_cast<float>(Den);
+
+				__m128 Eval(const Lanes&) const { return _mm_set1_ps(Value); }
+			};
+
+			/// <summary>
+			/// 実行時の値 (トラックバーの値など)
+			/// <para>式を作成するときに 4 要素へ展開しておき、評価のたびには展開しません。</para>
+			/// </summary>
+			struct Variable final : Expr<Variable>
+			{
+				explicit Variable(float value) : Value(_mm_set1_ps(value)) {}
+
+				__m128 Eval(const Lanes&) const { return Value; }
+
+				__m128 Value;
+			};
+
+			/// <summary>
+			/// 実行時の値を式にします
+			/// </summary>
+			/// <param name="value">値</param>
+			inline Variable Param(float value) { return Variable(value); }
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				struct AddOp { static __m128 Apply(__m128 a, __m128 b) { return _mm_add_ps(a, b); } };
+				struct SubOp { static __m128 Apply(__m128 a, __m128 b) { return _mm_sub_ps(a, b); } };
+				struct MulOp { static __m128 Apply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); } };
+				struct DivOp { static __m128 Apply(__m128 a, __m128 b) { return _mm_div_ps(a, b); } };
+				struct MinOp { static __m128 Apply(__m128 a, __m128 b) { return _mm_min_ps(a, b); } };
+				struct MaxOp { static __m128 Apply(__m128 a, __m128 b) { return _mm_max_ps(a, b); } };
+
+				struct NegOp { static __m128 Apply(__m128 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); } };
+				struct AbsOp { static __m128 Apply(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); } };
+				struct SqrtOp { static __m128 Apply(__m128 a) { return _mm_sqrt_ps(_mm_max_ps(a, _mm_setzero_ps())); } };
+
+				/// <summary>
+				/// 式または数値を式の型に変換します (数値は Variable になります)
+				/// </summary>
+				template<class T, bool Arithmetic = std::is_arithmetic<T>::value>
+				struct ToExpr
+				{
+					using Type = T;
+					static const T& Get(const Expr<T>& value) { return value.Self(); }
+				};
+
+				template<class T>
+				struct ToExpr<T, true>
+				{
+					using Type = Variable;
+					static Variable Get(T value) { return Variable(static_cast<float>(value)); }
+				};
+			}
+
+			/// <summary>
+			/// 2 項演算の式
+			/// </summary>
+			template<class Op, class L, class R>
+			struct Binary final : Expr<Binary<Op, L, R>>
+			{
+				Binary(const L& left, const R& right) : Left(left), Right(right) {}
+
+				__m128 Eval(const Lanes& v) const { return Op::Apply(Left.Eval(v), Right.Eval(v)); }
+
+				L Left;
+				R Right;
+			};
+
+			/// <summary>
+			/// 単項演算の式
+			/// </summary>
+			template<class Op, class E>
+			struct Unary final : Expr<Unary<Op, E>>
+			{
+				explicit Unary(const E& operand) : Operand(operand) {}
+
+				__m128 Eval(const Lanes& v) const { return Op::Apply(Operand.Eval(v)); }
+
+				E Operand;
+			};
+
+			/// <summary>
+			/// 線形補間 a + (b - a) * t の式
+			/// </summary>
+			template<class A, class B, class T>
+			struct Lerp final : Expr<Lerp<A, B, T>>
+			{
+				Lerp(const A& a, const B& b, const T& t) : From(a), To(b), Weight(t) {}
+
+				__m128 Eval(const Lanes& v) const
+				{
+					const __m128 a = From.Eval(v);
+					return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(To.Eval(v), a), Weight.Eval(v)));
+				}
+
+				A From;
+				B To;
+				T Weight;
+			};
+
+// 式と式、式と float の 2 項演算子を定義する
+#define AU_PIXELEXPR_BINARY_OPERATOR(symbol, Op) \
+			template<class L, class R> \
+			inline Binary<Detail::Op, L, R> operator symbol(const Expr<L>& left, const Expr<R>& right) { return { left.Self(), right.Self() }; } \
+			template<class L> \
+			inline Binary<Detail::Op, L, Variable> operator symbol(const Expr<L>& left, float right) { return { left.Self(), Variable(right) }; } \
+			template<class R> \
+			inline Binary<Detail::Op, Variable, R> operator symbol(float left, const Expr<R>& right) { return { Variable(left), right.Self() }; }
+
+			AU_PIXELEXPR_BINARY_OPERATOR(+, AddOp)
+			AU_PIXELEXPR_BINARY_OPERATOR(-, SubOp)
+			AU_PIXELEXPR_BINARY_OPERATOR(*, MulOp)
+			AU_PIXELEXPR_BINARY_OPERATOR(/, DivOp)
+
+#undef AU_PIXELEXPR_BINARY_OPERATOR
+
+			template<class E>
+			inline Unary<Detail::NegOp, E> operator-(const Expr<E>& operand) { return Unary<Detail::NegOp, E>(operand.Self()); }
+
+			/// <summary>
+			/// 小さい方の値
+			/// </summary>
+			template<class L, class R>
+			inline auto Min(const L& left, const R& right)
+			{
+				using LE = Detail::ToExpr<L>;
+				using RE = Detail::ToExpr<R>;
+				return Binary<Detail::MinOp, typename LE::Type, typename RE::Type>(LE::Get(left), RE::Get(right));
+			}
+
+			/// <summary>
+			/// 大きい方の値
+			/// </summary>
+			template<class L, class R>
+			inline auto Max(const L& left, const R& right)
+			{
+				using LE = Detail::ToExpr<L>;
+				using RE = Detail::ToExpr<R>;
+				return Binary<Detail::MaxOp, typename LE::Type, typename RE::Type>(LE::Get(left), RE::Get(right));
+			}
+
+			/// <summary>
+			/// 値を minimum ～ maximum の範囲に収めます
+			/// </summary>
+			template<class E, class Lo, class Hi>
+			inline auto Clamp(const E& value, const Lo& minimum, const Hi& maximum)
+			{
+				return Min(Max(value, minimum), maximum);
+			}
+
+			/// <summary>
+			/// 絶対値
+			/// </summary>
+			template<class E>
+			inline Unary<Detail::AbsOp, E> Abs(const Expr<E>& operand) { return Unary<Detail::AbsOp, E>(operand.Self()); }
+
+			/// <summary>
+			/// 平方根 (負の値は 0 として扱います)
+			/// </summary>
+			template<class E>
+			inline Unary<Detail::SqrtOp, E> Sqrt(const Expr<E>& operand) { return Unary<Detail::SqrtOp, E>(operand.Self()); }
+
+			/// <summary>
+			/// 線形補間 from + (to - from) * weight
+			/// </summary>
+			template<class A, class B, class T>
+			inline auto Mix(const A& from, const B& to, const T& weight)
+			{
+				using AE = Detail::ToExpr<A>;
+				using BE = Detail::ToExpr<B>;
+				using TE = Detail::ToExpr<T>;
+				return Lerp<typename AE::Type, typename BE::Type, typename TE::Type>(AE::Get(from), BE::Get(to), TE::Get(weight));
+			}
+
+			/// <summary>
+			/// 1 つのチャンネルに式の値を代入する処理
+			/// </summary>
+			template<int Index, class E>
+			struct AssignStatement final
+			{
+				void Run(Lanes& v) const { Channel<Index>::Store(v, Value.Eval(v)); }
+
+				E Value;
+			};
+
+			/// <summary>
+			/// 3 つのチャンネルに、代入前の値で評価した式を同時に代入する処理 (チャンネルミキサーなど)
+			/// </summary>
+			template<class EY, class ECb, class ECr>
+			struct AssignYCStatement final
+			{
+				void Run(Lanes& v) const
+				{
+					const __m128 y = ValueY.Eval(v);
+					const __m128 cb = ValueCb.Eval(v);
+					const __m128 cr = ValueCr.Eval(v);
+					v.Y = y;
+					v.Cb = cb;
+					v.Cr = cr;
+				}
+
+				EY ValueY;
+				ECb ValueCb;
+				ECr ValueCr;
+			};
+
+			/// <summary>
+			/// 複数の処理を順に実行する処理 (後の処理は前の処理の結果を参照します)
+			/// </summary>
+			template<class... Statements>
+			struct Chain final
+			{
+				void Run(Lanes& v) const
+				{
+					std::apply([&v](const Statements&... statements) { (statements.Run(v), ...); }, Items);
+				}
+
+				std::tuple<Statements...> Items;
+			};
+
+			/// <summary>
+			/// チャンネルに式の値を代入する処理を作成します
+			/// </summary>
+			/// <param name="channel">代入先 (Y, Cb, Cr)</param>
+			/// <param name="value">式 (float も可)</param>
+			template<int Index, class E>
+			inline auto Assign(Channel<Index>, const E& value)
+			{
+				using VE = Detail::ToExpr<E>;
+				return AssignStatement<Index, typename VE::Type>{ VE::Get(value) };
+			}
+
+			/// <summary>
+			/// 3 つのチャンネルに同時に代入する処理を作成します (式は全て代入前の値で評価します)
+			/// </summary>
+			template<class EY, class ECb, class ECr>
+			inline auto AssignYC(const EY& y, const ECb& cb, const ECr& cr)
+			{
+				using YE = Detail::ToExpr<EY>;
+				using CbE = Detail::ToExpr<ECb>;
+				using CrE = Detail::ToExpr<ECr>;
+				return AssignYCStatement<typename YE::Type, typename CbE::Type, typename CrE::Type>{ YE::Get(y), CbE::Get(cb), CrE::Get(cr) };
+			}
+
+			/// <summary>
+			/// 処理を連結します (連結した処理も Fuse() に渡せます)
+			/// </summary>
+			template<class... Statements>
+			inline Chain<Statements...> Fuse(const Statements&... statements)
+			{
+				return Chain<Statements...>{ std::tuple<Statements...>(statements...) };
+			}
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// 符号付き 16bit 4 要素を float に変換します
+				/// </summary>
+				inline __m128 ToFloat4(__m128i value)
+				{
+					return _mm_cvtepi32_ps(_mm_srai_epi32(value, 16));
+				}
+
+				/// <summary>
+				/// float 4 要素 x 2 を飽和・丸めして符号付き 16bit 8 要素にします (NaN は -32768)
+				/// </summary>
+				inline __m128i FromFloat8(__m128 lo, __m128 hi)
+				{
+					// int32 の範囲外は _mm_cvtps_epi32 が 0x80000000 を返すため、先に 16bit の範囲に収める
+					// (_mm_max_ps は NaN の場合に第 2 引数を返す)
+					const __m128 minimum = _mm_set1_ps(-32768.0f);
+					const __m128 maximum = _mm_set1_ps(32767.0f);
+					lo = _mm_min_ps(_mm_max_ps(lo, minimum), maximum);
+					hi = _mm_min_ps(_mm_max_ps(hi, minimum), maximum);
+					return _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+				}
+
+				/// <summary>
+				/// 8 画素に処理を適用します
+				/// </summary>
+				/// <param name="simd">SSSE3 で読み書きする (false なら 1 画素ずつ分離します)</param>
+				template<class Statement>
+				inline void Run8(Filter::Pixel_YC* pPixels, const Statement& statement, bool simd)
+				{
+					__m128i y, cb, cr;
+					if (simd) {
+						Utility::Simd::LoadYC8(pPixels, y, cb, cr);
+					}
+					else {
+						alignas(16) short values[3][8];
+						for (int i = 0; i < 8; ++i) {
+							values[0][i] = pPixels[i].Y;
+							values[1][i] = pPixels[i].Cb;
+							values[2][i] = pPixels[i].Cr;
+						}
+						y = _mm_load_si128(reinterpret_cast<const __m128i*>(values[0]));
+						cb = _mm_load_si128(reinterpret_cast<const __m128i*>(values[1]));
+						cr = _mm_load_si128(reinterpret_cast<const __m128i*>(values[2]));
+					}
+
+					// 上位 16bit に置いてから算術シフトで符号拡張する
+					Lanes lo = { ToFloat4(_mm_unpacklo_epi16(y, y)), ToFloat4(_mm_unpacklo_epi16(cb, cb)), ToFloat4(_mm_unpacklo_epi16(cr, cr)) };
+					Lanes hi = { ToFloat4(_mm_unpackhi_epi16(y, y)), ToFloat4(_mm_unpackhi_epi16(cb, cb)), ToFloat4(_mm_unpackhi_epi16(cr, cr)) };
+					statement.Run(lo);
+					statement.Run(hi);
+					y = FromFloat8(lo.Y, hi.Y);
+					cb = FromFloat8(lo.Cb, hi.Cb);
+					cr = FromFloat8(lo.Cr, hi.Cr);
+
+					if (simd) {
+						Utility::Simd::StoreYC8(pPixels, y, cb, cr);
+					}
+					else {
+						alignas(16) short values[3][8];
+						_mm_store_si128(reinterpret_cast<__m128i*>(values[0]), y);
+						_mm_store_si128(reinterpret_cast<__m128i*>(values[1]), cb);
+						_mm_store_si128(reinterpret_cast<__m128i*>(values[2]), cr);
+						for (int i = 0; i < 8; ++i) {
+							pPixels[i].Y = values[0][i];
+							pPixels[i].Cb = values[1][i];
+							pPixels[i].Cr = values[2][i];
+						}
+					}
+				}
+
+				/// <summary>
+				/// 1 行に処理を適用します
+				/// <para>端数の画素は 8 画素の作業領域に写して同じ経路で処理するため、結果は位置によらず一致します。</para>
+				/// </summary>
+				template<class Statement>
+				inline void RunRow(Filter::Pixel_YC* pRow, int width, const Statement& statement, bool simd)
+				{
+					int x = 0;
+					for (; x + 8 <= width; x += 8) {
+						Run8(pRow + x, statement, simd);
+					}
+					if (x < width) {
+						Filter::Pixel_YC tail[8] = {};
+						const std::size_t size = static_cast<std::size_t>(width - x) * sizeof(Filter::Pixel_YC);
+						std::memcpy(tail, pRow + x, size);
+						Run8(tail, statement, simd);
+						std::memcpy(pRow + x, tail, size);
+					}
+				}
+			}
+
+			/// <summary>
+			/// Pixel_YC 形式の画像に処理を適用します (その場で書き換えます)
+			/// </summary>
+			/// <param name="pYC">Pixel_YC 形式の画像</param>
+			/// <param name="lineSize">1 行のバイト数</param>
+			/// <param name="width">画像の幅</param>
+			/// <param name="height">画像の高さ</param>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr 可)</param>
+			/// <param name="statement">Assign() / AssignYC() / Fuse() で作成した処理</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			template<class Statement>
+			inline bool Apply(Filter::Pixel_YC* pYC, int lineSize, int width, int height, MultiThread::Exec_Func pExec, const Statement& statement)
+			{
+				if (pYC == nullptr || width <= 0 || height <= 0) {
+					return false;
+				}
+				const bool simd = Utility::Simd::Has(Utility::Simd::Feature::SSSE3);
+				return MultiThread::ForEachRange(pExec, height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						Filter::Pixel_YC* pRow = reinterpret_cast<Filter::Pixel_YC*>(reinterpret_cast<unsigned char*>(pYC) + static_cast<std::size_t>(lineSize) * y);
+						Detail::RunRow(pRow, width, statement, simd);
+					}
+				});
+			}
+
+			/// <summary>
+			/// フィルタ処理中の画像 (pYC_Edit) に処理を適用します
+			/// </summary>
+			/// <param name="pFilter">フィルタテーブル構造体のアドレス</param>
+			/// <param name="pInfo">フィルタプロシージャ用構造体へのポインタ</param>
+			/// <param name="statement">Assign() / AssignYC() / Fuse() で作成した処理</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			template<class Statement>
+			inline bool Apply(FilterPluginTable* pFilter, FilterProcInfo* pInfo, const Statement& statement)
+			{
+				return Apply(pInfo->pYC_Edit, pInfo->Line_Size, pInfo->Width, pInfo->Height, pFilter->pCallbackFunctionSet->ExecMultiThread, statement);
+			}
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,551 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AlignedBuffer.h"
+#include "MultiThread.h"
+#include <algorithm>    // std::min, std::max
+#include <emmintrin.h>  // SSE2 intrinsics
+#include <new>          // std::bad_alloc
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 編集中のプレビューを縮小した解像度で処理するための補助
+		/// <para>func_proc の先頭で ProxyFrame を作成すると、FilterProcInfo の画像が縮小画像に差し替えられ、</para>
+		/// <para>破棄 (または Commit()) 時に元の解像度へ拡大して書き戻されます。</para>
+		/// <para>出力中 (IsSaving) や編集中でない場合は何も行わず、常にフル解像度で処理されます。</para>
+		/// </summary>
+		namespace ProxyPreview
+		{
+			/// <summary>
+			/// プロキシプレビューの設定
+			/// <para>フィルタの func_proc から参照されるため、編集中に変更しても次のフレームから反映されます。</para>
+			/// </summary>
+			struct Settings
+			{
+				/// <summary>
+				/// プロキシプレビューを有効にするか
+				/// </summary>
+				bool Enabled = true;
+
+				/// <summary>
+				/// 縮小率 (2 なら 1/2 の解像度、1 以下なら無効)
+				/// </summary>
+				int Factor = 2;
+
+				/// <summary>
+				/// 縮小後の最小の幅 (これを下回る場合は縮小率を下げます)
+				/// </summary>
+				int MinWidth = 320;
+			};
+
+			/// <summary>
+			/// プロキシプレビューの設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 設定への参照
+			/// </returns>
+			inline Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// トラックバーの値が解像度にどう依存するかを示す定数
+			/// </summary>
+			enum class ParameterScale : int {
+				/// <summary>
+				/// 解像度に依存しない (強さ、角度、色など)
+				/// </summary>
+				None = 0,
+
+				/// <summary>
+				/// 長さ (半径、幅、移動量など)
+				/// <para>縮小率で割った値になります。</para>
+				/// </summary>
+				Length = 1,
+
+				/// <summary>
+				/// 面積 (画素数など)
+				/// <para>縮小率の 2 乗で割った値になります。</para>
+				/// </summary>
+				Area = 2,
+			};
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				enum : int {
+					/// <summary>
+					/// 縮小率の上限
+					/// </summary>
+					MaxFactor = 8,
+
+					/// <summary>
+					/// 縮小時にまとめて処理する出力画素数
+					/// </summary>
+					ReduceGroup = 8,
+
+					/// <summary>
+					/// 拡大時にまとめて処理する出力画素数
+					/// </summary>
+					ExpandChunk = 64,
+				};
+
+				/// <summary>
+				/// 縦横の補間位置
+				/// </summary>
+				struct Tap
+				{
+					int Index0;
+					int Index1;
+
+					/// <summary>
+					/// Index1 側の重み (0 ～ 255)
+					/// </summary>
+					int Weight;
+				};
+
+				/// <summary>
+				/// 符号付きの合計値を四捨五入で割ります
+				/// </summary>
+				inline short DivideRound(int sum, int divisor)
+				{
+					const int half = divisor / 2;
+					return static_cast<short>(sum >= 0 ? (sum + half) / divisor : -((-sum + half) / divisor));
+				}
+
+				/// <summary>
+				/// 画素の平均で 1/factor に縮小します
+				/// </summary>
+				/// <param name="pSrc">縮小元の画像</param>
+				/// <param name="srcStride">縮小元の 1 行の画素数</param>
+				/// <param name="pDst">縮小先の画像</param>
+				/// <param name="dstStride">縮小先の 1 行の画素数</param>
+				/// <param name="dstWidth">縮小先の幅</param>
+				/// <param name="factor">縮小率 (2 ～ MaxFactor)</param>
+				/// <param name="begin">処理する縮小先の開始行</param>
+				/// <param name="end">処理する縮小先の終了行 (この行は含まない)</param>
+				inline void ReduceRows(const Pixel_YC* pSrc, int srcStride, Pixel_YC* pDst, int dstStride, int dstWidth, int factor, int begin, int end)
+				{
+					const int divisor = factor * factor;
+					const int groupShorts = ReduceGroup * factor * 3;
+					alignas(16) int sums[ReduceGroup * MaxFactor * 3];
+
+					for (int y = begin; y < end; ++y) {
+						const short* rows[MaxFactor];
+						for (int r = 0; r < factor; ++r) {
+							rows[r] = reinterpret_cast<const short*>(pSrc + static_cast<std::size_t>(y * factor + r) * srcStride);
+						}
+						short* pOut = reinterpret_cast<short*>(pDst + static_cast<std::size_t>(y) * dstStride);
+
+						int x = 0;
+						for (; x + ReduceGroup <= dstWidth; x += ReduceGroup) {
+							// 縦方向の合計を 32bit で求める
+							const int offset = x * factor * 3;
+							for (int i = 0; i < groupShorts; i += 8) {
+								__m128i lo = _mm_setzero_si128();
+								__m128i hi = _mm_setzero_si128();
+								for (int r = 0; r < factor; ++r) {
+									const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + offset + i));
+									lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+									hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+								}
+								_mm_store_si128(reinterpret_cast<__m128i*>(sums + i), lo);
+								_mm_store_si128(reinterpret_cast<__m128i*>(sums + i + 4), hi);
+							}
+
+							// 横方向の合計
+							for (int p = 0; p < ReduceGroup; ++p) {
+								for (int c = 0; c < 3; ++c) {
+									int sum = 0;
+									for (int k = 0; k < factor; ++k) {
+										sum += sums[(p * factor + k) * 3 + c];
+									}
+									pOut[(x + p) * 3 + c] = DivideRound(sum, divisor);
+								}
+							}
+						}
+						for (; x < dstWidth; ++x) {
+							for (int c = 0; c < 3; ++c) {
+								int sum = 0;
+								for (int r = 0; r < factor; ++r) {
+									for (int k = 0; k < factor; ++k) {
+										sum += rows[r][(x * factor + k) * 3 + c];
+									}
+								}
+								pOut[x * 3 + c] = DivideRound(sum, divisor);
+							}
+						}
+					}
+				}
+
+				/// <summary>
+				/// 拡大用の補間位置を作成します (画素の中心を合わせます)
+				/// </summary>
+				/// <param name="srcLength">拡大元の長さ</param>
+				/// <param name="dstLength">拡大先の長さ</param>
+				/// <param name="pTaps">dstLength 個の補間位置の格納先</param>
+				inline void BuildTaps(int srcLength, int dstLength, Tap* pTaps)
+				{
+					for (int d = 0; d < dstLength; ++d) {
+						long long pos = (2LL * d + 1) * srcLength * 256 / (2LL * dstLength) - 128;
+						if (pos < 0) {
+							pos = 0;
+						}
+						Tap& tap = pTaps[d];
+						tap.Index0 = static_cast<int>(pos >> 8);
+						tap.Weight = static_cast<int>(pos & 255);
+						if (tap.Index0 >= srcLength - 1) {
+							tap.Index0 = srcLength - 1;
+							tap.Weight = 0;
+						}
+						tap.Index1 = (std::min)(tap.Index0 + 1, srcLength - 1);
+					}
+				}
+
+				/// <summary>
+				/// 2 つの short 配列を重み付きで合成します
+				/// </summary>
+				/// <param name="p0">合成元 0</param>
+				/// <param name="p1">合成元 1</param>
+				/// <param name="weight1">合成元 1 の重み (0 ～ 255)</param>
+				/// <param name="count">要素数</param>
+				/// <param name="pDst">合成先</param>
+				inline void BlendShorts(const short* p0, const short* p1, int weight1, int count, short* pDst)
+				{
+					const int weight0 = 256 - weight1;
+					const __m128i weights = _mm_set1_epi32((weight1 << 16) | weight0);
+					const __m128i round = _mm_set1_epi32(128);
+
+					int i = 0;
+					for (; i + 8 <= count; i += 8) {
+						const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p0 + i));
+						const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1 + i));
+						__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights);
+						__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights);
+						lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 8);
+						hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 8);
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_packs_epi32(lo, hi));
+					}
+					for (; i < count; ++i) {
+						pDst[i] = static_cast<short>((p0[i] * weight0 + p1[i] * weight1 + 128) >> 8);
+					}
+				}
+
+				/// <summary>
+				/// 双線形補間で拡大します
+				/// <para>縦方向の補間を SSE2 で行ってから、横方向を補間します。拡大専用です (dst ≧ src)。</para>
+				/// </summary>
+				/// <param name="pSrc">拡大元の画像</param>
+				/// <param name="srcStride">拡大元の 1 行の画素数</param>
+				/// <param name="pDst">拡大先の画像</param>
+				/// <param name="dstStride">拡大先の 1 行の画素数</param>
+				/// <param name="dstWidth">拡大先の幅</param>
+				/// <param name="pTapsX">横方向の補間位置</param>
+				/// <param name="pTapsY">縦方向の補間位置</param>
+				/// <param name="begin">処理する拡大先の開始行</param>
+				/// <param name="end">処理する拡大先の終了行 (この行は含まない)</param>
+				inline void ExpandRows(const Pixel_YC* pSrc, int srcStride, Pixel_YC* pDst, int dstStride, int dstWidth, const Tap* pTapsX, const Tap* pTapsY, int begin, int end)
+				{
+					short blended[(ExpandChunk + 1) * 3];
+
+					for (int y = begin; y < end; ++y) {
+						const Tap& tapY = pTapsY[y];
+						const short* pRow0 = reinterpret_cast<const short*>(pSrc + static_cast<std::size_t>(tapY.Index0) * srcStride);
+						const short* pRow1 = reinterpret_cast<const short*>(pSrc + static_cast<std::size_t>(tapY.Index1) * srcStride);
+						short* pOut = reinterpret_cast<short*>(pDst + static_cast<std::size_t>(y) * dstStride);
+
+						for (int x0 = 0; x0 < dstWidth; x0 += ExpandChunk) {
+							const int count = (std::min)(static_cast<int>(ExpandChunk), dstWidth - x0);
+							const int first = pTapsX[x0].Index0;
+							const int span = pTapsX[x0 + count - 1].Index1 - first + 1;
+							BlendShorts(pRow0 + first * 3, pRow1 + first * 3, tapY.Weight, span * 3, blended);
+
+							for (int i = 0; i < count; ++i) {
+								const Tap& tapX = pTapsX[x0 + i];
+								const short* a = blended + (tapX.Index0 - first) * 3;
+								const short* b = blended + (tapX.Index1 - first) * 3;
+								const int weight0 = 256 - tapX.Weight;
+								for (int c = 0; c < 3; ++c) {
+									pOut[(x0 + i) * 3 + c] = static_cast<short>((a[c] * weight0 + b[c] * tapX.Weight + 128) >> 8);
+								}
+							}
+						}
+					}
+				}
+
+				/// <summary>
+				/// 縮小画像用のバッファ
+				/// <para>func_proc はメインスレッドからのみ呼び出されるため、フィルタ間で使い回します。</para>
+				/// </summary>
+				struct Buffers
+				{
+					Utility::AlignedBuffer<Pixel_YC> Edit;
+					Utility::AlignedBuffer<Pixel_YC> Temp;
+					bool InUse = false;
+				};
+
+				/// <summary>
+				/// 縮小画像用のバッファを取得します
+				/// </summary>
+				inline Buffers& GetBuffers()
+				{
+					static Buffers buffers;
+					return buffers;
+				}
+			}
+
+			/// <summary>
+			/// 縮小解像度で処理するフレーム
+			/// <para>func_proc の中でスタックに作成して使用します。作成後は pInfo の画像サイズとポインタが縮小画像のものになります。</para>
+			/// <para>フィルタが画像サイズを変更した場合も、縮小率に応じた元の解像度のサイズへ拡大されます。</para>
+			/// <para>インターレース解除フィルタでは使用できません (常にフル解像度になります)。</para>
+			/// </summary>
+			class ProxyFrame final
+			{
+			public:
+				/// <summary>
+				/// 縮小解像度での処理を開始します
+				/// </summary>
+				/// <param name="pFilter">フィルタ構造体へのポインタ</param>
+				/// <param name="pInfo">フィルタプロシージャ用構造体へのポインタ</param>
+				/// <param name="pScales">トラックバーごとの ParameterScale の配列 (Trackbar_Num 個、nullptr なら全て None)</param>
+				ProxyFrame(FilterPluginTable* pFilter, FilterProcInfo* pInfo, const ParameterScale* pScales = nullptr)
+					: m_pFilter(pFilter), m_pInfo(pInfo), m_pScales(pScales)
+				{
+					const int factor = GetProxyFactor();
+					if (factor >= 2) {
+						Begin(factor);
+					}
+				}
+
+				~ProxyFrame() { Commit(); }
+
+				ProxyFrame(const ProxyFrame&) = delete;
+				ProxyFrame& operator=(const ProxyFrame&) = delete;
+
+				/// <summary>
+				/// 縮小解像度で処理中かを取得します
+				/// </summary>
+				bool IsActive() const { return m_active; }
+
+				/// <summary>
+				/// 縮小率を取得します (縮小していない場合は 1)
+				/// </summary>
+				int GetFactor() const { return m_active ? m_factor : 1; }
+
+				/// <summary>
+				/// 解像度に合わせたトラックバーの値を取得します
+				/// </summary>
+				/// <param name="index">トラックバーの番号</param>
+				/// <returns>
+				/// 縮小率と ParameterScale に応じて換算した値
+				/// </returns>
+				int GetTrackbar(int index) const
+				{
+					const int value = m_pFilter->pTrackbar_List[index];
+					if (!m_active || m_pScales == nullptr) {
+						return value;
+					}
+					switch (m_pScales[index]) {
+					case ParameterScale::Length:
+						return Detail::DivideRound(value, m_factor);
+					case ParameterScale::Area:
+						return Detail::DivideRound(value, m_factor * m_factor);
+					default:
+						return value;
+					}
+				}
+
+				/// <summary>
+				/// フル解像度での長さを縮小解像度の長さに換算します
+				/// </summary>
+				/// <param name="length">フル解像度での長さ</param>
+				/// <returns>
+				/// 縮小解像度での長さ
+				/// </returns>
+				double ScaleLength(double length) const { return length / GetFactor(); }
+
+				/// <summary>
+				/// 縮小画像を元の解像度へ拡大し、FilterProcInfo を元に戻します
+				/// <para>デストラクタからも呼び出されます。func_proc から戻る前に画像を参照したい場合に使用します。</para>
+				/// </summary>
+				void Commit()
+				{
+					if (!m_active) {
+						return;
+					}
+					m_active = false;
+
+					// フィルタが変更した縮小画像のサイズを元の解像度に換算する
+					const int proxyWidth = (std::max)(m_pInfo->Width, 1);
+					const int proxyHeight = (std::max)(m_pInfo->Height, 1);
+					const int width = (std::min)(static_cast<int>(static_cast<long long>(proxyWidth) * m_width / m_proxyWidth), m_widthMax);
+					const int height = (std::min)(static_cast<int>(static_cast<long long>(proxyHeight) * m_height / m_proxyHeight), m_heightMax);
+
+					const Pixel_YC* pProxy = m_pInfo->pYC_Edit;
+					const int proxyStride = m_pInfo->Line_Size / Pixel_YC::Size;
+
+					m_pInfo->pYC_Edit = m_pEdit;
+					m_pInfo->pYC_Temp = m_pTemp;
+					m_pInfo->Width = width;
+					m_pInfo->Height = height;
+					m_pInfo->Width_Max = m_widthMax;
+					m_pInfo->Height_Max = m_heightMax;
+					m_pInfo->Line_Size = m_lineSize;
+
+					if (width > 0 && height > 0) {
+						std::vector<Detail::Tap> tapsX(width);
+						std::vector<Detail::Tap> tapsY(height);
+						Detail::BuildTaps(proxyWidth, width, tapsX.data());
+						Detail::BuildTaps(proxyHeight, height, tapsY.data());
+
+						const int stride = m_lineSize / Pixel_YC::Size;
+						Pixel_YC* pEdit = m_pEdit;
+						const Detail::Tap* pTapsX = tapsX.data();
+						const Detail::Tap* pTapsY = tapsY.data();
+						MultiThread::ForEachRange(GetExec(), height, [&](int begin, int end) {
+							Detail::ExpandRows(pProxy, proxyStride, pEdit, stride, width, pTapsX, pTapsY, begin, end);
+						});
+					}
+
+					Detail::GetBuffers().InUse = false;
+				}
+
+			private:
+				/// <summary>
+				/// 現在の状態で使用する縮小率を求めます
+				/// </summary>
+				/// <returns>
+				/// 縮小率 (縮小しない場合は 1)
+				/// </returns>
+				int GetProxyFactor() const
+				{
+					const Settings& settings = GetSettings();
+					if (!settings.Enabled || settings.Factor < 2) {
+						return 1;
+					}
+					if (m_pFilter == nullptr || m_pInfo == nullptr || m_pFilter->pCallbackFunctionSet == nullptr) {
+						return 1;
+					}
+					if ((m_pFilter->Flag & FilterPluginTable::FilterFlag::InterlaceFilter) == FilterPluginTable::FilterFlag::InterlaceFilter) {
+						return 1;
+					}
+					if (m_pInfo->Edit_Handle == nullptr || m_pInfo->Width <= 0 || m_pInfo->Height <= 0) {
+						return 1;
+					}
+					const CallbackFunctionSet* pFunctions = m_pFilter->pCallbackFunctionSet;
+					if (pFunctions->IsEditing(m_pInfo->Edit_Handle) == 0 || pFunctions->IsSaving(m_pInfo->Edit_Handle) != 0) {
+						return 1;
+					}
+
+					int factor = (std::min)(settings.Factor, static_cast<int>(Detail::MaxFactor));
+					while (factor >= 2 && (m_pInfo->Width / factor < settings.MinWidth || m_pInfo->Height / factor < 1)) {
+						--factor;
+					}
+					return factor;
+				}
+
+				/// <summary>
+				/// 画像を縮小して FilterProcInfo を差し替えます
+				/// </summary>
+				/// <param name="factor">縮小率</param>
+				void Begin(int factor)
+				{
+					Detail::Buffers& buffers = Detail::GetBuffers();
+					if (buffers.InUse) {
+						return;
+					}
+
+					const int proxyWidthMax = m_pInfo->Width_Max / factor;
+					const int proxyHeightMax = m_pInfo->Height_Max / factor;
+					const int proxyStride = (proxyWidthMax + 7) & ~7;
+					const std::size_t count = static_cast<std::size_t>(proxyStride) * proxyHeightMax;
+					try {
+						if (buffers.Edit.GetCount() < count) {
+							buffers.Edit.Allocate(count);
+						}
+						if (buffers.Temp.GetCount() < count) {
+							buffers.Temp.Allocate(count);
+						}
+					}
+					catch (const std::bad_alloc&) {
+						buffers.Edit.Free();
+						buffers.Temp.Free();
+						return;
+					}
+					buffers.InUse = true;
+
+					m_factor = factor;
+					m_pEdit = m_pInfo->pYC_Edit;
+					m_pTemp = m_pInfo->pYC_Temp;
+					m_width = m_pInfo->Width;
+					m_height = m_pInfo->Height;
+					m_widthMax = m_pInfo->Width_Max;
+					m_heightMax = m_pInfo->Height_Max;
+					m_lineSize = m_pInfo->Line_Size;
+					m_proxyWidth = m_width / factor;
+					m_proxyHeight = m_height / factor;
+
+					const Pixel_YC* pEdit = m_pEdit;
+					const int stride = m_lineSize / Pixel_YC::Size;
+					Pixel_YC* pProxy = buffers.Edit.GetData();
+					const int proxyWidth = m_proxyWidth;
+					MultiThread::ForEachRange(GetExec(), m_proxyHeight, [&](int begin, int end) {
+						Detail::ReduceRows(pEdit, stride, pProxy, proxyStride, proxyWidth, factor, begin, end);
+					});
+
+					m_pInfo->pYC_Edit = pProxy;
+					m_pInfo->pYC_Temp = buffers.Temp.GetData();
+					m_pInfo->Width = m_proxyWidth;
+					m_pInfo->Height = m_proxyHeight;
+					m_pInfo->Width_Max = proxyWidthMax;
+					m_pInfo->Height_Max = proxyHeightMax;
+					m_pInfo->Line_Size = proxyStride * Pixel_YC::Size;
+					m_active = true;
+				}
+
+				/// <summary>
+				/// ExecMultiThread() へのポインタを取得します
+				/// </summary>
+				MultiThread::Exec_Func GetExec() const { return m_pFilter->pCallbackFunctionSet->ExecMultiThread; }
+
+				FilterPluginTable* m_pFilter;
+				FilterProcInfo* m_pInfo;
+				const ParameterScale* m_pScales;
+				bool m_active = false;
+				int m_factor = 1;
+				Pixel_YC* m_pEdit = nullptr;
+				Pixel_YC* m_pTemp = nullptr;
+				int m_width = 0;
+				int m_height = 0;
+				int m_widthMax = 0;
+				int m_heightMax = 0;
+				int m_lineSize = 0;
+				int m_proxyWidth = 0;
+				int m_proxyHeight = 0;
+			};
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,408 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AlignedBuffer.h"
+#include "MultiThread.h"
+#include <algorithm>    // std::min, std::max, std::swap
+#include <cmath>        // std::floor, std::ceil, std::sin, std::abs
+#include <emmintrin.h>  // SSE2 intrinsics
+#include <new>          // std::bad_alloc
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// リサイズの補間方法の定数
+		/// </summary>
+		enum class ResampleKernel : int {
+			/// <summary>
+			/// 双線形補間
+			/// </summary>
+			Bilinear = 0,
+
+			/// <summary>
+			/// 双三次補間 (a = -0.5)
+			/// </summary>
+			Bicubic = 1,
+
+			/// <summary>
+			/// Lanczos (3 lobe)
+			/// </summary>
+			Lanczos3 = 2,
+
+			/// <summary>
+			/// 面積平均 (縮小時のモアレが少ない)
+			/// </summary>
+			Area = 3,
+		};
+
+		/// <summary>
+		/// 1 方向のリサイズの重みテーブル
+		/// <para>出力位置ごとに、参照する入力の開始位置と固定小数点 (14bit) の重みを保持します。</para>
+		/// <para>範囲外を参照する重みは端の画素に加算されるため、常に入力の範囲内だけを参照します。</para>
+		/// </summary>
+		class ResampleWeightTable final
+		{
+		public:
+			enum : int {
+				/// <summary>
+				/// 重みの小数部のビット数
+				/// </summary>
+				WeightBits = 14,
+
+				/// <summary>
+				/// 重みの 1.0
+				/// </summary>
+				WeightOne = 1 << WeightBits,
+			};
+
+			/// <summary>
+			/// 重みテーブルを作成します
+			/// <para>前回と同じ条件の場合は作成済みのテーブルをそのまま使用します。</para>
+			/// </summary>
+			/// <param name="kernel">補間方法</param>
+			/// <param name="srcLength">入力の長さ</param>
+			/// <param name="dstLength">出力の長さ</param>
+			void Build(ResampleKernel kernel, int srcLength, int dstLength)
+			{
+				if (kernel == m_kernel && srcLength == m_srcLength && dstLength == m_dstLength) {
+					return;
+				}
+				m_kernel = kernel;
+				m_srcLength = srcLength;
+				m_dstLength = dstLength;
+
+				const double scale = static_cast<double>(srcLength) / dstLength;
+				const double filterScale = (std::max)(scale, 1.0);
+				const double support = (kernel == ResampleKernel::Area) ? scale / 2 + 1 : GetSupport(kernel) * filterScale;
+
+				// 補間関数の範囲全体を評価し、入力より長い場合は保持する重みの数だけを入力の長さに抑えます
+				const int window = static_cast<int>(std::ceil(support)) * 2 + 1;
+				m_taps = (std::min)(window, srcLength);
+
+				m_starts.assign(dstLength, 0);
+				m_weights.assign(static_cast<std::size_t>(dstLength) * m_taps, 0);
+				std::vector<double> weights(m_taps);
+
+				for (int d = 0; d < dstLength; ++d) {
+					const double center = (d + 0.5) * scale - 0.5;
+					const int low = static_cast<int>(std::floor(center - support)) + 1;
+					const int start = (std::max)(0, (std::min)(low, srcLength - m_taps));
+					std::fill(weights.begin(), weights.end(), 0.0);
+
+					double total = 0;
+					for (int i = low; i < low + window; ++i) {
+						double weight;
+						if (kernel == ResampleKernel::Area) {
+							// 出力画素が覆う入力の範囲 [d * scale, (d + 1) * scale) との重なり
+							const double left = (std::max)(d * scale, static_cast<double>(i));
+							const double right = (std::min)((d + 1) * scale, static_cast<double>(i + 1));
+							weight = (std::max)(right - left, 0.0);
+						}
+						else {
+							weight = Evaluate(kernel, (i - center) / filterScale);
+						}
+						weights[(std::max)(0, (std::min)(i, srcLength - 1)) - start] += weight;
+						total += weight;
+					}
+
+					// 合計が WeightOne になるように丸め誤差を最大の重みで吸収する
+					short* pWeights = m_weights.data() + static_cast<std::size_t>(d) * m_taps;
+					int sum = 0;
+					int largest = 0;
+					for (int k = 0; k < m_taps; ++k) {
+						const double normalized = total != 0 ? weights[k] / total : (k == 0 ? 1.0 : 0.0);
+						pWeights[k] = static_cast<short>(std::floor(normalized * WeightOne + 0.5));
+						sum += pWeights[k];
+						if (std::abs(pWeights[k]) > std::abs(pWeights[largest])) {
+							largest = k;
+						}
+					}
+					pWeights[largest] = static_cast<short>(pWeights[largest] + WeightOne - sum);
+					m_starts[d] = start;
+				}
+			}
+
+			/// <summary>
+			/// 出力 1 画素あたりの参照数を取得します
+			/// </summary>
+			int GetTaps() const { return m_taps; }
+
+			/// <summary>
+			/// 出力位置の参照開始位置を取得します
+			/// </summary>
+			/// <param name="index">出力位置</param>
+			int GetStart(int index) const { return m_starts[index]; }
+
+			/// <summary>
+			/// 出力位置の重み (GetTaps() 個) を取得します
+			/// </summary>
+			/// <param name="index">出力位置</param>
+			const short* GetWeights(int index) const { return m_weights.data() + static_cast<std::size_t>(index) * m_taps; }
+
+		private:
+			/// <summary>
+			/// 補間関数の片側の範囲を取得します
+			/// </summary>
+			static double GetSupport(ResampleKernel kernel)
+			{
+				switch (kernel) {
+				case ResampleKernel::Bicubic:
+					return 2.0;
+				case ResampleKernel::Lanczos3:
+					return 3.0;
+				default:
+					return 1.0;
+				}
+			}
+
+			/// <summary>
+			/// 補間関数の値を求めます
+			/// </summary>
+			static double Evaluate(ResampleKernel kernel, double x)
+			{
+				x = std::abs(x);
+				switch (kernel) {
+				case ResampleKernel::Bicubic:
+				{
+					const double a = -0.5;
+					if (x < 1) {
+						return ((a + 2) * x - (a + 3)) * x * x + 1;
+					}
+					if (x < 2) {
+						return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+					}
+					return 0;
+				}
+				case ResampleKernel::Lanczos3:
+				{
+					if (x < 1e-8) {
+						return 1;
+					}
+					if (x >= 3) {
+						return 0;
+					}
+					const double pi = 3.14159265358979323846;
+					return 3 * std::sin(pi * x) * std::sin(pi * x / 3) / (pi * pi * x * x);
+				}
+				default:
+					return x < 1 ? 1 - x : 0;
+				}
+			}
+
+			ResampleKernel m_kernel = ResampleKernel::Bilinear;
+			int m_srcLength = 0;
+			int m_dstLength = 0;
+			int m_taps = 0;
+			std::vector<int> m_starts;
+			std::vector<short> m_weights;
+		};
+
+		/// <summary>
+		/// Pixel_YC の分離型リサイズ
+		/// <para>CallbackFunctionSet::ResizeYC() と異なり、補間方法を選択でき、ExecMultiThread() で並列に処理します。</para>
+		/// <para>縦方向を SSE2 で補間してから横方向を補間します。出力の行ごとに処理が閉じているため、行単位で分割して並列化します。</para>
+		/// <para>重みテーブルと作業領域は保持して使い回すため、フィルタごとに 1 つ作成してください。</para>
+		/// </summary>
+		class Resampler final
+		{
+		public:
+			/// <summary>
+			/// リサイズの準備をします
+			/// </summary>
+			/// <param name="kernel">補間方法</param>
+			explicit Resampler(ResampleKernel kernel = ResampleKernel::Bicubic) : m_kernel(kernel) {}
+
+			Resampler(const Resampler&) = delete;
+			Resampler& operator=(const Resampler&) = delete;
+
+			/// <summary>
+			/// 補間方法を設定します
+			/// </summary>
+			void SetKernel(ResampleKernel kernel) { m_kernel = kernel; }
+
+			/// <summary>
+			/// 補間方法を取得します
+			/// </summary>
+			ResampleKernel GetKernel() const { return m_kernel; }
+
+			/// <summary>
+			/// 画像の任意の領域をリサイズします
+			/// <para>入力と出力の領域は重ならないようにしてください。</para>
+			/// </summary>
+			/// <param name="pDst">リサイズ後の画像を格納するポインタ</param>
+			/// <param name="dstLineSize">出力の 1 行のバイト数 (FilterProcInfo::Line_Size など)</param>
+			/// <param name="width">リサイズ後の幅</param>
+			/// <param name="height">リサイズ後の高さ</param>
+			/// <param name="pSrc">元画像へのポインタ</param>
+			/// <param name="srcLineSize">元画像の 1 行のバイト数</param>
+			/// <param name="srcX">元画像のリサイズ対象領域の左上の X 座標</param>
+			/// <param name="srcY">元画像のリサイズ対象領域の左上の Y 座標</param>
+			/// <param name="srcWidth">元画像のリサイズ対象領域の幅</param>
+			/// <param name="srcHeight">元画像のリサイズ対象領域の高さ</param>
+			/// <param name="pExec">ExecMultiThread() へのポインタ (nullptr なら呼び出し元のスレッドで処理)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Resize(Pixel_YC* pDst, int dstLineSize, int width, int height,
+				const Pixel_YC* pSrc, int srcLineSize, int srcX, int srcY, int srcWidth, int srcHeight,
+				MultiThread::Exec_Func pExec = nullptr)
+			{
+				if (pDst == nullptr || pSrc == nullptr || width <= 0 || height <= 0 || srcWidth <= 0 || srcHeight <= 0) {
+					return false;
+				}
+
+				// 作業領域は 1 行あたり 4 要素単位で読み込むため、末尾に余白を確保する
+				const int workStride = (srcWidth * 3 + 8 + 7) & ~7;
+				try {
+					m_horizontal.Build(m_kernel, srcWidth, width);
+					m_vertical.Build(m_kernel, srcHeight, height);
+					const std::size_t workCount = static_cast<std::size_t>(workStride) * height;
+					if (m_work.GetCount() < workCount) {
+						m_work.Allocate(workCount);
+					}
+				}
+				catch (const std::bad_alloc&) {
+					return false;
+				}
+
+				const unsigned char* pSrcBase = reinterpret_cast<const unsigned char*>(pSrc)
+					+ static_cast<std::size_t>(srcY) * srcLineSize + static_cast<std::size_t>(srcX) * Pixel_YC::Size;
+				unsigned char* pDstBase = reinterpret_cast<unsigned char*>(pDst);
+				short* pWork = m_work.GetData();
+				const ResampleWeightTable& horizontal = m_horizontal;
+				const ResampleWeightTable& vertical = m_vertical;
+
+				return MultiThread::ForEachRange(pExec, height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						short* pRow = pWork + static_cast<std::size_t>(y) * workStride;
+						VerticalRow(pSrcBase, srcLineSize, srcWidth * 3, vertical.GetStart(y), vertical.GetTaps(), vertical.GetWeights(y), pRow);
+						pRow[srcWidth * 3] = 0;
+						HorizontalRow(pRow, horizontal, width, reinterpret_cast<short*>(pDstBase + static_cast<std::size_t>(y) * dstLineSize));
+					}
+				});
+			}
+
+			/// <summary>
+			/// フィルタ処理中のフレーム画像をリサイズします
+			/// <para>pYC_Edit を pYC_Temp へリサイズしてから入れ替え、Width と Height を更新します。</para>
+			/// </summary>
+			/// <param name="pFilter">フィルタ構造体へのポインタ</param>
+			/// <param name="pInfo">フィルタプロシージャ用構造体へのポインタ</param>
+			/// <param name="width">リサイズ後の幅 (Width_Max 以下)</param>
+			/// <param name="height">リサイズ後の高さ (Height_Max 以下)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool ResizeFrame(FilterPluginTable* pFilter, FilterProcInfo* pInfo, int width, int height)
+			{
+				if (width > pInfo->Width_Max || height > pInfo->Height_Max) {
+					return false;
+				}
+				if (!Resize(pInfo->pYC_Temp, pInfo->Line_Size, width, height,
+					pInfo->pYC_Edit, pInfo->Line_Size, 0, 0, pInfo->Width, pInfo->Height,
+					pFilter->pCallbackFunctionSet->ExecMultiThread)) {
+					return false;
+				}
+				std::swap(pInfo->pYC_Edit, pInfo->pYC_Temp);
+				pInfo->Width = width;
+				pInfo->Height = height;
+				return true;
+			}
+
+		private:
+			/// <summary>
+			/// 縦方向に補間した 1 行を作業領域に書き込みます
+			/// </summary>
+			static void VerticalRow(const unsigned char* pSrc, int srcLineSize, int count, int start, int taps, const short* pWeights, short* pDst)
+			{
+				const __m128i round = _mm_set1_epi32(1 << (ResampleWeightTable::WeightBits - 1));
+
+				int i = 0;
+				for (; i + 8 <= count; i += 8) {
+					__m128i lo = round;
+					__m128i hi = round;
+					for (int k = 0; k < taps; k += 2) {
+						const short* pRow0 = reinterpret_cast<const short*>(pSrc + static_cast<std::size_t>(start + k) * srcLineSize);
+						const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + i));
+						__m128i b = _mm_setzero_si128();
+						unsigned int weight1 = 0;
+						if (k + 1 < taps) {
+							const short* pRow1 = reinterpret_cast<const short*>(pSrc + static_cast<std::size_t>(start + k + 1) * srcLineSize);
+							b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + i));
+							weight1 = static_cast<unsigned short>(pWeights[k + 1]);
+						}
+						const __m128i weights = _mm_set1_epi32(static_cast<int>((weight1 << 16) | static_cast<unsigned short>(pWeights[k])));
+						lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+						hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+					}
+					lo = _mm_srai_epi32(lo, ResampleWeightTable::WeightBits);
+					hi = _mm_srai_epi32(hi, ResampleWeightTable::WeightBits);
+					_mm_store_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_packs_epi32(lo, hi));
+				}
+				for (; i < count; ++i) {
+					int sum = 1 << (ResampleWeightTable::WeightBits - 1);
+					for (int k = 0; k < taps; ++k) {
+						sum += reinterpret_cast<const short*>(pSrc + static_cast<std::size_t>(start + k) * srcLineSize)[i] * pWeights[k];
+					}
+					pDst[i] = Saturate(sum >> ResampleWeightTable::WeightBits);
+				}
+			}
+
+			/// <summary>
+			/// 作業領域の 1 行を横方向に補間して出力します
+			/// <para>1 画素 (3 要素) を 4 要素のレジスタで計算するため、作業領域の行末には 1 要素の余白が必要です。</para>
+			/// </summary>
+			static void HorizontalRow(const short* pSrc, const ResampleWeightTable& table, int width, short* pDst)
+			{
+				const __m128i round = _mm_set1_epi32(1 << (ResampleWeightTable::WeightBits - 1));
+				const __m128i zero = _mm_setzero_si128();
+				const int taps = table.GetTaps();
+
+				for (int x = 0; x < width; ++x) {
+					const short* p = pSrc + table.GetStart(x) * 3;
+					const short* pWeights = table.GetWeights(x);
+					__m128i sum = round;
+					for (int k = 0; k < taps; ++k) {
+						const __m128i v = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + k * 3)), zero);
+						sum = _mm_add_epi32(sum, _mm_madd_epi16(v, _mm_set1_epi32(static_cast<unsigned short>(pWeights[k]))));
+					}
+					const __m128i packed = _mm_packs_epi32(_mm_srai_epi32(sum, ResampleWeightTable::WeightBits), zero);
+					const int yc = _mm_cvtsi128_si32(packed);
+					pDst[x * 3 + 0] = static_cast<short>(yc);
+					pDst[x * 3 + 1] = static_cast<short>(yc >> 16);
+					pDst[x * 3 + 2] = static_cast<short>(_mm_extract_epi16(packed, 2));
+				}
+			}
+
+			/// <summary>
+			/// short の範囲に収めます
+			/// </summary>
+			static short Saturate(int value)
+			{
+				return static_cast<short>((std::max)(-32768, (std::min)(value, 32767)));
+			}
+
+			ResampleKernel m_kernel;
+			ResampleWeightTable m_horizontal;
+			ResampleWeightTable m_vertical;
+			Utility::AlignedBuffer<short> m_work;
+		};
+	}
+
+#endif
+}
@@ -0,0 +1,466 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AlignedBuffer.h"
+#include "../Utility/Fft.h"
+#include <algorithm>    // std::min, std::max, std::fill, std::copy
+#include <cmath>        // std::cos, std::sqrt, std::lrint
+#include <cstring>      // std::memmove, std::memcpy
+#include <functional>   // std::function
+#include <memory>       // std::unique_ptr
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// 内部実装
+		/// </summary>
+		namespace Detail
+		{
+			/// <summary>
+			/// float を 16bit PCM に丸めます
+			/// </summary>
+			inline short ToPcm16(float value)
+			{
+				const long rounded = std::lrint(value);
+				return static_cast<short>((std::min)((std::max)(rounded, -32768l), 32767l));
+			}
+
+			/// <summary>
+			/// FilterProc をまたいだ音声の連続性を判定します
+			/// </summary>
+			class AudioContinuity final
+			{
+			public:
+				/// <summary>
+				/// 今回の FilterProc が前回の続きか調べます
+				/// </summary>
+				/// <returns>
+				/// true なら前回の次のフレーム (false なら状態を初期化してください)
+				/// </returns>
+				bool Next(const FilterProcInfo* fpip)
+				{
+					const bool continuous = (fpip->Frame == m_nextFrame);
+					m_nextFrame = fpip->Frame + 1;
+					return continuous;
+				}
+
+				void Reset() { m_nextFrame = -1; }
+
+			private:
+				int m_nextFrame = -1;
+			};
+		}
+
+		/// <summary>
+		/// 音声フィルタ用の短時間フーリエ変換 (オーバーラップ加算)
+		/// <para>入力を窓掛けしてスペクトルに変換し、コールバックで加工した後に逆変換して重ね合わせます。解析と合成には平方根ハン窓を使用します。</para>
+		/// <para>FilterInit で生成し FilterExit で破棄してください。バッファはチャンネル数が変わったときだけ確保し直すため、FilterProc ではメモリを確保しません。</para>
+		/// <para>連続したフレームを処理している間はオーバーラップの状態を引き継ぎ、シークなどで不連続になった場合は初期化します。出力は GetLatency() サンプル遅れます。</para>
+		/// </summary>
+		class StftProcessor final
+		{
+		public:
+			/// <summary>
+			/// スペクトルを受け取る関数
+			/// <para>pReal, pImag はビン数 (点数 / 2 + 1) 分で、書き換えた内容が合成されます。</para>
+			/// </summary>
+			using Callback = std::function<void(int channel, float* pReal, float* pImag, int bins)>;
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="size">FFT の点数 (8 以上の 2 の累乗)</param>
+			/// <param name="overlap">重なり数 (2 以上の 2 の累乗、移動量は点数 / 重なり数)</param>
+			/// <param name="callback">スペクトルを受け取る関数</param>
+			StftProcessor(int size, int overlap, Callback callback)
+				: m_size(size), m_hop(size / (std::max)(overlap, 2)), m_callback(std::move(callback))
+			{
+				const double pi = 3.14159265358979323846;
+				m_window.Allocate(size);
+				for (int n = 0; n < size; ++n) {
+					m_window[n] = static_cast<float>(std::sqrt(0.5 - 0.5 * std::cos(2.0 * pi * n / size)));
+				}
+				// 平方根ハン窓 2 回分 (= ハン窓) の重ね合わせは 点数 / 移動量 / 2 になる
+				m_scale = 2.0f * m_hop / size;
+			}
+
+			StftProcessor(const StftProcessor&) = delete;
+			StftProcessor& operator=(const StftProcessor&) = delete;
+
+			/// <summary>
+			/// 出力の遅延 (サンプル数) を取得します
+			/// </summary>
+			int GetLatency() const { return m_size; }
+
+			/// <summary>
+			/// ビン数を取得します
+			/// </summary>
+			int GetBins() const { return m_size / 2 + 1; }
+
+			/// <summary>
+			/// チャンネル数を設定し、バッファを確保します
+			/// </summary>
+			/// <param name="channels">チャンネル数</param>
+			void Prepare(int channels)
+			{
+				if (channels == static_cast<int>(m_channels.size())) {
+					return;
+				}
+				m_channels.clear();
+				for (int c = 0; c < channels; ++c) {
+					m_channels.emplace_back(std::unique_ptr<Channel>(new Channel(m_size)));
+				}
+				m_real.Allocate(GetBins());
+				m_imag.Allocate(GetBins());
+				m_frame.Allocate(m_size);
+				Reset();
+			}
+
+			/// <summary>
+			/// オーバーラップの状態を初期化します
+			/// </summary>
+			void Reset()
+			{
+				Clear();
+				m_continuity.Reset();
+			}
+
+			/// <summary>
+			/// FilterProc の音声を処理します (pAudio を書き換えます)
+			/// <para>前回の次のフレームでなければ、オーバーラップの状態を初期化してから処理します。</para>
+			/// </summary>
+			/// <returns>
+			/// true なら処理した
+			/// </returns>
+			bool Process(FilterProcInfo* fpip)
+			{
+				if (fpip->pAudio == nullptr || fpip->Audio_Channel <= 0) {
+					return false;
+				}
+				Prepare(fpip->Audio_Channel);
+				if (!m_continuity.Next(fpip)) {
+					Clear();
+				}
+				Run(fpip->pAudio, fpip->pAudio, fpip->Audio_Total, true);
+				return true;
+			}
+
+			/// <summary>
+			/// 音声を処理します (16bit PCM、インターリーブ)
+			/// </summary>
+			/// <param name="pAudio">音声 (処理結果で上書きされます)</param>
+			/// <param name="frames">フレーム数</param>
+			void Process(short* pAudio, int frames)
+			{
+				Run(pAudio, pAudio, frames, true);
+			}
+
+			/// <summary>
+			/// スペクトルの解析だけを行います (合成しないため、スペクトル表示などに使用します)
+			/// </summary>
+			/// <param name="pAudio">音声 (16bit PCM、インターリーブ)</param>
+			/// <param name="frames">フレーム数</param>
+			void Analyze(const short* pAudio, int frames)
+			{
+				Run(pAudio, nullptr, frames, false);
+			}
+
+		private:
+			/// <summary>
+			/// チャンネルごとの状態
+			/// </summary>
+			struct Channel final
+			{
+				explicit Channel(int size)
+					: Fft(size), Input(size), Output(size), Accumulator(size)
+				{
+				}
+
+				Utility::RealFft Fft;
+				Utility::AlignedBuffer<float> Input;
+				Utility::AlignedBuffer<float> Output;
+				Utility::AlignedBuffer<float> Accumulator;
+			};
+
+			void Clear()
+			{
+				for (auto& pChannel : m_channels) {
+					std::fill(pChannel->Input.GetData(), pChannel->Input.GetData() + m_size, 0.0f);
+					std::fill(pChannel->Output.GetData(), pChannel->Output.GetData() + m_size, 0.0f);
+					std::fill(pChannel->Accumulator.GetData(), pChannel->Accumulator.GetData() + m_size, 0.0f);
+				}
+				m_position = m_size - m_hop;
+			}
+
+			void Run(const short* pSrc, short* pDst, int frames, bool synthesize)
+			{
+				const int channels = static_cast<int>(m_channels.size());
+				const int start = m_size - m_hop;
+				for (int done = 0; done < frames;) {
+					const int count = (std::min)(frames - done, m_size - m_position);
+					for (int c = 0; c < channels; ++c) {
+						Channel& channel = *m_channels[c];
+						const short* pIn = pSrc + static_cast<std::size_t>(done) * channels + c;
+						float* pInput = channel.Input.GetData() + m_position;
+						for (int i = 0; i < count; ++i) {
+							pInput[i] = pIn[static_cast<std::size_t>(i) * channels];
+						}
+						if (pDst != nullptr) {
+							short* pOut = pDst + static_cast<std::size_t>(done) * channels + c;
+							const float* pOutput = channel.Output.GetData() + (m_position - start);
+							for (int i = 0; i < count; ++i) {
+								pOut[static_cast<std::size_t>(i) * channels] = Detail::ToPcm16(pOutput[i]);
+							}
+						}
+					}
+					done += count;
+					m_position += count;
+
+					if (m_position >= m_size) {
+						for (int c = 0; c < channels; ++c) {
+							ProcessFrame(c, *m_channels[c], synthesize);
+						}
+						m_position = start;
+					}
+				}
+			}
+
+			void ProcessFrame(int index, Channel& channel, bool synthesize)
+			{
+				float* pFrame = m_frame.GetData();
+				float* pInput = channel.Input.GetData();
+				const float* pWindow = m_window.GetData();
+				for (int n = 0; n < m_size; ++n) {
+					pFrame[n] = pInput[n] * pWindow[n];
+				}
+				channel.Fft.Forward(pFrame, m_real.GetData(), m_imag.GetData());
+				if (m_callback) {
+					m_callback(index, m_real.GetData(), m_imag.GetData(), GetBins());
+				}
+				std::memmove(pInput, pInput + m_hop, sizeof(float) * (m_size - m_hop));
+				if (!synthesize) {
+					return;
+				}
+
+				channel.Fft.Inverse(m_real.GetData(), m_imag.GetData(), pFrame);
+				float* pAccumulator = channel.Accumulator.GetData();
+				for (int n = 0; n < m_size; ++n) {
+					pAccumulator[n] += pFrame[n] * pWindow[n] * m_scale;
+				}
+				std::memcpy(channel.Output.GetData(), pAccumulator, sizeof(float) * m_hop);
+				std::memmove(pAccumulator, pAccumulator + m_hop, sizeof(float) * (m_size - m_hop));
+				std::fill(pAccumulator + m_size - m_hop, pAccumulator + m_size, 0.0f);
+			}
+
+			int m_size;
+			int m_hop;
+			float m_scale;
+			Callback m_callback;
+			Utility::AlignedBuffer<float> m_window;
+			std::vector<std::unique_ptr<Channel>> m_channels;
+			Utility::AlignedBuffer<float> m_real;
+			Utility::AlignedBuffer<float> m_imag;
+			Utility::AlignedBuffer<float> m_frame;
+			int m_position = 0;
+			Detail::AudioContinuity m_continuity;
+		};
+
+		/// <summary>
+		/// 音声フィルタ用の FFT 畳み込み (オーバーラップ保存)
+		/// <para>FIR フィルタ (インパルス応答) を点数 / 2 サンプルのブロック単位で周波数領域で畳み込みます。長いインパルス応答でも計算量はタップ数によらずほぼ一定です。</para>
+		/// <para>StftProcessor と同様に FilterInit で生成し、FilterProc をまたいで状態を引き継ぎます。出力は GetLatency() サンプル遅れます。</para>
+		/// </summary>
+		class FftConvolver final
+		{
+		public:
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="size">FFT の点数 (8 以上の 2 の累乗、インパルス応答は点数 / 2 + 1 タップまで)</param>
+			explicit FftConvolver(int size)
+				: m_size(size), m_fft(size), m_responseReal(size / 2 + 1), m_responseImag(size / 2 + 1),
+				m_real(size / 2 + 1), m_imag(size / 2 + 1), m_frame(size)
+			{
+				std::fill(m_responseReal.GetData(), m_responseReal.GetData() + GetBins(), 1.0f);
+				std::fill(m_responseImag.GetData(), m_responseImag.GetData() + GetBins(), 0.0f);
+			}
+
+			FftConvolver(const FftConvolver&) = delete;
+			FftConvolver& operator=(const FftConvolver&) = delete;
+
+			/// <summary>
+			/// 出力の遅延 (サンプル数) を取得します
+			/// </summary>
+			int GetLatency() const { return m_size / 2; }
+
+			/// <summary>
+			/// インパルス応答を設定します (状態は初期化しません)
+			/// </summary>
+			/// <param name="pResponse">インパルス応答</param>
+			/// <param name="length">タップ数 (点数 / 2 + 1 を超える分は無視します)</param>
+			void SetResponse(const float* pResponse, int length)
+			{
+				length = (std::min)(length, m_size / 2 + 1);
+				float* pFrame = m_frame.GetData();
+				std::fill(pFrame, pFrame + m_size, 0.0f);
+				std::copy(pResponse, pResponse + length, pFrame);
+				m_fft.Forward(pFrame, m_responseReal.GetData(), m_responseImag.GetData());
+			}
+
+			/// <summary>
+			/// チャンネル数を設定し、バッファを確保します
+			/// </summary>
+			/// <param name="channels">チャンネル数</param>
+			void Prepare(int channels)
+			{
+				if (channels == static_cast<int>(m_input.size())) {
+					return;
+				}
+				m_input.clear();
+				m_output.clear();
+				for (int c = 0; c < channels; ++c) {
+					m_input.emplace_back(m_size);
+					m_output.emplace_back(m_size / 2);
+				}
+				Reset();
+			}
+
+			/// <summary>
+			/// 状態を初期化します
+			/// </summary>
+			void Reset()
+			{
+				Clear();
+				m_continuity.Reset();
+			}
+
+			/// <summary>
+			/// FilterProc の音声を処理します (pAudio を書き換えます)
+			/// <para>前回の次のフレームでなければ、状態を初期化してから処理します。</para>
+			/// </summary>
+			/// <returns>
+			/// true なら処理した
+			/// </returns>
+			bool Process(FilterProcInfo* fpip)
+			{
+				if (fpip->pAudio == nullptr || fpip->Audio_Channel <= 0) {
+					return false;
+				}
+				Prepare(fpip->Audio_Channel);
+				if (!m_continuity.Next(fpip)) {
+					Clear();
+				}
+				Process(fpip->pAudio, fpip->Audio_Total);
+				return true;
+			}
+
+			/// <summary>
+			/// 音声を処理します (16bit PCM、インターリーブ)
+			/// </summary>
+			/// <param name="pAudio">音声 (処理結果で上書きされます)</param>
+			/// <param name="frames">フレーム数</param>
+			void Process(short* pAudio, int frames)
+			{
+				const int channels = static_cast<int>(m_input.size());
+				const int block = m_size / 2;
+				for (int done = 0; done < frames;) {
+					const int count = (std::min)(frames - done, m_size - m_position);
+					for (int c = 0; c < channels; ++c) {
+						short* p = pAudio + static_cast<std::size_t>(done) * channels + c;
+						float* pInput = m_input[c].GetData() + m_position;
+						const float* pOutput = m_output[c].GetData() + (m_position - block);
+						for (int i = 0; i < count; ++i) {
+							pInput[i] = p[static_cast<std::size_t>(i) * channels];
+							p[static_cast<std::size_t>(i) * channels] = Detail::ToPcm16(pOutput[i]);
+						}
+					}
+					done += count;
+					m_position += count;
+
+					if (m_position >= m_size) {
+						for (int c = 0; c < channels; ++c) {
+							ProcessBlock(m_input[c].GetData(), m_output[c].GetData());
+						}
+						m_position = block;
+					}
+				}
+			}
+
+		private:
+			int GetBins() const { return m_size / 2 + 1; }
+
+			void Clear()
+			{
+				for (auto& input : m_input) {
+					std::fill(input.GetData(), input.GetData() + m_size, 0.0f);
+				}
+				for (auto& output : m_output) {
+					std::fill(output.GetData(), output.GetData() + m_size / 2, 0.0f);
+				}
+				m_position = m_size / 2;
+			}
+
+			/// <summary>
+			/// 直前のブロックと合わせて変換し、循環畳み込みの影響がない後半を出力します
+			/// </summary>
+			void ProcessBlock(float* pInput, float* pOutput)
+			{
+				const int block = m_size / 2;
+				float* pReal = m_real.GetData();
+				float* pImag = m_imag.GetData();
+				m_fft.Forward(pInput, pReal, pImag);
+
+				const float* pResponseReal = m_responseReal.GetData();
+				const float* pResponseImag = m_responseImag.GetData();
+				const int bins = GetBins();
+				int k = 0;
+				for (; k + 4 <= bins; k += 4) {
+					const __m128 xr = _mm_load_ps(pReal + k), xi = _mm_load_ps(pImag + k);
+					const __m128 hr = _mm_load_ps(pResponseReal + k), hi = _mm_load_ps(pResponseImag + k);
+					_mm_store_ps(pReal + k, _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi)));
+					_mm_store_ps(pImag + k, _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr)));
+				}
+				for (; k < bins; ++k) {
+					const float xr = pReal[k], xi = pImag[k];
+					pReal[k] = xr * pResponseReal[k] - xi * pResponseImag[k];
+					pImag[k] = xr * pResponseImag[k] + xi * pResponseReal[k];
+				}
+
+				float* pFrame = m_frame.GetData();
+				m_fft.Inverse(pReal, pImag, pFrame);
+				std::memcpy(pOutput, pFrame + block, sizeof(float) * block);
+				std::memcpy(pInput, pInput + block, sizeof(float) * block);
+			}
+
+			int m_size;
+			Utility::RealFft m_fft;
+			Utility::AlignedBuffer<float> m_responseReal;
+			Utility::AlignedBuffer<float> m_responseImag;
+			Utility::AlignedBuffer<float> m_real;
+			Utility::AlignedBuffer<float> m_imag;
+			Utility::AlignedBuffer<float> m_frame;
+			std::vector<Utility::AlignedBuffer<float>> m_input;
+			std::vector<Utility::AlignedBuffer<float>> m_output;
+			int m_position = 0;
+			Detail::AudioContinuity m_continuity;
+		};
+	}
+
+#endif
+}
@@ -0,0 +1,536 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include <algorithm>    // std::min, std::max, std::copy_n
+#include <emmintrin.h>  // SSE2 intrinsics
+#include <list>         // std::list
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr, std::weak_ptr, std::unique_ptr
+#include <string>       // std::wstring
+#include <unordered_map> // std::unordered_map
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Filter プラグイン
+	/// </summary>
+	namespace Filter
+	{
+		/// <summary>
+		/// ラスタライズした 1 文字
+		/// </summary>
+		struct Glyph
+		{
+			/// <summary>
+			/// 幅
+			/// </summary>
+			int Width;
+
+			/// <summary>
+			/// 高さ
+			/// </summary>
+			int Height;
+
+			/// <summary>
+			/// 描画位置から左端までの距離
+			/// </summary>
+			int OffsetX;
+
+			/// <summary>
+			/// ベースラインから上端までの距離 (上方向が正)
+			/// </summary>
+			int OffsetY;
+
+			/// <summary>
+			/// 次の文字までの距離
+			/// </summary>
+			int Advance;
+
+			/// <summary>
+			/// 被覆率 (0 ～ 255、Width × Height)
+			/// </summary>
+			std::vector<unsigned char> Coverage;
+		};
+
+		/// <summary>
+		/// 文字のラスタライザ
+		/// <para>GDI 以外のラスタライザ (FreeType など) を使用する場合は、これを実装して TextFont に渡します。GDI の実装は GdiGlyphRasterizer.h にあります。</para>
+		/// </summary>
+		class GlyphRasterizer
+		{
+		public:
+			virtual ~GlyphRasterizer() = default;
+
+			/// <summary>
+			/// 1 文字をラスタライズします
+			/// </summary>
+			/// <param name="codepoint">文字コード (UTF-16)</param>
+			/// <param name="pGlyph">結果を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			virtual bool Rasterize(unsigned int codepoint, Glyph* pGlyph) = 0;
+
+			/// <summary>
+			/// 行の上端からベースラインまでの距離を取得します
+			/// </summary>
+			virtual int GetAscent() const = 0;
+
+			/// <summary>
+			/// 行の高さを取得します
+			/// </summary>
+			virtual int GetLineHeight() const = 0;
+		};
+
+		/// <summary>
+		/// 文字の被覆率をまとめて保持するアトラス
+		/// <para>固定サイズのページに棚詰めで配置し、ページが埋まると新しいページを追加します。</para>
+		/// </summary>
+		class GlyphAtlas final
+		{
+		public:
+			enum : int {
+				/// <summary>
+				/// ページの幅と高さ
+				/// </summary>
+				PageSize = 1024,
+			};
+
+			/// <summary>
+			/// アトラス上の 1 文字
+			/// </summary>
+			struct Entry
+			{
+				int Page;
+				int X;
+				int Y;
+				int Width;
+				int Height;
+				int OffsetX;
+				int OffsetY;
+				int Advance;
+			};
+
+			/// <summary>
+			/// 文字を検索します
+			/// </summary>
+			/// <param name="codepoint">文字コード</param>
+			/// <returns>
+			/// 文字へのポインタ (nullptr なら未登録)
+			/// </returns>
+			const Entry* Find(unsigned int codepoint) const
+			{
+				const auto it = m_entries.find(codepoint);
+				return it != m_entries.end() ? &it->second : nullptr;
+			}
+
+			/// <summary>
+			/// 文字を登録します
+			/// </summary>
+			/// <param name="codepoint">文字コード</param>
+			/// <param name="glyph">ラスタライズした文字</param>
+			/// <returns>
+			/// 登録した文字へのポインタ
+			/// </returns>
+			const Entry* Insert(unsigned int codepoint, const Glyph& glyph)
+			{
+				Entry entry = { 0, 0, 0, (std::min)(glyph.Width, static_cast<int>(PageSize)), (std::min)(glyph.Height, static_cast<int>(PageSize)),
+					glyph.OffsetX, glyph.OffsetY, glyph.Advance };
+
+				if (entry.Width > 0 && entry.Height > 0) {
+					// 隣の文字と混ざらないように 1 ピクセルの余白を空ける
+					if (m_pages.empty() || m_shelfX + entry.Width > PageSize) {
+						m_shelfX = 0;
+						m_shelfY += m_shelfHeight + 1;
+						m_shelfHeight = 0;
+					}
+					if (m_pages.empty() || m_shelfY + entry.Height > PageSize) {
+						m_pages.emplace_back(static_cast<std::size_t>(PageSize) * PageSize, static_cast<unsigned char>(0));
+						m_shelfX = 0;
+						m_shelfY = 0;
+						m_shelfHeight = 0;
+					}
+					entry.Page = static_cast<int>(m_pages.size()) - 1;
+					entry.X = m_shelfX;
+					entry.Y = m_shelfY;
+					m_shelfX += entry.Width + 1;
+					m_shelfHeight = (std::max)(m_shelfHeight, entry.Height);
+
+					unsigned char* pPage = m_pages.back().data();
+					for (int y = 0; y < entry.Height; ++y) {
+						std::copy_n(glyph.Coverage.data() + static_cast<std::size_t>(y) * glyph.Width, entry.Width,
+							pPage + static_cast<std::size_t>(entry.Y + y) * PageSize + entry.X);
+					}
+				}
+				return &(m_entries[codepoint] = entry);
+			}
+
+			/// <summary>
+			/// 文字の 1 行分の被覆率へのポインタを取得します
+			/// </summary>
+			/// <param name="entry">文字</param>
+			/// <param name="y">文字の中の行</param>
+			const unsigned char* GetRow(const Entry& entry, int y) const
+			{
+				return m_pages[entry.Page].data() + static_cast<std::size_t>(entry.Y + y) * PageSize + entry.X;
+			}
+
+		private:
+			std::unordered_map<unsigned int, Entry> m_entries;
+			std::vector<std::vector<unsigned char>> m_pages;
+			int m_shelfX = 0;
+			int m_shelfY = 0;
+			int m_shelfHeight = 0;
+		};
+
+		/// <summary>
+		/// レイアウト済みの 1 行
+		/// </summary>
+		struct TextLine
+		{
+			/// <summary>
+			/// 幅
+			/// </summary>
+			int Width;
+
+			/// <summary>
+			/// 高さ
+			/// </summary>
+			int Height;
+
+			/// <summary>
+			/// 不透明度 (0 ～ 4096、Width × Height)
+			/// </summary>
+			std::vector<short> Alpha;
+		};
+
+		/// <summary>
+		/// DrawTextYC() の代わりに使用できるテキスト描画
+		/// <para>文字は初回だけラスタライズしてアトラスに保持し、行は被覆率まで合成した状態でキャッシュします。</para>
+		/// <para>同じフォント名、サイズ、太さのフォントは Get() で DLL 内のフィルタ間で共有されます。</para>
+		/// <para>func_proc などのメインスレッドからのみ呼び出してください。</para>
+		/// </summary>
+		class TextFont final
+		{
+		public:
+			enum : std::size_t {
+				/// <summary>
+				/// キャッシュする行数の既定値
+				/// </summary>
+				DefaultLineCacheSize = 256,
+			};
+
+			/// <summary>
+			/// ラスタライザを指定して作成します
+			/// </summary>
+			/// <param name="pRasterizer">ラスタライザ</param>
+			explicit TextFont(std::unique_ptr<GlyphRasterizer> pRasterizer)
+				: m_pRasterizer(std::move(pRasterizer))
+			{
+			}
+
+			TextFont(const TextFont&) = delete;
+			TextFont& operator=(const TextFont&) = delete;
+
+			/// <summary>
+			/// フォントを共有して取得します
+			/// <para>同じキーのフォントが使用中であれば、そのフォント (とキャッシュ) を共有します。使用中でなければ create() で作成します。</para>
+			/// </summary>
+			/// <param name="key">フォントを識別するキー (フォント名、サイズなど)</param>
+			/// <param name="create">ラスタライザを作成する関数</param>
+			/// <returns>
+			/// フォント
+			/// </returns>
+			template<class Create>
+			static std::shared_ptr<TextFont> GetShared(const std::wstring& key, Create&& create)
+			{
+				static std::map<std::wstring, std::weak_ptr<TextFont>> fonts;
+
+				auto& weak = fonts[key];
+				std::shared_ptr<TextFont> font = weak.lock();
+				if (font == nullptr) {
+					font = std::make_shared<TextFont>(std::unique_ptr<GlyphRasterizer>(create()));
+					weak = font;
+				}
+				return font;
+			}
+
+#ifdef _WIN32
+			/// <summary>
+			/// GDI のフォントを取得します (GdiGlyphRasterizer.h で定義)
+			/// <para>同じ条件のフォントが使用中であれば、そのフォント (とキャッシュ) を共有します。</para>
+			/// </summary>
+			/// <param name="pFaceName">フォント名</param>
+			/// <param name="size">文字の高さ (ピクセル)</param>
+			/// <param name="weight">太さ (FW_NORMAL = 400)</param>
+			/// <param name="italic">斜体にするか</param>
+			/// <returns>
+			/// フォント
+			/// </returns>
+			static std::shared_ptr<TextFont> Get(const wchar_t* pFaceName, int size, int weight = 400, bool italic = false);
+#endif
+
+			/// <summary>
+			/// キャッシュする行数を設定します
+			/// </summary>
+			void SetLineCacheSize(std::size_t count)
+			{
+				m_lineCacheSize = (std::max)(count, static_cast<std::size_t>(1));
+				Trim();
+			}
+
+			/// <summary>
+			/// 行の高さを取得します
+			/// </summary>
+			int GetLineHeight() const { return m_pRasterizer->GetLineHeight(); }
+
+			/// <summary>
+			/// 1 行をレイアウトします
+			/// <para>同じ文字列の行はキャッシュから返します。</para>
+			/// </summary>
+			/// <param name="text">文字列 (改行を含まない)</param>
+			/// <returns>
+			/// レイアウト済みの行
+			/// </returns>
+			std::shared_ptr<const TextLine> Layout(const std::wstring& text)
+			{
+				const auto found = m_lines.find(text);
+				if (found != m_lines.end()) {
+					m_order.splice(m_order.begin(), m_order, found->second.Order);
+					return found->second.Line;
+				}
+
+				// 文字の位置を決めてから、被覆率を 1 枚の不透明度に合成する
+				struct Placed { const GlyphAtlas::Entry* pEntry; int X; int Y; };
+				std::vector<Placed> placed;
+				const int ascent = m_pRasterizer->GetAscent();
+				int penX = 0;
+				int left = 0;
+				int right = 0;
+				int bottom = m_pRasterizer->GetLineHeight();
+				for (wchar_t c : text) {
+					const GlyphAtlas::Entry* pEntry = GetEntry(c);
+					if (pEntry == nullptr) {
+						continue;
+					}
+					const Placed p = { pEntry, penX + pEntry->OffsetX, ascent - pEntry->OffsetY };
+					if (pEntry->Width > 0) {
+						placed.push_back(p);
+						left = (std::min)(left, p.X);
+						right = (std::max)(right, p.X + pEntry->Width);
+						bottom = (std::max)(bottom, p.Y + pEntry->Height);
+					}
+					penX += pEntry->Advance;
+				}
+				right = (std::max)(right, penX);
+
+				auto line = std::make_shared<TextLine>();
+				line->Width = right - left;
+				line->Height = bottom;
+				line->Alpha.assign(static_cast<std::size_t>(line->Width) * line->Height, 0);
+				for (const Placed& p : placed) {
+					for (int y = 0; y < p.pEntry->Height; ++y) {
+						const int lineY = p.Y + y;
+						if (lineY < 0) {
+							continue;
+						}
+						const unsigned char* pSrc = m_atlas.GetRow(*p.pEntry, y);
+						short* pDst = line->Alpha.data() + static_cast<std::size_t>(lineY) * line->Width + (p.X - left);
+						for (int x = 0; x < p.pEntry->Width; ++x) {
+							// 重なった部分は 1 - (1 - a)(1 - b) で合成する
+							const int a = (pSrc[x] * 4096 + 127) / 255;
+							pDst[x] = static_cast<short>(a + pDst[x] - ((a * pDst[x] + 2048) >> 12));
+						}
+					}
+				}
+
+				m_order.push_front(text);
+				m_lines[text] = CachedLine{ line, m_order.begin() };
+				Trim();
+				return line;
+			}
+
+			/// <summary>
+			/// 文字列を描画します
+			/// <para>DrawTextYC() と同様に描画先の範囲でクリッピングします。改行で複数行に分けて描画します。</para>
+			/// </summary>
+			/// <param name="pDst">描画先の画像へのポインタ (nullptr ならサイズだけを返します)</param>
+			/// <param name="dstLineSize">描画先の 1 行のバイト数</param>
+			/// <param name="width">描画先の幅</param>
+			/// <param name="height">描画先の高さ</param>
+			/// <param name="x">描画する左上の X 座標</param>
+			/// <param name="y">描画する左上の Y 座標</param>
+			/// <param name="text">文字列</param>
+			/// <param name="color">描画色</param>
+			/// <param name="transparent">透明度 (0 ～ 4096)</param>
+			/// <param name="pWidth">描画したテキスト領域の幅 (nullptr 可)</param>
+			/// <param name="pHeight">描画したテキスト領域の高さ (nullptr 可)</param>
+			void Draw(Pixel_YC* pDst, int dstLineSize, int width, int height, int x, int y, const std::wstring& text,
+				const Pixel_YC& color, int transparent, int* pWidth = nullptr, int* pHeight = nullptr)
+			{
+				const int opacity = 4096 - (std::max)(0, (std::min)(transparent, 4096));
+				int textWidth = 0;
+				int lineY = y;
+				std::size_t begin = 0;
+				while (begin <= text.size()) {
+					std::size_t end = text.find(L'\n', begin);
+					if (end == std::wstring::npos) {
+						end = text.size();
+					}
+					std::size_t last = end;
+					if (last > begin && text[last - 1] == L'\r') {
+						--last;
+					}
+					const std::shared_ptr<const TextLine> line = Layout(text.substr(begin, last - begin));
+					textWidth = (std::max)(textWidth, line->Width);
+					if (pDst != nullptr && opacity > 0) {
+						BlendLine(pDst, dstLineSize, width, height, x, lineY, *line, color, opacity);
+					}
+					lineY += GetLineHeight();
+					begin = end + 1;
+				}
+				if (pWidth != nullptr) {
+					*pWidth = textWidth;
+				}
+				if (pHeight != nullptr) {
+					*pHeight = lineY - y;
+				}
+			}
+
+#ifdef _WIN32
+			/// <summary>
+			/// 文字列 (ANSI) を描画します (GdiGlyphRasterizer.h で定義)
+			/// </summary>
+			void Draw(Pixel_YC* pDst, int dstLineSize, int width, int height, int x, int y, const char* pText,
+				const Pixel_YC& color, int transparent, int* pWidth = nullptr, int* pHeight = nullptr);
+#endif
+
+		private:
+			struct CachedLine
+			{
+				std::shared_ptr<const TextLine> Line;
+				std::list<std::wstring>::iterator Order;
+			};
+
+			/// <summary>
+			/// アトラスから文字を取得します (未登録ならラスタライズします)
+			/// </summary>
+			const GlyphAtlas::Entry* GetEntry(unsigned int codepoint)
+			{
+				const GlyphAtlas::Entry* pEntry = m_atlas.Find(codepoint);
+				if (pEntry != nullptr) {
+					return pEntry;
+				}
+				Glyph glyph;
+				if (!m_pRasterizer->Rasterize(codepoint, &glyph)) {
+					return nullptr;
+				}
+				return m_atlas.Insert(codepoint, glyph);
+			}
+
+			/// <summary>
+			/// 古い行をキャッシュから破棄します
+			/// </summary>
+			void Trim()
+			{
+				while (m_order.size() > m_lineCacheSize) {
+					m_lines.erase(m_order.back());
+					m_order.pop_back();
+				}
+			}
+
+			/// <summary>
+			/// 1 行を描画色で合成します
+			/// </summary>
+			static void BlendLine(Pixel_YC* pDst, int dstLineSize, int width, int height, int x, int y,
+				const TextLine& line, const Pixel_YC& color, int opacity)
+			{
+				const int left = (std::max)(x, 0);
+				const int top = (std::max)(y, 0);
+				const int right = (std::min)(x + line.Width, width);
+				const int bottom = (std::min)(y + line.Height, height);
+				if (left >= right || top >= bottom) {
+					return;
+				}
+
+				alignas(16) short color3[24];
+				for (int i = 0; i < 8; ++i) {
+					color3[i * 3 + 0] = color.Y;
+					color3[i * 3 + 1] = color.Cb;
+					color3[i * 3 + 2] = color.Cr;
+				}
+				alignas(16) short alpha3[24];
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i scale = _mm_set1_epi16(static_cast<short>(opacity << 1));
+				const __m128i round = _mm_set1_epi32(2048);
+				const int count = right - left;
+
+				for (int row = top; row < bottom; ++row) {
+					const short* pAlpha = line.Alpha.data() + static_cast<std::size_t>(row - y) * line.Width + (left - x);
+					short* d = reinterpret_cast<short*>(reinterpret_cast<unsigned char*>(pDst) + static_cast<std::size_t>(row) * dstLineSize) + left * 3;
+
+					int i = 0;
+					for (; i + 8 <= count; i += 8) {
+						__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAlpha + i));
+						if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero)) == 0xffff) {
+							continue;
+						}
+						// (a << 3) * (opacity << 1) >> 16 = a * opacity / 4096
+						a = _mm_mulhi_epu16(_mm_slli_epi16(a, 3), scale);
+						alignas(16) short alpha[8];
+						_mm_store_si128(reinterpret_cast<__m128i*>(alpha), a);
+						for (int p = 0; p < 8; ++p) {
+							alpha3[p * 3 + 0] = alpha[p];
+							alpha3[p * 3 + 1] = alpha[p];
+							alpha3[p * 3 + 2] = alpha[p];
+						}
+						for (int k = 0; k < 24; k += 8) {
+							const __m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i * 3 + k));
+							const __m128i src = _mm_load_si128(reinterpret_cast<const __m128i*>(color3 + k));
+							const __m128i weight = _mm_load_si128(reinterpret_cast<const __m128i*>(alpha3 + k));
+							const __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(4096), weight);
+							__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(dst, src), _mm_unpacklo_epi16(inverse, weight));
+							__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(dst, src), _mm_unpackhi_epi16(inverse, weight));
+							lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 12);
+							hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 12);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 3 + k), _mm_packs_epi32(lo, hi));
+						}
+					}
+					for (; i < count; ++i) {
+						const int a = (pAlpha[i] * opacity) >> 12;
+						if (a == 0) {
+							continue;
+						}
+						for (int c = 0; c < 3; ++c) {
+							const int dst = d[i * 3 + c];
+							d[i * 3 + c] = static_cast<short>((dst * (4096 - a) + color3[c] * a + 2048) >> 12);
+						}
+					}
+				}
+			}
+
+			std::unique_ptr<GlyphRasterizer> m_pRasterizer;
+			GlyphAtlas m_atlas;
+			std::unordered_map<std::wstring, CachedLine> m_lines;
+			std::list<std::wstring> m_order;
+			std::size_t m_lineCacheSize = DefaultLineCacheSize;
+		};
+	}
+
+#endif
+}
+
+#ifdef _WIN32
+#include "GdiGlyphRasterizer.h"
+#endif
@@ -0,0 +1,150 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <cctype>       // std::isdigit
+#include <cstdlib>      // std::atoi, std::atof
+#include <string>       // std::string
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// 入力プラグイン
+	/// </summary>
+	namespace Input
+	{
+		/// <summary>
+		/// ファイル名の解析
+		/// <para>入力プラグインがファイル名から拡張子や解像度、フレームレートを取得するために使用します。</para>
+		/// </summary>
+		namespace FileName
+		{
+			/// <summary>
+			/// ディレクトリ部分 (末尾の区切り文字を含む) を取得します
+			/// </summary>
+			/// <param name="name">ファイル名</param>
+			/// <returns>
+			/// ディレクトリ部分 (無ければ空文字列)
+			/// </returns>
+			inline std::string GetDirectory(const std::string& name)
+			{
+				const std::size_t separator = name.find_last_of("\\/");
+				return separator == std::string::npos ? std::string() : name.substr(0, separator + 1);
+			}
+
+			/// <summary>
+			/// ディレクトリ部分を除いたファイル名を取得します
+			/// </summary>
+			/// <param name="name">ファイル名</param>
+			/// <returns>
+			/// ディレクトリ部分を除いたファイル名
+			/// </returns>
+			inline std::string GetBaseName(const std::string& name)
+			{
+				const std::size_t separator = name.find_last_of("\\/");
+				return separator == std::string::npos ? name : name.substr(separator + 1);
+			}
+
+			/// <summary>
+			/// 文字列を小文字にします (ASCII のみ)
+			/// </summary>
+			inline std::string ToLower(std::string text)
+			{
+				for (char& c : text) {
+					if (c >= 'A' && c <= 'Z') {
+						c = static_cast<char>(c - 'A' + 'a');
+					}
+				}
+				return text;
+			}
+
+			/// <summary>
+			/// 小文字にした拡張子 (ドットを含む) を取得します
+			/// </summary>
+			/// <param name="name">ファイル名</param>
+			/// <returns>
+			/// 拡張子 (無ければ空文字列)
+			/// </returns>
+			inline std::string GetExtension(const std::string& name)
+			{
+				const std::size_t dot = name.find_last_of('.');
+				const std::size_t separator = name.find_last_of("\\/");
+				if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+					return std::string();
+				}
+				return ToLower(name.substr(dot));
+			}
+
+			/// <summary>
+			/// ファイル名に含まれる "1920x1080" のような解像度を取得します
+			/// </summary>
+			/// <param name="name">ファイル名</param>
+			/// <param name="pWidth">幅を格納するポインタ</param>
+			/// <param name="pHeight">高さを格納するポインタ</param>
+			/// <returns>
+			/// true なら解像度が見つかった
+			/// </returns>
+			inline bool ParseResolution(const std::string& name, int* pWidth, int* pHeight)
+			{
+				const std::string base = GetBaseName(name);
+				for (std::size_t i = 1; i + 1 < base.size(); ++i) {
+					if (base[i] == 'x' && std::isdigit(static_cast<unsigned char>(base[i - 1])) && std::isdigit(static_cast<unsigned char>(base[i + 1]))) {
+						std::size_t begin = i;
+						while (begin > 0 && std::isdigit(static_cast<unsigned char>(base[begin - 1]))) {
+							--begin;
+						}
+						*pWidth = std::atoi(base.c_str() + begin);
+						*pHeight = std::atoi(base.c_str() + i + 1);
+						return true;
+					}
+				}
+				return false;
+			}
+
+			/// <summary>
+			/// ファイル名に含まれる "29.97fps" のようなフレームレートを取得します
+			/// <para>29.97 / 59.94 / 23.976 は NTSC 系の分数 (30000/1001 など) として扱います。</para>
+			/// </summary>
+			/// <param name="name">ファイル名</param>
+			/// <param name="pRate">フレームレートを格納するポインタ</param>
+			/// <param name="pScale">フレームレートの分母を格納するポインタ</param>
+			/// <returns>
+			/// true ならフレームレートが見つかった
+			/// </returns>
+			inline bool ParseFrameRate(const std::string& name, int* pRate, int* pScale)
+			{
+				const std::string base = ToLower(GetBaseName(name));
+				const std::size_t fps = base.find("fps");
+				if (fps == std::string::npos || fps == 0) {
+					return false;
+				}
+
+				std::size_t begin = fps;
+				while (begin > 0 && (std::isdigit(static_cast<unsigned char>(base[begin - 1])) || base[begin - 1] == '.')) {
+					--begin;
+				}
+				const double value = std::atof(base.substr(begin, fps - begin).c_str());
+				if (value <= 0.0) {
+					return false;
+				}
+
+				const double ntsc = value * 1001.0 / 1000.0;
+				const int rounded = static_cast<int>(ntsc + 0.5);
+				if (ntsc - rounded < 0.01 && rounded - ntsc < 0.01 && static_cast<int>(value + 0.5) != static_cast<int>(value)) {
+					*pRate = rounded * 1000;
+					*pScale = 1001;
+				}
+				else {
+					*pRate = static_cast<int>(value * 1000.0 + 0.5);
+					*pScale = 1000;
+				}
+				return true;
+			}
+		}
+	}
+}
@@ -0,0 +1,505 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/File.h"
+#include "../Utility/ImageFile.h"
+#include "../Utility/ThreadPool.h"
+#include "FileName.h"
+#include <windows.h>
+#include <cstdlib>      // std::strtoll
+#include <cstring>      // std::memcpy
+#include <future>       // std::shared_future
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr, std::make_shared, std::unique_ptr
+#include <mutex>        // std::mutex, std::lock_guard
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Input プラグイン
+	/// </summary>
+	namespace Input
+	{
+		/// <summary>
+		/// 連番画像入力プラグイン (BMP / PNG / TGA)
+		/// <para>"image0001.png" のようにファイル名の末尾に番号を持つ画像を開くと、同じフォルダにある連続した番号の画像を 1 本の動画として読み込みます。</para>
+		/// <para>デコードはスレッドプールで並列に行い、再生方向に合わせて数フレーム先まで先読みします。</para>
+		/// <para>フレームレートはファイル名に "29.97fps" のような指定があればそれを、無ければ Settings の値を使用します。</para>
+		/// </summary>
+		namespace ImageSequenceInput
+		{
+			/// <summary>
+			/// プラグイン名
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(PluginName, "Image Sequence Reader");
+
+			/// <summary>
+			/// 入力ファイルフィルタ
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(FileFilter, "Image Sequence (*.bmp;*.png;*.tga)\0*.bmp;*.png;*.tga\0");
+
+			/// <summary>
+			/// プラグインの情報
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(PluginInformation, "Image Sequence Reader version 1.00");
+
+			/// <summary>
+			/// 動作設定
+			/// <para>GetPluginTable() を返す前に変更してください。</para>
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// 既定のフレームレート
+				/// </summary>
+				int Rate = 30;
+
+				/// <summary>
+				/// 既定のフレームレートの分母
+				/// </summary>
+				int Scale = 1;
+
+				/// <summary>
+				/// 先読みするフレーム数 (0 なら先読みしない)
+				/// </summary>
+				int ReadAhead = 8;
+
+				/// <summary>
+				/// デコードに使用するスレッド数 (0 なら論理プロセッサ数)
+				/// </summary>
+				int ThreadNum = 0;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			inline Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// 内部処理
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// デコード用のスレッドプールを取得します
+				/// <para>プラグインの終了時 (Exit) に停止します。</para>
+				/// </summary>
+				inline Utility::ThreadPool& GetDecodePool()
+				{
+					static Utility::ThreadPool pool(GetSettings().ThreadNum);
+					return pool;
+				}
+
+				/// <summary>
+				/// DIB (24bit、ボトムアップ) の 1 行のバイト数を取得します
+				/// </summary>
+				inline std::size_t GetDibStride(int width)
+				{
+					return (static_cast<std::size_t>(width) * 3 + 3) & ~static_cast<std::size_t>(3);
+				}
+
+				/// <summary>
+				/// 画像ファイルを読み込み、24bit DIB に変換します
+				/// </summary>
+				/// <param name="name">ファイル名</param>
+				/// <param name="width">期待する幅 (0 なら確認しない)</param>
+				/// <param name="height">期待する高さ (0 なら確認しない)</param>
+				/// <param name="pImage">デコードした画像を格納するポインタ (幅と高さの取得用、nullptr 可)</param>
+				/// <returns>
+				/// DIB のデータ (失敗した場合は nullptr)
+				/// </returns>
+				inline std::shared_ptr<const std::vector<unsigned char>> LoadDib(const std::string& name, int width, int height, Utility::DecodedImage* pImage = nullptr)
+				{
+					try {
+						Utility::DecodedImage image;
+						if (!Utility::ImageDecoder::LoadFile(name.c_str(), &image)) {
+							return nullptr;
+						}
+						if ((width != 0 && image.Width != width) || (height != 0 && image.Height != height)) {
+							// 途中で解像度が変わる連番は未対応
+							return nullptr;
+						}
+
+						const std::size_t stride = GetDibStride(image.Width);
+						auto pDib = std::make_shared<std::vector<unsigned char>>(stride * image.Height, static_cast<unsigned char>(0));
+						for (int y = 0; y < image.Height; ++y) {
+							const unsigned char* pSrc = image.Pixels.data() + static_cast<std::size_t>(y) * image.Width * 4;
+							unsigned char* pDst = pDib->data() + static_cast<std::size_t>(image.Height - 1 - y) * stride;
+							for (int x = 0; x < image.Width; ++x, pSrc += 4, pDst += 3) {
+								pDst[0] = pSrc[0];
+								pDst[1] = pSrc[1];
+								pDst[2] = pSrc[2];
+							}
+						}
+						if (pImage != nullptr) {
+							pImage->Width = image.Width;
+							pImage->Height = image.Height;
+							pImage->HasAlpha = image.HasAlpha;
+						}
+						return pDib;
+					}
+					catch (...) {
+						// 巨大な画像でメモリを確保できない場合など
+						return nullptr;
+					}
+				}
+
+				/// <summary>
+				/// 指定したファイルから始まる連番画像のファイル名を列挙します
+				/// <para>ファイル名の拡張子の直前の数字を番号とし、番号が途切れるまでを 1 本の連番とします。</para>
+				/// <para>桁数の違い ("img9.png" と "img10.png") や大文字小文字の違いは許容します。</para>
+				/// </summary>
+				/// <param name="name">最初のファイル名</param>
+				/// <param name="pFiles">ファイル名を格納するポインタ</param>
+				/// <returns>
+				/// true なら成功 (番号を持たないファイルは 1 枚の静止画として扱います)
+				/// </returns>
+				inline bool EnumerateSequence(const std::string& name, std::vector<std::string>* pFiles)
+				{
+					pFiles->clear();
+
+					const std::string directory = FileName::GetDirectory(name);
+					const std::string base = FileName::GetBaseName(name);
+					const std::string extension = FileName::GetExtension(base);
+					const std::string stem = base.substr(0, base.size() - extension.size());
+
+					std::size_t digits = stem.size();
+					while (digits > 0 && stem[digits - 1] >= '0' && stem[digits - 1] <= '9') {
+						--digits;
+					}
+					if (digits == stem.size() || stem.size() - digits > 18) {
+						pFiles->push_back(name);
+						return true;
+					}
+					const std::string prefix = stem.substr(0, digits);
+					const std::string lowerPrefix = FileName::ToLower(prefix);
+					const long long first = std::strtoll(stem.c_str() + digits, nullptr, 10);
+
+					// 同じ接頭辞と拡張子を持つファイルを番号順に集めます
+					std::map<long long, std::string> numbered;
+					WIN32_FIND_DATAA data = {};
+					HANDLE hFind = ::FindFirstFileA((directory + prefix + "*" + extension).c_str(), &data);
+					if (hFind != INVALID_HANDLE_VALUE) {
+						do {
+							if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+								continue;
+							}
+							const std::string found(data.cFileName);
+							if (found.size() <= prefix.size() + extension.size()
+								|| FileName::ToLower(found.substr(0, prefix.size())) != lowerPrefix
+								|| FileName::GetExtension(found) != extension) {
+								continue;
+							}
+							const std::string number = found.substr(prefix.size(), found.size() - prefix.size() - extension.size());
+							if (number.size() > 18 || number.find_first_not_of("0123456789") != std::string::npos) {
+								continue;
+							}
+							numbered.emplace(std::strtoll(number.c_str(), nullptr, 10), directory + found);
+						} while (::FindNextFileA(hFind, &data));
+						::FindClose(hFind);
+					}
+
+					// 開いたファイル自身は必ず先頭にします
+					pFiles->push_back(name);
+					for (auto it = numbered.find(first + 1); it != numbered.end() && it->first == first + static_cast<long long>(pFiles->size()); ++it) {
+						if (pFiles->size() >= 0x7FFFFFFF) {
+							break;
+						}
+						pFiles->push_back(it->second);
+					}
+					return true;
+				}
+			}
+
+			/// <summary>
+			/// 入力ファイル (連番画像) の状態
+			/// </summary>
+			class Source final
+			{
+			public:
+				Source() = default;
+
+				~Source()
+				{
+					// 実行待ちの先読みタスクを破棄させます (タスクは共有状態のみを参照します)
+					std::lock_guard<std::mutex> lock(m_pShared->Mutex);
+					m_pShared->Closed = true;
+				}
+
+				Source(const Source&) = delete;
+				Source& operator=(const Source&) = delete;
+
+				/// <summary>
+				/// 入力ファイルを開きます
+				/// </summary>
+				/// <param name="pFileName">ファイル名</param>
+				/// <returns>
+				/// true なら成功
+				/// </returns>
+				bool Open(const char* pFileName)
+				{
+					const std::string name(pFileName);
+					if (!Detail::EnumerateSequence(name, &m_files) || m_files.empty()) {
+						return false;
+					}
+
+					// 先頭のフレームから解像度を取得します (デコード結果はそのままキャッシュします)
+					Utility::DecodedImage image;
+					auto pFirst = Detail::LoadDib(m_files[0], 0, 0, &image);
+					if (pFirst == nullptr) {
+						return false;
+					}
+					m_width = image.Width;
+					m_height = image.Height;
+					std::promise<Dib> promise;
+					promise.set_value(pFirst);
+					m_cache.emplace(0, promise.get_future().share());
+
+					m_rate = GetSettings().Rate;
+					m_scale = GetSettings().Scale;
+					FileName::ParseFrameRate(name, &m_rate, &m_scale);
+
+					m_format = InputInfo::BitmapInfoHeader();
+					m_format.biSize = sizeof(m_format);
+					m_format.biWidth = m_width;
+					m_format.biHeight = m_height;
+					m_format.biPlanes = 1;
+					m_format.biBitCount = 24;
+					m_format.biCompression = 0;
+					m_format.biSizeImage = static_cast<unsigned long>(Detail::GetDibStride(m_width) * m_height);
+					return true;
+				}
+
+				/// <summary>
+				/// ファイルの情報を取得します
+				/// </summary>
+				/// <param name="pInputInfo">情報を格納するポインタ</param>
+				void GetInfo(InputInfo* pInputInfo)
+				{
+					*pInputInfo = InputInfo();
+					pInputInfo->Flag |= InputInfo::InfoFlag::Video | InputInfo::InfoFlag::VideoRandomAccess;
+					pInputInfo->Rate = m_rate;
+					pInputInfo->Scale = m_scale;
+					pInputInfo->Frame_Total = static_cast<int>(m_files.size());
+					pInputInfo->pFormat = &m_format;
+					pInputInfo->Format_Size = sizeof(m_format);
+					pInputInfo->Handler = m_format.biCompression;
+				}
+
+				/// <summary>
+				/// 画像データを読み込みます
+				/// </summary>
+				/// <param name="frame">読み込むフレーム番号</param>
+				/// <param name="pBuffer">データを読み込むバッファへのポインタ</param>
+				/// <returns>
+				/// 読み込んだデータのバイト数 (失敗した場合は 0)
+				/// </returns>
+				int ReadVideo(int frame, void* pBuffer)
+				{
+					if (frame < 0 || frame >= static_cast<int>(m_files.size())) {
+						return 0;
+					}
+
+					std::shared_future<Dib> future;
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						UpdateWindow(frame);
+						future = Request(frame);
+
+						// 再生方向に先読みします
+						const int readAhead = GetSettings().ReadAhead;
+						for (int i = 1; i <= readAhead; ++i) {
+							const int next = frame + i * m_direction;
+							if (next < 0 || next >= static_cast<int>(m_files.size())) {
+								break;
+							}
+							Request(next);
+						}
+					}
+
+					Dib pDib = future.get();
+					if (pDib == nullptr) {
+						// 先読みが破棄されていた場合は、この場で読み込みます
+						pDib = Detail::LoadDib(m_files[frame], m_width, m_height);
+						if (pDib == nullptr) {
+							return 0;
+						}
+					}
+					std::memcpy(pBuffer, pDib->data(), pDib->size());
+					return static_cast<int>(pDib->size());
+				}
+
+			private:
+				using Dib = std::shared_ptr<const std::vector<unsigned char>>;
+
+				/// <summary>
+				/// 先読みタスクと共有する状態
+				/// </summary>
+				struct Shared final
+				{
+					std::mutex Mutex;
+					int Begin = 0;
+					int End = 0;
+					bool Closed = false;
+				};
+
+				/// <summary>
+				/// 再生方向とキャッシュを保持する範囲を更新し、範囲外のフレームを破棄します
+				/// </summary>
+				void UpdateWindow(int frame)
+				{
+					if (frame != m_lastFrame) {
+						m_direction = frame < m_lastFrame ? -1 : 1;
+					}
+					m_lastFrame = frame;
+
+					// 逆方向にも 1 フレームだけ残し、コマ送りの往復でデコードし直さないようにします
+					const int readAhead = GetSettings().ReadAhead;
+					const int begin = m_direction > 0 ? frame - 1 : frame - readAhead;
+					const int end = m_direction > 0 ? frame + readAhead : frame + 1;
+					{
+						std::lock_guard<std::mutex> lock(m_pShared->Mutex);
+						m_pShared->Begin = begin;
+						m_pShared->End = end;
+					}
+					for (auto it = m_cache.begin(); it != m_cache.end();) {
+						if (it->first < begin || it->first > end) {
+							it = m_cache.erase(it);
+						}
+						else {
+							++it;
+						}
+					}
+				}
+
+				/// <summary>
+				/// フレームのデコード結果を取得します (キャッシュに無ければデコードを投入します)
+				/// </summary>
+				std::shared_future<Dib> Request(int frame)
+				{
+					auto it = m_cache.find(frame);
+					if (it != m_cache.end()) {
+						return it->second;
+					}
+
+					std::shared_ptr<Shared> pShared = m_pShared;
+					const std::string name = m_files[frame];
+					const int width = m_width;
+					const int height = m_height;
+					std::shared_future<Dib> future = Detail::GetDecodePool().Submit([pShared, name, width, height, frame]() -> Dib {
+						{
+							// 実行を待つ間に範囲外になったフレームはデコードしません
+							std::lock_guard<std::mutex> lock(pShared->Mutex);
+							if (pShared->Closed || frame < pShared->Begin || frame > pShared->End) {
+								return nullptr;
+							}
+						}
+						return Detail::LoadDib(name, width, height);
+					}).share();
+					m_cache.emplace(frame, future);
+					return future;
+				}
+
+				std::vector<std::string> m_files;
+				int m_width = 0;
+				int m_height = 0;
+				int m_rate = 0;
+				int m_scale = 0;
+				InputInfo::BitmapInfoHeader m_format = {};
+
+				// キャッシュと先読み
+				std::map<int, std::shared_future<Dib>> m_cache;
+				std::shared_ptr<Shared> m_pShared = std::make_shared<Shared>();
+				int m_lastFrame = 0;
+				int m_direction = 1;
+				std::mutex m_mutex;
+			};
+
+			namespace Detail
+			{
+				inline int Exit()
+				{
+					// DLL のアンロード時 (ローダーロック中) にスレッドを join するとデッドロックするため、ここで停止します
+					GetDecodePool().Shutdown();
+					return 1;
+				}
+
+				inline InputPluginTable::InputHandle Open(char* pFile)
+				{
+					try {
+						std::unique_ptr<Source> pSource(new Source());
+						if (!pSource->Open(pFile)) {
+							return nullptr;
+						}
+						return pSource.release();
+					}
+					catch (...) {
+						return nullptr;
+					}
+				}
+
+				inline int Close(InputPluginTable::InputHandle hInput)
+				{
+					delete static_cast<Source*>(hInput);
+					return 1;
+				}
+
+				inline int GetInfo(InputPluginTable::InputHandle hInput, InputInfo* pInputInfo)
+				{
+					static_cast<Source*>(hInput)->GetInfo(pInputInfo);
+					return 1;
+				}
+
+				inline int ReadVideo(InputPluginTable::InputHandle hInput, int frame, void* pBuffer)
+				{
+					return static_cast<Source*>(hInput)->ReadVideo(frame, pBuffer);
+				}
+			}
+
+			/// <summary>
+			/// 入力プラグインテーブルを取得します
+			/// <para>GetInputPluginTable() からこの参照を返してください。</para>
+			/// </summary>
+			/// <returns>
+			/// 入力プラグインテーブル構造体の参照
+			/// </returns>
+			inline InputPluginTable& GetPluginTable()
+			{
+				static InputPluginTable table = []() {
+					InputPluginTable t = {};
+					t.Flag = InputPluginTable::PluginFlag::Video;
+					t.pName = const_cast<char*>(PluginNameA);
+					t.pFileFilter = const_cast<char*>(FileFilterA);
+					t.pInformation = const_cast<char*>(PluginInformationA);
+					t.Exit = Detail::Exit;
+					t.Open = Detail::Open;
+					t.Close = Detail::Close;
+					t.GetInfo = Detail::GetInfo;
+					t.ReadVideo = Detail::ReadVideo;
+					return t;
+				}();
+				return table;
+			}
+		}
+	}
+
+#endif
+}
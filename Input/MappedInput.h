@@ -0,0 +1,882 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/File.h"
+#include "../Utility/FourCC.h"
+#include "../Utility/Simd.h"
+#include "FileName.h"
+#include "SidecarIndex.h"
+#include <cstdlib>      // std::atoi, std::strtol
+#include <cstring>      // std::memchr, std::memcmp, std::memcpy, std::strncmp
+#include <memory>       // std::unique_ptr
+#include <mutex>        // std::mutex, std::lock_guard
+#include <string>       // std::string
+#include <utility>      // std::move
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Input プラグイン
+	/// </summary>
+	namespace Input
+	{
+		/// <summary>
+		/// メモリマップ入力プラグイン (Y4M / RAW / WAV)
+		/// <para>ファイルをメモリマップし、マップしたデータから出力バッファへ 1 回の変換で直接書き込みます。</para>
+		/// <para>Y4M は 8bit の 4:2:0 / 4:2:2 / 4:4:4 / mono に対応します。</para>
+		/// <para>RAW (.yuv) は 8bit 4:2:0 (I420) で、ファイル名に "1920x1080" のような解像度と、任意で "29.97fps" のようなフレームレートを含めてください。</para>
+		/// <para>同じフォルダに同名の .wav (PCM) があれば音声として読み込みます。.wav を直接開いた場合は音声のみになります。</para>
+		/// <para>Y4M のフレームオフセット表はサイドカー索引 (SidecarIndex) に保存され、2回目以降のオープンではスキャンしません。</para>
+		/// </summary>
+		namespace MappedInput
+		{
+			/// <summary>
+			/// プラグイン名
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(PluginName, "Mapped Y4M/RAW Reader");
+
+			/// <summary>
+			/// 入力ファイルフィルタ
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(FileFilter, "Y4M/RAW/WAV (*.y4m;*.yuv;*.wav)\0*.y4m;*.yuv;*.wav\0");
+
+			/// <summary>
+			/// プラグインの情報
+			/// </summary>
+			AU_DECLARE_CONSTANT_STRING(PluginInformation, "Mapped Y4M/RAW Reader version 1.00");
+
+			/// <summary>
+			/// 動作設定
+			/// <para>GetPluginTable() を返す前に変更してください。</para>
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// YUY2 で出力する (false なら Pixel_YC 形式)
+				/// <para>YUY2フィルタモードでは Pixel_YC 形式を使用出来ないため、true にしてください。</para>
+				/// <para>幅が奇数の場合は常に Pixel_YC 形式で出力します。</para>
+				/// </summary>
+				bool OutputYUY2 = false;
+
+				/// <summary>
+				/// 映像のマップ窓のサイズ
+				/// <para>1 フレームの方が大きい場合はフレームごとにマップします。</para>
+				/// </summary>
+				std::size_t WindowSize = Utility::MappedWindow::DefaultWindowSize;
+
+				/// <summary>
+				/// 音声のマップ窓のサイズ
+				/// <para>音声は 1 回の読み込みが小さいため、映像より小さくしています。</para>
+				/// </summary>
+				std::size_t AudioWindowSize = 1024 * 1024;
+
+				/// <summary>
+				/// Y4M のフレームオフセット表をサイドカーファイルに保存する
+				/// </summary>
+				bool UseSidecarIndex = true;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			inline Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// 色差のサブサンプリング形式
+			/// </summary>
+			enum class ChromaFormat : int {
+				/// <summary>
+				/// 輝度のみ
+				/// </summary>
+				Mono,
+
+				/// <summary>
+				/// 4:2:0
+				/// </summary>
+				Yuv420,
+
+				/// <summary>
+				/// 4:2:2
+				/// </summary>
+				Yuv422,
+
+				/// <summary>
+				/// 4:4:4
+				/// </summary>
+				Yuv444,
+			};
+
+			/// <summary>
+			/// 内部処理
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// 8bit の輝度を Pixel_YC の輝度に変換します (AviUtl の YUY2 → Pixel_YC 変換と同じ式)
+				/// </summary>
+				inline short ToYC_Y(int y) { return static_cast<short>(((y * 1197) >> 6) - 299); }
+
+				/// <summary>
+				/// 8bit の色差を Pixel_YC の色差に変換します (AviUtl の YUY2 → Pixel_YC 変換と同じ式)
+				/// </summary>
+				inline short ToYC_C(int c) { return static_cast<short>(((c - 128) * 4681 + 164) >> 8); }
+
+				/// <summary>
+				/// 4byte をアライメントを気にせず読み込みます
+				/// </summary>
+				inline int Load4(const unsigned char* p)
+				{
+					int value;
+					std::memcpy(&value, p, sizeof(value));
+					return value;
+				}
+
+				/// <summary>
+				/// 1 行分のプレーン情報
+				/// </summary>
+				struct PlaneRow final
+				{
+					/// <summary>
+					/// 輝度の行
+					/// </summary>
+					const unsigned char* pY;
+
+					/// <summary>
+					/// 色差(青)の行 (Mono なら NULL)
+					/// </summary>
+					const unsigned char* pU;
+
+					/// <summary>
+					/// 色差(赤)の行 (Mono なら NULL)
+					/// </summary>
+					const unsigned char* pV;
+
+					/// <summary>
+					/// 画素数
+					/// </summary>
+					int Width;
+
+					/// <summary>
+					/// 色差の画素数
+					/// </summary>
+					int ChromaWidth;
+
+					/// <summary>
+					/// 色差のサブサンプリング形式
+					/// </summary>
+					ChromaFormat Chroma;
+				};
+
+				/// <summary>
+				/// 1 画素分の 8bit 色差を取得します
+				/// <para>水平方向に間引かれている場合、奇数画素は隣接画素の平均 (_mm_avg_epu8 と同じ丸め) です。</para>
+				/// </summary>
+				inline int GetChroma(const unsigned char* pC, const PlaneRow& row, int x)
+				{
+					switch (row.Chroma) {
+					case ChromaFormat::Mono:
+						return 128;
+					case ChromaFormat::Yuv444:
+						return pC[x];
+					default:
+						break;
+					}
+					const int cx = x >> 1;
+					if ((x & 1) == 0) {
+						return pC[cx];
+					}
+					const int nx = cx + 1 < row.ChromaWidth ? cx + 1 : row.ChromaWidth - 1;
+					return (pC[cx] + pC[nx] + 1) >> 1;
+				}
+
+				/// <summary>
+				/// 1 行を Pixel_YC 形式に変換します (スカラー版)
+				/// </summary>
+				inline void ConvertRowYC48_Scalar(const PlaneRow& row, Filter::Pixel_YC* pDst, int begin)
+				{
+					for (int x = begin; x < row.Width; ++x) {
+						pDst[x].Y = ToYC_Y(row.pY[x]);
+						pDst[x].Cb = ToYC_C(GetChroma(row.pU, row, x));
+						pDst[x].Cr = ToYC_C(GetChroma(row.pV, row, x));
+					}
+				}
+
+				/// <summary>
+				/// 8画素分の 8bit 色差を 16bit に展開します (SSE2)
+				/// </summary>
+				inline __m128i LoadChroma8(const unsigned char* pC, const PlaneRow& row, int x)
+				{
+					const __m128i zero = _mm_setzero_si128();
+					switch (row.Chroma) {
+					case ChromaFormat::Mono:
+						return _mm_set1_epi16(128);
+					case ChromaFormat::Yuv444:
+						return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pC + x)), zero);
+					default:
+						break;
+					}
+					const int cx = x >> 1;
+					const __m128i even = _mm_cvtsi32_si128(Load4(pC + cx));
+					const __m128i odd = _mm_avg_epu8(even, _mm_cvtsi32_si128(Load4(pC + cx + 1)));
+					return _mm_unpacklo_epi8(_mm_unpacklo_epi8(even, odd), zero);
+				}
+
+				/// <summary>
+				/// 16bit の 8bit 値 8 要素を、係数ペア (乗数, 加算値) で変換して右シフトします (SSE2)
+				/// </summary>
+				template<int Shift>
+				inline __m128i MulAddShift(__m128i value, __m128i coefficient)
+				{
+					const __m128i one = _mm_set1_epi16(1);
+					const __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(value, one), coefficient), Shift);
+					const __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(value, one), coefficient), Shift);
+					return _mm_packs_epi32(lo, hi);
+				}
+
+				/// <summary>
+				/// 1 行を Pixel_YC 形式に変換します (SSSE3)
+				/// </summary>
+				inline void ConvertRowYC48_SSSE3(const PlaneRow& row, Filter::Pixel_YC* pDst)
+				{
+					// (y * 1197 - 299 * 64) >> 6, ((c - 128) * 4681 + 164) >> 8
+					const __m128i yCoefficient = _mm_setr_epi16(1197, -19136, 1197, -19136, 1197, -19136, 1197, -19136);
+					const __m128i cCoefficient = _mm_setr_epi16(4681, 164, 4681, 164, 4681, 164, 4681, 164);
+					const __m128i bias = _mm_set1_epi16(128);
+					const __m128i zero = _mm_setzero_si128();
+
+					// 色差を隣接画素と補間する場合は cx + 4 まで読むため、その分を末尾から除きます
+					int end = row.Width & ~7;
+					if (row.Chroma == ChromaFormat::Yuv420 || row.Chroma == ChromaFormat::Yuv422) {
+						while (end > 0 && (end >> 1) + 1 > row.ChromaWidth) {
+							end -= 8;
+						}
+					}
+
+					int x = 0;
+					for (; x < end; x += 8) {
+						const __m128i y8 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.pY + x)), zero);
+						const __m128i y = MulAddShift<6>(y8, yCoefficient);
+						const __m128i cb = MulAddShift<8>(_mm_sub_epi16(LoadChroma8(row.pU, row, x), bias), cCoefficient);
+						const __m128i cr = MulAddShift<8>(_mm_sub_epi16(LoadChroma8(row.pV, row, x), bias), cCoefficient);
+						Utility::Simd::StoreYC8(pDst + x, y, cb, cr);
+					}
+					ConvertRowYC48_Scalar(row, pDst, x);
+				}
+
+				/// <summary>
+				/// 1 行を YUY2 形式に変換します (スカラー版)
+				/// </summary>
+				inline void ConvertRowYUY2_Scalar(const PlaneRow& row, unsigned char* pDst, int begin)
+				{
+					for (int x = begin; x + 1 < row.Width; x += 2) {
+						const int cx = row.Chroma == ChromaFormat::Yuv444 ? x : x >> 1;
+						pDst[x * 2 + 0] = row.pY[x];
+						pDst[x * 2 + 1] = row.Chroma == ChromaFormat::Mono ? 128 : row.pU[cx];
+						pDst[x * 2 + 2] = row.pY[x + 1];
+						pDst[x * 2 + 3] = row.Chroma == ChromaFormat::Mono ? 128 : row.pV[cx];
+					}
+				}
+
+				/// <summary>
+				/// 1 行を YUY2 形式に変換します (SSE2)
+				/// <para>4:4:4 の色差は偶数画素の値を使用します (YUY2 の色差位置と同じ)。</para>
+				/// </summary>
+				inline void ConvertRowYUY2_SSE2(const PlaneRow& row, unsigned char* pDst)
+				{
+					const __m128i evenMask = _mm_set1_epi16(0x00FF);
+					const __m128i zero = _mm_setzero_si128();
+
+					int x = 0;
+					for (; x + 16 <= row.Width; x += 16) {
+						const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.pY + x));
+						__m128i uv;
+						switch (row.Chroma) {
+						case ChromaFormat::Mono:
+							uv = _mm_set1_epi8(static_cast<char>(0x80));
+							break;
+						case ChromaFormat::Yuv444: {
+							const __m128i u = _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.pU + x)), evenMask), zero);
+							const __m128i v = _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.pV + x)), evenMask), zero);
+							uv = _mm_unpacklo_epi8(u, v);
+							break;
+						}
+						default:
+							uv = _mm_unpacklo_epi8(
+								_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.pU + (x >> 1))),
+								_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.pV + (x >> 1))));
+							break;
+						}
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x * 2), _mm_unpacklo_epi8(y, uv));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x * 2 + 16), _mm_unpackhi_epi8(y, uv));
+					}
+					ConvertRowYUY2_Scalar(row, pDst, x);
+				}
+
+				/// <summary>
+				/// Y4M のフレームヘッダ ("FRAME" + 任意のパラメータ + 改行) を辿るスキャナ
+				/// <para>フレームヘッダの長さが可変のため、分割せずに先頭から順にスキャンします。</para>
+				/// </summary>
+				class Y4MScanner final : public IndexScanner
+				{
+				public:
+					/// <summary>
+					/// コンストラクタ
+					/// </summary>
+					/// <param name="streamHeaderSize">ストリームヘッダのバイト数 (改行を含む)</param>
+					/// <param name="frameSize">フレームデータのバイト数 (フレームヘッダを除く)</param>
+					/// <param name="info">索引に保存するストリーム情報</param>
+					Y4MScanner(unsigned long long streamHeaderSize, std::size_t frameSize, const IndexStreamInfo& info)
+						: m_streamHeaderSize(streamHeaderSize), m_frameSize(frameSize), m_info(info) {}
+
+					unsigned int GetScannerId() const override { return Utility::FourCC::Make('Y', '4', 'M', '1'); }
+
+					bool ReadStreamInfo(const Utility::MappedFile&, IndexStreamInfo* pInfo) override
+					{
+						*pInfo = m_info;
+						return true;
+					}
+
+					bool Scan(const Utility::MappedFile& file, unsigned long long, unsigned long long end, IndexChunk* pChunk) override
+					{
+						const unsigned long long maxFrameHeaderSize = 256;
+						Utility::MappedWindow window;
+						unsigned long long offset = m_streamHeaderSize;
+						pChunk->Frames.reserve(static_cast<std::size_t>((end - offset) / (m_frameSize + 6) + 1));
+						while (offset + 6 <= end) {
+							const std::size_t peek = static_cast<std::size_t>(end - offset < maxFrameHeaderSize ? end - offset : maxFrameHeaderSize);
+							const char* pHeader = reinterpret_cast<const char*>(window.Get(file, offset, peek));
+							if (pHeader == nullptr || std::strncmp(pHeader, "FRAME", 5) != 0) {
+								break;
+							}
+							const char* pEnd = static_cast<const char*>(std::memchr(pHeader, '\n', peek));
+							if (pEnd == nullptr) {
+								break;
+							}
+							const unsigned long long payload = offset + static_cast<unsigned long long>(pEnd - pHeader) + 1;
+							if (payload + m_frameSize > end) {
+								break;
+							}
+							IndexFrameEntry entry = {};
+							entry.Offset = payload;
+							entry.Size = static_cast<unsigned int>(m_frameSize);
+							entry.Flag = IndexFrameEntry::EntryFlag::Keyframe;
+							pChunk->Frames.push_back(entry);
+							offset = payload + m_frameSize;
+						}
+						return true;
+					}
+
+				private:
+					unsigned long long m_streamHeaderSize;
+					std::size_t m_frameSize;
+					IndexStreamInfo m_info;
+				};
+			}
+
+			/// <summary>
+			/// 入力ファイル (InputHandle の実体)
+			/// </summary>
+			class Source final
+			{
+			public:
+				Source()
+					: m_videoWindow(GetSettings().WindowSize)
+					, m_audioWindow(GetSettings().AudioWindowSize) {}
+
+				Source(const Source&) = delete;
+				Source& operator=(const Source&) = delete;
+
+				/// <summary>
+				/// 入力ファイルを開きます
+				/// </summary>
+				/// <param name="pFileName">ファイル名</param>
+				/// <returns>
+				/// true なら成功
+				/// </returns>
+				bool Open(const char* pFileName)
+				{
+					const std::string name(pFileName);
+					const std::string extension = FileName::GetExtension(name);
+
+					if (extension == ".wav") {
+						return OpenWave(name);
+					}
+
+					const bool video = extension == ".y4m" ? OpenY4M(name) : extension == ".yuv" ? OpenRaw(name) : false;
+					if (!video) {
+						return false;
+					}
+
+					// 同名の .wav があれば音声として使用します (失敗しても映像のみで続行)
+					OpenWave(name.substr(0, name.size() - extension.size()) + ".wav");
+					return true;
+				}
+
+				/// <summary>
+				/// 入力ファイルの情報を取得します
+				/// </summary>
+				/// <param name="pInputInfo">入力ファイル情報構造体へのポインタ</param>
+				void GetInfo(InputInfo* pInputInfo)
+				{
+					*pInputInfo = InputInfo();
+					if (m_videoFile.IsOpen()) {
+						pInputInfo->Flag |= InputInfo::InfoFlag::Video | InputInfo::InfoFlag::VideoRandomAccess;
+						pInputInfo->Rate = m_rate;
+						pInputInfo->Scale = m_scale;
+						pInputInfo->Frame_Total = m_frameTotal;
+						pInputInfo->pFormat = &m_format;
+						pInputInfo->Format_Size = sizeof(m_format);
+						pInputInfo->Handler = m_format.biCompression;
+					}
+					if (m_audioFile.IsOpen()) {
+						pInputInfo->Flag |= InputInfo::InfoFlag::Audio;
+						pInputInfo->Audio_Total = m_audioTotal;
+						pInputInfo->pAudio_Format = &m_audioFormat;
+						pInputInfo->Audio_Format_Size = sizeof(m_audioFormat);
+					}
+				}
+
+				/// <summary>
+				/// 画像データを読み込みます
+				/// </summary>
+				/// <param name="frame">読み込むフレーム番号</param>
+				/// <param name="pBuffer">データを読み込むバッファへのポインタ</param>
+				/// <returns>
+				/// 読み込んだデータサイズ
+				/// </returns>
+				int ReadVideo(int frame, void* pBuffer)
+				{
+					if (m_frameTotal <= 0) {
+						return 0;
+					}
+					if (frame < 0) {
+						frame = 0;
+					}
+					if (frame >= m_frameTotal) {
+						frame = m_frameTotal - 1;
+					}
+
+					// Y4M は索引から、RAW は固定長なので計算で求めます
+					const unsigned long long offset = m_index.IsOpen() ? m_index.GetFrame(frame).Offset : static_cast<unsigned long long>(frame) * m_frameSize;
+
+					std::lock_guard<std::mutex> lock(m_videoMutex);
+					const unsigned char* pFrame = m_videoWindow.Get(m_videoFile, offset, m_frameSize);
+					if (pFrame == nullptr) {
+						return 0;
+					}
+
+					const int chromaWidth = GetChromaWidth();
+					const unsigned char* pU = pFrame + static_cast<std::size_t>(m_width) * m_height;
+					const unsigned char* pV = pU + static_cast<std::size_t>(chromaWidth) * GetChromaHeight();
+					const bool ssse3 = Utility::Simd::Has(Utility::Simd::Feature::SSSE3);
+					const bool yuy2 = m_format.biCompression == Utility::FourCC::YUY2;
+
+					for (int y = 0; y < m_height; ++y) {
+						const int cy = m_chroma == ChromaFormat::Yuv420 ? y >> 1 : y;
+						Detail::PlaneRow row = {};
+						row.pY = pFrame + static_cast<std::size_t>(m_width) * y;
+						row.pU = m_chroma == ChromaFormat::Mono ? nullptr : pU + static_cast<std::size_t>(chromaWidth) * cy;
+						row.pV = m_chroma == ChromaFormat::Mono ? nullptr : pV + static_cast<std::size_t>(chromaWidth) * cy;
+						row.Width = m_width;
+						row.ChromaWidth = chromaWidth;
+						row.Chroma = m_chroma;
+
+						if (yuy2) {
+							Detail::ConvertRowYUY2_SSE2(row, static_cast<unsigned char*>(pBuffer) + static_cast<std::size_t>(m_width) * 2 * y);
+						}
+						else {
+							Filter::Pixel_YC* pDst = static_cast<Filter::Pixel_YC*>(pBuffer) + static_cast<std::size_t>(m_width) * y;
+							if (ssse3) {
+								Detail::ConvertRowYC48_SSSE3(row, pDst);
+							}
+							else {
+								Detail::ConvertRowYC48_Scalar(row, pDst, 0);
+							}
+						}
+					}
+					return static_cast<int>(m_format.biSizeImage);
+				}
+
+				/// <summary>
+				/// 音声データを読み込みます
+				/// <para>マップした PCM をそのままコピーします。</para>
+				/// </summary>
+				/// <param name="start">読み込み開始サンプル番号</param>
+				/// <param name="length">読み込むサンプル数</param>
+				/// <param name="pBuffer">データを読み込むバッファへのポインタ</param>
+				/// <returns>
+				/// 読み込んだサンプル数
+				/// </returns>
+				int ReadAudio(int start, int length, void* pBuffer)
+				{
+					if (!m_audioFile.IsOpen() || start < 0 || length <= 0 || start >= m_audioTotal) {
+						return 0;
+					}
+					if (length > m_audioTotal - start) {
+						length = m_audioTotal - start;
+					}
+
+					const std::size_t blockAlign = m_audioFormat.nBlockAlign;
+					std::lock_guard<std::mutex> lock(m_audioMutex);
+					const unsigned char* pData = m_audioWindow.Get(m_audioFile, m_audioOffset + blockAlign * start, blockAlign * length);
+					if (pData == nullptr) {
+						return 0;
+					}
+					std::memcpy(pBuffer, pData, blockAlign * length);
+					return length;
+				}
+
+			private:
+				int GetChromaWidth() const
+				{
+					switch (m_chroma) {
+					case ChromaFormat::Mono: return 0;
+					case ChromaFormat::Yuv444: return m_width;
+					default: return (m_width + 1) >> 1;
+					}
+				}
+
+				int GetChromaHeight() const
+				{
+					switch (m_chroma) {
+					case ChromaFormat::Mono: return 0;
+					case ChromaFormat::Yuv420: return (m_height + 1) >> 1;
+					default: return m_height;
+					}
+				}
+
+				/// <summary>
+				/// 映像の形式が決まった後に、フレームサイズと出力フォーマットを設定します
+				/// </summary>
+				bool SetupVideoFormat()
+				{
+					if (m_width <= 0 || m_height <= 0 || m_rate <= 0 || m_scale <= 0) {
+						return false;
+					}
+					m_frameSize = static_cast<std::size_t>(m_width) * m_height
+						+ static_cast<std::size_t>(GetChromaWidth()) * GetChromaHeight() * 2;
+
+					const bool yuy2 = GetSettings().OutputYUY2 && (m_width & 1) == 0;
+					m_format = InputInfo::BitmapInfoHeader();
+					m_format.biSize = sizeof(m_format);
+					m_format.biWidth = m_width;
+					m_format.biHeight = m_height;
+					m_format.biPlanes = 1;
+					m_format.biBitCount = yuy2 ? 16 : 48;
+					m_format.biCompression = yuy2 ? Utility::FourCC::YUY2 : Utility::FourCC::YC48;
+					m_format.biSizeImage = static_cast<unsigned long>(m_width) * m_height * (yuy2 ? 2 : Filter::Pixel_YC::Size);
+					return true;
+				}
+
+				/// <summary>
+				/// Y4M ファイルを開き、フレームのオフセット表を作成します
+				/// </summary>
+				bool OpenY4M(const std::string& name)
+				{
+					if (!m_videoFile.Open(name.c_str())) {
+						return false;
+					}
+
+					// ストリームヘッダ
+					enum { MaxHeaderSize = 1024 };
+					std::string header;
+					{
+						const Utility::MappedView view = m_videoFile.Map(0, MaxHeaderSize);
+						if (!view.IsValid()) {
+							return false;
+						}
+						const char* pBegin = reinterpret_cast<const char*>(view.GetData());
+						const char* pEnd = static_cast<const char*>(std::memchr(pBegin, '\n', view.GetSize()));
+						if (pEnd == nullptr) {
+							return false;
+						}
+						header.assign(pBegin, pEnd);
+					}
+					if (header.compare(0, 10, "YUV4MPEG2 ") != 0) {
+						return false;
+					}
+
+					m_rate = 30;
+					m_scale = 1;
+					m_chroma = ChromaFormat::Yuv420;
+					std::size_t position = 10;
+					while (position < header.size()) {
+						std::size_t next = header.find(' ', position);
+						if (next == std::string::npos) {
+							next = header.size();
+						}
+						const std::string token = header.substr(position, next - position);
+						position = next + 1;
+						if (token.empty()) {
+							continue;
+						}
+
+						const char* pValue = token.c_str() + 1;
+						switch (token[0]) {
+						case 'W':
+							m_width = std::atoi(pValue);
+							break;
+						case 'H':
+							m_height = std::atoi(pValue);
+							break;
+						case 'F': {
+							char* pColon = nullptr;
+							m_rate = static_cast<int>(std::strtol(pValue, &pColon, 10));
+							m_scale = *pColon == ':' ? static_cast<int>(std::strtol(pColon + 1, nullptr, 10)) : 1;
+							break;
+						}
+						case 'C': {
+							const std::string chroma(pValue);
+							if (chroma == "420jpeg" || chroma == "420paldv" || chroma == "420mpeg2" || chroma == "420") {
+								m_chroma = ChromaFormat::Yuv420;
+							}
+							else if (chroma == "422") {
+								m_chroma = ChromaFormat::Yuv422;
+							}
+							else if (chroma == "444") {
+								m_chroma = ChromaFormat::Yuv444;
+							}
+							else if (chroma == "mono") {
+								m_chroma = ChromaFormat::Mono;
+							}
+							else {
+								// 高ビット深度やアルファ付きは未対応
+								return false;
+							}
+							break;
+						}
+						default:
+							break;
+						}
+					}
+					if (!SetupVideoFormat()) {
+						return false;
+					}
+
+					// フレームのオフセット表 (サイドカー索引があればマップするだけ)
+					IndexStreamInfo info = {};
+					info.Rate = m_rate;
+					info.Scale = m_scale;
+					info.Format = m_format;
+					Detail::Y4MScanner scanner(header.size() + 1, m_frameSize, info);
+					if (!m_index.Open(name.c_str(), scanner, GetSettings().UseSidecarIndex)) {
+						return false;
+					}
+					m_frameTotal = m_index.GetFrameCount();
+					return m_frameTotal > 0;
+				}
+
+				/// <summary>
+				/// RAW (I420) ファイルを開きます
+				/// <para>解像度とフレームレートはファイル名から取得します。</para>
+				/// </summary>
+				bool OpenRaw(const std::string& name)
+				{
+					// "<幅>x<高さ>"
+					m_width = m_height = 0;
+					FileName::ParseResolution(name, &m_width, &m_height);
+
+					// "<フレームレート>fps" (指定が無ければ 30fps)
+					m_rate = 30;
+					m_scale = 1;
+					FileName::ParseFrameRate(name, &m_rate, &m_scale);
+
+					m_chroma = ChromaFormat::Yuv420;
+					if (!SetupVideoFormat() || !m_videoFile.Open(name.c_str())) {
+						return false;
+					}
+
+					const unsigned long long total = m_videoFile.GetSize() / m_frameSize;
+					m_frameTotal = total > 0x7FFFFFFF ? 0x7FFFFFFF : static_cast<int>(total);
+					return m_frameTotal > 0;
+				}
+
+				/// <summary>
+				/// WAV (PCM) ファイルを開きます
+				/// </summary>
+				bool OpenWave(const std::string& name)
+				{
+					Utility::MappedFile file;
+					if (!file.Open(name.c_str())) {
+						return false;
+					}
+
+					const unsigned long long fileSize = file.GetSize();
+					{
+						const Utility::MappedView view = file.Map(0, 12);
+						if (view.GetSize() < 12 || std::memcmp(view.GetData(), "RIFF", 4) != 0 || std::memcmp(view.GetData() + 8, "WAVE", 4) != 0) {
+							return false;
+						}
+					}
+
+					bool hasFormat = false;
+					unsigned long long offset = 12;
+					while (offset + 8 <= fileSize) {
+						unsigned long chunkSize = 0;
+						char id[4];
+						{
+							const Utility::MappedView view = file.Map(offset, 8);
+							if (view.GetSize() < 8) {
+								return false;
+							}
+							std::memcpy(id, view.GetData(), 4);
+							std::memcpy(&chunkSize, view.GetData() + 4, 4);
+						}
+						const unsigned long long body = offset + 8;
+
+						if (std::memcmp(id, "fmt ", 4) == 0 && chunkSize >= 16) {
+							const Utility::MappedView view = file.Map(body, chunkSize < 40 ? chunkSize : 40);
+							if (view.GetSize() < 16) {
+								return false;
+							}
+							const unsigned char* p = view.GetData();
+							unsigned short tag;
+							std::memcpy(&tag, p, 2);
+							// WAVE_FORMAT_EXTENSIBLE はサブフォーマットが PCM の場合のみ受け付けます
+							if (tag == 0xFFFE && view.GetSize() >= 26) {
+								std::memcpy(&tag, p + 24, 2);
+							}
+							if (tag != 1) {
+								return false;
+							}
+							m_audioFormat = InputInfo::WaveFormatEx();
+							m_audioFormat.wFormatTag = 1;
+							std::memcpy(&m_audioFormat.nChannels, p + 2, 2);
+							std::memcpy(&m_audioFormat.nSamplesPerSec, p + 4, 4);
+							std::memcpy(&m_audioFormat.nAvgBytesPerSec, p + 8, 4);
+							std::memcpy(&m_audioFormat.nBlockAlign, p + 12, 2);
+							std::memcpy(&m_audioFormat.wBitsPerSample, p + 14, 2);
+							hasFormat = m_audioFormat.nBlockAlign != 0;
+						}
+						else if (std::memcmp(id, "data", 4) == 0 && hasFormat) {
+							// サイズが壊れている (書き込み途中など) 場合はファイル末尾までとします
+							unsigned long long dataSize = chunkSize;
+							if (dataSize > fileSize - body) {
+								dataSize = fileSize - body;
+							}
+							const unsigned long long total = dataSize / m_audioFormat.nBlockAlign;
+							m_audioTotal = total > 0x7FFFFFFF ? 0x7FFFFFFF : static_cast<int>(total);
+							m_audioOffset = body;
+							m_audioFile = std::move(file);
+							return m_audioTotal > 0;
+						}
+						offset = body + chunkSize + (chunkSize & 1);
+					}
+					return false;
+				}
+
+				// 映像
+				Utility::MappedFile m_videoFile;
+				Utility::MappedWindow m_videoWindow;
+				SidecarIndex m_index;
+				int m_frameTotal = 0;
+				std::size_t m_frameSize = 0;
+				int m_width = 0;
+				int m_height = 0;
+				int m_rate = 0;
+				int m_scale = 0;
+				ChromaFormat m_chroma = ChromaFormat::Yuv420;
+				InputInfo::BitmapInfoHeader m_format = {};
+				std::mutex m_videoMutex;
+
+				// 音声
+				Utility::MappedFile m_audioFile;
+				Utility::MappedWindow m_audioWindow;
+				unsigned long long m_audioOffset = 0;
+				int m_audioTotal = 0;
+				InputInfo::WaveFormatEx m_audioFormat = {};
+				std::mutex m_audioMutex;
+			};
+
+			namespace Detail
+			{
+				inline int Exit()
+				{
+					// サイドカー索引の作成に使用したスレッドプールを、DLL のアンロード前に停止します
+					Utility::ThreadPool::GetDefault().Shutdown();
+					return 1;
+				}
+
+				inline InputPluginTable::InputHandle Open(char* pFile)
+				{
+					try {
+						std::unique_ptr<Source> pSource(new Source());
+						if (!pSource->Open(pFile)) {
+							return nullptr;
+						}
+						return pSource.release();
+					}
+					catch (...) {
+						return nullptr;
+					}
+				}
+
+				inline int Close(InputPluginTable::InputHandle hInput)
+				{
+					delete static_cast<Source*>(hInput);
+					return 1;
+				}
+
+				inline int GetInfo(InputPluginTable::InputHandle hInput, InputInfo* pInputInfo)
+				{
+					static_cast<Source*>(hInput)->GetInfo(pInputInfo);
+					return 1;
+				}
+
+				inline int ReadVideo(InputPluginTable::InputHandle hInput, int frame, void* pBuffer)
+				{
+					return static_cast<Source*>(hInput)->ReadVideo(frame, pBuffer);
+				}
+
+				inline int ReadAudio(InputPluginTable::InputHandle hInput, int start, int length, void* pBuffer)
+				{
+					return static_cast<Source*>(hInput)->ReadAudio(start, length, pBuffer);
+				}
+			}
+
+			/// <summary>
+			/// 入力プラグインテーブルを取得します
+			/// <para>GetInputPluginTable() からこの参照を返してください。</para>
+			/// </summary>
+			/// <returns>
+			/// 入力プラグインテーブル構造体の参照
+			/// </returns>
+			inline InputPluginTable& GetPluginTable()
+			{
+				static InputPluginTable table = []() {
+					InputPluginTable t = {};
+					t.Flag = InputPluginTable::PluginFlag::Video | InputPluginTable::PluginFlag::Audio;
+					t.pName = const_cast<char*>(PluginNameA);
+					t.pFileFilter = const_cast<char*>(FileFilterA);
+					t.pInformation = const_cast<char*>(PluginInformationA);
+					t.Exit = Detail::Exit;
+					t.Open = Detail::Open;
+					t.Close = Detail::Close;
+					t.GetInfo = Detail::GetInfo;
+					t.ReadVideo = Detail::ReadVideo;
+					t.ReadAudio = Detail::ReadAudio;
+					return t;
+				}();
+				return table;
+			}
+		}
+	}
+
+#endif
+}
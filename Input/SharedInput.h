@@ -0,0 +1,349 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/AudioBlockCache.h"
+#include "../Utility/File.h"
+#include "../Utility/FrameCache.h"
+#include "../Utility/ThreadPool.h"
+#include <cstring>      // std::memcpy
+#include <iterator>     // std::next
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr, std::weak_ptr, std::unique_ptr
+#include <mutex>        // std::mutex, std::lock_guard
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Input プラグイン
+	/// </summary>
+	namespace Input
+	{
+		/// <summary>
+		/// 入力ハンドルの共有
+		/// <para>AviUtl や拡張編集は、同じファイルをタイムラインのオブジェクトごとに何度も Open します。</para>
+		/// <para>既存の入力プラグインテーブルをこの層で包むと、同じファイルに対する Open は 1 つのデコーダー (内側の入力ハンドル) と 1 つのフレームキャッシュを参照カウントで共有し、呼び出し元には軽量な論理ハンドルを返します。</para>
+		/// <para>論理ハンドルごとにカーソル (最後に読んだフレーム) を持ち、キャッシュは全てのカーソルの周辺を残すように破棄するため、読み手同士がシーク状態を荒らし合いません。</para>
+		/// <para>PCM16 の音声は AudioBlockCache で保持し、重なり合う小さな ReadAudio を内側のデコーダーへ毎回渡さないようにします。</para>
+		/// </summary>
+		namespace SharedInput
+		{
+			/// <summary>
+			/// 動作設定
+			/// <para>GetPluginTable() を返す前に変更してください。</para>
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// ファイルごとのフレームキャッシュの容量 (0 ならキャッシュしない)
+				/// </summary>
+				std::size_t CacheSize = Utility::FrameCache::DefaultCapacity;
+
+				/// <summary>
+				/// PCM16 の音声をブロック単位でキャッシュし、再生方向に先読みする
+				/// </summary>
+				bool CacheAudio = true;
+
+				/// <summary>
+				/// 音声の先読みをスレッドプールで行う
+				/// <para>false なら、内側の ReadAudio は常に呼び出し元のスレッドで実行されます。</para>
+				/// <para>VFW / DirectShow / COM など、スレッドに結び付いたデコーダーを包む場合は false のままにしてください。</para>
+				/// </summary>
+				bool BackgroundAudioPrefetch = false;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			inline Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// 内部処理
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// 1 フレームの読み込みに必要なバッファのバイト数を取得します
+				/// </summary>
+				inline std::size_t GetFrameBufferSize(const InputInfo& info)
+				{
+					if (info.pFormat == nullptr) {
+						return 0;
+					}
+					const InputInfo::BitmapInfoHeader& format = *info.pFormat;
+					const std::size_t width = format.biWidth < 0 ? -static_cast<long long>(format.biWidth) : format.biWidth;
+					const std::size_t height = format.biHeight < 0 ? -static_cast<long long>(format.biHeight) : format.biHeight;
+					const std::size_t stride = ((width * format.biBitCount + 31) / 32) * 4;
+					const std::size_t size = stride * height;
+					return size > format.biSizeImage ? size : format.biSizeImage;
+				}
+
+				/// <summary>
+				/// 物理ファイルごとに共有する状態
+				/// </summary>
+				class SharedFile final
+				{
+				public:
+					SharedFile(const InputPluginTable& table, InputPluginTable::InputHandle hInput)
+						: m_table(table), m_hInput(hInput), m_cache(GetSettings().CacheSize)
+					{
+						m_info = InputInfo();
+						m_table.GetInfo(m_hInput, &m_info);
+						m_frameSize = GetFrameBufferSize(m_info);
+
+						const InputInfo::WaveFormatEx* pAudio = m_info.pAudio_Format;
+						if (GetSettings().CacheAudio && m_table.ReadAudio != nullptr && pAudio != nullptr
+							&& pAudio->wFormatTag == 1 && pAudio->wBitsPerSample == 16 && pAudio->nChannels > 0 && m_info.Audio_Total > 0) {
+							m_pAudioCache.reset(new Utility::AudioBlockCache(pAudio->nChannels, m_info.Audio_Total,
+								[this](long long start, int length, short* pBuffer) {
+									std::lock_guard<std::mutex> lock(m_mutex);
+									return m_table.ReadAudio(m_hInput, static_cast<int>(start), length, pBuffer);
+								}, GetSettings().BackgroundAudioPrefetch ? &Utility::ThreadPool::GetDefault() : nullptr));
+						}
+					}
+
+					~SharedFile()
+					{
+						// 先読み中の音声を待ってから内側のハンドルを閉じます
+						m_pAudioCache.reset();
+						m_table.Close(m_hInput);
+					}
+
+					SharedFile(const SharedFile&) = delete;
+					SharedFile& operator=(const SharedFile&) = delete;
+
+					const InputInfo& GetInfo() const { return m_info; }
+
+					int AddCursor()
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						return m_cache.AddCursor();
+					}
+
+					void RemoveCursor(int cursor)
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_cache.RemoveCursor(cursor);
+					}
+
+					int ReadVideo(int cursor, int frame, void* pBuffer)
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_cache.SetCursor(cursor, frame);
+
+						if (m_table.ReadVideo == nullptr) {
+							return 0;
+						}
+						if (m_cache.GetCapacity() == 0 || m_frameSize == 0) {
+							return m_table.ReadVideo(m_hInput, frame, pBuffer);
+						}
+
+						Utility::FrameCache::Frame data = m_cache.Find(frame);
+						if (data == nullptr) {
+							// 内側のデコーダーへ読み込み、キャッシュに残します
+							auto pData = std::make_shared<std::vector<unsigned char>>(m_frameSize);
+							const int size = m_table.ReadVideo(m_hInput, frame, pData->data());
+							if (size <= 0 || static_cast<std::size_t>(size) > pData->size()) {
+								return 0;
+							}
+							pData->resize(size);
+							pData->shrink_to_fit();
+							data = pData;
+							m_cache.Insert(frame, data);
+						}
+						std::memcpy(pBuffer, data->data(), data->size());
+						return static_cast<int>(data->size());
+					}
+
+					int ReadAudio(int start, int length, void* pBuffer)
+					{
+						if (m_pAudioCache != nullptr) {
+							return m_pAudioCache->Read(start, length, pBuffer);
+						}
+						std::lock_guard<std::mutex> lock(m_mutex);
+						return m_table.ReadAudio != nullptr ? m_table.ReadAudio(m_hInput, start, length, pBuffer) : 0;
+					}
+
+					int IsKeyframe(int frame)
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						return m_table.IsKeyframe != nullptr ? m_table.IsKeyframe(m_hInput, frame) : 1;
+					}
+
+				private:
+					const InputPluginTable& m_table;
+					InputPluginTable::InputHandle m_hInput;
+					InputInfo m_info;
+					std::size_t m_frameSize = 0;
+					Utility::FrameCache m_cache;
+					std::unique_ptr<Utility::AudioBlockCache> m_pAudioCache;
+					std::mutex m_mutex;
+				};
+
+				/// <summary>
+				/// 呼び出し元に返す論理ハンドル
+				/// </summary>
+				struct Handle final
+				{
+					std::shared_ptr<SharedFile> File;
+					int Cursor;
+				};
+
+				/// <summary>
+				/// 内側の入力プラグインテーブルごとの共有処理
+				/// </summary>
+				/// <typeparam name="GetInnerTable">内側の入力プラグインテーブルを返す関数</typeparam>
+				template<InputPluginTable& (*GetInnerTable)()>
+				struct Wrapper final
+				{
+					/// <summary>
+					/// 開いているファイルの一覧 (論理ハンドルが全て閉じられると失効します)
+					/// </summary>
+					static std::map<std::string, std::weak_ptr<SharedFile>>& GetFiles()
+					{
+						static std::map<std::string, std::weak_ptr<SharedFile>> files;
+						return files;
+					}
+
+					static std::mutex& GetMutex()
+					{
+						static std::mutex mutex;
+						return mutex;
+					}
+
+					static int Init()
+					{
+						const InputPluginTable& inner = GetInnerTable();
+						return inner.Init != nullptr ? inner.Init() : 1;
+					}
+
+					static int Exit()
+					{
+						const InputPluginTable& inner = GetInnerTable();
+						const int result = inner.Exit != nullptr ? inner.Exit() : 1;
+
+						// 音声の先読みに使用したスレッドプールを、DLL のアンロード前に停止します
+						if (GetSettings().BackgroundAudioPrefetch) {
+							Utility::ThreadPool::GetDefault().Shutdown();
+						}
+						return result;
+					}
+
+					static InputPluginTable::InputHandle Open(char* pFile)
+					{
+						try {
+							const InputPluginTable& inner = GetInnerTable();
+							const std::string key = Utility::GetFileKey(pFile);
+
+							std::shared_ptr<SharedFile> pShared;
+							{
+								std::lock_guard<std::mutex> lock(GetMutex());
+								auto& files = GetFiles();
+								for (auto it = files.begin(); it != files.end();) {
+									it = it->second.expired() ? files.erase(it) : std::next(it);
+								}
+
+								auto it = files.find(key);
+								if (it != files.end()) {
+									pShared = it->second.lock();
+								}
+								if (pShared == nullptr) {
+									InputPluginTable::InputHandle hInput = inner.Open(pFile);
+									if (hInput == nullptr) {
+										return nullptr;
+									}
+									pShared = std::make_shared<SharedFile>(inner, hInput);
+									files[key] = pShared;
+								}
+							}
+
+							std::unique_ptr<Handle> pHandle(new Handle{ pShared, pShared->AddCursor() });
+							return pHandle.release();
+						}
+						catch (...) {
+							return nullptr;
+						}
+					}
+
+					static int Close(InputPluginTable::InputHandle hInput)
+					{
+						Handle* pHandle = static_cast<Handle*>(hInput);
+						pHandle->File->RemoveCursor(pHandle->Cursor);
+						delete pHandle;
+						return 1;
+					}
+
+					static int GetInfo(InputPluginTable::InputHandle hInput, InputInfo* pInputInfo)
+					{
+						*pInputInfo = static_cast<Handle*>(hInput)->File->GetInfo();
+						return 1;
+					}
+
+					static int ReadVideo(InputPluginTable::InputHandle hInput, int frame, void* pBuffer)
+					{
+						Handle* pHandle = static_cast<Handle*>(hInput);
+						return pHandle->File->ReadVideo(pHandle->Cursor, frame, pBuffer);
+					}
+
+					static int ReadAudio(InputPluginTable::InputHandle hInput, int start, int length, void* pBuffer)
+					{
+						return static_cast<Handle*>(hInput)->File->ReadAudio(start, length, pBuffer);
+					}
+
+					static int IsKeyframe(InputPluginTable::InputHandle hInput, int frame)
+					{
+						return static_cast<Handle*>(hInput)->File->IsKeyframe(frame);
+					}
+				};
+			}
+
+			/// <summary>
+			/// 入力ハンドルを共有する入力プラグインテーブルを取得します
+			/// <para>GetInputPluginTable() から、例えば GetPluginTable&lt;MappedInput::GetPluginTable&gt;() を返してください。</para>
+			/// <para>名前やファイルフィルタ、Init / Exit / Config は内側のテーブルのものをそのまま使用します。</para>
+			/// </summary>
+			/// <typeparam name="GetInnerTable">内側の入力プラグインテーブルを返す関数</typeparam>
+			/// <returns>
+			/// 入力プラグインテーブル構造体の参照
+			/// </returns>
+			template<InputPluginTable& (*GetInnerTable)()>
+			inline InputPluginTable& GetPluginTable()
+			{
+				using Wrapper = Detail::Wrapper<GetInnerTable>;
+				static InputPluginTable table = []() {
+					const InputPluginTable& inner = GetInnerTable();
+					InputPluginTable t = inner;
+					t.Init = Wrapper::Init;
+					t.Exit = Wrapper::Exit;
+					t.Open = Wrapper::Open;
+					t.Close = Wrapper::Close;
+					t.GetInfo = Wrapper::GetInfo;
+					t.ReadVideo = Wrapper::ReadVideo;
+					t.ReadAudio = Wrapper::ReadAudio;
+					t.IsKeyframe = Wrapper::IsKeyframe;
+					return t;
+				}();
+				return table;
+			}
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,601 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/File.h"
+#include "../Utility/ThreadPool.h"
+#include <algorithm>    // std::upper_bound
+#include <array>        // std::array
+#include <atomic>       // std::atomic
+#include <cstring>      // std::memcpy, std::memcmp
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Input プラグイン
+	/// </summary>
+	namespace Input
+	{
+		/// <summary>
+		/// 索引のフレーム情報
+		/// </summary>
+		struct IndexFrameEntry final
+		{
+			/// <summary>
+			/// フレーム情報のフラグ定数
+			/// </summary>
+			enum class EntryFlag : unsigned int {
+				/// <summary>
+				/// キーフレーム
+				/// </summary>
+				Keyframe = 1,
+			};
+
+			/// <summary>
+			/// ファイル先頭からのオフセット
+			/// </summary>
+			unsigned long long Offset;
+
+			/// <summary>
+			/// データのバイト数
+			/// </summary>
+			unsigned int Size;
+
+			/// <summary>
+			/// フラグ
+			/// </summary>
+			EntryFlag Flag;
+		};
+
+		// operators
+		AU_DECLARE_ENUMCLASS_OPERATOR(IndexFrameEntry::EntryFlag)
+
+		/// <summary>
+		/// 索引の音声ブロック情報
+		/// </summary>
+		struct IndexAudioEntry final
+		{
+			/// <summary>
+			/// ファイル先頭からのオフセット
+			/// </summary>
+			unsigned long long Offset;
+
+			/// <summary>
+			/// データのバイト数
+			/// </summary>
+			unsigned int Size;
+
+			/// <summary>
+			/// ブロックに含まれるサンプル数
+			/// </summary>
+			unsigned int Sample_Count;
+
+			/// <summary>
+			/// ブロック先頭のサンプル番号 (索引作成時に設定されます)
+			/// </summary>
+			long long Sample_Start;
+		};
+
+		/// <summary>
+		/// 索引に保存するストリーム情報
+		/// </summary>
+		struct IndexStreamInfo final
+		{
+			/// <summary>
+			/// フレームレート
+			/// </summary>
+			int Rate;
+
+			/// <summary>
+			/// フレームレート
+			/// </summary>
+			int Scale;
+
+			/// <summary>
+			/// 画像フォーマット
+			/// </summary>
+			InputInfo::BitmapInfoHeader Format;
+
+			/// <summary>
+			/// 音声フォーマット
+			/// </summary>
+			InputInfo::WaveFormatEx Audio_Format;
+
+			/// <summary>
+			/// スキャナ固有のデータ (コーデック設定など)
+			/// </summary>
+			std::array<unsigned char, 64> Extra;
+		};
+
+		/// <summary>
+		/// 1 チャンク分のスキャン結果
+		/// </summary>
+		struct IndexChunk final
+		{
+			/// <summary>
+			/// チャンク内で開始するフレーム (ファイル順)
+			/// </summary>
+			std::vector<IndexFrameEntry> Frames;
+
+			/// <summary>
+			/// チャンク内で開始する音声ブロック (ファイル順、Sample_Start は設定不要)
+			/// </summary>
+			std::vector<IndexAudioEntry> Audio;
+		};
+
+		/// <summary>
+		/// コンテナ形式ごとのスキャナ
+		/// <para>入力プラグインがコンテナ形式に合わせて実装し、SidecarIndex::Open() に渡します。</para>
+		/// </summary>
+		class IndexScanner
+		{
+		public:
+			virtual ~IndexScanner() = default;
+
+			/// <summary>
+			/// スキャナの識別子
+			/// <para>スキャン結果が変わる修正をした場合は値を変えてください。索引が作り直されます。</para>
+			/// </summary>
+			virtual unsigned int GetScannerId() const = 0;
+
+			/// <summary>
+			/// ヘッダを解析してストリーム情報を取得します
+			/// </summary>
+			/// <param name="file">入力ファイル</param>
+			/// <param name="pInfo">ストリーム情報を格納するポインタ (ゼロ初期化済み)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			virtual bool ReadStreamInfo(const Utility::MappedFile& file, IndexStreamInfo* pInfo) = 0;
+
+			/// <summary>
+			/// 並列スキャンのチャンクサイズ
+			/// <para>任意の位置から同期を取り直せる形式 (スタートコードを持つ形式など) のみ 0 以外を返してください。</para>
+			/// </summary>
+			/// <returns>
+			/// チャンクのバイト数 (0 なら分割せずに 1 スレッドでスキャン)
+			/// </returns>
+			virtual unsigned long long GetChunkSize() const { return 0; }
+
+			/// <summary>
+			/// 範囲内で開始するフレームと音声ブロックを列挙します
+			/// <para>複数のスレッドから同時に呼ばれます。データが end を跨ぐ場合は end 以降も読んで構いません。</para>
+			/// </summary>
+			/// <param name="file">入力ファイル</param>
+			/// <param name="begin">範囲の先頭オフセット</param>
+			/// <param name="end">範囲の終端オフセット (この位置は含まない)</param>
+			/// <param name="pChunk">スキャン結果を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			virtual bool Scan(const Utility::MappedFile& file, unsigned long long begin, unsigned long long end, IndexChunk* pChunk) = 0;
+		};
+
+		/// <summary>
+		/// サイドカーファイルに永続化するフレーム/キーフレーム/音声サンプルの索引
+		/// <para>初回は IndexScanner で並列にスキャンして "&lt;入力ファイル名&gt;.auidx" に保存し、2回目以降はサイズと更新日時が一致すればマップして使用します。</para>
+		/// <para>作成後は読み込み専用のため、複数のスレッドから同時に参照できます。</para>
+		/// </summary>
+		class SidecarIndex final
+		{
+		public:
+			/// <summary>
+			/// サイドカーファイルのバージョン
+			/// </summary>
+			enum { Version = 1 };
+
+			/// <summary>
+			/// サイドカーファイルのヘッダ
+			/// </summary>
+			struct Header final
+			{
+				/// <summary>
+				/// 識別子 ("AUIX")
+				/// </summary>
+				std::array<char, 4> Magic;
+
+				/// <summary>
+				/// バージョン
+				/// </summary>
+				unsigned int Version;
+
+				/// <summary>
+				/// スキャナの識別子
+				/// </summary>
+				unsigned int ScannerId;
+
+				/// <summary>
+				/// ヘッダのバイト数
+				/// </summary>
+				unsigned int HeaderSize;
+
+				/// <summary>
+				/// 入力ファイルのサイズと更新日時
+				/// </summary>
+				Utility::FileStamp Source;
+
+				/// <summary>
+				/// フレーム数
+				/// </summary>
+				unsigned int Frame_Count;
+
+				/// <summary>
+				/// キーフレーム数
+				/// </summary>
+				unsigned int Keyframe_Count;
+
+				/// <summary>
+				/// 音声ブロック数
+				/// </summary>
+				unsigned int Audio_Count;
+
+				/// <summary>
+				/// 予約領域
+				/// </summary>
+				unsigned int Reserved;
+
+				/// <summary>
+				/// ストリーム情報
+				/// </summary>
+				IndexStreamInfo Info;
+			};
+
+			SidecarIndex() = default;
+			SidecarIndex(const SidecarIndex&) = delete;
+			SidecarIndex& operator=(const SidecarIndex&) = delete;
+
+			/// <summary>
+			/// 索引を開きます
+			/// <para>有効なサイドカーファイルがあればマップし、無ければスキャンして作成します。</para>
+			/// </summary>
+			/// <param name="pFileName">入力ファイル名</param>
+			/// <param name="scanner">コンテナ形式のスキャナ</param>
+			/// <param name="persist">作成した索引をサイドカーファイルに保存する</param>
+			/// <param name="pPool">スキャンに使用するスレッドプール (NULLなら既定のスレッドプール)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Open(const char* pFileName, IndexScanner& scanner, bool persist = true, Utility::ThreadPool* pPool = nullptr)
+			{
+				Close();
+
+				Utility::FileStamp stamp = {};
+				if (!Utility::GetFileStamp(pFileName, &stamp)) {
+					return false;
+				}
+
+				const std::string sidecarName = GetSidecarName(pFileName);
+				if (persist && Load(sidecarName.c_str(), scanner.GetScannerId(), stamp)) {
+					return true;
+				}
+				if (!Build(pFileName, scanner, stamp, pPool != nullptr ? *pPool : Utility::ThreadPool::GetDefault())) {
+					return false;
+				}
+				if (persist) {
+					// 保存できない場所 (読み込み専用メディアなど) でも、メモリ上の索引で続行します
+					Utility::WriteFileAtomically(sidecarName.c_str(), m_blob.data(), m_blob.size());
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// 索引を閉じます
+			/// </summary>
+			void Close()
+			{
+				m_view.Reset();
+				m_blob.clear();
+				m_blob.shrink_to_fit();
+				m_pHeader = nullptr;
+				m_pFrames = nullptr;
+				m_pKeyframes = nullptr;
+				m_pAudio = nullptr;
+			}
+
+			/// <summary>
+			/// 索引を開いているか
+			/// </summary>
+			bool IsOpen() const { return m_pHeader != nullptr; }
+
+			/// <summary>
+			/// サイドカーファイルから読み込んだか (false ならスキャンして作成した)
+			/// </summary>
+			bool IsMapped() const { return m_view.IsValid(); }
+
+			/// <summary>
+			/// ストリーム情報を取得します
+			/// </summary>
+			const IndexStreamInfo& GetStreamInfo() const { return m_pHeader->Info; }
+
+			/// <summary>
+			/// フレーム数を取得します
+			/// </summary>
+			int GetFrameCount() const { return static_cast<int>(m_pHeader->Frame_Count); }
+
+			/// <summary>
+			/// フレーム情報を取得します
+			/// </summary>
+			/// <param name="frame">フレーム番号 (0 ～ GetFrameCount()-1)</param>
+			const IndexFrameEntry& GetFrame(int frame) const { return m_pFrames[frame]; }
+
+			/// <summary>
+			/// キーフレームか調べます
+			/// </summary>
+			/// <param name="frame">フレーム番号</param>
+			/// <returns>
+			/// true ならキーフレーム
+			/// </returns>
+			bool IsKeyframe(int frame) const
+			{
+				if (frame < 0 || frame >= GetFrameCount()) {
+					return false;
+				}
+				return (m_pFrames[frame].Flag & IndexFrameEntry::EntryFlag::Keyframe) == IndexFrameEntry::EntryFlag::Keyframe;
+			}
+
+			/// <summary>
+			/// 指定したフレームを復号するために、シークする先のキーフレームを取得します
+			/// </summary>
+			/// <param name="frame">フレーム番号</param>
+			/// <returns>
+			/// frame 以前で最も近いキーフレームの番号 (キーフレームが無ければ 0)
+			/// </returns>
+			int GetSeekPoint(int frame) const
+			{
+				const unsigned int* pEnd = m_pKeyframes + m_pHeader->Keyframe_Count;
+				const unsigned int* p = std::upper_bound(m_pKeyframes, pEnd, static_cast<unsigned int>(frame < 0 ? 0 : frame));
+				return p == m_pKeyframes ? 0 : static_cast<int>(*(p - 1));
+			}
+
+			/// <summary>
+			/// 音声の総サンプル数を取得します
+			/// </summary>
+			long long GetAudioTotal() const
+			{
+				const unsigned int count = m_pHeader->Audio_Count;
+				return count == 0 ? 0 : m_pAudio[count - 1].Sample_Start + m_pAudio[count - 1].Sample_Count;
+			}
+
+			/// <summary>
+			/// 音声ブロック数を取得します
+			/// </summary>
+			int GetAudioEntryCount() const { return static_cast<int>(m_pHeader->Audio_Count); }
+
+			/// <summary>
+			/// 音声ブロック情報を取得します
+			/// </summary>
+			/// <param name="index">ブロック番号 (0 ～ GetAudioEntryCount()-1)</param>
+			const IndexAudioEntry& GetAudioEntry(int index) const { return m_pAudio[index]; }
+
+			/// <summary>
+			/// 指定したサンプルを含む音声ブロックを探します
+			/// </summary>
+			/// <param name="sample">サンプル番号</param>
+			/// <returns>
+			/// ブロック番号 (-1 なら範囲外)
+			/// </returns>
+			int FindAudioEntry(long long sample) const
+			{
+				if (sample < 0 || sample >= GetAudioTotal()) {
+					return -1;
+				}
+				const IndexAudioEntry* pEnd = m_pAudio + m_pHeader->Audio_Count;
+				const IndexAudioEntry* p = std::upper_bound(m_pAudio, pEnd, sample,
+					[](long long value, const IndexAudioEntry& entry) { return value < entry.Sample_Start; });
+				return static_cast<int>(p - m_pAudio) - 1;
+			}
+
+			/// <summary>
+			/// 索引の情報から入力ファイル情報を設定します (InputPluginTable::GetInfo 用)
+			/// <para>フォーマットへのポインタは索引を閉じるまで有効です。</para>
+			/// </summary>
+			/// <param name="pInputInfo">入力ファイル情報構造体へのポインタ</param>
+			void GetInfo(InputInfo* pInputInfo) const
+			{
+				*pInputInfo = InputInfo();
+				const IndexStreamInfo& info = m_pHeader->Info;
+				if (m_pHeader->Frame_Count > 0) {
+					pInputInfo->Flag |= InputInfo::InfoFlag::Video;
+					pInputInfo->Rate = info.Rate;
+					pInputInfo->Scale = info.Scale;
+					pInputInfo->Frame_Total = GetFrameCount();
+					pInputInfo->pFormat = const_cast<InputInfo::BitmapInfoHeader*>(&info.Format);
+					pInputInfo->Format_Size = sizeof(info.Format);
+					pInputInfo->Handler = info.Format.biCompression;
+				}
+				if (m_pHeader->Audio_Count > 0) {
+					const long long total = GetAudioTotal();
+					pInputInfo->Flag |= InputInfo::InfoFlag::Audio;
+					pInputInfo->Audio_Total = total > 0x7FFFFFFF ? 0x7FFFFFFF : static_cast<int>(total);
+					pInputInfo->pAudio_Format = const_cast<InputInfo::WaveFormatEx*>(&info.Audio_Format);
+					pInputInfo->Audio_Format_Size = sizeof(info.Audio_Format);
+				}
+			}
+
+			/// <summary>
+			/// 入力ファイル名からサイドカーファイル名を作成します
+			/// </summary>
+			static std::string GetSidecarName(const char* pFileName)
+			{
+				return std::string(pFileName) + ".auidx";
+			}
+
+		private:
+			// 各値はファイルから読み込むため、32bit の std::size_t で桁あふれしないよう 64bit で計算します
+
+			static unsigned long long Align8(unsigned long long value) { return (value + 7) & ~7ull; }
+
+			static unsigned long long GetFramesOffset() { return Align8(sizeof(Header)); }
+
+			static unsigned long long GetKeyframesOffset(const Header& header)
+			{
+				return GetFramesOffset() + sizeof(IndexFrameEntry) * static_cast<unsigned long long>(header.Frame_Count);
+			}
+
+			static unsigned long long GetAudioOffset(const Header& header)
+			{
+				return Align8(GetKeyframesOffset(header) + sizeof(unsigned int) * static_cast<unsigned long long>(header.Keyframe_Count));
+			}
+
+			static unsigned long long GetTotalSize(const Header& header)
+			{
+				return GetAudioOffset(header) + sizeof(IndexAudioEntry) * static_cast<unsigned long long>(header.Audio_Count);
+			}
+
+			/// <summary>
+			/// メモリ上の索引データに各配列のポインタを設定します
+			/// </summary>
+			bool Attach(const unsigned char* pData, std::size_t size)
+			{
+				if (size < sizeof(Header)) {
+					return false;
+				}
+				const Header* pHeader = reinterpret_cast<const Header*>(pData);
+				if (std::memcmp(pHeader->Magic.data(), "AUIX", 4) != 0 || pHeader->Version != Version || pHeader->HeaderSize != sizeof(Header)) {
+					return false;
+				}
+				if (pHeader->Frame_Count > size / sizeof(IndexFrameEntry) || pHeader->Keyframe_Count > size / sizeof(unsigned int)
+					|| pHeader->Audio_Count > size / sizeof(IndexAudioEntry) || GetTotalSize(*pHeader) != size) {
+					return false;
+				}
+				m_pHeader = pHeader;
+				m_pFrames = reinterpret_cast<const IndexFrameEntry*>(pData + static_cast<std::size_t>(GetFramesOffset()));
+				m_pKeyframes = reinterpret_cast<const unsigned int*>(pData + static_cast<std::size_t>(GetKeyframesOffset(*pHeader)));
+				m_pAudio = reinterpret_cast<const IndexAudioEntry*>(pData + static_cast<std::size_t>(GetAudioOffset(*pHeader)));
+				return true;
+			}
+
+			/// <summary>
+			/// サイドカーファイルをマップします
+			/// </summary>
+			bool Load(const char* pSidecarName, unsigned int scannerId, const Utility::FileStamp& stamp)
+			{
+				Utility::MappedFile file;
+				if (!file.Open(pSidecarName) || file.GetSize() > 0x7FFFFFFF) {
+					return false;
+				}
+				m_view = file.Map(0, static_cast<std::size_t>(file.GetSize()));
+				if (!m_view.IsValid() || !Attach(m_view.GetData(), m_view.GetSize())
+					|| m_pHeader->ScannerId != scannerId || m_pHeader->Source != stamp) {
+					Close();
+					return false;
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// 入力ファイルをスキャンして索引を作成します
+			/// </summary>
+			bool Build(const char* pFileName, IndexScanner& scanner, const Utility::FileStamp& stamp, Utility::ThreadPool& pool)
+			{
+				Utility::MappedFile file;
+				if (!file.Open(pFileName)) {
+					return false;
+				}
+
+				Header header = {};
+				std::memcpy(header.Magic.data(), "AUIX", 4);
+				header.Version = Version;
+				header.ScannerId = scanner.GetScannerId();
+				header.HeaderSize = sizeof(Header);
+				header.Source = stamp;
+				if (!scanner.ReadStreamInfo(file, &header.Info)) {
+					return false;
+				}
+
+				// チャンクごとに並列スキャン
+				const unsigned long long fileSize = file.GetSize();
+				const unsigned long long chunkSize = scanner.GetChunkSize() == 0 ? fileSize : scanner.GetChunkSize();
+				const unsigned long long chunkNum = (fileSize + chunkSize - 1) / chunkSize;
+				if (chunkNum > 0x7FFFFFFF) {
+					return false;
+				}
+				std::vector<IndexChunk> chunks(static_cast<std::size_t>(chunkNum));
+				std::atomic<bool> failed(false);
+				pool.ParallelFor(static_cast<int>(chunkNum), [&](int index) {
+					if (failed.load()) {
+						return;
+					}
+					const unsigned long long begin = chunkSize * index;
+					const unsigned long long end = begin + chunkSize < fileSize ? begin + chunkSize : fileSize;
+					if (!scanner.Scan(file, begin, end, &chunks[index])) {
+						failed = true;
+					}
+				});
+				if (failed.load()) {
+					return false;
+				}
+
+				// 連結
+				std::vector<unsigned int> keyframes;
+				std::size_t frameCount = 0;
+				std::size_t audioCount = 0;
+				for (const IndexChunk& chunk : chunks) {
+					for (const IndexFrameEntry& frame : chunk.Frames) {
+						if ((frame.Flag & IndexFrameEntry::EntryFlag::Keyframe) == IndexFrameEntry::EntryFlag::Keyframe) {
+							keyframes.push_back(static_cast<unsigned int>(frameCount));
+						}
+						++frameCount;
+					}
+					audioCount += chunk.Audio.size();
+				}
+				header.Frame_Count = static_cast<unsigned int>(frameCount);
+				header.Keyframe_Count = static_cast<unsigned int>(keyframes.size());
+				header.Audio_Count = static_cast<unsigned int>(audioCount);
+				if (GetTotalSize(header) > 0x7FFFFFFF) {
+					return false;
+				}
+
+				m_blob.assign(static_cast<std::size_t>(GetTotalSize(header)), 0);
+				std::memcpy(m_blob.data(), &header, sizeof(header));
+				IndexFrameEntry* pFrames = reinterpret_cast<IndexFrameEntry*>(m_blob.data() + static_cast<std::size_t>(GetFramesOffset()));
+				IndexAudioEntry* pAudio = reinterpret_cast<IndexAudioEntry*>(m_blob.data() + static_cast<std::size_t>(GetAudioOffset(header)));
+				long long sample = 0;
+				for (IndexChunk& chunk : chunks) {
+					if (!chunk.Frames.empty()) {
+						std::memcpy(pFrames, chunk.Frames.data(), sizeof(IndexFrameEntry) * chunk.Frames.size());
+						pFrames += chunk.Frames.size();
+					}
+					for (IndexAudioEntry& entry : chunk.Audio) {
+						entry.Sample_Start = sample;
+						sample += entry.Sample_Count;
+						*pAudio++ = entry;
+					}
+					chunk = IndexChunk();
+				}
+				if (!keyframes.empty()) {
+					std::memcpy(m_blob.data() + static_cast<std::size_t>(GetKeyframesOffset(header)), keyframes.data(), sizeof(unsigned int) * keyframes.size());
+				}
+				return Attach(m_blob.data(), m_blob.size());
+			}
+
+			Utility::MappedView m_view;
+			std::vector<unsigned char> m_blob;
+			const Header* m_pHeader = nullptr;
+			const IndexFrameEntry* m_pFrames = nullptr;
+			const unsigned int* m_pKeyframes = nullptr;
+			const IndexAudioEntry* m_pAudio = nullptr;
+		};
+
+		// POD check
+		static_assert(std::is_pod<IndexFrameEntry>::value, "Error: IndexFrameEntry is non-POD.");
+		static_assert(std::is_pod<IndexAudioEntry>::value, "Error: IndexAudioEntry is non-POD.");
+		static_assert(std::is_pod<SidecarIndex::Header>::value, "Error: SidecarIndex::Header is non-POD.");
+
+		// Size check
+		static_assert(sizeof(IndexFrameEntry) == 16, "Error: IndexFrameEntry size does not fit.");
+		static_assert(sizeof(IndexAudioEntry) == 24, "Error: IndexAudioEntry size does not fit.");
+	}
+
+#endif
+}
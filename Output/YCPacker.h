@@ -0,0 +1,718 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "../Utility/FourCC.h"
+#include "../Utility/Simd.h"
+#include "../Utility/ThreadPool.h"
+#include <algorithm>    // std::min
+#include <cstddef>      // std::ptrdiff_t, std::size_t
+#include <cstring>      // std::memcpy, std::memset
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+#ifndef _WIN64 // x86環境のみ利用可能
+
+	/// <summary>
+	/// Output プラグイン
+	/// </summary>
+	namespace Output
+	{
+		/// <summary>
+		/// Pixel_YC (Y 0～4096, Cb/Cr ±2048) をエンコーダー向けの高ビット深度形式に詰め替えます
+		/// <para>P010 / P016 (4:2:0)、v210 (4:2:2)、4:4:4 16bit 平面に対応し、値の範囲の変換と色差の位置 (サイティング) を指定できます。</para>
+		/// <para>変換は SSSE3 で行い (使用できない場合はスカラー版)、スレッドプールを指定すると行のまとまり (スライス) ごとに並列化します。</para>
+		/// <para>10bit 形式は、符号 -> Pixel_YC -> 符号 の往復で元の符号に戻ります。16bit 形式は Pixel_YC -> 符号 -> Pixel_YC で元の値に戻ります。</para>
+		/// </summary>
+		namespace YCPacker
+		{
+			/// <summary>
+			/// 出力形式
+			/// </summary>
+			enum class PackedFormat : int {
+				/// <summary>
+				/// P010 (10bit 4:2:0、Y 平面 + UV 交互平面、16bit の上位 10bit に格納)
+				/// </summary>
+				P010,
+
+				/// <summary>
+				/// P016 (16bit 4:2:0、Y 平面 + UV 交互平面)
+				/// </summary>
+				P016,
+
+				/// <summary>
+				/// v210 (10bit 4:2:2、6 画素を 32bit x 4 に格納、1 行は 128byte 境界)
+				/// </summary>
+				V210,
+
+				/// <summary>
+				/// 4:4:4 16bit 平面 (Y, Cb, Cr の順に 3 平面)
+				/// </summary>
+				Yuv444P16,
+			};
+
+			/// <summary>
+			/// 出力する値の範囲
+			/// </summary>
+			enum class PackRange : int {
+				/// <summary>
+				/// リミテッドレンジ (8bit 換算で Y 16～235, C 16～240)
+				/// </summary>
+				Limited,
+
+				/// <summary>
+				/// フルレンジ (10bit は 0～1023、16bit は Pixel_YC の 16 倍)
+				/// </summary>
+				Full,
+			};
+
+			/// <summary>
+			/// 色差を間引く位置 (H.264 / HEVC の chroma_sample_loc_type)
+			/// </summary>
+			enum class ChromaSiting : int {
+				/// <summary>
+				/// 水平は左の画素と同位置、垂直は 2 行の中間 (type 0、MPEG-2 / BT.709 の既定)
+				/// </summary>
+				Left,
+
+				/// <summary>
+				/// 水平・垂直とも 2 画素の中間 (type 1、JPEG / MPEG-1)
+				/// </summary>
+				Center,
+
+				/// <summary>
+				/// 水平・垂直とも左上の画素と同位置 (type 2、BT.2020)
+				/// </summary>
+				TopLeft,
+			};
+
+			/// <summary>
+			/// 変換の設定
+			/// </summary>
+			struct PackOptions final
+			{
+				/// <summary>
+				/// 出力する値の範囲
+				/// </summary>
+				PackRange Range = PackRange::Limited;
+
+				/// <summary>
+				/// 色差を間引く位置 (4:2:0 / 4:2:2 のみ)
+				/// </summary>
+				ChromaSiting Siting = ChromaSiting::Left;
+			};
+
+			/// <summary>
+			/// 1 行のバイト数 (P010 / P016 / 4:4:4 は Y 平面の 1 行) を取得します
+			/// </summary>
+			/// <param name="format">出力形式</param>
+			/// <param name="width">画像の幅</param>
+			/// <returns>
+			/// 1 行のバイト数
+			/// </returns>
+			inline std::size_t GetPitch(PackedFormat format, int width)
+			{
+				if (format == PackedFormat::V210) {
+					return static_cast<std::size_t>((width + 47) / 48) * 128;
+				}
+				return static_cast<std::size_t>(width) * 2;
+			}
+
+			/// <summary>
+			/// 1 フレームのバイト数を取得します
+			/// </summary>
+			/// <param name="format">出力形式</param>
+			/// <param name="width">画像の幅</param>
+			/// <param name="height">画像の高さ</param>
+			/// <returns>
+			/// 1 フレームのバイト数
+			/// </returns>
+			inline std::size_t GetFrameSize(PackedFormat format, int width, int height)
+			{
+				const std::size_t plane = GetPitch(format, width) * height;
+				switch (format) {
+				case PackedFormat::P010:
+				case PackedFormat::P016:
+					return plane + plane / 2;
+				case PackedFormat::Yuv444P16:
+					return plane * 3;
+				default:
+					return plane;
+				}
+			}
+
+			/// <summary>
+			/// 出力形式の FOURCC を取得します
+			/// </summary>
+			/// <param name="format">出力形式</param>
+			/// <returns>
+			/// FOURCC (4:4:4 16bit 平面は対応する FOURCC がないため 0)
+			/// </returns>
+			inline unsigned long GetFourCC(PackedFormat format)
+			{
+				switch (format) {
+				case PackedFormat::P010: return Utility::FourCC::P010;
+				case PackedFormat::P016: return Utility::FourCC::P016;
+				case PackedFormat::V210: return Utility::FourCC::V210;
+				default: return 0;
+				}
+			}
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// 並列化するスライスの行数 (4:2:0 は 2 行の組の数)
+				/// </summary>
+				enum : int { SliceRows = 16 };
+
+				/// <summary>
+				/// Pixel_YC から符号への変換係数
+				/// <para>符号 = ((値 * Mul + Add) >> Shift) + Offset を 0～Max に丸めます。</para>
+				/// </summary>
+				struct Scale final
+				{
+					short Mul;
+					short Add;
+					int Shift;
+					int Offset;
+					int Max;
+				};
+
+				/// <summary>
+				/// 輝度と色差の変換係数
+				/// </summary>
+				struct Scales final
+				{
+					Scale Y;
+					Scale C;
+				};
+
+				/// <summary>
+				/// ビット深度と範囲から変換係数を取得します
+				/// </summary>
+				inline Scales GetScales(int bits, PackRange range)
+				{
+					if (bits == 10) {
+						// 4096 -> 876 (219 << 2) / 1023
+						return range == PackRange::Limited
+							? Scales{ { 219, 512, 10, 64, 1023 }, { 224, 512, 10, 512, 1023 } }
+							: Scales{ { 1023, 2048, 12, 0, 1023 }, { 1023, 2048, 12, 512, 1023 } };
+					}
+					// 4096 -> 56064 (219 << 8) / 65536
+					return range == PackRange::Limited
+						? Scales{ { 219, 8, 4, 4096, 65535 }, { 224, 8, 4, 32768, 65535 } }
+						: Scales{ { 256, 8, 4, 0, 65535 }, { 256, 8, 4, 32768, 65535 } };
+				}
+
+				/// <summary>
+				/// Pixel_YC の値を符号に変換します (スカラー版)
+				/// </summary>
+				inline int ToCode(int value, const Scale& s)
+				{
+					const int code = ((value * s.Mul + s.Add) >> s.Shift) + s.Offset;
+					return code < 0 ? 0 : code > s.Max ? s.Max : code;
+				}
+
+				/// <summary>
+				/// 符号を Pixel_YC の値に戻します (最も近い値、ToCode の逆変換)
+				/// </summary>
+				inline int FromCode(int code, const Scale& s)
+				{
+					const int numerator = (code - s.Offset) * (1 << s.Shift);
+					const int value = numerator >= 0 ? (numerator + s.Mul / 2) / s.Mul : -((-numerator + s.Mul / 2) / s.Mul);
+					return value < -32768 ? -32768 : value > 32767 ? 32767 : value;
+				}
+
+				/// <summary>
+				/// Pixel_YC の値 8 要素を符号に変換します (SSE2、ToCode と同じ結果)
+				/// </summary>
+				inline __m128i ToCode8(__m128i value, const Scale& s)
+				{
+					const __m128i one = _mm_set1_epi16(1);
+					const __m128i coefficient = _mm_set1_epi32(static_cast<int>(static_cast<unsigned short>(s.Mul) | (static_cast<unsigned int>(static_cast<unsigned short>(s.Add)) << 16)));
+					const __m128i count = _mm_cvtsi32_si128(s.Shift);
+					const __m128i offset = _mm_set1_epi32(s.Offset);
+					const __m128i lo = _mm_add_epi32(_mm_sra_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(value, one), coefficient), count), offset);
+					const __m128i hi = _mm_add_epi32(_mm_sra_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(value, one), coefficient), count), offset);
+					if (s.Max > 32767) {
+						// 符号なし 16bit への飽和は、32768 ずらして符号付きで飽和させてから戻す
+						const __m128i bias = _mm_set1_epi32(32768);
+						return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias)), _mm_set1_epi16(-32768));
+					}
+					return _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()), _mm_set1_epi16(static_cast<short>(s.Max)));
+				}
+
+				/// <summary>
+				/// 2 つの値の平均 ((a + b + 1) >> 1) を求めます
+				/// </summary>
+				inline int Average(int a, int b)
+				{
+					return (a + b + 1) >> 1;
+				}
+
+				/// <summary>
+				/// 符号付き 16bit 8 要素の平均 ((a + b + 1) >> 1) を桁あふれなしに求めます (SSE2)
+				/// </summary>
+				inline __m128i Average8(__m128i a, __m128i b)
+				{
+					const __m128i bias = _mm_set1_epi16(-32768);
+					return _mm_xor_si128(_mm_avg_epu16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias)), bias);
+				}
+
+				/// <summary>
+				/// 16 要素 (a, b) の偶数番目 8 要素を取り出します (SSE2)
+				/// </summary>
+				inline __m128i Even8(__m128i a, __m128i b)
+				{
+					return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+				}
+
+				/// <summary>
+				/// 16 要素 (a, b) の奇数番目 8 要素を取り出します (SSE2)
+				/// </summary>
+				inline __m128i Odd8(__m128i a, __m128i b)
+				{
+					return _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+				}
+
+				/// <summary>
+				/// 1 行の輝度を符号に変換します
+				/// </summary>
+				/// <param name="codeShift">符号を左シフトするビット数 (P010 は 6)</param>
+				/// <param name="simd">SSSE3 を使用する</param>
+				inline void LumaRow(const Filter::Pixel_YC* pSrc, unsigned short* pDst, int width, const Scale& s, int codeShift, bool simd)
+				{
+					int x = 0;
+					if (simd) {
+						const __m128i count = _mm_cvtsi32_si128(codeShift);
+						for (; x + 8 <= width; x += 8) {
+							__m128i y, cb, cr;
+							Utility::Simd::LoadYC8(pSrc + x, y, cb, cr);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x), _mm_sll_epi16(ToCode8(y, s), count));
+						}
+					}
+					for (; x < width; ++x) {
+						pDst[x] = static_cast<unsigned short>(ToCode(pSrc[x].Y, s) << codeShift);
+					}
+				}
+
+				/// <summary>
+				/// 1 行の色差を間引かずに符号に変換します (4:4:4)
+				/// </summary>
+				inline void ChromaRow444(const Filter::Pixel_YC* pSrc, unsigned short* pCb, unsigned short* pCr, int width, const Scale& s, bool simd)
+				{
+					int x = 0;
+					if (simd) {
+						for (; x + 8 <= width; x += 8) {
+							__m128i y, cb, cr;
+							Utility::Simd::LoadYC8(pSrc + x, y, cb, cr);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pCb + x), ToCode8(cb, s));
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pCr + x), ToCode8(cr, s));
+						}
+					}
+					for (; x < width; ++x) {
+						pCb[x] = static_cast<unsigned short>(ToCode(pSrc[x].Cb, s));
+						pCr[x] = static_cast<unsigned short>(ToCode(pSrc[x].Cr, s));
+					}
+				}
+
+				/// <summary>
+				/// 色差を垂直方向に間引きます (4:2:2 は pRow1 を nullptr にして取り出すだけにします)
+				/// <para>pCb / pCr は width + 2 要素で、[1] ～ [width] に書き込み、両端に端の値を複製します。</para>
+				/// </summary>
+				/// <param name="pPrev">pRow0 の 1 行上 (TopLeft のみ使用)</param>
+				/// <param name="pRow0">偶数行</param>
+				/// <param name="pRow1">奇数行 (nullptr なら垂直方向に間引きません)</param>
+				inline void VerticalChroma(const Filter::Pixel_YC* pPrev, const Filter::Pixel_YC* pRow0, const Filter::Pixel_YC* pRow1,
+					short* pCb, short* pCr, int width, ChromaSiting siting, bool simd)
+				{
+					const bool topLeft = siting == ChromaSiting::TopLeft;
+					int x = 0;
+					if (simd) {
+						for (; x + 8 <= width; x += 8) {
+							__m128i y, cb, cr;
+							Utility::Simd::LoadYC8(pRow0 + x, y, cb, cr);
+							if (pRow1 != nullptr) {
+								__m128i y1, cb1, cr1;
+								Utility::Simd::LoadYC8(pRow1 + x, y1, cb1, cr1);
+								if (topLeft) {
+									// [1, 2, 1] / 4
+									__m128i yp, cbp, crp;
+									Utility::Simd::LoadYC8(pPrev + x, yp, cbp, crp);
+									cb = Average8(Average8(cbp, cb1), cb);
+									cr = Average8(Average8(crp, cr1), cr);
+								}
+								else {
+									cb = Average8(cb, cb1);
+									cr = Average8(cr, cr1);
+								}
+							}
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pCb + 1 + x), cb);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pCr + 1 + x), cr);
+						}
+					}
+					for (; x < width; ++x) {
+						int cb = pRow0[x].Cb;
+						int cr = pRow0[x].Cr;
+						if (pRow1 != nullptr) {
+							cb = topLeft ? Average(Average(pPrev[x].Cb, pRow1[x].Cb), cb) : Average(cb, pRow1[x].Cb);
+							cr = topLeft ? Average(Average(pPrev[x].Cr, pRow1[x].Cr), cr) : Average(cr, pRow1[x].Cr);
+						}
+						pCb[1 + x] = static_cast<short>(cb);
+						pCr[1 + x] = static_cast<short>(cr);
+					}
+					pCb[0] = pCb[1];
+					pCr[0] = pCr[1];
+					pCb[width + 1] = pCb[width];
+					pCr[width + 1] = pCr[width];
+				}
+
+				/// <summary>
+				/// VerticalChroma() の結果を水平方向に間引いて符号に変換します
+				/// </summary>
+				/// <param name="pTemp">VerticalChroma() の結果 (width + 2 要素)</param>
+				/// <param name="pDst">符号 (count 要素)</param>
+				/// <param name="count">出力する色差の数 (幅の半分)</param>
+				inline void HorizontalChroma(const short* pTemp, unsigned short* pDst, int count, ChromaSiting siting, const Scale& s, int codeShift, bool simd)
+				{
+					const short* t = pTemp + 1;
+					const bool center = siting == ChromaSiting::Center;
+					int k = 0;
+					if (simd) {
+						const __m128i shift = _mm_cvtsi32_si128(codeShift);
+						for (; k + 8 <= count; k += 8) {
+							const short* p = t + 2 * k;
+							const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+							const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8));
+							__m128i c;
+							if (center) {
+								c = Average8(Even8(a, b), Odd8(a, b));
+							}
+							else {
+								// [1, 2, 1] / 4 (1 つ左から読んだ偶数番目が t[2k - 1])
+								const __m128i l0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 1));
+								const __m128i l1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 7));
+								c = Average8(Average8(Even8(l0, l1), Odd8(a, b)), Even8(a, b));
+							}
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + k), _mm_sll_epi16(ToCode8(c, s), shift));
+						}
+					}
+					for (; k < count; ++k) {
+						const int c = center ? Average(t[2 * k], t[2 * k + 1]) : Average(Average(t[2 * k - 1], t[2 * k + 1]), t[2 * k]);
+						pDst[k] = static_cast<unsigned short>(ToCode(c, s) << codeShift);
+					}
+				}
+
+				/// <summary>
+				/// Cb と Cr の符号を交互に並べます (UV 交互平面)
+				/// </summary>
+				inline void InterleaveRow(const unsigned short* pCb, const unsigned short* pCr, unsigned short* pDst, int count, bool simd)
+				{
+					int k = 0;
+					if (simd) {
+						for (; k + 8 <= count; k += 8) {
+							const __m128i cb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCb + k));
+							const __m128i cr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCr + k));
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + k * 2), _mm_unpacklo_epi16(cb, cr));
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + k * 2 + 8), _mm_unpackhi_epi16(cb, cr));
+						}
+					}
+					for (; k < count; ++k) {
+						pDst[k * 2 + 0] = pCb[k];
+						pDst[k * 2 + 1] = pCr[k];
+					}
+				}
+
+				/// <summary>
+				/// 10bit の符号 1 行分を v210 に詰めます (幅を超える部分と行末の余りは 0)
+				/// </summary>
+				inline void PackV210Row(const unsigned short* pY, const unsigned short* pCb, const unsigned short* pCr, int width, unsigned char* pDst, std::size_t pitch)
+				{
+					const int chroma = width / 2;
+					const auto y = [pY, width](int i) { return i < width ? static_cast<unsigned int>(pY[i]) : 0u; };
+					const auto cb = [pCb, chroma](int k) { return k < chroma ? static_cast<unsigned int>(pCb[k]) : 0u; };
+					const auto cr = [pCr, chroma](int k) { return k < chroma ? static_cast<unsigned int>(pCr[k]) : 0u; };
+					const int groups = (width + 5) / 6;
+					for (int g = 0; g < groups; ++g) {
+						const int i = g * 6;
+						const int k = g * 3;
+						const unsigned int words[4] = {
+							cb(k) | (y(i) << 10) | (cr(k) << 20),
+							y(i + 1) | (cb(k + 1) << 10) | (y(i + 2) << 20),
+							cr(k + 1) | (y(i + 3) << 10) | (cb(k + 2) << 20),
+							y(i + 4) | (cr(k + 2) << 10) | (y(i + 5) << 20),
+						};
+						std::memcpy(pDst + g * 16, words, sizeof(words));
+					}
+					std::memset(pDst + groups * 16, 0, pitch - static_cast<std::size_t>(groups) * 16);
+				}
+
+				/// <summary>
+				/// v210 の 1 行分を 10bit の符号に戻します
+				/// </summary>
+				inline void UnpackV210Row(const unsigned char* pSrc, unsigned short* pY, unsigned short* pCb, unsigned short* pCr, int width)
+				{
+					const int chroma = width / 2;
+					const int groups = (width + 5) / 6;
+					for (int g = 0; g < groups; ++g) {
+						unsigned int words[4];
+						std::memcpy(words, pSrc + g * 16, sizeof(words));
+						const unsigned int values[12] = {
+							words[0] & 1023, (words[0] >> 10) & 1023, (words[0] >> 20) & 1023,
+							words[1] & 1023, (words[1] >> 10) & 1023, (words[1] >> 20) & 1023,
+							words[2] & 1023, (words[2] >> 10) & 1023, (words[2] >> 20) & 1023,
+							words[3] & 1023, (words[3] >> 10) & 1023, (words[3] >> 20) & 1023,
+						};
+						// Cb0 Y0 Cr0 Y1 Cb1 Y2 Cr1 Y3 Cb2 Y4 Cr2 Y5
+						for (int j = 0; j < 6; ++j) {
+							if (g * 6 + j < width) {
+								pY[g * 6 + j] = static_cast<unsigned short>(values[j * 2 + 1]);
+							}
+						}
+						for (int j = 0; j < 3; ++j) {
+							if (g * 3 + j < chroma) {
+								pCb[g * 3 + j] = static_cast<unsigned short>(values[j * 4]);
+								pCr[g * 3 + j] = static_cast<unsigned short>(values[j * 4 + 2]);
+							}
+						}
+					}
+				}
+
+				/// <summary>
+				/// 0 ～ count-1 を SliceRows ごとのスライスに分けて処理します
+				/// </summary>
+				/// <param name="pPool">スレッドプール (nullptr なら呼び出し元のスレッドで処理します)</param>
+				/// <param name="func">void(int begin, int end) の関数オブジェクト</param>
+				template<class Func>
+				inline void ForEachSlice(Utility::ThreadPool* pPool, int count, Func&& func)
+				{
+					if (pPool == nullptr) {
+						func(0, count);
+						return;
+					}
+					const int slices = (count + SliceRows - 1) / SliceRows;
+					pPool->ParallelFor(slices, [count, &func](int index) {
+						func(index * SliceRows, (std::min)(count, (index + 1) * static_cast<int>(SliceRows)));
+					});
+				}
+
+				/// <summary>
+				/// 出力形式のビット深度と、符号を左シフトするビット数を取得します
+				/// </summary>
+				inline void GetCodeFormat(PackedFormat format, int* pBits, int* pCodeShift)
+				{
+					*pBits = format == PackedFormat::P010 || format == PackedFormat::V210 ? 10 : 16;
+					*pCodeShift = format == PackedFormat::P010 ? 6 : 0;
+				}
+
+				/// <summary>
+				/// 画像の大きさが出力形式に対応しているか調べます
+				/// </summary>
+				inline bool IsSupportedSize(PackedFormat format, int width, int height)
+				{
+					if (width <= 0 || height <= 0) {
+						return false;
+					}
+					switch (format) {
+					case PackedFormat::P010:
+					case PackedFormat::P016:
+						return (width & 1) == 0 && (height & 1) == 0;
+					case PackedFormat::V210:
+						return (width & 1) == 0;
+					default:
+						return true;
+					}
+				}
+			}
+
+			/// <summary>
+			/// Pixel_YC 形式の画像を詰め替えます
+			/// </summary>
+			/// <param name="pSrc">Pixel_YC 形式の画像</param>
+			/// <param name="srcLineSize">pSrc の 1 行のバイト数</param>
+			/// <param name="width">画像の幅 (4:2:0 / 4:2:2 は偶数)</param>
+			/// <param name="height">画像の高さ (4:2:0 は偶数)</param>
+			/// <param name="format">出力形式</param>
+			/// <param name="pDst">出力先 (GetFrameSize() バイト、1 行は GetPitch() バイト)</param>
+			/// <param name="options">変換の設定</param>
+			/// <param name="pPool">スライスを並列に処理するスレッドプール (nullptr なら呼び出し元のスレッドで処理します)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool Pack(const Filter::Pixel_YC* pSrc, int srcLineSize, int width, int height, PackedFormat format, void* pDst,
+				const PackOptions& options = PackOptions(), Utility::ThreadPool* pPool = nullptr)
+			{
+				if (pSrc == nullptr || pDst == nullptr || !Detail::IsSupportedSize(format, width, height)) {
+					return false;
+				}
+				int bits, codeShift;
+				Detail::GetCodeFormat(format, &bits, &codeShift);
+				const Detail::Scales scales = Detail::GetScales(bits, options.Range);
+				const bool simd = Utility::Simd::Has(Utility::Simd::Feature::SSSE3);
+				const std::size_t pitch = GetPitch(format, width);
+				unsigned char* pBase = static_cast<unsigned char*>(pDst);
+				const auto source = [pSrc, srcLineSize, height](int y) {
+					const int row = y < 0 ? 0 : y >= height ? height - 1 : y;
+					return reinterpret_cast<const Filter::Pixel_YC*>(reinterpret_cast<const unsigned char*>(pSrc) + static_cast<std::ptrdiff_t>(srcLineSize) * row);
+				};
+				const auto plane = [pBase, pitch](std::size_t index, int y) {
+					return reinterpret_cast<unsigned short*>(pBase + pitch * index + pitch * y);
+				};
+				const int chroma = width / 2;
+
+				switch (format) {
+				case PackedFormat::P010:
+				case PackedFormat::P016:
+					Detail::ForEachSlice(pPool, height / 2, [&](int begin, int end) {
+						std::vector<short> temp(static_cast<std::size_t>(width + 2) * 2);
+						std::vector<unsigned short> codes(static_cast<std::size_t>(chroma) * 2);
+						short* pCbTemp = temp.data();
+						short* pCrTemp = temp.data() + width + 2;
+						for (int j = begin; j < end; ++j) {
+							Detail::LumaRow(source(j * 2), plane(0, j * 2), width, scales.Y, codeShift, simd);
+							Detail::LumaRow(source(j * 2 + 1), plane(0, j * 2 + 1), width, scales.Y, codeShift, simd);
+							Detail::VerticalChroma(source(j * 2 - 1), source(j * 2), source(j * 2 + 1), pCbTemp, pCrTemp, width, options.Siting, simd);
+							Detail::HorizontalChroma(pCbTemp, codes.data(), chroma, options.Siting, scales.C, codeShift, simd);
+							Detail::HorizontalChroma(pCrTemp, codes.data() + chroma, chroma, options.Siting, scales.C, codeShift, simd);
+							Detail::InterleaveRow(codes.data(), codes.data() + chroma, plane(height, j), chroma, simd);
+						}
+					});
+					return true;
+
+				case PackedFormat::V210:
+					Detail::ForEachSlice(pPool, height, [&](int begin, int end) {
+						std::vector<short> temp(static_cast<std::size_t>(width + 2) * 2);
+						std::vector<unsigned short> codes(static_cast<std::size_t>(width) * 2);
+						short* pCbTemp = temp.data();
+						short* pCrTemp = temp.data() + width + 2;
+						unsigned short* pY = codes.data();
+						unsigned short* pCb = codes.data() + width;
+						unsigned short* pCr = codes.data() + width + chroma;
+						for (int y = begin; y < end; ++y) {
+							Detail::LumaRow(source(y), pY, width, scales.Y, 0, simd);
+							Detail::VerticalChroma(nullptr, source(y), nullptr, pCbTemp, pCrTemp, width, options.Siting, simd);
+							Detail::HorizontalChroma(pCbTemp, pCb, chroma, options.Siting, scales.C, 0, simd);
+							Detail::HorizontalChroma(pCrTemp, pCr, chroma, options.Siting, scales.C, 0, simd);
+							Detail::PackV210Row(pY, pCb, pCr, width, pBase + pitch * y, pitch);
+						}
+					});
+					return true;
+
+				default:
+					Detail::ForEachSlice(pPool, height, [&](int begin, int end) {
+						for (int y = begin; y < end; ++y) {
+							Detail::LumaRow(source(y), plane(0, y), width, scales.Y, 0, simd);
+							Detail::ChromaRow444(source(y), plane(height, y), plane(static_cast<std::size_t>(height) * 2, y), width, scales.C, simd);
+						}
+					});
+					return true;
+				}
+			}
+
+			/// <summary>
+			/// 詰め替えた画像を Pixel_YC 形式に戻します
+			/// <para>色差は最も近い位置の値を複製して拡大します (往復の確認や、プレビュー向けです)。</para>
+			/// </summary>
+			/// <param name="pSrc">Pack() で出力した画像</param>
+			/// <param name="format">pSrc の形式</param>
+			/// <param name="width">画像の幅</param>
+			/// <param name="height">画像の高さ</param>
+			/// <param name="pDst">Pixel_YC 形式の出力先</param>
+			/// <param name="dstLineSize">pDst の 1 行のバイト数</param>
+			/// <param name="range">pSrc の値の範囲</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool Unpack(const void* pSrc, PackedFormat format, int width, int height, Filter::Pixel_YC* pDst, int dstLineSize, PackRange range = PackRange::Limited)
+			{
+				if (pSrc == nullptr || pDst == nullptr || !Detail::IsSupportedSize(format, width, height)) {
+					return false;
+				}
+				int bits, codeShift;
+				Detail::GetCodeFormat(format, &bits, &codeShift);
+				const Detail::Scales scales = Detail::GetScales(bits, range);
+				const std::size_t pitch = GetPitch(format, width);
+				const unsigned char* pBase = static_cast<const unsigned char*>(pSrc);
+				const auto plane = [pBase, pitch](std::size_t index, int y) {
+					return reinterpret_cast<const unsigned short*>(pBase + pitch * index + pitch * y);
+				};
+				std::vector<unsigned short> codes(format == PackedFormat::V210 ? static_cast<std::size_t>(width) * 2 : 0);
+
+				for (int y = 0; y < height; ++y) {
+					Filter::Pixel_YC* pRow = reinterpret_cast<Filter::Pixel_YC*>(reinterpret_cast<unsigned char*>(pDst) + static_cast<std::ptrdiff_t>(dstLineSize) * y);
+					const unsigned short* pY;
+					const unsigned short* pCb;
+					const unsigned short* pCr;
+					int chromaStep = 2;
+					int codeStep = 1;
+					switch (format) {
+					case PackedFormat::P010:
+					case PackedFormat::P016:
+						pY = plane(0, y);
+						pCb = plane(height, y / 2);
+						pCr = pCb + 1;
+						codeStep = 2;
+						break;
+					case PackedFormat::V210:
+						Detail::UnpackV210Row(pBase + pitch * y, codes.data(), codes.data() + width, codes.data() + width + width / 2, width);
+						pY = codes.data();
+						pCb = codes.data() + width;
+						pCr = codes.data() + width + width / 2;
+						break;
+					default:
+						pY = plane(0, y);
+						pCb = plane(height, y);
+						pCr = plane(static_cast<std::size_t>(height) * 2, y);
+						chromaStep = 1;
+						break;
+					}
+					for (int x = 0; x < width; ++x) {
+						const int k = (x / chromaStep) * codeStep;
+						pRow[x].Y = static_cast<short>(Detail::FromCode(pY[x] >> codeShift, scales.Y));
+						pRow[x].Cb = static_cast<short>(Detail::FromCode(pCb[k] >> codeShift, scales.C));
+						pRow[x].Cr = static_cast<short>(Detail::FromCode(pCr[k] >> codeShift, scales.C));
+					}
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// 出力フレームを Pixel_YC 形式で取得し、詰め替えます
+			/// <para>GetVideoEx() で 'Y''C''4''8' を要求するため、出力プラグインの Output() から呼び出してください。</para>
+			/// </summary>
+			/// <param name="info">出力ファイル情報</param>
+			/// <param name="frame">フレーム番号</param>
+			/// <param name="format">出力形式</param>
+			/// <param name="pDst">出力先 (GetFrameSize() バイト)</param>
+			/// <param name="options">変換の設定</param>
+			/// <param name="pPool">スライスを並列に処理するスレッドプール (nullptr なら呼び出し元のスレッドで処理します)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool PackVideo(const OutputInfo& info, int frame, PackedFormat format, void* pDst,
+				const PackOptions& options = PackOptions(), Utility::ThreadPool* pPool = nullptr)
+			{
+				if (info.GetVideoEx == nullptr) {
+					return false;
+				}
+				const Filter::Pixel_YC* pFrame = static_cast<const Filter::Pixel_YC*>(info.GetVideoEx(frame, Utility::FourCC::YC48));
+				if (pFrame == nullptr) {
+					return false;
+				}
+				return Pack(pFrame, info.Width * static_cast<int>(sizeof(Filter::Pixel_YC)), info.Width, info.Height, format, pDst, options, pPool);
+			}
+		}
+	}
+
+#endif
+}
@@ -0,0 +1,373 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// AudioKernel のテスト
+// Fade / CrossFade のゲインが直線 (start + (end - start) × f / frames) から 1 以内で、続けて呼び出した場合に段差が生じないことを確認します。
+// Fade / CrossFade / Measure / MixMatrix (と Gain / MixAdd) の結果を、このファイルのスカラー実装と完全に一致するか比較します。
+// SSE2 で処理するチャンネル数 (1, 2, 4, 8) とスカラーで処理するチャンネル数、8 サンプルに満たない端数を含めます。
+// 併せて、SSE2 の実装とスカラー実装の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Utility/AudioKernel.h"
+#include <algorithm>    // std::min, std::max
+#include <climits>      // INT_MIN
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	short Saturate(long long value)
+	{
+		return static_cast<short>((std::min)((std::max)(value, -32768LL), 32767LL));
+	}
+
+	short MulQ12(int sample, int gain)
+	{
+		return Saturate((static_cast<long long>(sample) * gain + AudioKernel::Unity / 2) >> 12);
+	}
+
+	/// <summary>
+	/// 直線的に変化するゲインのフレーム f の値 (start + (end - start) × f / frames を四捨五入)
+	/// </summary>
+	int LinearGain(int start, int end, int frames, int frame)
+	{
+		const long long numerator = 2LL * (end - start) * frame + frames;
+		const long long denominator = 2LL * frames;
+		const long long quotient = numerator / denominator - ((numerator % denominator) < 0 ? 1 : 0);
+		return static_cast<int>(start + quotient);
+	}
+
+	// スカラー実装 (フレームごとのゲインを指定)
+
+	void ScalarFade(short* pData, int frames, int channels, const std::vector<int>& gains)
+	{
+		for (int f = 0; f < frames; ++f) {
+			for (int c = 0; c < channels; ++c) {
+				pData[f * channels + c] = MulQ12(pData[f * channels + c], gains[f]);
+			}
+		}
+	}
+
+	void ScalarCrossFade(short* pDst, const short* pA, const short* pB, int frames, int channels, const std::vector<int>& weights)
+	{
+		for (int f = 0; f < frames; ++f) {
+			const int w = weights[f];
+			for (int c = 0; c < channels; ++c) {
+				const int i = f * channels + c;
+				pDst[i] = Saturate((static_cast<long long>(pA[i]) * (AudioKernel::Unity - w) + static_cast<long long>(pB[i]) * w + AudioKernel::Unity / 2) >> 12);
+			}
+		}
+	}
+
+	std::vector<int> LinearGains(int start, int end, int frames)
+	{
+		std::vector<int> gains(frames);
+		for (int f = 0; f < frames; ++f) {
+			gains[f] = LinearGain(start, end, frames, f);
+		}
+		return gains;
+	}
+
+	/// <summary>
+	/// 全て 1.0 の音声に Fade() を掛けて、フレームごとのゲインを取得します (チャンネルごとに異なる場合は INT_MIN)
+	/// </summary>
+	std::vector<int> ProbeFade(int frames, int channels, int startGain, int endGain)
+	{
+		std::vector<short> data(static_cast<std::size_t>(frames) * channels, static_cast<short>(AudioKernel::Unity));
+		AudioKernel::Fade(data.data(), frames, channels, startGain, endGain);
+		std::vector<int> gains(frames);
+		for (int f = 0; f < frames; ++f) {
+			gains[f] = data[static_cast<std::size_t>(f) * channels];
+			for (int c = 1; c < channels; ++c) {
+				gains[f] = (data[static_cast<std::size_t>(f) * channels + c] == gains[f]) ? gains[f] : INT_MIN;
+			}
+		}
+		return gains;
+	}
+
+	/// <summary>
+	/// A を 0、B を 1.0 として CrossFade() を掛けて、フレームごとの重みを取得します
+	/// </summary>
+	std::vector<int> ProbeCrossFade(int frames, int channels, int startWeight, int endWeight)
+	{
+		const std::vector<short> a(static_cast<std::size_t>(frames) * channels, short(0));
+		const std::vector<short> b(a.size(), static_cast<short>(AudioKernel::Unity));
+		std::vector<short> data(a.size());
+		AudioKernel::CrossFade(data.data(), a.data(), b.data(), frames, channels, startWeight, endWeight);
+		std::vector<int> weights(frames);
+		for (int f = 0; f < frames; ++f) {
+			weights[f] = data[static_cast<std::size_t>(f) * channels];
+			for (int c = 1; c < channels; ++c) {
+				weights[f] = (data[static_cast<std::size_t>(f) * channels + c] == weights[f]) ? weights[f] : INT_MIN;
+			}
+		}
+		return weights;
+	}
+
+	/// <summary>
+	/// 取得したゲインが直線から 1 以上離れていないか調べます
+	/// </summary>
+	bool NearLinear(const std::vector<int>& gains, int start, int end)
+	{
+		const int frames = static_cast<int>(gains.size());
+		for (int f = 0; f < frames; ++f) {
+			const int expected = LinearGain(start, end, frames, f);
+			if (gains[f] < expected - 1 || gains[f] > expected + 1) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void ScalarMeasure(const short* pData, int frames, int channels, AudioKernel::Level* pLevels)
+	{
+		for (int f = 0; f < frames; ++f) {
+			for (int c = 0; c < channels; ++c) {
+				const int value = pData[f * channels + c];
+				pLevels[c].Peak = (std::max)(pLevels[c].Peak, value < 0 ? -value : value);
+				pLevels[c].SumSquares += static_cast<unsigned long long>(static_cast<long long>(value) * value);
+				pLevels[c].Count += 1;
+			}
+		}
+	}
+
+	void ScalarMixMatrix(short* pDst, int dstChannels, const short* pSrc, int srcChannels, int frames, const short* pMatrix)
+	{
+		std::vector<short> out(static_cast<std::size_t>(frames) * dstChannels);
+		for (int f = 0; f < frames; ++f) {
+			for (int d = 0; d < dstChannels; ++d) {
+				long long sum = 0;
+				for (int s = 0; s < srcChannels; ++s) {
+					sum += static_cast<long long>(pSrc[f * srcChannels + s]) * pMatrix[d * srcChannels + s];
+				}
+				out[static_cast<std::size_t>(f) * dstChannels + d] = Saturate((sum + AudioKernel::Unity / 2) >> 12);
+			}
+		}
+		std::copy(out.begin(), out.end(), pDst);
+	}
+
+	std::vector<short> MakeSamples(std::size_t count, Test::Random& random)
+	{
+		std::vector<short> samples(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			// 飽和を確認するため、最大値と最小値を混ぜます
+			const int kind = random.Range(0, 15);
+			samples[i] = static_cast<short>(kind == 0 ? 32767 : kind == 1 ? -32768 : random.Range(-32768, 32767));
+		}
+		return samples;
+	}
+
+	bool SameLevels(const std::vector<AudioKernel::Level>& a, const std::vector<AudioKernel::Level>& b)
+	{
+		for (std::size_t c = 0; c < a.size(); ++c) {
+			if (a[c].Peak != b[c].Peak || a[c].SumSquares != b[c].SumSquares || a[c].Count != b[c].Count) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void TestChannels(int channels, int frames, Test::Random& random)
+	{
+		const std::size_t count = static_cast<std::size_t>(frames) * channels;
+		const std::vector<short> a = MakeSamples(count, random);
+		const std::vector<short> b = MakeSamples(count, random);
+
+		// Fade (範囲外のゲインと負のゲインを含む)
+		// ゲインは直線から 1 以内で、SSE2 で処理しないチャンネル数 (3) と同じであること
+		const int gains[][2] = { { 0, 4096 }, { 4096, 0 }, { -3000, 30000 }, { 40000, -40000 }, { 4096, 4096 } };
+		for (const auto& gain : gains) {
+			const int start = (std::min)((std::max)(gain[0], -32768), 32767);
+			const int end = (std::min)((std::max)(gain[1], -32768), 32767);
+			const std::vector<int> probed = ProbeFade(frames, channels, gain[0], gain[1]);
+			AU_CHECK(NearLinear(probed, start, end));
+			AU_CHECK(probed == ProbeFade(frames, 3, gain[0], gain[1]));
+
+			std::vector<short> expected = a;
+			std::vector<short> actual = a;
+			ScalarFade(expected.data(), frames, channels, probed);
+			AudioKernel::Fade(actual.data(), frames, channels, gain[0], gain[1]);
+			AU_CHECK(actual == expected);
+		}
+
+		// CrossFade (出力先が入力と同じ場合を含む)
+		const int weights[][2] = { { 0, 4096 }, { 4096, 0 }, { 1000, 3000 }, { -100, 5000 } };
+		for (const auto& weight : weights) {
+			const int start = (std::min)((std::max)(weight[0], 0), static_cast<int>(AudioKernel::Unity));
+			const int end = (std::min)((std::max)(weight[1], 0), static_cast<int>(AudioKernel::Unity));
+			const std::vector<int> probed = ProbeCrossFade(frames, channels, weight[0], weight[1]);
+			AU_CHECK(NearLinear(probed, start, end));
+			AU_CHECK(probed == ProbeCrossFade(frames, 3, weight[0], weight[1]));
+
+			std::vector<short> expected(count);
+			std::vector<short> actual(count);
+			ScalarCrossFade(expected.data(), a.data(), b.data(), frames, channels, probed);
+			AudioKernel::CrossFade(actual.data(), a.data(), b.data(), frames, channels, weight[0], weight[1]);
+			AU_CHECK(actual == expected);
+
+			std::vector<short> inPlace = a;
+			AudioKernel::CrossFade(inPlace.data(), inPlace.data(), b.data(), frames, channels, weight[0], weight[1]);
+			AU_CHECK(inPlace == expected);
+		}
+
+		// Measure (2 回呼び出して累積を確認)
+		{
+			std::vector<AudioKernel::Level> expected(channels);
+			std::vector<AudioKernel::Level> actual(channels);
+			ScalarMeasure(a.data(), frames, channels, expected.data());
+			ScalarMeasure(b.data(), frames, channels, expected.data());
+			AudioKernel::Measure(a.data(), frames, channels, actual.data());
+			AudioKernel::Measure(b.data(), frames, channels, actual.data());
+			AU_CHECK(SameLevels(actual, expected));
+		}
+
+		// Gain / MixAdd
+		for (const int gain : { 0, 4096, 3000, -4096, 20000, 40000 }) {
+			std::vector<short> expected = a;
+			std::vector<short> actual = a;
+			for (short& value : expected) {
+				value = MulQ12(value, (std::min)(gain, 32767));
+			}
+			AudioKernel::Gain(actual.data(), static_cast<int>(count), gain);
+			AU_CHECK(actual == expected);
+
+			expected = a;
+			actual = a;
+			for (std::size_t i = 0; i < count; ++i) {
+				expected[i] = Saturate(expected[i] + MulQ12(b[i], (std::min)(gain, 32767)));
+			}
+			AudioKernel::MixAdd(actual.data(), b.data(), static_cast<int>(count), gain);
+			AU_CHECK(actual == expected);
+		}
+	}
+
+	void TestMixMatrix(int srcChannels, int dstChannels, int frames, Test::Random& random)
+	{
+		// 出力チャンネルごとの係数の絶対値の和が 32767 以下になるようにします
+		std::vector<short> matrix(static_cast<std::size_t>(srcChannels) * dstChannels);
+		for (short& value : matrix) {
+			value = static_cast<short>(random.Range(-32767 / srcChannels, 32767 / srcChannels));
+		}
+		const std::vector<short> src = MakeSamples(static_cast<std::size_t>(frames) * srcChannels, random);
+		std::vector<short> expected(static_cast<std::size_t>(frames) * dstChannels);
+		std::vector<short> actual(expected.size());
+		ScalarMixMatrix(expected.data(), dstChannels, src.data(), srcChannels, frames, matrix.data());
+		AU_CHECK(AudioKernel::MixMatrix(actual.data(), dstChannels, src.data(), srcChannels, frames, matrix.data()));
+		AU_CHECK(actual == expected);
+
+		if (srcChannels == dstChannels) {
+			std::vector<short> inPlace = src;
+			AU_CHECK(AudioKernel::MixMatrix(inPlace.data(), dstChannels, inPlace.data(), srcChannels, frames, matrix.data()));
+			AU_CHECK(inPlace == expected);
+		}
+	}
+
+	/// <summary>
+	/// 長いフェードが終了値に達し、続けて呼び出した場合に段差が生じないことを確認します
+	/// </summary>
+	void TestRampContinuity()
+	{
+		for (const int channels : { 1, 2, 3, 8 }) {
+			// 1 秒のフェードの最終フレームは終了値から 1 以内
+			const std::vector<int> in = ProbeFade(48000, channels, 0, AudioKernel::Unity);
+			const std::vector<int> out = ProbeFade(48000, channels, AudioKernel::Unity, 0);
+			AU_CHECK(NearLinear(in, 0, AudioKernel::Unity) && in.back() >= AudioKernel::Unity - 1);
+			AU_CHECK(NearLinear(out, AudioKernel::Unity, 0) && out.back() <= 1);
+			const std::vector<int> cross = ProbeCrossFade(48000, channels, AudioKernel::Unity, 0);
+			AU_CHECK(NearLinear(cross, AudioKernel::Unity, 0) && cross.back() <= 1);
+
+			// 2 回の呼び出しのつなぎ目の差は 1 フレーム分の変化量以内
+			const std::vector<int> first = ProbeFade(4801, channels, 0, 3000);
+			const std::vector<int> second = ProbeFade(997, channels, 3000, -2000);
+			AU_CHECK(second.front() == 3000);
+			AU_CHECK(first.back() >= 3000 - 2 && first.back() <= 3000);
+
+			// ブロックごとに分けて呼び出しても、1 回のフェードと 1 以内で一致する
+			const int blockFrames = 480;
+			const int blocks = 200;
+			const std::vector<int> whole = LinearGains(-32768, 32767, blockFrames * blocks);
+			bool joined = true;
+			for (int block = 0; block < blocks; ++block) {
+				const int start = LinearGain(-32768, 32767, blockFrames * blocks, block * blockFrames);
+				const int end = (block + 1 < blocks) ? LinearGain(-32768, 32767, blockFrames * blocks, (block + 1) * blockFrames) : 32767;
+				const std::vector<int> part = ProbeFade(blockFrames, channels, start, end);
+				for (int f = 0; f < blockFrames; ++f) {
+					const int expected = whole[static_cast<std::size_t>(block) * blockFrames + f];
+					joined = joined && part[f] >= expected - 1 && part[f] <= expected + 1;
+				}
+			}
+			AU_CHECK(joined);
+		}
+	}
+
+	/// <summary>
+	/// 48kHz ステレオ 60 秒分の処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		const int frames = 48000 * 60;
+		const std::vector<short> a = MakeSamples(static_cast<std::size_t>(frames) * 2, random);
+		const std::vector<short> b = MakeSamples(a.size(), random);
+		std::vector<short> work(a.size());
+		std::vector<short> mono(frames);
+		const short pan[4] = { 3000, 1000, 500, 3500 };
+		const short down[2] = { 2048, 2048 };
+		AudioKernel::Level levels[2];
+
+		// スカラー実装はコンパイラの自動ベクトル化の対象になる場合があります
+		std::printf("throughput (48 kHz stereo, 60 s), AudioKernel / scalar:\n");
+		const std::vector<int> fade = LinearGains(4096, 3000, frames);
+		const std::vector<int> cross = LinearGains(0, 4096, frames);
+		std::printf("  Fade      %.2f / %.2f ms\n",
+			Test::Measure([&]() { AudioKernel::Fade(work.data(), frames, 2, 4096, 3000); }),
+			Test::Measure([&]() { ScalarFade(work.data(), frames, 2, fade); }));
+		std::printf("  CrossFade %.2f / %.2f ms\n",
+			Test::Measure([&]() { AudioKernel::CrossFade(work.data(), a.data(), b.data(), frames, 2, 0, 4096); }),
+			Test::Measure([&]() { ScalarCrossFade(work.data(), a.data(), b.data(), frames, 2, cross); }));
+		std::printf("  Measure   %.2f / %.2f ms\n",
+			Test::Measure([&]() { AudioKernel::Measure(a.data(), frames, 2, levels); }),
+			Test::Measure([&]() { ScalarMeasure(a.data(), frames, 2, levels); }));
+		std::printf("  MixMatrix 2->2 %.2f / %.2f ms, 2->1 %.2f / %.2f ms\n",
+			Test::Measure([&]() { AudioKernel::MixMatrix(work.data(), 2, a.data(), 2, frames, pan); }),
+			Test::Measure([&]() { ScalarMixMatrix(work.data(), 2, a.data(), 2, frames, pan); }),
+			Test::Measure([&]() { AudioKernel::MixMatrix(mono.data(), 1, a.data(), 2, frames, down); }),
+			Test::Measure([&]() { ScalarMixMatrix(mono.data(), 1, a.data(), 2, frames, down); }));
+
+		// 結果を使用して、計測した処理が省略されないようにします
+		std::printf("  (checksum %d)\n", work[frames] + mono[frames / 2] + levels[0].Peak + static_cast<int>(levels[1].SumSquares & 0xFF));
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	for (int channels = 1; channels <= AudioKernel::MaxChannels; ++channels) {
+		for (const int frames : { 0, 1, 3, 7, 8, 9, 33, 1001, 4800 }) {
+			TestChannels(channels, frames, random);
+		}
+	}
+
+	const int layouts[][2] = { { 2, 2 }, { 1, 2 }, { 2, 1 }, { 1, 1 }, { 3, 2 }, { 2, 6 }, { 6, 2 }, { 8, 8 } };
+	for (const auto& layout : layouts) {
+		for (const int frames : { 0, 1, 3, 4, 7, 8, 9, 17, 1001 }) {
+			TestMixMatrix(layout[0], layout[1], frames, random);
+		}
+	}
+
+	// 範囲外のチャンネル数は失敗します
+	{
+		short sample = 0;
+		const short matrix[1] = { 4096 };
+		AU_CHECK(!AudioKernel::MixMatrix(&sample, 0, &sample, 1, 1, matrix));
+		AU_CHECK(!AudioKernel::MixMatrix(&sample, 1, &sample, AudioKernel::MaxChannels + 1, 1, matrix));
+	}
+
+	TestRampContinuity();
+	Benchmark(random);
+
+	return Test::Finish("AudioKernelTest");
+}
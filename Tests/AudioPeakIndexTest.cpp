@@ -0,0 +1,281 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// AudioPeakIndex のテスト
+// Query() の最小値・最大値・実効値を、音声から直接求めた値と比較します。Invalidate() した範囲の作り直しと、Save() / Load() の往復を確認します。
+// バイト数の取得とデータの保存の間にバックグラウンドの構築が進んでも、Save() が渡した領域の外に書き込まないことを確認します。
+// 併せて、インデックスの構築と Query() の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Utility/AudioPeakIndex.h"
+#include <algorithm>            // std::min, std::max, std::count
+#include <atomic>               // std::atomic
+#include <chrono>               // std::chrono::milliseconds
+#include <cmath>                // std::sqrt, std::fabs
+#include <condition_variable>   // std::condition_variable
+#include <cstring>              // std::memcpy
+#include <mutex>                // std::mutex, std::unique_lock, std::lock_guard
+#include <thread>               // std::this_thread
+#include <vector>               // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	/// <summary>
+	/// テスト用の音声 (チャンネルごとに異なる値)
+	/// </summary>
+	short SampleAt(long long frame, int channel, int seed)
+	{
+		std::uint32_t x = static_cast<std::uint32_t>(frame * 2654435761u) ^ static_cast<std::uint32_t>(channel * 40503 + seed * 977);
+		x ^= x >> 15;
+		x *= 0x2C1B3C6Du;
+		x ^= x >> 12;
+		return static_cast<short>(x);
+	}
+
+	AudioPeakIndex::Loader MakeLoader(int channels, long long total, int seed)
+	{
+		return [channels, total, seed](long long start, int length, short* pBuffer) {
+			const int frames = static_cast<int>((std::min)(static_cast<long long>(length), total - start));
+			for (int f = 0; f < frames; ++f) {
+				for (int c = 0; c < channels; ++c) {
+					pBuffer[f * channels + c] = SampleAt(start + f, c, seed);
+				}
+			}
+			return frames;
+		};
+	}
+
+	/// <summary>
+	/// Query() の結果を音声から直接求めた値と比較します
+	/// <para>1 ピクセルの範囲はバケット単位に広がるため、比較する範囲も同じ規則で求めます。</para>
+	/// </summary>
+	bool CheckQuery(const AudioPeakIndex& index, int channel, long long start, long long end, int pixels, int seed)
+	{
+		std::vector<AudioPeakIndex::Peak> peaks(pixels);
+		if (!index.Query(channel, start, end, pixels, peaks.data())) {
+			return false;
+		}
+		const long long total = index.GetTotalSamples();
+		start = (std::max)(start, 0ll);
+		end = (std::min)(end, total);
+		const long long samplesPerPixel = (end - start) / pixels;
+		long long bucketSamples = AudioPeakIndex::BucketSamples;
+		for (int level = 1; level < AudioPeakIndex::LevelCount && bucketSamples * AudioPeakIndex::LevelRatio <= samplesPerPixel; ++level) {
+			bucketSamples *= AudioPeakIndex::LevelRatio;
+		}
+		for (int p = 0; p < pixels; ++p) {
+			const long long s0 = start + (end - start) * p / pixels;
+			const long long s1 = start + (end - start) * (p + 1) / pixels;
+			const long long b0 = s0 / bucketSamples;
+			const long long b1 = (std::max)((s1 + bucketSamples - 1) / bucketSamples, b0 + 1);
+			const long long f0 = b0 * bucketSamples;
+			const long long f1 = (std::min)(b1 * bucketSamples, total);
+			short mn = 32767;
+			short mx = -32768;
+			double sum = 0.0;
+			for (long long f = f0; f < f1; ++f) {
+				const short value = SampleAt(f, channel, seed);
+				mn = (std::min)(mn, value);
+				mx = (std::max)(mx, value);
+				sum += static_cast<double>(value) * value;
+			}
+			const double rms = f1 > f0 ? std::sqrt(sum / (f1 - f0)) : 0.0;
+			// 二乗和は float で累積するため、相対誤差を許容します
+			if (peaks[p].Min != mn || peaks[p].Max != mx || std::fabs(peaks[p].Rms - rms) > rms * 1e-3 + 1e-3) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void TestQuery(int channels)
+	{
+		const long long total = AudioPeakIndex::ChunkSamples * 3 + 12345;
+		AudioPeakIndex index(channels, total, MakeLoader(channels, total, 1));
+		std::vector<AudioPeakIndex::Peak> peaks(16);
+		AU_CHECK(!index.Query(0, 0, total, 16, peaks.data()));
+		AU_CHECK(!index.Update(2));
+		AU_CHECK(index.GetProgress() == 0.5);
+		AU_CHECK(index.Update(10));
+
+		for (int c = 0; c < channels; ++c) {
+			AU_CHECK(CheckQuery(index, c, 0, total, 1, 1));
+			AU_CHECK(CheckQuery(index, c, 0, total, 37, 1));
+			AU_CHECK(CheckQuery(index, c, 1000, 1000 + 256 * 100, 100, 1));
+			AU_CHECK(CheckQuery(index, c, 777, 777 + 4096 * 9 + 5, 9, 1));
+			AU_CHECK(CheckQuery(index, c, total - 300, total + 1000, 3, 1));
+		}
+		AU_CHECK(!index.Query(channels, 0, total, 1, peaks.data()));
+	}
+
+	void TestInvalidate()
+	{
+		const int channels = 2;
+		const long long total = AudioPeakIndex::ChunkSamples * 4;
+		std::atomic<int> seed{ 1 };
+		AudioPeakIndex index(channels, total, [&](long long start, int length, short* pBuffer) {
+			for (int f = 0; f < length; ++f) {
+				for (int c = 0; c < channels; ++c) {
+					pBuffer[f * channels + c] = SampleAt(start + f, c, seed);
+				}
+			}
+			return length;
+		});
+		AU_CHECK(index.Update(4));
+
+		// 2 番目のチャンクだけを作り直す (他のチャンクは古い音声のまま)
+		seed = 2;
+		index.Invalidate(AudioPeakIndex::ChunkSamples + 10, 1);
+		AU_CHECK(!index.IsComplete());
+		AU_CHECK(index.GetProgress() == 0.75);
+		AU_CHECK(index.Update(1));
+		AU_CHECK(CheckQuery(index, 1, AudioPeakIndex::ChunkSamples, AudioPeakIndex::ChunkSamples * 2, 64, 2));
+		AU_CHECK(CheckQuery(index, 0, 0, AudioPeakIndex::ChunkSamples, 64, 1));
+		AU_CHECK(!CheckQuery(index, 0, 0, AudioPeakIndex::ChunkSamples, 64, 2));
+	}
+
+	void TestSaveLoad()
+	{
+		const int channels = 3;
+		const long long total = AudioPeakIndex::ChunkSamples * 5 + 100;
+		AudioPeakIndex index(channels, total, MakeLoader(channels, total, 3));
+		int size = 0;
+		AU_CHECK(!index.Save(nullptr, &size) && size == 0);
+
+		index.Update(2);
+		index.Invalidate(0, 1);
+		AU_CHECK(index.Save(nullptr, &size) && size > 0);
+		std::vector<unsigned char> data(size);
+		AU_CHECK(index.Save(data.data(), &size) && size == static_cast<int>(data.size()));
+
+		AudioPeakIndex loaded(channels, total, MakeLoader(channels, total, 3));
+		AU_CHECK(loaded.Load(data.data(), size));
+		AU_CHECK(loaded.GetProgress() == index.GetProgress());
+		AU_CHECK(CheckQuery(loaded, 2, AudioPeakIndex::ChunkSamples, AudioPeakIndex::ChunkSamples * 2, 20, 3));
+		AU_CHECK(loaded.Update(10));
+		AU_CHECK(CheckQuery(loaded, 1, 0, total, 50, 3));
+
+		// チャンネル数・総サンプル数・バイト数が一致しない場合は読み込まない
+		AudioPeakIndex other(channels, total + 1, MakeLoader(channels, total + 1, 3));
+		AU_CHECK(!other.Load(data.data(), size));
+		AU_CHECK(!loaded.Load(data.data(), size - 1));
+		AU_CHECK(!loaded.Load(nullptr, size));
+	}
+
+	/// <summary>
+	/// バイト数を取得した後にバックグラウンドの構築でチャンクが増えても、渡した領域の外に書き込まないことを確認します
+	/// </summary>
+	void TestSaveDuringBuild()
+	{
+		const int channels = 2;
+		const long long total = AudioPeakIndex::ChunkSamples * 6;
+		const unsigned char guard = 0xA5;
+		const int guardBytes = 1 << 20;
+		ThreadPool pool(1);
+
+		// ProjectSave の 2 回の呼び出しの間に構築を完了させる
+		{
+			AudioPeakIndex index(channels, total, MakeLoader(channels, total, 4), &pool);
+			index.Update(1);
+			int size = 0;
+			AU_CHECK(index.Save(nullptr, &size));
+			const int queried = size;
+
+			index.StartBuild();
+			while (!index.IsComplete()) {
+				std::this_thread::yield();
+			}
+
+			std::vector<unsigned char> data(static_cast<std::size_t>(queried) + guardBytes, guard);
+			AU_CHECK(index.Save(data.data(), &size));
+			AU_CHECK(size == queried);
+			AU_CHECK(std::count(data.begin() + queried, data.end(), guard) == guardBytes);
+
+			// 収まった分だけが構築済みとして読み込まれる
+			AudioPeakIndex loaded(channels, total, MakeLoader(channels, total, 4));
+			AU_CHECK(loaded.Load(data.data(), size));
+			AU_CHECK(loaded.GetProgress() * 6 == 1.0);
+			AU_CHECK(CheckQuery(loaded, 1, 0, AudioPeakIndex::ChunkSamples, 10, 4));
+
+			// ヘッダに満たない領域には何も保存しない
+			size = 10;
+			AU_CHECK(!index.Save(data.data(), &size) && size == 0);
+		}
+
+		// 構築中に繰り返し保存する
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+			int allowed = 1;
+			auto load = MakeLoader(channels, total, 5);
+			AudioPeakIndex index(channels, total, [&](long long start, int length, short* pBuffer) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					condition.wait(lock, [&]() { return start / AudioPeakIndex::ChunkSamples < allowed; });
+				}
+				return load(start, length, pBuffer);
+			}, &pool);
+			index.StartBuild();
+
+			for (int step = 1; step <= 6; ++step) {
+				int size = 0;
+				index.Save(nullptr, &size);
+				const int queried = size;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					allowed = step + 1;
+				}
+				condition.notify_all();
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+				std::vector<unsigned char> data(static_cast<std::size_t>(queried) + guardBytes, guard);
+				size = queried;
+				index.Save(data.data(), &size);
+				AU_CHECK(size <= queried);
+				AU_CHECK(std::count(data.begin() + queried, data.end(), guard) == guardBytes);
+			}
+			while (!index.IsComplete()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	/// <summary>
+	/// 48kHz ステレオ 10 分の構築と、全体を 1920 ピクセルで取得する処理時間を出力します
+	/// </summary>
+	void Benchmark()
+	{
+		const int channels = 2;
+		const long long total = 48000LL * 600;
+		std::vector<short> samples(static_cast<std::size_t>(total) * channels);
+		for (std::size_t i = 0; i < samples.size(); ++i) {
+			samples[i] = SampleAt(static_cast<long long>(i / channels), static_cast<int>(i % channels), 6);
+		}
+		AudioPeakIndex index(channels, total, [&](long long start, int length, short* pBuffer) {
+			std::memcpy(pBuffer, samples.data() + start * channels, sizeof(short) * length * channels);
+			return length;
+		});
+		std::vector<AudioPeakIndex::Peak> peaks(1920);
+		std::printf("48 kHz stereo, 10 min: build %.2f ms, query (1920 px) whole / 1 s %.3f / %.3f ms\n",
+			Test::Measure([&]() { index.Reset(total); index.Update(1 << 20); }),
+			Test::Measure([&]() { index.Query(0, 0, total, 1920, peaks.data()); }),
+			Test::Measure([&]() { index.Query(0, 48000 * 300, 48000 * 301, 1920, peaks.data()); }));
+	}
+}
+
+int main()
+{
+	for (const int channels : { 1, 2, 3, 6, 8, 10 }) {
+		TestQuery(channels);
+	}
+	TestInvalidate();
+	TestSaveLoad();
+	TestSaveDuringBuild();
+	Benchmark();
+
+	return Test::Finish("AudioPeakIndexTest");
+}
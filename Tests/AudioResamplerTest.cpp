@@ -0,0 +1,317 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// AudioResampler のテスト
+// 出力を、同じ窓付き sinc を正確な位相で double で計算した結果と比較します (位相数の上限を超える変換比では、位相の丸めによる誤差の範囲内か確認します)。
+// 分割して Push() / Pull() した結果と一度に変換した結果、Seek() した位置からの結果が一致すること、正弦波を正確に変換することを確認します。
+// 併せて、48kHz → 44.1kHz の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Utility/AudioResampler.h"
+#include <algorithm>    // std::min, std::max, std::copy, std::equal
+#include <cmath>        // std::sin, std::sqrt, std::fabs
+#include <numeric>      // std::gcd
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	/// <summary>
+	/// 帯域を制限したテスト信号 (入力の 1/8 以下の周波数の正弦波の和、振幅 0.9 以下)
+	/// </summary>
+	struct Signal final
+	{
+		double Frequencies[3];
+		double Amplitudes[3] = { 0.4, 0.3, 0.2 };
+
+		explicit Signal(int srcRate)
+		{
+			Frequencies[0] = srcRate * 0.01;
+			Frequencies[1] = srcRate * 0.047;
+			Frequencies[2] = srcRate * 0.11;
+		}
+
+		double At(double position, int srcRate) const
+		{
+			double value = 0.0;
+			for (int i = 0; i < 3; ++i) {
+				value += Amplitudes[i] * std::sin(2.0 * Pi * Frequencies[i] * position / srcRate + i);
+			}
+			return value;
+		}
+
+		/// <summary>
+		/// 1 サンプルあたりの変化量の上限
+		/// </summary>
+		double MaxSlope(int srcRate) const
+		{
+			double slope = 0.0;
+			for (int i = 0; i < 3; ++i) {
+				slope += Amplitudes[i] * 2.0 * Pi * Frequencies[i] / srcRate;
+			}
+			return slope;
+		}
+
+		std::vector<float> Make(int frames, int srcRate) const
+		{
+			std::vector<float> samples(frames);
+			for (int n = 0; n < frames; ++n) {
+				samples[n] = static_cast<float>(At(n, srcRate));
+			}
+			return samples;
+		}
+	};
+
+	double BesselI0(double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+		for (int k = 1; k < 64; ++k) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	/// <summary>
+	/// 出力 n を、正確な位相の窓付き sinc (Normal の設計値) で求めます
+	/// </summary>
+	double Reference(const std::vector<float>& input, long long n, int srcRate, int dstRate, int taps)
+	{
+		const double beta = 8.0;
+		const double cutoff = 0.94 * (std::min)(1.0, static_cast<double>(dstRate) / srcRate);
+		const long long position = n * srcRate;
+		const long long index = position / dstRate;
+		const double fraction = static_cast<double>(position % dstRate) / dstRate;
+		const int half = taps / 2;
+		double sum = 0.0;
+		double weight = 0.0;
+		for (int k = 0; k < taps; ++k) {
+			const double distance = (k - half + 1) - fraction;
+			const double x = distance * cutoff;
+			const double sinc = (x == 0.0) ? 1.0 : std::sin(Pi * x) / (Pi * x);
+			const double ratio = distance / half;
+			const double w = (ratio <= -1.0 || ratio >= 1.0) ? 0.0 : BesselI0(beta * std::sqrt(1.0 - ratio * ratio)) / BesselI0(beta);
+			const long long source = index - half + 1 + k;
+			const double sample = (source >= 0 && source < static_cast<long long>(input.size())) ? input[static_cast<std::size_t>(source)] : 0.0;
+			sum += sample * sinc * w;
+			weight += sinc * w;
+		}
+		return sum / weight;
+	}
+
+	/// <summary>
+	/// 先頭から一度に変換します (先頭より前は無音)
+	/// </summary>
+	std::vector<float> Convert(AudioResampler& resampler, const std::vector<float>& input, int outputFrames)
+	{
+		const long long first = resampler.Seek(0);
+		resampler.Push(static_cast<const float* const*>(nullptr), static_cast<int>(-first));
+		const float* pInput = input.data();
+		resampler.Push(&pInput, static_cast<int>(input.size()));
+		resampler.Push(static_cast<const float* const*>(nullptr), resampler.GetTaps());
+		std::vector<float> output(outputFrames);
+		float* pOutput = output.data();
+		AU_CHECK(resampler.Pull(&pOutput, outputFrames) == outputFrames);
+		return output;
+	}
+
+	/// <summary>
+	/// 正確な位相で計算した結果と比較します
+	/// </summary>
+	void TestReference(int srcRate, int dstRate)
+	{
+		const Signal signal(srcRate);
+		const std::vector<float> input = signal.Make(4000, srcRate);
+		AudioResampler resampler(1, srcRate, dstRate);
+		const int outputFrames = static_cast<int>(resampler.ToDestination(4000));
+		const std::vector<float> output = Convert(resampler, input, outputFrames);
+
+		// 位相を 1024 分割に丸める場合、位相の誤差は 0.5 / 1024 サンプル以内
+		const bool exact = (dstRate / std::gcd(srcRate, dstRate)) <= 1024;
+		const double tolerance = exact ? 2e-6 : signal.MaxSlope(srcRate) * 0.5 / 1024 + 2e-6;
+		double error = 0.0;
+		for (int n = 0; n < outputFrames; ++n) {
+			error = (std::max)(error, std::fabs(output[n] - Reference(input, n, srcRate, dstRate, resampler.GetTaps())));
+		}
+		AU_CHECK(error <= tolerance);
+	}
+
+	/// <summary>
+	/// 分割して変換した結果と一度に変換した結果を比較します
+	/// </summary>
+	void TestChunked(int channels, int srcRate, int dstRate, Test::Random& random)
+	{
+		const int frames = 30000;
+		std::vector<short> input(static_cast<std::size_t>(frames) * channels);
+		for (short& value : input) {
+			value = static_cast<short>(random.Range(-20000, 20000));
+		}
+
+		AudioResampler whole(channels, srcRate, dstRate, AudioResampler::Quality::High);
+		const long long first = whole.Seek(0);
+		whole.Push(static_cast<const short*>(nullptr), static_cast<int>(-first));
+		whole.Push(input.data(), frames);
+		const int available = whole.GetAvailable();
+		AU_CHECK(available > 0 && available <= whole.ToDestination(frames));
+		std::vector<short> expected(static_cast<std::size_t>(available) * channels);
+		AU_CHECK(whole.Pull(expected.data(), available) == available);
+		AU_CHECK(whole.GetAvailable() == 0);
+
+		AudioResampler chunked(channels, srcRate, dstRate, AudioResampler::Quality::High);
+		chunked.Push(static_cast<const short*>(nullptr), static_cast<int>(-chunked.Seek(0)));
+		std::vector<short> actual;
+		std::vector<short> buffer;
+		for (int done = 0; done < frames;) {
+			const int count = (std::min)(frames - done, random.Range(1, 2500));
+			chunked.Push(input.data() + static_cast<std::size_t>(done) * channels, count);
+			done += count;
+			const int pull = random.Range(0, chunked.GetAvailable());
+			buffer.resize(static_cast<std::size_t>(pull) * channels);
+			AU_CHECK(chunked.Pull(buffer.data(), pull) == pull);
+			actual.insert(actual.end(), buffer.begin(), buffer.end());
+		}
+		const int rest = chunked.GetAvailable();
+		buffer.resize(static_cast<std::size_t>(rest) * channels);
+		chunked.Pull(buffer.data(), rest);
+		actual.insert(actual.end(), buffer.begin(), buffer.end());
+		AU_CHECK(actual == expected);
+	}
+
+	/// <summary>
+	/// Seek() した位置からの結果と、先頭から変換した結果を比較します
+	/// </summary>
+	void TestSeek(int srcRate, int dstRate, Test::Random& random)
+	{
+		const int frames = 20000;
+		const int channels = 2;
+		std::vector<short> input(static_cast<std::size_t>(frames) * channels);
+		for (short& value : input) {
+			value = static_cast<short>(random.Range(-20000, 20000));
+		}
+		auto load = [&](long long start, int length, short* pBuffer) {
+			const int count = static_cast<int>((std::max)((std::min)(static_cast<long long>(length), frames - start), 0ll));
+			std::copy(input.begin() + static_cast<std::ptrdiff_t>(start) * channels, input.begin() + static_cast<std::ptrdiff_t>(start + count) * channels, pBuffer);
+			return count;
+		};
+
+		AudioResampleReader sequential(load, channels, srcRate, dstRate);
+		const int total = static_cast<int>(AudioResampler(channels, srcRate, dstRate).ToDestination(frames));
+		std::vector<short> expected(static_cast<std::size_t>(total) * channels);
+		for (int done = 0; done < total;) {
+			const int count = (std::min)(total - done, 1601);
+			AU_CHECK(sequential.Read(done, count, expected.data() + static_cast<std::size_t>(done) * channels) == count);
+			done += count;
+		}
+
+		// 読み込み位置を飛ばしても、同じ位置の出力は同じ
+		AudioResampleReader seeking(load, channels, srcRate, dstRate);
+		bool same = true;
+		for (int i = 0; i < 40; ++i) {
+			const int start = random.Range(0, total - 1);
+			const int count = (std::min)(random.Range(1, 3000), total - start);
+			std::vector<short> block(static_cast<std::size_t>(count) * channels);
+			AU_CHECK(seeking.Read(start, count, block.data()) == count);
+			same = same && std::equal(block.begin(), block.end(), expected.begin() + static_cast<std::ptrdiff_t>(start) * channels);
+		}
+		AU_CHECK(same);
+
+		// AudioResampler::Seek() の戻り値の位置から入力すれば、先頭から変換した場合と同じ
+		AudioResampler resampler(channels, srcRate, dstRate);
+		const int target = total / 3;
+		const long long source = resampler.Seek(target);
+		AU_CHECK(source <= resampler.ToSource(target));
+		resampler.Push(input.data() + static_cast<std::size_t>(source) * channels, static_cast<int>(frames - source));
+		std::vector<short> block(static_cast<std::size_t>(500) * channels);
+		AU_CHECK(resampler.Pull(block.data(), 500) == 500);
+		AU_CHECK(std::equal(block.begin(), block.end(), expected.begin() + static_cast<std::ptrdiff_t>(target) * channels));
+
+		// 末尾の後ろは無音
+		std::vector<short> tail(static_cast<std::size_t>(100) * channels, 1);
+		AU_CHECK(seeking.Read(total + 10000, 100, tail.data()) <= 100);
+	}
+
+	/// <summary>
+	/// 1kHz の正弦波を変換し、理想的な正弦波との差の実効値を求めます
+	/// </summary>
+	double SineError(int srcRate, int dstRate, AudioResampler::Quality quality)
+	{
+		const int frames = srcRate / 2;
+		std::vector<float> input(frames);
+		for (int n = 0; n < frames; ++n) {
+			input[n] = static_cast<float>(0.5 * std::sin(2.0 * Pi * 1000.0 * n / srcRate));
+		}
+		AudioResampler resampler(1, srcRate, dstRate, quality);
+		const int outputFrames = static_cast<int>(resampler.ToDestination(frames));
+		const std::vector<float> output = Convert(resampler, input, outputFrames);
+
+		// 先頭と末尾の無音との境界は除きます
+		const int margin = resampler.GetTaps() * 2 * dstRate / srcRate + 8;
+		double sum = 0.0;
+		int count = 0;
+		for (int n = margin; n < outputFrames - margin; ++n) {
+			const double expected = 0.5 * std::sin(2.0 * Pi * 1000.0 * n / dstRate);
+			sum += (output[n] - expected) * (output[n] - expected);
+			++count;
+		}
+		return std::sqrt(sum / count) / (0.5 / std::sqrt(2.0));
+	}
+
+	void TestSine()
+	{
+		const int rates[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 48000, 8000 }, { 22050, 96000 }, { 48000, 44101 } };
+		for (const auto& rate : rates) {
+			AU_CHECK(SineError(rate[0], rate[1], AudioResampler::Quality::Fast) < 1e-2);
+			AU_CHECK(SineError(rate[0], rate[1], AudioResampler::Quality::Normal) < 1e-3);
+			AU_CHECK(SineError(rate[0], rate[1], AudioResampler::Quality::High) < 1e-4);
+		}
+	}
+
+	/// <summary>
+	/// 48kHz → 44.1kHz ステレオ 60 秒分の処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		const int frames = 48000 * 60;
+		std::vector<short> input(static_cast<std::size_t>(frames) * 2);
+		for (short& value : input) {
+			value = static_cast<short>(random.Range(-20000, 20000));
+		}
+		std::vector<short> output(static_cast<std::size_t>(44100) * 60 * 2 + 16);
+		std::printf("48 kHz -> 44.1 kHz stereo, 60 s:");
+		for (const auto quality : { AudioResampler::Quality::Fast, AudioResampler::Quality::Normal, AudioResampler::Quality::High }) {
+			AudioResampler resampler(2, 48000, 44100, quality);
+			std::printf(" %d taps %.2f ms", resampler.GetTaps(), Test::Measure([&]() {
+				resampler.Reset();
+				for (int done = 0; done < frames; done += 4800) {
+					resampler.Push(input.data() + static_cast<std::size_t>(done) * 2, 4800);
+					resampler.Pull(output.data(), resampler.GetAvailable());
+				}
+			}, 3));
+		}
+		std::printf("\n");
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	const int rates[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 48000, 32000 }, { 8000, 48000 }, { 48000, 48000 }, { 48000, 44101 }, { 44101, 48000 } };
+	for (const auto& rate : rates) {
+		TestReference(rate[0], rate[1]);
+		TestSeek(rate[0], rate[1], random);
+		for (const int channels : { 1, 2, 3, 6 }) {
+			TestChunked(channels, rate[0], rate[1], random);
+		}
+	}
+	TestSine();
+	Benchmark(random);
+
+	return Test::Finish("AudioResamplerTest");
+}
@@ -0,0 +1,275 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// Blitter のテスト
+// ランダムに配置した画像 (はみ出し、透明度、画素ごとの不透明度、合成モードを含む) の合成結果を、CopyYC() と同じ式で 1 画素ずつ合成するスカラー実装と比較します。
+// 不透明度が 0 の区間の読み飛ばしと完全に不透明な区間のコピーを通る配置を含め、スレッド数によらず同じ結果になることを確認します。
+// 併せて、1 枚ずつ合成する場合と Draw() でまとめて合成する場合の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Filter/Blitter.h"
+#include <algorithm>    // std::min, std::max
+#include <cstring>      // std::memcmp
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+
+namespace
+{
+	/// <summary>
+	/// コピー元の画像と不透明度
+	/// </summary>
+	struct Source final
+	{
+		int Width = 0;
+		int Height = 0;
+		int Pitch = 0;
+		std::vector<Pixel_YC> Pixels;
+		std::vector<short> Alpha;
+	};
+
+	Source MakeSource(int width, int height, bool alpha, Test::Random& random)
+	{
+		Source source;
+		source.Width = width;
+		source.Height = height;
+		source.Pitch = width + random.Range(0, 5);
+		source.Pixels.resize(static_cast<std::size_t>(source.Pitch) * height);
+		for (Pixel_YC& p : source.Pixels) {
+			// 加算・減算の飽和を含めるため、範囲の端の値を混ぜます
+			const int kind = random.Range(0, 7);
+			p.Y = static_cast<short>(kind == 0 ? 32767 : kind == 1 ? -32768 : random.Range(-2000, 6000));
+			p.Cb = static_cast<short>(random.Range(-3000, 3000));
+			p.Cr = static_cast<short>(kind == 2 ? -32768 : random.Range(-3000, 3000));
+		}
+		if (alpha) {
+			source.Alpha.resize(source.Pixels.size());
+			// 0 と 4096 が 8 画素以上続く区間を作ります
+			for (std::size_t i = 0; i < source.Alpha.size();) {
+				const int run = random.Range(1, 24);
+				const int kind = random.Range(0, 3);
+				for (int r = 0; r < run && i < source.Alpha.size(); ++r, ++i) {
+					source.Alpha[i] = static_cast<short>(kind == 0 ? 0 : kind == 1 ? Blitter::AlphaMax : random.Range(0, Blitter::AlphaMax));
+				}
+			}
+		}
+		return source;
+	}
+
+	BlitItem MakeItem(const Source& source, int dstWidth, int dstHeight, Test::Random& random)
+	{
+		BlitItem item = {};
+		item.pSrc = source.Pixels.data();
+		item.SrcLineSize = source.Pitch * static_cast<int>(sizeof(Pixel_YC));
+		item.SrcX = random.Range(0, source.Width / 4);
+		item.SrcY = random.Range(0, source.Height / 4);
+		item.Width = random.Range(1, source.Width - item.SrcX);
+		item.Height = random.Range(1, source.Height - item.SrcY);
+		item.X = random.Range(-item.Width, dstWidth);
+		item.Y = random.Range(-item.Height, dstHeight);
+		const int kind = random.Range(0, 5);
+		item.Transparent = kind == 0 ? 0 : kind == 1 ? -100 : kind == 2 ? 5000 : random.Range(0, Blitter::AlphaMax);
+		item.Mode = static_cast<BlendMode>(random.Range(0, 5) < 3 ? 0 : random.Range(1, 2));
+		item.pAlpha = source.Alpha.empty() ? nullptr : source.Alpha.data();
+		item.AlphaStride = source.Pitch;
+		return item;
+	}
+
+	/// <summary>
+	/// CopyYC() と同じ式で 1 画素ずつ合成します
+	/// </summary>
+	void ReferenceBlit(Pixel_YC* pDst, int dstPitch, int width, int height, const BlitItem& item)
+	{
+		if (item.pSrc == nullptr) {
+			return;
+		}
+		const int opacity = Blitter::AlphaMax - (std::max)(0, (std::min)(item.Transparent, static_cast<int>(Blitter::AlphaMax)));
+		for (int y = 0; y < item.Height; ++y) {
+			for (int x = 0; x < item.Width; ++x) {
+				const int dx = item.X + x;
+				const int dy = item.Y + y;
+				if (dx < 0 || dy < 0 || dx >= width || dy >= height) {
+					continue;
+				}
+				const int sx = item.SrcX + x;
+				const int sy = item.SrcY + y;
+				const Pixel_YC& src = *reinterpret_cast<const Pixel_YC*>(reinterpret_cast<const unsigned char*>(item.pSrc) + static_cast<std::size_t>(sy) * item.SrcLineSize + sx * sizeof(Pixel_YC));
+				const int alpha = item.pAlpha != nullptr ? (item.pAlpha[sy * item.AlphaStride + sx] * opacity + Blitter::AlphaMax / 2) >> 12 : opacity;
+				Pixel_YC& dst = pDst[dy * dstPitch + dx];
+				short* pChannels[3] = { &dst.Y, &dst.Cb, &dst.Cr };
+				const int values[3] = { src.Y, src.Cb, src.Cr };
+				for (int c = 0; c < 3; ++c) {
+					const int d = *pChannels[c];
+					int s = values[c];
+					// 飽和加算・飽和減算
+					if (item.Mode == BlendMode::Add) {
+						s = (std::max)((std::min)(d + s, 32767), -32768);
+					}
+					else if (item.Mode == BlendMode::Subtract) {
+						s = (std::max)((std::min)(d - s, 32767), -32768);
+					}
+					*pChannels[c] = static_cast<short>((d * (Blitter::AlphaMax - alpha) + s * alpha + Blitter::AlphaMax / 2) >> 12);
+				}
+			}
+		}
+	}
+
+	std::vector<Pixel_YC> MakeFrame(int pitch, int height, Test::Random& random)
+	{
+		std::vector<Pixel_YC> frame(static_cast<std::size_t>(pitch) * height);
+		for (Pixel_YC& p : frame) {
+			p.Y = static_cast<short>(random.Range(0, 4096));
+			p.Cb = static_cast<short>(random.Range(-2048, 2048));
+			p.Cr = static_cast<short>(random.Range(-2048, 2048));
+		}
+		return frame;
+	}
+
+	bool SameImage(const std::vector<Pixel_YC>& a, const std::vector<Pixel_YC>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), sizeof(Pixel_YC) * a.size()) == 0;
+	}
+
+	void TestRandom(Test::Random& random)
+	{
+		for (int round = 0; round < 200; ++round) {
+			const int width = random.Range(1, 150);
+			const int height = random.Range(1, 60);
+			const int pitch = width + random.Range(0, 9);
+			const int count = random.Range(1, 6);
+			std::vector<Source> sources;
+			sources.reserve(count);
+			Blitter blitter;
+			std::vector<BlitItem> items;
+			for (int i = 0; i < count; ++i) {
+				sources.push_back(MakeSource(random.Range(1, 120), random.Range(1, 50), random.Range(0, 1) == 0, random));
+				items.push_back(MakeItem(sources.back(), width, height, random));
+				blitter.Add(items.back());
+			}
+
+			const std::vector<Pixel_YC> frame = MakeFrame(pitch, height, random);
+			std::vector<Pixel_YC> expected = frame;
+			for (const BlitItem& item : items) {
+				ReferenceBlit(expected.data(), pitch, width, height, item);
+			}
+
+			std::vector<Pixel_YC> actual = frame;
+			AU_CHECK(blitter.Draw(actual.data(), pitch * static_cast<int>(sizeof(Pixel_YC)), width, height));
+			AU_CHECK(SameImage(actual, expected));
+
+			// スレッド数によらず同じ (Draw() は何度でも呼び出せます)
+			for (const int threads : { 1, 3, 7 }) {
+				Test::GetThreadNum() = threads;
+				std::vector<Pixel_YC> threaded = frame;
+				AU_CHECK(blitter.Draw(threaded.data(), pitch * static_cast<int>(sizeof(Pixel_YC)), width, height, Test::ExecMultiThread));
+				AU_CHECK(SameImage(threaded, expected));
+			}
+			Test::GetThreadNum() = 4;
+		}
+	}
+
+	void TestPaths(Test::Random& random)
+	{
+		const int width = 64;
+		const int height = 8;
+		const std::vector<Pixel_YC> frame = MakeFrame(width, height, random);
+		Source source = MakeSource(width, height, true, random);
+
+		// 全画素が不透明度 0 なら何も変わらない (8 画素単位の読み飛ばしと端数)
+		std::fill(source.Alpha.begin(), source.Alpha.end(), short(0));
+		{
+			Blitter blitter;
+			BlitItem item = MakeItem(source, width, height, random);
+			item.SrcX = item.SrcY = item.X = item.Y = 0;
+			item.Width = 61;
+			item.Height = height;
+			item.Transparent = 0;
+			item.Mode = BlendMode::Add;
+			blitter.Add(item);
+			std::vector<Pixel_YC> actual = frame;
+			AU_CHECK(blitter.Draw(actual.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height));
+			AU_CHECK(SameImage(actual, frame));
+		}
+
+		// 完全に不透明な通常合成はコピーと同じ (pAlpha あり・なし)
+		std::fill(source.Alpha.begin(), source.Alpha.end(), static_cast<short>(Blitter::AlphaMax));
+		for (const bool alpha : { false, true }) {
+			Blitter blitter;
+			blitter.Add(0, 0, source.Pixels.data(), source.Pitch * static_cast<int>(sizeof(Pixel_YC)), 0, 0, 61, height, 0);
+			if (alpha) {
+				blitter.Clear();
+				BlitItem item = { source.Pixels.data(), source.Pitch * static_cast<int>(sizeof(Pixel_YC)), 0, 0, 61, height, 0, 0, 0, BlendMode::Normal, source.Alpha.data(), source.Pitch };
+				blitter.Add(item);
+			}
+			std::vector<Pixel_YC> actual = frame;
+			AU_CHECK(blitter.Draw(actual.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height));
+			bool copied = true;
+			for (int y = 0; y < height; ++y) {
+				copied = copied && std::memcmp(&actual[y * width], &source.Pixels[y * source.Pitch], 61 * sizeof(Pixel_YC)) == 0;
+				copied = copied && std::memcmp(&actual[y * width + 61], &frame[y * width + 61], 3 * sizeof(Pixel_YC)) == 0;
+			}
+			AU_CHECK(copied);
+		}
+
+		// 透明度 4096 と nullptr の画像、範囲外の画像は無視する
+		{
+			Blitter blitter;
+			blitter.Add(0, 0, source.Pixels.data(), source.Pitch * static_cast<int>(sizeof(Pixel_YC)), 0, 0, width, height, 4096);
+			blitter.Add(0, 0, nullptr, 0, 0, 0, width, height, 0);
+			blitter.Add(width, 0, source.Pixels.data(), source.Pitch * static_cast<int>(sizeof(Pixel_YC)), 0, 0, width, height, 0);
+			blitter.Add(-width, -height, source.Pixels.data(), source.Pitch * static_cast<int>(sizeof(Pixel_YC)), 0, 0, width, height, 0);
+			std::vector<Pixel_YC> actual = frame;
+			AU_CHECK(blitter.Draw(actual.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height, Test::ExecMultiThread));
+			AU_CHECK(SameImage(actual, frame));
+		}
+	}
+
+	/// <summary>
+	/// 1920x1080 に 256x256 の画像 40 枚 (半数は画素ごとの不透明度あり) を合成する処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		const int width = 1920;
+		const int height = 1080;
+		std::vector<Source> sources;
+		for (int i = 0; i < 40; ++i) {
+			sources.push_back(MakeSource(256, 256, i % 2 == 0, random));
+		}
+		Blitter blitter;
+		std::vector<BlitItem> items;
+		for (const Source& source : sources) {
+			BlitItem item = MakeItem(source, width, height, random);
+			item.SrcX = item.SrcY = 0;
+			item.Width = item.Height = 256;
+			item.Transparent = 0;
+			item.Mode = BlendMode::Normal;
+			items.push_back(item);
+			blitter.Add(item);
+		}
+		std::vector<Pixel_YC> frame = MakeFrame(width, height, random);
+		const int lineSize = width * static_cast<int>(sizeof(Pixel_YC));
+		std::printf("1920x1080, 40 x 256x256: per item / Draw 1 thread / Draw %d threads: %.2f / %.2f / %.2f ms\n", Test::GetThreadNum(),
+			Test::Measure([&]() {
+				for (const BlitItem& item : items) {
+					Blitter single;
+					single.Add(item);
+					single.Draw(frame.data(), lineSize, width, height);
+				}
+			}),
+			Test::Measure([&]() { blitter.Draw(frame.data(), lineSize, width, height); }),
+			Test::Measure([&]() { blitter.Draw(frame.data(), lineSize, width, height, Test::ExecMultiThread); }));
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	TestRandom(random);
+	TestPaths(random);
+	Benchmark(random);
+
+	return Test::Finish("BlitterTest");
+}
@@ -0,0 +1,355 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// ColorConverter のテスト
+// スカラー / SSSE3 / AVX2 の結果が、ランダムなフォーマット・マトリクス・レンジ・ディザ・上下反転の組み合わせで完全に一致するか比較します。
+// BT.601 の RGB → Pixel_YC が AviUtl の既定の変換と ±2 以内で一致し、RGB24 の全色が Pixel_YC を経由して元に戻ることを確認します。
+// 誤差拡散の結果がスレッド数によらないことを確認し、1920x1080 の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Color/ColorConverter.h"
+#include <algorithm>    // std::copy, std::max
+#include <cmath>        // std::abs
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Color;
+using namespace AviUtl::Color::ColorConverter;
+
+namespace
+{
+	/// <summary>
+	/// 比較する命令セット
+	/// </summary>
+	std::vector<Detail::Path> GetPaths()
+	{
+		std::vector<Detail::Path> paths = { Detail::Path::Scalar };
+		if (Utility::Simd::Has(Utility::Simd::Feature::SSSE3)) {
+			paths.push_back(Detail::Path::Ssse3);
+		}
+		if (Utility::Simd::Has(Utility::Simd::Feature::AVX2)) {
+			paths.push_back(Detail::Path::Avx2);
+		}
+		return paths;
+	}
+
+	const char* GetPathName(Detail::Path path)
+	{
+		return path == Detail::Path::Avx2 ? "AVX2" : path == Detail::Path::Ssse3 ? "SSSE3" : "scalar";
+	}
+
+	/// <summary>
+	/// 変換する画像 (Pixel_YC の 1 行は ycPitch 画素)
+	/// </summary>
+	struct Image
+	{
+		int Width;
+		int Height;
+		int YCPitch;
+		std::vector<Pixel_YC> YC;
+		std::vector<unsigned char> Pixel;
+
+		Image(PixelFormat format, int width, int height, int ycPitch)
+			: Width(width), Height(height), YCPitch(ycPitch),
+			YC(static_cast<std::size_t>(ycPitch) * height),
+			Pixel(static_cast<std::size_t>(Detail::GetPixelLineSize(format, width)) * height) {}
+	};
+
+	/// <summary>
+	/// 指定した命令セットで処理されるように ColorInfo を作成します
+	/// </summary>
+	ColorInfo MakeInfo(Image& image, Detail::Path path, bool invert)
+	{
+		GetSettings().UseAVX2 = path == Detail::Path::Avx2;
+		ColorInfo info = {};
+		info.Flag = path == Detail::Path::Scalar ? static_cast<ColorInfo::InfoFlag>(0) : ColorInfo::InfoFlag::UseSSE2;
+		if (invert) {
+			info.Flag = info.Flag | ColorInfo::InfoFlag::InvertHeight;
+		}
+		info.pYC = image.YC.data();
+		info.pPixel = image.Pixel.data();
+		info.Width = image.Width;
+		info.Height = image.Height;
+		info.Line_Size = image.YCPitch * static_cast<int>(sizeof(Pixel_YC));
+		info.YC_Size = static_cast<int>(sizeof(Pixel_YC));
+		info.ExecMultiThread = Test::ExecMultiThread;
+		return info;
+	}
+
+	bool ToYC(Image& image, Detail::Path path, bool invert, PixelFormat format, ColorMatrix matrix, ColorRange range)
+	{
+		ColorInfo info = MakeInfo(image, path, invert);
+		return ColorConverter::ToYC(&info, format, matrix, range);
+	}
+
+	bool FromYC(Image& image, Detail::Path path, bool invert, PixelFormat format, ColorMatrix matrix, ColorRange range, DitherMode dither)
+	{
+		ColorInfo info = MakeInfo(image, path, invert);
+		return ColorConverter::FromYC(&info, format, matrix, range, dither);
+	}
+
+	bool SameYC(const std::vector<Pixel_YC>& a, const std::vector<Pixel_YC>& b)
+	{
+		for (std::size_t i = 0; i < a.size(); ++i) {
+			if (a[i].Y != b[i].Y || a[i].Cb != b[i].Cb || a[i].Cr != b[i].Cr) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// ランダムな条件で、各命令セットの ToYC() / FromYC() の結果を比較します
+	/// </summary>
+	void TestParity(const std::vector<Detail::Path>& paths, Test::Random& random)
+	{
+		for (int i = 0; i < 400; ++i) {
+			const PixelFormat format = static_cast<PixelFormat>(random.Range(0, 2));
+			const ColorMatrix matrix = static_cast<ColorMatrix>(random.Range(0, 1));
+			const ColorRange range = static_cast<ColorRange>(random.Range(0, 1));
+			const DitherMode dither = static_cast<DitherMode>(random.Range(0, 2));
+			const bool invert = random.Range(0, 1) != 0;
+			int width = random.Range(1, 100);
+			if (format == PixelFormat::YUY2) {
+				width = (width + 1) & ~1;
+			}
+			const int height = random.Range(1, 70);
+			const int ycPitch = width + random.Range(0, 5);
+			Test::GetThreadNum() = random.Range(1, 8);
+
+			// DIB → Pixel_YC (DIB の行末の詰め物も含めて乱数)
+			Image source(format, width, height, ycPitch);
+			for (unsigned char& value : source.Pixel) {
+				value = static_cast<unsigned char>(random.Next());
+			}
+			std::vector<Pixel_YC> expectedYC;
+			for (const Detail::Path path : paths) {
+				Image image = source;
+				AU_CHECK(ToYC(image, path, invert, format, matrix, range));
+				if (expectedYC.empty()) {
+					expectedYC = image.YC;
+				}
+				else {
+					AU_CHECK(SameYC(image.YC, expectedYC));
+				}
+			}
+
+			// Pixel_YC → DIB (飽和を確認するため範囲外の値を含めます)
+			for (Pixel_YC& yc : source.YC) {
+				yc.Y = static_cast<short>(random.Range(-400, 4600));
+				yc.Cb = static_cast<short>(random.Range(-2400, 2400));
+				yc.Cr = static_cast<short>(random.Range(-2400, 2400));
+			}
+			std::vector<unsigned char> expectedPixel;
+			for (const Detail::Path path : paths) {
+				Image image = source;
+				AU_CHECK(FromYC(image, path, invert, format, matrix, range, dither));
+				if (expectedPixel.empty()) {
+					expectedPixel = image.Pixel;
+				}
+				else {
+					AU_CHECK(image.Pixel == expectedPixel);
+				}
+			}
+		}
+		Test::GetThreadNum() = 4;
+	}
+
+	/// <summary>
+	/// 上下反転で DIB の行が逆順に読み書きされることを確認します
+	/// </summary>
+	void TestInvertHeight(Test::Random& random)
+	{
+		const int width = 7;
+		const int height = 5;
+		const std::ptrdiff_t lineSize = Detail::GetPixelLineSize(PixelFormat::RGB24, width);
+		Image image(PixelFormat::RGB24, width, height, width);
+		for (unsigned char& value : image.Pixel) {
+			value = static_cast<unsigned char>(random.Next());
+		}
+		Image flipped = image;
+		for (int y = 0; y < height; ++y) {
+			std::copy(image.Pixel.begin() + lineSize * y, image.Pixel.begin() + lineSize * (y + 1), flipped.Pixel.begin() + lineSize * (height - 1 - y));
+		}
+		AU_CHECK(ToYC(image, Detail::Path::Scalar, false, PixelFormat::RGB24, ColorMatrix::Bt601, ColorRange::Limited));
+		AU_CHECK(ToYC(flipped, Detail::Path::Scalar, true, PixelFormat::RGB24, ColorMatrix::Bt601, ColorRange::Limited));
+		AU_CHECK(SameYC(image.YC, flipped.YC));
+	}
+
+	/// <summary>
+	/// BT.601 の RGB → Pixel_YC が AviUtl の既定の変換と ±2 以内で一致し、RGB24 の全色が元に戻ることを確認します
+	/// <para>係数の丸め方が異なるため、AviUtl の変換とは完全には一致しません。</para>
+	/// </summary>
+	void TestRoundTrip(const std::vector<Detail::Path>& paths)
+	{
+		// R を 1 枚ごとに変え、G と B を 256x256 の画像に並べます
+		const int size = 256;
+		for (const Detail::Path path : paths) {
+			for (const ColorMatrix matrix : { ColorMatrix::Bt601, ColorMatrix::Bt709 }) {
+				int maxDifference = 0;
+				int mismatches = 0;
+				for (int r = 0; r < 256; ++r) {
+					Image image(PixelFormat::RGB24, size, size, size);
+					for (int g = 0; g < size; ++g) {
+						for (int b = 0; b < size; ++b) {
+							unsigned char* pPixel = image.Pixel.data() + (static_cast<std::size_t>(g) * size + b) * 3;
+							pPixel[0] = static_cast<unsigned char>(b);
+							pPixel[1] = static_cast<unsigned char>(g);
+							pPixel[2] = static_cast<unsigned char>(r);
+						}
+					}
+					const std::vector<unsigned char> original = image.Pixel;
+					ToYC(image, path, false, PixelFormat::RGB24, matrix, ColorRange::Limited);
+
+					if (matrix == ColorMatrix::Bt601) {
+						for (int g = 0; g < size; ++g) {
+							for (int b = 0; b < size; ++b) {
+								const Pixel_YC& yc = image.YC[static_cast<std::size_t>(g) * size + b];
+								const int y = ((4918 * r + 354) >> 10) + ((9655 * g + 585) >> 10) + ((1875 * b + 523) >> 10);
+								const int cb = ((-2775 * r + 240) >> 10) + ((-5449 * g + 515) >> 10) + ((8224 * b + 256) >> 10);
+								const int cr = ((8224 * r + 256) >> 10) + ((-6887 * g + 110) >> 10) + ((-1337 * b + 646) >> 10);
+								maxDifference = (std::max)({ maxDifference, std::abs(yc.Y - y), std::abs(yc.Cb - cb), std::abs(yc.Cr - cr) });
+							}
+						}
+					}
+
+					FromYC(image, path, false, PixelFormat::RGB24, matrix, ColorRange::Limited, DitherMode::None);
+					if (image.Pixel != original) {
+						++mismatches;
+					}
+				}
+				if (mismatches != 0) {
+					std::printf("round trip (%s, matrix %d): %d planes differ\n", GetPathName(path), static_cast<int>(matrix), mismatches);
+				}
+				AU_CHECK(maxDifference <= 2);
+				AU_CHECK(mismatches == 0);
+			}
+		}
+
+		// YUY2 は Y と C の全ての値が元に戻ります (色差が行内で一定なら補間の影響を受けません)
+		for (const ColorRange range : { ColorRange::Limited, ColorRange::Full }) {
+			Image image(PixelFormat::YUY2, size * 2, size, size * 2);
+			for (int c = 0; c < size; ++c) {
+				for (int y = 0; y < size; ++y) {
+					unsigned char* pPixel = image.Pixel.data() + (static_cast<std::size_t>(c) * size + y) * 4;
+					pPixel[0] = pPixel[2] = static_cast<unsigned char>(y);
+					pPixel[1] = pPixel[3] = static_cast<unsigned char>(c);
+				}
+			}
+			const std::vector<unsigned char> original = image.Pixel;
+			for (const Detail::Path path : paths) {
+				AU_CHECK(ToYC(image, path, false, PixelFormat::YUY2, ColorMatrix::Bt601, range));
+				AU_CHECK(FromYC(image, path, false, PixelFormat::YUY2, ColorMatrix::Bt601, range, DitherMode::None));
+				AU_CHECK(image.Pixel == original);
+			}
+		}
+	}
+
+	/// <summary>
+	/// 誤差拡散と順序ディザの結果がスレッド数によらず同じで、平均の明るさを保つことを確認します
+	/// </summary>
+	void TestDither(const std::vector<Detail::Path>& paths, Test::Random& random)
+	{
+		for (const DitherMode dither : { DitherMode::Ordered, DitherMode::ErrorDiffusion }) {
+			for (const PixelFormat format : { PixelFormat::RGB24, PixelFormat::RGB32 }) {
+				const int width = random.Range(1, 200);
+				const int height = random.Range(33, 150);
+				Image source(format, width, height, width);
+				for (Pixel_YC& yc : source.YC) {
+					yc.Y = static_cast<short>(random.Range(-300, 4500));
+					yc.Cb = static_cast<short>(random.Range(-2200, 2200));
+					yc.Cr = static_cast<short>(random.Range(-2200, 2200));
+				}
+				std::vector<unsigned char> expected;
+				for (const Detail::Path path : paths) {
+					for (const int threadNum : { 1, 3, 7, 16 }) {
+						Test::GetThreadNum() = threadNum;
+						Image image = source;
+						AU_CHECK(FromYC(image, path, false, format, ColorMatrix::Bt709, ColorRange::Limited, dither));
+						if (expected.empty()) {
+							expected = image.Pixel;
+						}
+						else {
+							AU_CHECK(image.Pixel == expected);
+						}
+					}
+				}
+			}
+		}
+		Test::GetThreadNum() = 4;
+
+		// 32 列ごとに Y を 1 ずつ変えた灰色で、各列の平均が元の値の 1/50 階調以内に収まります
+		const int size = 256;
+		for (const DitherMode dither : { DitherMode::Ordered, DitherMode::ErrorDiffusion }) {
+			Image image(PixelFormat::RGB24, size, size, size);
+			for (int i = 0; i < size * size; ++i) {
+				image.YC[i].Y = static_cast<short>(2000 + (i % size) / 32);
+				image.YC[i].Cb = 0;
+				image.YC[i].Cr = 0;
+			}
+			AU_CHECK(FromYC(image, paths.back(), false, PixelFormat::RGB24, ColorMatrix::Bt601, ColorRange::Limited, dither));
+			for (int column = 0; column < size / 32; ++column) {
+				double sum = 0.0;
+				for (int y = 0; y < size; ++y) {
+					for (int x = column * 32; x < column * 32 + 32; ++x) {
+						sum += image.Pixel[(static_cast<std::size_t>(y) * size + x) * 3 + 1];
+					}
+				}
+				const double mean = sum / (32.0 * size);
+				const double ideal = (2000 + column) * 255.0 / 4096.0;
+				AU_CHECK(std::abs(mean - ideal) < 0.02);
+			}
+		}
+	}
+
+	/// <summary>
+	/// 1920x1080 の処理時間を出力します
+	/// </summary>
+	void Benchmark(const std::vector<Detail::Path>& paths, Test::Random& random)
+	{
+		const int width = 1920;
+		const int height = 1080;
+		Image rgb(PixelFormat::RGB24, width, height, width);
+		Image yuy2(PixelFormat::YUY2, width, height, width);
+		for (unsigned char& value : rgb.Pixel) {
+			value = static_cast<unsigned char>(random.Next());
+		}
+		for (unsigned char& value : yuy2.Pixel) {
+			value = static_cast<unsigned char>(random.Next());
+		}
+
+		std::printf("throughput (1920x1080, %d threads, BT.709):\n", Test::GetThreadNum());
+		for (const Detail::Path path : paths) {
+			std::printf("  %-6s RGB24->YC %.2f ms, YC->RGB24 %.2f / ordered %.2f / diffusion %.2f ms, YUY2->YC %.2f ms, YC->YUY2 %.2f ms\n", GetPathName(path),
+				Test::Measure([&]() { ToYC(rgb, path, true, PixelFormat::RGB24, ColorMatrix::Bt709, ColorRange::Limited); }),
+				Test::Measure([&]() { FromYC(rgb, path, true, PixelFormat::RGB24, ColorMatrix::Bt709, ColorRange::Limited, DitherMode::None); }),
+				Test::Measure([&]() { FromYC(rgb, path, true, PixelFormat::RGB24, ColorMatrix::Bt709, ColorRange::Limited, DitherMode::Ordered); }),
+				Test::Measure([&]() { FromYC(rgb, path, true, PixelFormat::RGB24, ColorMatrix::Bt709, ColorRange::Limited, DitherMode::ErrorDiffusion); }),
+				Test::Measure([&]() { ToYC(yuy2, path, false, PixelFormat::YUY2, ColorMatrix::Bt709, ColorRange::Limited); }),
+				Test::Measure([&]() { FromYC(yuy2, path, false, PixelFormat::YUY2, ColorMatrix::Bt709, ColorRange::Limited, DitherMode::None); }));
+		}
+	}
+}
+
+int main()
+{
+	Test::Random random;
+	const std::vector<Detail::Path> paths = GetPaths();
+
+	TestParity(paths, random);
+	TestInvertHeight(random);
+	TestRoundTrip(paths);
+	TestDither(paths, random);
+
+	// 前提条件を満たさない場合は何もしません
+	{
+		Image image(PixelFormat::YUY2, 3, 1, 3);
+		AU_CHECK(!ToYC(image, Detail::Path::Scalar, false, PixelFormat::YUY2, ColorMatrix::Bt601, ColorRange::Limited));
+	}
+
+	Benchmark(paths, random);
+
+	GetSettings().UseAVX2 = true;
+	return Test::Finish("ColorConverterTest");
+}
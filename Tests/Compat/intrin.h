@@ -0,0 +1,17 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+// GCC / Clang でテストをビルドするための MSVC の <intrin.h> の代替
+
+#include <cpuid.h>      // __cpuid_count
+#include <immintrin.h>  // SSE/AVX intrinsics, _xgetbv
+
+#undef __cpuid
+
+inline void __cpuid(int cpuInfo[4], int function)
+{
+	__cpuid_count(function, 0, cpuInfo[0], cpuInfo[1], cpuInfo[2], cpuInfo[3]);
+}
@@ -0,0 +1,24 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+// GCC / Clang でテストをビルドするための MSVC の <malloc.h> の代替
+
+#include <cstddef>      // std::size_t
+#include <cstdlib>      // posix_memalign, std::free
+
+inline void* _aligned_malloc(std::size_t size, std::size_t alignment)
+{
+	void* p = nullptr;
+	if (alignment < sizeof(void*)) {
+		alignment = sizeof(void*);
+	}
+	return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+}
+
+inline void _aligned_free(void* p)
+{
+	std::free(p);
+}
@@ -0,0 +1,316 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// Fft / Stft のテスト
+// FftPlan と RealFft の結果を double の素朴な DFT と比較し、順変換と逆変換で元に戻ることを確認します。
+// StftProcessor (重なり数 2, 4) が何もしないコールバックで入力を GetLatency() サンプル遅らせて再現すること、FftConvolver が直接の畳み込みと一致することを確認します。
+// 併せて、変換と音声処理の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Filter/Stft.h"
+#include <algorithm>    // std::max, std::min
+#include <cmath>        // std::cos, std::sin, std::fabs, std::lrint
+#include <memory>       // std::shared_ptr
+#include <cstdlib>      // std::abs
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	float RandomFloat(Test::Random& random)
+	{
+		return static_cast<float>(random.Range(-1000000, 1000000)) / 1000000.0f;
+	}
+
+	/// <summary>
+	/// 素朴な DFT (double)
+	/// </summary>
+	void NaiveDft(const std::vector<double>& inReal, const std::vector<double>& inImag, int bins, std::vector<double>* pReal, std::vector<double>* pImag)
+	{
+		const int size = static_cast<int>(inReal.size());
+		pReal->assign(bins, 0.0);
+		pImag->assign(bins, 0.0);
+		for (int k = 0; k < bins; ++k) {
+			double sr = 0.0, si = 0.0;
+			for (int n = 0; n < size; ++n) {
+				// 角度の誤差を抑えるため、k × n を点数で割った余りから求める
+				const double angle = -2.0 * Pi * static_cast<double>((static_cast<long long>(k) * n) % size) / size;
+				const double c = std::cos(angle), s = std::sin(angle);
+				sr += inReal[n] * c - inImag[n] * s;
+				si += inReal[n] * s + inImag[n] * c;
+			}
+			(*pReal)[k] = sr;
+			(*pImag)[k] = si;
+		}
+	}
+
+	/// <summary>
+	/// 最大誤差が scale × 10^-5 以内か調べます (scale は値の大きさの目安で、変換結果なら点数)
+	/// </summary>
+	bool Near(const float* pActual, const std::vector<double>& expected, int count, double scale)
+	{
+		double error = 0.0;
+		for (int i = 0; i < count; ++i) {
+			error = (std::max)(error, std::fabs(pActual[i] - expected[i]));
+		}
+		return error <= scale * 1e-5;
+	}
+
+	void TestComplex(Test::Random& random)
+	{
+		AU_CHECK(FftPlan::Get(2) == nullptr && FftPlan::Get(12) == nullptr && FftPlan::Get(0) == nullptr);
+		AU_CHECK(FftPlan::Get(64) == FftPlan::Get(64));
+
+		for (int size = 4; size <= 2048; size *= 2) {
+			const std::shared_ptr<const FftPlan> pPlan = FftPlan::Get(size);
+			AU_CHECK(pPlan != nullptr && pPlan->GetSize() == size);
+			AlignedBuffer<float> real(size), imag(size);
+			std::vector<double> inReal(size), inImag(size);
+			for (int n = 0; n < size; ++n) {
+				real[n] = RandomFloat(random);
+				imag[n] = RandomFloat(random);
+				inReal[n] = real[n];
+				inImag[n] = imag[n];
+			}
+			std::vector<double> expectedReal, expectedImag;
+			NaiveDft(inReal, inImag, size, &expectedReal, &expectedImag);
+			pPlan->Forward(real.GetData(), imag.GetData());
+			AU_CHECK(Near(real.GetData(), expectedReal, size, size));
+			AU_CHECK(Near(imag.GetData(), expectedImag, size, size));
+
+			// 逆変換は正規化しない
+			pPlan->Inverse(real.GetData(), imag.GetData());
+			std::vector<double> scaledReal(size), scaledImag(size);
+			for (int n = 0; n < size; ++n) {
+				scaledReal[n] = inReal[n] * size;
+				scaledImag[n] = inImag[n] * size;
+			}
+			AU_CHECK(Near(real.GetData(), scaledReal, size, size));
+			AU_CHECK(Near(imag.GetData(), scaledImag, size, size));
+		}
+	}
+
+	void TestReal(Test::Random& random)
+	{
+		for (int size = 8; size <= 4096; size *= 2) {
+			RealFft fft(size);
+			AU_CHECK(fft.GetSize() == size && fft.GetBins() == size / 2 + 1);
+			const int bins = fft.GetBins();
+			std::vector<float> input(size);
+			std::vector<double> inReal(size), inImag(size, 0.0);
+			for (int n = 0; n < size; ++n) {
+				input[n] = RandomFloat(random);
+				inReal[n] = input[n];
+			}
+			std::vector<double> expectedReal, expectedImag;
+			NaiveDft(inReal, inImag, bins, &expectedReal, &expectedImag);
+			std::vector<float> real(bins), imag(bins);
+			fft.Forward(input.data(), real.data(), imag.data());
+			AU_CHECK(Near(real.data(), expectedReal, bins, size));
+			AU_CHECK(Near(imag.data(), expectedImag, bins, size));
+			AU_CHECK(std::fabs(imag[0]) <= size * 1e-5 && std::fabs(imag[bins - 1]) <= size * 1e-5);
+
+			// 0 と N/2 の虚部は無視する
+			imag[0] = 123.0f;
+			imag[bins - 1] = -456.0f;
+			std::vector<float> output(size);
+			fft.Inverse(real.data(), imag.data(), output.data());
+			AU_CHECK(Near(output.data(), inReal, size, 1.0));
+		}
+
+		// 純音は 1 つのビンに集まる
+		const int size = 1024;
+		RealFft fft(size);
+		std::vector<float> input(size), real(size / 2 + 1), imag(size / 2 + 1);
+		for (int n = 0; n < size; ++n) {
+			input[n] = static_cast<float>(std::cos(2.0 * Pi * 37 * n / size));
+		}
+		fft.Forward(input.data(), real.data(), imag.data());
+		AU_CHECK(std::fabs(real[37] - size / 2) < 1e-2);
+		AU_CHECK(std::fabs(real[36]) < 1e-2 && std::fabs(real[38]) < 1e-2);
+	}
+
+	std::vector<short> MakeAudio(int frames, int channels, Test::Random& random)
+	{
+		std::vector<short> audio(static_cast<std::size_t>(frames) * channels);
+		for (int f = 0; f < frames; ++f) {
+			for (int c = 0; c < channels; ++c) {
+				const double tone = 8000.0 * std::sin(2.0 * Pi * (440.0 + 300.0 * c) * f / 48000.0);
+				audio[static_cast<std::size_t>(f) * channels + c] = static_cast<short>(std::lrint(tone + random.Range(-6000, 6000)));
+			}
+		}
+		return audio;
+	}
+
+	/// <summary>
+	/// 不揃いなブロックに分けて処理します
+	/// </summary>
+	template<class Processor>
+	void ProcessChunked(Processor& processor, std::vector<short>& audio, int channels, Test::Random& random)
+	{
+		const int frames = static_cast<int>(audio.size() / channels);
+		for (int done = 0; done < frames;) {
+			const int count = (std::min)(frames - done, random.Range(1, 3000));
+			processor.Process(audio.data() + static_cast<std::size_t>(done) * channels, count);
+			done += count;
+		}
+	}
+
+	void TestStft(Test::Random& random)
+	{
+		const int channels = 2;
+		const int frames = 48000;
+		const std::vector<short> source = MakeAudio(frames, channels, random);
+		for (const int size : { 256, 1024 }) {
+			for (const int overlap : { 2, 4 }) {
+				int calls = 0;
+				StftProcessor stft(size, overlap, [&](int, float*, float*, int bins) {
+					calls += (bins == size / 2 + 1) ? 1 : 0;
+				});
+				AU_CHECK(stft.GetBins() == size / 2 + 1);
+				stft.Prepare(channels);
+				std::vector<short> audio = source;
+				stft.Process(audio.data(), frames);
+
+				// 遅延までは無音、その後は遅れた入力と ±1 以内
+				const int latency = stft.GetLatency();
+				AU_CHECK(latency == size);
+				int mismatches = 0;
+				for (int f = 0; f < frames; ++f) {
+					for (int c = 0; c < channels; ++c) {
+						const int expected = f < latency ? 0 : source[static_cast<std::size_t>(f - latency) * channels + c];
+						mismatches += std::abs(audio[static_cast<std::size_t>(f) * channels + c] - expected) > 1 ? 1 : 0;
+					}
+				}
+				AU_CHECK(mismatches == 0);
+				const int hop = size / overlap;
+				AU_CHECK(calls == frames / hop * channels);
+
+				// 分けて処理しても同じ結果
+				StftProcessor chunked(size, overlap, nullptr);
+				chunked.Prepare(channels);
+				std::vector<short> pieces = source;
+				ProcessChunked(chunked, pieces, channels, random);
+				AU_CHECK(pieces == audio);
+
+				// 不連続なフレームでは状態を初期化する
+				FilterProcInfo fpi = {};
+				std::vector<short> first = source;
+				fpi.pAudio = first.data();
+				fpi.Audio_Channel = channels;
+				fpi.Audio_Total = frames;
+				fpi.Frame = 10;
+				AU_CHECK(chunked.Process(&fpi));
+				AU_CHECK(first == audio);
+				std::vector<short> resumed = source;
+				fpi.pAudio = resumed.data();
+				fpi.Frame = 20;
+				AU_CHECK(chunked.Process(&fpi));
+				AU_CHECK(resumed == audio);
+			}
+		}
+	}
+
+	void TestConvolver(Test::Random& random)
+	{
+		const int channels = 2;
+		const int frames = 20000;
+		const std::vector<short> source = MakeAudio(frames, channels, random);
+		for (const int size : { 64, 512, 2048 }) {
+			for (const int taps : { 1, 7, size / 4, size / 2 + 1 }) {
+				std::vector<float> response(taps);
+				double sum = 0.0;
+				for (int t = 0; t < taps; ++t) {
+					response[t] = RandomFloat(random);
+					sum += std::fabs(response[t]);
+				}
+				// 飽和しないよう、係数の絶対値の和を 1 にします
+				for (float& value : response) {
+					value = static_cast<float>(value / sum);
+				}
+
+				FftConvolver convolver(size);
+				convolver.SetResponse(response.data(), taps);
+				convolver.Prepare(channels);
+				std::vector<short> audio = source;
+				ProcessChunked(convolver, audio, channels, random);
+
+				const int latency = convolver.GetLatency();
+				AU_CHECK(latency == size / 2);
+				int mismatches = 0;
+				for (int f = 0; f < frames; ++f) {
+					for (int c = 0; c < channels; ++c) {
+						double expected = 0.0;
+						for (int t = 0; t < taps && t <= f - latency; ++t) {
+							expected += response[t] * source[static_cast<std::size_t>(f - latency - t) * channels + c];
+						}
+						mismatches += std::abs(audio[static_cast<std::size_t>(f) * channels + c] - std::lrint(expected)) > 1 ? 1 : 0;
+					}
+				}
+				AU_CHECK(mismatches == 0);
+			}
+		}
+
+		// 既定の応答は遅延のみ
+		FftConvolver identity(256);
+		identity.Prepare(1);
+		std::vector<short> mono = MakeAudio(1000, 1, random);
+		const std::vector<short> original = mono;
+		identity.Process(mono.data(), 1000);
+		int mismatches = 0;
+		for (int f = 128; f < 1000; ++f) {
+			mismatches += std::abs(mono[f] - original[f - 128]) > 1 ? 1 : 0;
+		}
+		AU_CHECK(mismatches == 0);
+	}
+
+	/// <summary>
+	/// 変換と、48kHz ステレオ 60 秒分の音声処理の処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		RealFft fft(4096);
+		std::vector<float> input(4096), output(4096), real(2049), imag(2049);
+		for (float& value : input) {
+			value = RandomFloat(random);
+		}
+		std::printf("RealFft 4096 forward + inverse x1000: %.2f ms\n", Test::Measure([&]() {
+			for (int i = 0; i < 1000; ++i) {
+				fft.Forward(input.data(), real.data(), imag.data());
+				fft.Inverse(real.data(), imag.data(), output.data());
+			}
+		}));
+
+		const int frames = 48000 * 60;
+		const std::vector<short> source = MakeAudio(frames, 2, random);
+		std::vector<short> audio = source;
+		StftProcessor stft(2048, 4, [](int, float* pReal, float*, int bins) { pReal[bins - 1] = 0.0f; });
+		stft.Prepare(2);
+		std::vector<float> response(1025, 1.0f / 1025);
+		FftConvolver convolver(2048);
+		convolver.SetResponse(response.data(), 1025);
+		convolver.Prepare(2);
+		std::printf("48 kHz stereo, 60 s: StftProcessor (2048, overlap 4) %.2f ms, FftConvolver (2048, 1025 taps) %.2f ms\n",
+			Test::Measure([&]() { stft.Process(audio.data(), frames); }, 3),
+			Test::Measure([&]() { convolver.Process(audio.data(), frames); }, 3));
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	TestComplex(random);
+	TestReal(random);
+	TestStft(random);
+	TestConvolver(random);
+	Benchmark(random);
+
+	return Test::Finish("FftTest");
+}
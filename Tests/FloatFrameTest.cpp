@@ -0,0 +1,311 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// FloatFrame のテスト
+// HashRow() が離れた位置の増減 (16byte 内の +3 と -1 など) を検出し、FloatPipeline が書き換えられた pYC_Edit を読み込み直すことを確認します。
+// 変更されていなければ FloatFrame を丸めずに受け渡すこと、行の変換の SIMD 版とスカラー版、半精度の変換が F16C と一致することを確認します。
+// 併せて、1920x1080 のハッシュと変換の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Filter/FloatFrame.h"
+#include <algorithm>    // std::min
+#include <cstring>      // std::memcpy, std::memcmp
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+
+namespace
+{
+	/// <summary>
+	/// 4byte の値を加えます (リトルエンディアンの 32bit 整数として)
+	/// </summary>
+	void AddWord(unsigned char* p, int value)
+	{
+		unsigned int word;
+		std::memcpy(&word, p, sizeof(word));
+		word += static_cast<unsigned int>(value);
+		std::memcpy(p, &word, sizeof(word));
+	}
+
+	bool SameImage(const std::vector<Pixel_YC>& a, const std::vector<Pixel_YC>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), sizeof(Pixel_YC) * a.size()) == 0;
+	}
+
+	/// <summary>
+	/// HashRow() が内容だけで決まり、打ち消し合う変更を検出することを確認します
+	/// </summary>
+	void TestHash(Test::Random& random)
+	{
+		for (const std::size_t size : { 16u, 24u, 31u, 32u, 96u, 100u, 11520u }) {
+			std::vector<unsigned char> row(size + 8);
+			for (unsigned char& value : row) {
+				value = static_cast<unsigned char>(random.Next());
+			}
+			const unsigned long long hash = FloatFrameDetail::HashRow(row.data(), size);
+
+			// 行の後ろのバイトは含まず、先頭のアドレスによらない
+			std::vector<unsigned char> shifted(size + 3);
+			std::memcpy(shifted.data() + 3, row.data(), size);
+			AU_CHECK(FloatFrameDetail::HashRow(shifted.data() + 3, size) == hash);
+			row[size] ^= 0xFF;
+			AU_CHECK(FloatFrameDetail::HashRow(row.data(), size) == hash);
+
+			// 16byte ブロックの byte 0 の 32bit 値に +3、byte 4 に -1 (線形のチェックサムでは打ち消し合う)
+			for (std::size_t offset = 0; offset + 8 <= size; offset += 16) {
+				std::vector<unsigned char> changed(row.begin(), row.begin() + size);
+				AddWord(changed.data() + offset, 3);
+				AddWord(changed.data() + offset + 4, -1);
+				AU_CHECK(FloatFrameDetail::HashRow(changed.data(), size) != hash);
+			}
+
+			// 2 か所の増減を打ち消し合うように変更
+			for (int i = 0; i < 200; ++i) {
+				std::vector<unsigned char> changed(row.begin(), row.begin() + size);
+				const std::size_t a = random.Range(0, static_cast<int>(size) - 4);
+				const std::size_t b = random.Range(0, static_cast<int>(size) - 4);
+				const int delta = random.Range(1, 1000);
+				AddWord(changed.data() + a, delta);
+				AddWord(changed.data() + b, -delta);
+				if (std::memcmp(changed.data(), row.data(), size) != 0) {
+					AU_CHECK(FloatFrameDetail::HashRow(changed.data(), size) != hash);
+				}
+			}
+
+			// 1bit の変更
+			for (std::size_t bit = 0; bit < (std::min)(size * 8, static_cast<std::size_t>(512)); ++bit) {
+				std::vector<unsigned char> changed(row.begin(), row.begin() + size);
+				changed[bit / 8] ^= static_cast<unsigned char>(1 << (bit % 8));
+				AU_CHECK(FloatFrameDetail::HashRow(changed.data(), size) != hash);
+			}
+		}
+
+		// 端数を 0 で埋めても、0 が続く長い行とは区別する
+		const unsigned char zeros[32] = {};
+		AU_CHECK(FloatFrameDetail::HashRow(zeros, 20) != FloatFrameDetail::HashRow(zeros, 24));
+		AU_CHECK(FloatFrameDetail::HashRow(zeros, 0) != FloatFrameDetail::HashRow(zeros, 32));
+	}
+
+	/// <summary>
+	/// 半精度と float の変換が F16C と一致することを確認します
+	/// </summary>
+	void TestHalf(Test::Random& random)
+	{
+		if (!Utility::Simd::Has(Utility::Simd::Feature::F16C)) {
+			std::printf("F16C is not available; skipped the half-precision comparison\n");
+			return;
+		}
+		int mismatches = 0;
+		for (unsigned int half = 0; half < 65536; ++half) {
+			const float expected = _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(static_cast<int>(half))));
+			const float actual = FloatFrameDetail::HalfToFloat(static_cast<unsigned short>(half));
+			if (std::memcmp(&expected, &actual, sizeof(float)) != 0) {
+				++mismatches;
+			}
+		}
+		for (int i = 0; i < 1 << 22; ++i) {
+			// 半精度の非正規化数の範囲と、無限大・NaN を含めます
+			const unsigned int bits = i < (1 << 20) ? 0x33000000u + static_cast<unsigned int>(i) * 8 : random.Next();
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			const unsigned short expected = static_cast<unsigned short>(_mm_extract_epi16(_mm_cvtps_ph(_mm_set_ss(value), 0), 0));
+			if (FloatFrameDetail::FloatToHalf(value) != expected) {
+				++mismatches;
+			}
+		}
+		AU_CHECK(mismatches == 0);
+	}
+
+	/// <summary>
+	/// 行の変換の SIMD 版とスカラー版を比較し、Pixel_YC -> float -> Pixel_YC で元に戻ることを確認します
+	/// <para>FloatFrame の行と同じく、平面の各行は 64byte 境界に置きます。</para>
+	/// </summary>
+	void TestRows(Test::Random& random)
+	{
+		const bool simd = Utility::Simd::Has(Utility::Simd::Feature::SSSE3);
+		const bool f16c = Utility::Simd::Has(Utility::Simd::Feature::F16C);
+		enum : int { MaxWidth = 64 };
+		alignas(64) float fast[3][MaxWidth];
+		alignas(64) float scalar[3][MaxWidth];
+		alignas(64) unsigned short halfFast[3][MaxWidth];
+		alignas(64) unsigned short halfScalar[3][MaxWidth];
+		for (int width = 1; width < MaxWidth; ++width) {
+			std::vector<Pixel_YC> src(width);
+			for (Pixel_YC& p : src) {
+				p.Y = static_cast<short>(random.Next());
+				p.Cb = static_cast<short>(random.Next());
+				p.Cr = static_cast<short>(random.Next());
+			}
+			FloatFrameDetail::ImportRow(src.data(), width, fast[0], fast[1], fast[2], simd, f16c);
+			FloatFrameDetail::ImportRow(src.data(), width, scalar[0], scalar[1], scalar[2], false, false);
+			for (int plane = 0; plane < 3; ++plane) {
+				AU_CHECK(std::memcmp(fast[plane], scalar[plane], sizeof(float) * width) == 0);
+			}
+
+			std::vector<Pixel_YC> back(width);
+			FloatFrameDetail::ExportRow(fast[0], fast[1], fast[2], width, back.data(), simd, f16c);
+			AU_CHECK(std::memcmp(back.data(), src.data(), sizeof(Pixel_YC) * width) == 0);
+
+			FloatFrameDetail::ImportRow(src.data(), width, halfFast[0], halfFast[1], halfFast[2], simd, f16c);
+			FloatFrameDetail::ImportRow(src.data(), width, halfScalar[0], halfScalar[1], halfScalar[2], false, false);
+			for (int plane = 0; plane < 3; ++plane) {
+				AU_CHECK(std::memcmp(halfFast[plane], halfScalar[plane], sizeof(unsigned short) * width) == 0);
+			}
+
+			std::vector<Pixel_YC> backFast(width);
+			std::vector<Pixel_YC> backScalar(width);
+			FloatFrameDetail::ExportRow(halfFast[0], halfFast[1], halfFast[2], width, backFast.data(), simd, f16c);
+			FloatFrameDetail::ExportRow(halfFast[0], halfFast[1], halfFast[2], width, backScalar.data(), false, false);
+			AU_CHECK(std::memcmp(backFast.data(), backScalar.data(), sizeof(Pixel_YC) * width) == 0);
+		}
+	}
+
+	/// <summary>
+	/// FloatPipeline の受け渡しと、間のフィルタによる変更の検出を確認します
+	/// </summary>
+	void TestPipeline(Test::Random& random)
+	{
+		CallbackFunctionSet callbacks = {};
+		callbacks.ExecMultiThread = Test::ExecMultiThread;
+		FilterPluginTable filter = {};
+		filter.pCallbackFunctionSet = &callbacks;
+
+		const int width = 37;
+		const int height = 11;
+		const int maxWidth = 40;
+		const int maxHeight = 12;
+		std::vector<Pixel_YC> edit(static_cast<std::size_t>(maxWidth) * maxHeight);
+		std::vector<Pixel_YC> temp(edit.size());
+		for (Pixel_YC& p : edit) {
+			p.Y = static_cast<short>(random.Range(16, 4080));
+			p.Cb = static_cast<short>(random.Range(-2000, 2000));
+			p.Cr = static_cast<short>(random.Range(-2000, 2000));
+		}
+
+		FilterProcInfo info = {};
+		info.pYC_Edit = edit.data();
+		info.pYC_Temp = temp.data();
+		info.Width = width;
+		info.Height = height;
+		info.Width_Max = maxWidth;
+		info.Height_Max = maxHeight;
+		info.Line_Size = maxWidth * static_cast<int>(sizeof(Pixel_YC));
+		info.Frame = 3;
+		info.Edit_Handle = &info;
+
+		FloatPipeline& pipeline = FloatPipeline::GetInstance();
+		const auto addY = [](int, float* pY, float*, float*) {
+			// 1 回では四捨五入で Pixel_YC に現れない量
+			for (int x = 0; x < 37; ++x) {
+				pY[x] += 0.3f / 4096.0f;
+			}
+		};
+
+		for (const FloatStorage storage : { FloatStorage::Float32, FloatStorage::Float16 }) {
+			// 変更されていなければ丸めずに受け渡す
+			FloatFrame first;
+			AU_CHECK(pipeline.Acquire(&filter, &info, &first, storage));
+			AU_CHECK(first.ForEachRow(Test::ExecMultiThread, addY));
+			const void* pBuffer = storage == FloatStorage::Float32 ? static_cast<const void*>(first.GetRow(0, 0)) : static_cast<const void*>(first.GetHalfRow(0, 0));
+			const std::vector<Pixel_YC> before = edit;
+			AU_CHECK(pipeline.Commit(&filter, &info, std::move(first)));
+			if (storage == FloatStorage::Float32) {
+				AU_CHECK(SameImage(edit, before));
+			}
+
+			FloatFrame second;
+			AU_CHECK(pipeline.Acquire(&filter, &info, &second, storage));
+			AU_CHECK((storage == FloatStorage::Float32 ? static_cast<const void*>(second.GetRow(0, 0)) : static_cast<const void*>(second.GetHalfRow(0, 0))) == pBuffer);
+			AU_CHECK(second.ForEachRow(Test::ExecMultiThread, addY));
+			AU_CHECK(pipeline.Commit(&filter, &info, std::move(second)));
+			if (storage == FloatStorage::Float32) {
+				// 0.3 + 0.3 が累積して 1 増える
+				int wrong = 0;
+				for (int y = 0; y < height; ++y) {
+					for (int x = 0; x < width; ++x) {
+						const std::size_t i = static_cast<std::size_t>(y) * maxWidth + x;
+						if (edit[i].Y != before[i].Y + 1 || edit[i].Cb != before[i].Cb || edit[i].Cr != before[i].Cr) {
+							++wrong;
+						}
+					}
+				}
+				AU_CHECK(wrong == 0);
+			}
+
+			// 間のフィルタが 16byte 内の 32bit 値に +3 と -1 を加えた場合 (Y += 3, Cr -= 1)
+			Pixel_YC& target = edit[static_cast<std::size_t>(5) * maxWidth + 8];
+			target.Y = 100;
+			target.Cr = 100;
+			FloatFrame reloaded;
+			AU_CHECK(pipeline.Acquire(&filter, &info, &reloaded, storage));
+			AU_CHECK(pipeline.Commit(&filter, &info, std::move(reloaded)));
+			AddWord(reinterpret_cast<unsigned char*>(&target), 3);
+			AddWord(reinterpret_cast<unsigned char*>(&target) + 4, -1);
+			AU_CHECK(target.Y == 103 && target.Cr == 99);
+
+			FloatFrame third;
+			AU_CHECK(pipeline.Acquire(&filter, &info, &third, storage));
+			std::vector<Pixel_YC> exported(edit.size());
+			AU_CHECK(third.Export(exported.data(), info.Line_Size, Test::ExecMultiThread));
+			AU_CHECK(exported[static_cast<std::size_t>(5) * maxWidth + 8].Y == 103);
+			AU_CHECK(exported[static_cast<std::size_t>(5) * maxWidth + 8].Cr == 99);
+			AU_CHECK(pipeline.Commit(&filter, &info, std::move(third)));
+
+			// フレームが変わった場合も読み込み直す
+			++info.Frame;
+			FloatFrame fourth;
+			AU_CHECK(pipeline.Acquire(&filter, &info, &fourth, storage));
+			AU_CHECK(pipeline.Commit(&filter, &info, std::move(fourth)));
+		}
+		pipeline.Clear();
+	}
+
+	/// <summary>
+	/// 1920x1080 の処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		const int width = 1920;
+		const int height = 1080;
+		std::vector<Pixel_YC> image(static_cast<std::size_t>(width) * height);
+		for (Pixel_YC& p : image) {
+			p.Y = static_cast<short>(random.Range(0, 4096));
+			p.Cb = static_cast<short>(random.Range(-2048, 2048));
+			p.Cr = static_cast<short>(random.Range(-2048, 2048));
+		}
+		const int lineSize = width * static_cast<int>(sizeof(Pixel_YC));
+		unsigned long long hash = 0;
+		FloatFrame frame;
+		std::printf("throughput (1920x1080, %d threads):\n", Test::GetThreadNum());
+		std::printf("  HashRow (1 thread) %.2f ms\n", Test::Measure([&]() {
+			for (int y = 0; y < height; ++y) {
+				hash += FloatFrameDetail::HashRow(image.data() + static_cast<std::size_t>(width) * y, static_cast<std::size_t>(lineSize));
+			}
+		}));
+		for (const FloatStorage storage : { FloatStorage::Float32, FloatStorage::Float16 }) {
+			// Export() は Import() した形式で計測するため、順に計測します
+			const double importTime = Test::Measure([&]() { frame.Import(image.data(), lineSize, width, height, storage, Test::ExecMultiThread); });
+			const double exportTime = Test::Measure([&]() { frame.Export(image.data(), lineSize, Test::ExecMultiThread); });
+			std::printf("  %s Import %.2f ms, Export %.2f ms\n", storage == FloatStorage::Float32 ? "float32" : "float16", importTime, exportTime);
+		}
+
+		// 結果を使用して、計測した処理が省略されないようにします
+		std::printf("  (checksum %d)\n", static_cast<int>(hash & 0xFF));
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	TestHash(random);
+	TestHalf(random);
+	TestRows(random);
+	TestPipeline(random);
+	Benchmark(random);
+
+	return Test::Finish("FloatFrameTest");
+}
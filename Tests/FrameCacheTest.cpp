@@ -0,0 +1,82 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// FrameCache のテスト
+// 容量が 0 のキャッシュは何も保持しないこと (FilterRuntime で重み 0 のフィルタに割り当てる容量) と、
+// 容量を超えたときにカーソルから最も遠いフレームを破棄し、直近のフレームは 1 つだけなら残すことを確認します。
+
+#include "TestCommon.h"
+#include "../Utility/FrameCache.h"
+#include <memory>       // std::make_shared
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	FrameCache::Frame MakeFrame(std::size_t size)
+	{
+		return std::make_shared<const std::vector<unsigned char>>(size, static_cast<unsigned char>(size));
+	}
+}
+
+int main()
+{
+	// 容量 0 は何も保持しない
+	{
+		FrameCache cache(0);
+		cache.Insert(1, MakeFrame(100));
+		cache.Insert(2, MakeFrame(1));
+		AU_CHECK(cache.GetCount() == 0 && cache.GetUsage() == 0);
+		AU_CHECK(cache.Find(1) == nullptr && cache.Find(2) == nullptr);
+	}
+
+	// 容量を 0 にすると、直近のフレームも含めて全て破棄する
+	{
+		FrameCache cache(1000);
+		cache.Insert(1, MakeFrame(100));
+		cache.Insert(2, MakeFrame(100));
+		AU_CHECK(cache.GetCount() == 2 && cache.GetUsage() == 200);
+		cache.SetCapacity(0);
+		AU_CHECK(cache.GetCount() == 0 && cache.GetUsage() == 0);
+		cache.Insert(3, MakeFrame(100));
+		AU_CHECK(cache.GetCount() == 0 && cache.Find(3) == nullptr);
+
+		cache.SetCapacity(1000);
+		cache.Insert(3, MakeFrame(100));
+		AU_CHECK(cache.Find(3) != nullptr);
+	}
+
+	// 容量を超える 1 フレームは残す
+	{
+		FrameCache cache(50);
+		cache.Insert(1, MakeFrame(100));
+		AU_CHECK(cache.GetCount() == 1 && cache.Find(1) != nullptr);
+		cache.Insert(2, MakeFrame(100));
+		AU_CHECK(cache.GetCount() == 1 && cache.Find(2) != nullptr && cache.GetUsage() == 100);
+	}
+
+	// カーソルから最も遠いフレームから破棄する
+	{
+		FrameCache cache(300);
+		const int a = cache.AddCursor();
+		const int b = cache.AddCursor();
+		cache.SetCursor(a, 10);
+		cache.SetCursor(b, 100);
+		cache.Insert(10, MakeFrame(100));
+		cache.Insert(50, MakeFrame(100));
+		cache.Insert(100, MakeFrame(100));
+		cache.Insert(101, MakeFrame(100));
+		AU_CHECK(cache.GetCount() == 3 && cache.GetUsage() == 300);
+		AU_CHECK(cache.Find(50) == nullptr);
+		AU_CHECK(cache.Find(10) != nullptr && cache.Find(100) != nullptr && cache.Find(101) != nullptr);
+
+		// 置き換えは使用量を二重に数えない
+		cache.Insert(101, MakeFrame(100));
+		AU_CHECK(cache.GetCount() == 3 && cache.GetUsage() == 300);
+	}
+
+	return Test::Finish("FrameCacheTest");
+}
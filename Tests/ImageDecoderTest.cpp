@@ -0,0 +1,458 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// ImageDecoder のテスト
+// BMP / TGA / PNG をその場で生成してファイルに書き出し、読み戻してデコードした結果を元の画素と比較します。
+
+#include "TestCommon.h"
+#include "../Utility/ImageDecoder.h"
+#include <algorithm>    // std::min
+#include <cstdio>       // std::remove
+#include <cstdlib>      // std::abs
+#include <cstring>      // std::memcmp, std::memcpy
+#include <fstream>      // std::ifstream, std::ofstream
+#include <iterator>     // std::istreambuf_iterator
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	typedef std::vector<unsigned char> Bytes;
+
+	/// <summary>
+	/// テスト用の画像 (BGRA)
+	/// </summary>
+	struct Image
+	{
+		int Width;
+		int Height;
+		Bytes Pixels;
+
+		const unsigned char* At(int x, int y) const { return Pixels.data() + (static_cast<std::size_t>(y) * Width + x) * 4; }
+	};
+
+	Image MakeImage(int width, int height, bool alpha, Test::Random& random)
+	{
+		Image image = { width, height, Bytes(static_cast<std::size_t>(width) * height * 4) };
+		for (std::size_t i = 0; i < image.Pixels.size(); ++i) {
+			image.Pixels[i] = static_cast<unsigned char>(random.Next() >> 24);
+			if (i % 4 == 3 && !alpha) {
+				image.Pixels[i] = 255;
+			}
+		}
+		return image;
+	}
+
+	void PutLE16(Bytes& out, unsigned int value) { out.push_back(value & 0xFF); out.push_back((value >> 8) & 0xFF); }
+	void PutLE32(Bytes& out, unsigned int value) { PutLE16(out, value & 0xFFFF); PutLE16(out, value >> 16); }
+	void PutBE32(Bytes& out, unsigned int value) { out.push_back(value >> 24); out.push_back((value >> 16) & 0xFF); out.push_back((value >> 8) & 0xFF); out.push_back(value & 0xFF); }
+
+	/// <summary>
+	/// BMP (BI_RGB) を生成します
+	/// </summary>
+	Bytes MakeBmp(const Image& image, int bitCount, bool topDown, const Bytes& palette = Bytes(), const Bytes& indices = Bytes())
+	{
+		const std::size_t stride = ((static_cast<std::size_t>(image.Width) * bitCount + 31) / 32) * 4;
+		const std::size_t paletteSize = palette.size();
+		Bytes out = { 'B', 'M' };
+		PutLE32(out, static_cast<unsigned int>(14 + 40 + paletteSize + stride * image.Height));
+		PutLE32(out, 0);
+		PutLE32(out, static_cast<unsigned int>(14 + 40 + paletteSize));
+		PutLE32(out, 40);
+		PutLE32(out, image.Width);
+		PutLE32(out, static_cast<unsigned int>(topDown ? -image.Height : image.Height));
+		PutLE16(out, 1);
+		PutLE16(out, bitCount);
+		PutLE32(out, 0);
+		PutLE32(out, static_cast<unsigned int>(stride * image.Height));
+		PutLE32(out, 2835);
+		PutLE32(out, 2835);
+		PutLE32(out, static_cast<unsigned int>(paletteSize / 4));
+		PutLE32(out, 0);
+		out.insert(out.end(), palette.begin(), palette.end());
+		for (int row = 0; row < image.Height; ++row) {
+			const int y = topDown ? row : image.Height - 1 - row;
+			Bytes line(stride, 0);
+			for (int x = 0; x < image.Width; ++x) {
+				if (bitCount == 8) {
+					line[x] = indices[static_cast<std::size_t>(y) * image.Width + x];
+				}
+				else {
+					std::memcpy(line.data() + x * (bitCount / 8), image.At(x, y), bitCount / 8);
+				}
+			}
+			out.insert(out.end(), line.begin(), line.end());
+		}
+		return out;
+	}
+
+	/// <summary>
+	/// TGA (トゥルーカラー) を生成します。RLE は同じ画素が続く区間を繰り返しパケットにします
+	/// </summary>
+	Bytes MakeTga(const Image& image, int depth, bool rle, bool topDown)
+	{
+		Bytes out = { 0, 0, static_cast<unsigned char>(rle ? 10 : 2), 0, 0, 0, 0, 0 };
+		PutLE16(out, 0);
+		PutLE16(out, 0);
+		PutLE16(out, image.Width);
+		PutLE16(out, image.Height);
+		out.push_back(static_cast<unsigned char>(depth));
+		out.push_back(static_cast<unsigned char>((depth == 32 ? 8 : 0) | (topDown ? 0x20 : 0)));
+
+		const std::size_t pixelSize = depth / 8;
+		std::vector<const unsigned char*> pixels;
+		for (int row = 0; row < image.Height; ++row) {
+			const int y = topDown ? row : image.Height - 1 - row;
+			for (int x = 0; x < image.Width; ++x) {
+				pixels.push_back(image.At(x, y));
+			}
+		}
+		for (std::size_t i = 0; i < pixels.size();) {
+			if (!rle) {
+				out.insert(out.end(), pixels[i], pixels[i] + pixelSize);
+				++i;
+				continue;
+			}
+			std::size_t run = 1;
+			while (i + run < pixels.size() && run < 128 && std::memcmp(pixels[i], pixels[i + run], pixelSize) == 0) {
+				++run;
+			}
+			if (run > 1) {
+				out.push_back(static_cast<unsigned char>(0x80 | (run - 1)));
+				out.insert(out.end(), pixels[i], pixels[i] + pixelSize);
+			}
+			else {
+				std::size_t raw = 1;
+				while (i + raw < pixels.size() && raw < 128 && std::memcmp(pixels[i + raw - 1], pixels[i + raw], pixelSize) != 0) {
+					++raw;
+				}
+				out.push_back(static_cast<unsigned char>(raw - 1));
+				for (std::size_t j = 0; j < raw; ++j) {
+					out.insert(out.end(), pixels[i + j], pixels[i + j] + pixelSize);
+				}
+				run = raw;
+			}
+			i += run;
+		}
+		return out;
+	}
+
+	/// <summary>
+	/// deflate のビット列を書き込みます
+	/// </summary>
+	class BitWriter final
+	{
+	public:
+		explicit BitWriter(Bytes& out) : m_out(out), m_bit(0) {}
+
+		void Put(unsigned int value, int count)
+		{
+			for (int i = 0; i < count; ++i) {
+				if (m_bit == 0) {
+					m_out.push_back(0);
+				}
+				m_out.back() |= ((value >> i) & 1) << m_bit;
+				m_bit = (m_bit + 1) & 7;
+			}
+		}
+
+		// ハフマン符号は上位ビットから書き込みます
+		void PutReversed(unsigned int code, int count)
+		{
+			for (int i = count - 1; i >= 0; --i) {
+				Put((code >> i) & 1, 1);
+			}
+		}
+
+	private:
+		Bytes& m_out;
+		int m_bit;
+	};
+
+	/// <summary>
+	/// zlib 形式で圧縮します (非圧縮ブロック、または固定ハフマンのリテラルのみ)
+	/// </summary>
+	Bytes Deflate(const Bytes& data, bool fixedHuffman)
+	{
+		Bytes out = { 0x78, 0x01 };
+		if (fixedHuffman) {
+			BitWriter writer(out);
+			writer.Put(1, 1);
+			writer.Put(1, 2);
+			for (const unsigned char value : data) {
+				if (value < 144) {
+					writer.PutReversed(0x30 + value, 8);
+				}
+				else {
+					writer.PutReversed(0x190 + value - 144, 9);
+				}
+			}
+			writer.PutReversed(0, 7);
+		}
+		else {
+			// 複数ブロックに分割されることも確認するため、小さいブロックにします
+			const std::size_t blockSize = 100;
+			std::size_t offset = 0;
+			do {
+				const std::size_t length = (std::min)(blockSize, data.size() - offset);
+				const bool last = offset + length == data.size();
+				out.push_back(last ? 1 : 0);
+				PutLE16(out, static_cast<unsigned int>(length));
+				PutLE16(out, static_cast<unsigned int>(~length & 0xFFFF));
+				out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+				offset += length;
+			} while (offset < data.size());
+		}
+		unsigned int a = 1, b = 0;
+		for (const unsigned char value : data) {
+			a = (a + value) % 65521;
+			b = (b + a) % 65521;
+		}
+		PutBE32(out, (b << 16) | a);
+		return out;
+	}
+
+	void PutChunk(Bytes& out, const char* pType, const Bytes& data)
+	{
+		PutBE32(out, static_cast<unsigned int>(data.size()));
+		out.insert(out.end(), pType, pType + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		// CRC は検査されないため 0 にします
+		PutBE32(out, 0);
+	}
+
+	/// <summary>
+	/// PNG (8bit) を生成します。行ごとにフィルタ種別を切り替えます
+	/// </summary>
+	/// <param name="colorType">0 = グレー, 2 = RGB, 3 = パレット, 6 = RGBA</param>
+	Bytes MakePng(const Image& image, int colorType, bool interlace, bool fixedHuffman, const Bytes& palette = Bytes(), const Bytes& indices = Bytes())
+	{
+		const std::size_t channels = colorType == 2 ? 3 : colorType == 6 ? 4 : 1;
+		static const int passes[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+		static const int progressive[1][4] = { { 0, 0, 1, 1 } };
+		const int (*pPasses)[4] = interlace ? passes : progressive;
+
+		Bytes raw;
+		int filter = 0;
+		for (int pass = 0; pass < (interlace ? 7 : 1); ++pass) {
+			const int passWidth = (image.Width - pPasses[pass][0] + pPasses[pass][2] - 1) / pPasses[pass][2];
+			const int passHeight = (image.Height - pPasses[pass][1] + pPasses[pass][3] - 1) / pPasses[pass][3];
+			if (passWidth <= 0 || passHeight <= 0) {
+				continue;
+			}
+			const std::size_t rowSize = passWidth * channels;
+			Bytes previous(rowSize, 0);
+			for (int y = 0; y < passHeight; ++y) {
+				const int srcY = pPasses[pass][1] + y * pPasses[pass][3];
+				Bytes row(rowSize);
+				for (int x = 0; x < passWidth; ++x) {
+					const int srcX = pPasses[pass][0] + x * pPasses[pass][2];
+					const unsigned char* pSrc = image.At(srcX, srcY);
+					unsigned char* pDst = row.data() + x * channels;
+					switch (colorType) {
+					case 0: pDst[0] = pSrc[0]; break;
+					case 3: pDst[0] = indices[static_cast<std::size_t>(srcY) * image.Width + srcX]; break;
+					default:
+						pDst[0] = pSrc[2];
+						pDst[1] = pSrc[1];
+						pDst[2] = pSrc[0];
+						if (channels == 4) {
+							pDst[3] = pSrc[3];
+						}
+						break;
+					}
+				}
+
+				// 前の行は先頭行なら 0 として扱われます
+				raw.push_back(static_cast<unsigned char>(filter));
+				for (std::size_t i = 0; i < rowSize; ++i) {
+					const int a = i >= channels ? row[i - channels] : 0;
+					const int b = previous[i];
+					const int c = i >= channels ? previous[i - channels] : 0;
+					int predictor = 0;
+					switch (filter) {
+					case 1: predictor = a; break;
+					case 2: predictor = b; break;
+					case 3: predictor = (a + b) >> 1; break;
+					case 4:
+					{
+						const int p = a + b - c;
+						const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+						predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+						break;
+					}
+					}
+					raw.push_back(static_cast<unsigned char>(row[i] - predictor));
+				}
+				previous = row;
+				filter = (filter + 1) % 5;
+			}
+		}
+
+		Bytes out = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+		Bytes header;
+		PutBE32(header, image.Width);
+		PutBE32(header, image.Height);
+		header.push_back(8);
+		header.push_back(static_cast<unsigned char>(colorType));
+		header.push_back(0);
+		header.push_back(0);
+		header.push_back(interlace ? 1 : 0);
+		PutChunk(out, "IHDR", header);
+		if (colorType == 3) {
+			PutChunk(out, "PLTE", palette);
+		}
+		// IDAT を 2 つに分割します
+		const Bytes compressed = Deflate(raw, fixedHuffman);
+		const std::size_t half = compressed.size() / 2;
+		PutChunk(out, "IDAT", Bytes(compressed.begin(), compressed.begin() + half));
+		PutChunk(out, "IDAT", Bytes(compressed.begin() + half, compressed.end()));
+		PutChunk(out, "IEND", Bytes());
+		return out;
+	}
+
+	/// <summary>
+	/// ファイルに書き出してから読み戻してデコードします
+	/// </summary>
+	bool WriteAndDecode(const std::string& fileName, const Bytes& data, DecodedImage* pImage)
+	{
+		{
+			std::ofstream file(fileName, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(data.data()), data.size());
+			if (!file) {
+				return false;
+			}
+		}
+		Bytes loaded;
+		{
+			std::ifstream file(fileName, std::ios::binary);
+			loaded.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+		std::remove(fileName.c_str());
+		return loaded == data && ImageDecoder::Decode(loaded.data(), loaded.size(), pImage);
+	}
+
+	/// <summary>
+	/// デコード結果を期待値と比較します
+	/// </summary>
+	bool Equals(const DecodedImage& decoded, const Image& expected, bool compareAlpha)
+	{
+		if (decoded.Width != expected.Width || decoded.Height != expected.Height || decoded.Pixels.size() != expected.Pixels.size()) {
+			return false;
+		}
+		for (std::size_t i = 0; i < decoded.Pixels.size(); ++i) {
+			const unsigned char value = i % 4 == 3 && !compareAlpha ? 255 : expected.Pixels[i];
+			if (decoded.Pixels[i] != value) {
+				std::printf("  mismatch at pixel %d, channel %d: %d != %d\n", static_cast<int>(i / 4), static_cast<int>(i % 4), decoded.Pixels[i], value);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// グレースケール / パレットの画像を作ります
+	/// </summary>
+	Image MakeIndexed(const Image& source, bool gray, Bytes* pPalette, Bytes* pIndices, bool bgrPalette)
+	{
+		Image image = source;
+		pIndices->resize(static_cast<std::size_t>(source.Width) * source.Height);
+		pPalette->clear();
+		for (int i = 0; i < 16 && !gray; ++i) {
+			const unsigned char color[3] = { static_cast<unsigned char>(i * 17), static_cast<unsigned char>(255 - i * 13), static_cast<unsigned char>(i * 7) };
+			// BMP は BGRx、PNG は RGB の並び
+			if (bgrPalette) {
+				pPalette->insert(pPalette->end(), { color[0], color[1], color[2], 0 });
+			}
+			else {
+				pPalette->insert(pPalette->end(), { color[2], color[1], color[0] });
+			}
+		}
+		for (std::size_t i = 0; i < pIndices->size(); ++i) {
+			unsigned char* pDst = image.Pixels.data() + i * 4;
+			if (gray) {
+				pDst[1] = pDst[2] = pDst[0];
+			}
+			else {
+				const unsigned char index = static_cast<unsigned char>(source.Pixels[i * 4] % 16);
+				(*pIndices)[i] = index;
+				pDst[0] = static_cast<unsigned char>(index * 17);
+				pDst[1] = static_cast<unsigned char>(255 - index * 13);
+				pDst[2] = static_cast<unsigned char>(index * 7);
+			}
+			pDst[3] = 255;
+		}
+		return image;
+	}
+}
+
+int main()
+{
+	Test::Random random;
+	DecodedImage decoded;
+
+	// 行の境界が揃わないサイズ (BMP の行パディングと Adam7 の欠けたパスを含む)
+	const Image opaque = MakeImage(13, 7, false, random);
+	const Image alpha = MakeImage(13, 7, true, random);
+	Bytes palette, indices;
+
+	// BMP
+	AU_CHECK(WriteAndDecode("ImageDecoderTest_24.bmp", MakeBmp(opaque, 24, false), &decoded));
+	AU_CHECK(Equals(decoded, opaque, false) && !decoded.HasAlpha);
+	AU_CHECK(WriteAndDecode("ImageDecoderTest_32.bmp", MakeBmp(alpha, 32, true), &decoded));
+	AU_CHECK(Equals(decoded, alpha, true) && decoded.HasAlpha);
+	{
+		const Image indexed = MakeIndexed(opaque, false, &palette, &indices, true);
+		AU_CHECK(WriteAndDecode("ImageDecoderTest_8.bmp", MakeBmp(indexed, 8, false, palette, indices), &decoded));
+		AU_CHECK(Equals(decoded, indexed, false));
+	}
+
+	// TGA
+	AU_CHECK(WriteAndDecode("ImageDecoderTest_24.tga", MakeTga(opaque, 24, false, false), &decoded));
+	AU_CHECK(Equals(decoded, opaque, false));
+	AU_CHECK(WriteAndDecode("ImageDecoderTest_32.tga", MakeTga(alpha, 32, false, true), &decoded));
+	AU_CHECK(Equals(decoded, alpha, true) && decoded.HasAlpha);
+	{
+		// 同じ画素の連続を含めて RLE の両方のパケットを使います
+		Image runs = alpha;
+		for (int x = 2; x < 11; ++x) {
+			std::memcpy(runs.Pixels.data() + (3 * runs.Width + x) * 4, runs.At(1, 3), 4);
+		}
+		AU_CHECK(WriteAndDecode("ImageDecoderTest_rle.tga", MakeTga(runs, 32, true, false), &decoded));
+		AU_CHECK(Equals(decoded, runs, true));
+	}
+
+	// PNG
+	for (int mode = 0; mode < 4; ++mode) {
+		const bool interlace = (mode & 1) != 0;
+		const bool fixedHuffman = (mode & 2) != 0;
+		AU_CHECK(WriteAndDecode("ImageDecoderTest_rgba.png", MakePng(alpha, 6, interlace, fixedHuffman), &decoded));
+		AU_CHECK(Equals(decoded, alpha, true) && decoded.HasAlpha);
+		AU_CHECK(WriteAndDecode("ImageDecoderTest_rgb.png", MakePng(opaque, 2, interlace, fixedHuffman), &decoded));
+		AU_CHECK(Equals(decoded, opaque, false) && !decoded.HasAlpha);
+
+		const Image gray = MakeIndexed(opaque, true, &palette, &indices, false);
+		AU_CHECK(WriteAndDecode("ImageDecoderTest_gray.png", MakePng(gray, 0, interlace, fixedHuffman), &decoded));
+		AU_CHECK(Equals(decoded, gray, false));
+
+		const Image indexed = MakeIndexed(opaque, false, &palette, &indices, false);
+		AU_CHECK(WriteAndDecode("ImageDecoderTest_palette.png", MakePng(indexed, 3, interlace, fixedHuffman, palette, indices), &decoded));
+		AU_CHECK(Equals(decoded, indexed, false));
+	}
+
+	// 途中で切れたファイルは失敗として扱われます
+	{
+		const Bytes files[] = { MakeBmp(opaque, 24, false), MakeTga(opaque, 24, true, false), MakePng(alpha, 6, false, false) };
+		for (const Bytes& file : files) {
+			for (std::size_t size = 0; size < file.size(); size += 7) {
+				AU_CHECK(!ImageDecoder::Decode(file.data(), size, &decoded));
+			}
+		}
+	}
+
+	return Test::Finish("ImageDecoderTest");
+}
@@ -0,0 +1,121 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// LoudnessScan のテスト
+// GetAudioFiltering() を模した関数で、1 フレームにつき 1 回だけ呼び出されることと、
+// まとめて測定した結果が LoudnessMeter に直接渡した場合と一致することを確認します。
+
+#include "TestCommon.h"
+#include "../Filter/LoudnessScan.h"
+#include <cmath>        // std::abs, std::lrint, std::pow, std::sin
+#include <cstring>      // std::memcpy
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+
+namespace
+{
+	const int Channels = 2;
+	const int AudioRate = 48000;
+	const int VideoRate = 30000;
+	const int VideoScale = 1001;
+
+	/// <summary>
+	/// 模擬するファイルの音声と呼び出し回数
+	/// </summary>
+	struct Source
+	{
+		std::vector<short> Samples;
+		int Calls = 0;
+		int NullCalls = 0;
+		int LastFrame = -1;
+	};
+
+	Source& GetSource()
+	{
+		static Source source;
+		return source;
+	}
+
+	/// <summary>
+	/// フレームの先頭のサンプル位置 (29.97fps で 1601 / 1602 サンプルが交互に現れます)
+	/// </summary>
+	long long GetFrameStart(int frame)
+	{
+		return static_cast<long long>(frame) * AudioRate * VideoScale / VideoRate;
+	}
+
+	int GetFileInfo(void*, FileInfo* pFileInfo)
+	{
+		pFileInfo->Audio_Channel = Channels;
+		pFileInfo->Audio_Rate = AudioRate;
+		pFileInfo->Video_Rate = VideoRate;
+		pFileInfo->Video_Scale = VideoScale;
+		return 1;
+	}
+
+	int GetAudioFiltering(void*, void*, int frame, void* pBuffer)
+	{
+		Source& source = GetSource();
+		++source.Calls;
+		source.LastFrame = frame;
+		const long long start = GetFrameStart(frame);
+		const int samples = static_cast<int>(GetFrameStart(frame + 1) - start);
+		if (pBuffer == nullptr) {
+			++source.NullCalls;
+			return samples;
+		}
+		std::memcpy(pBuffer, source.Samples.data() + start * Channels, static_cast<std::size_t>(samples) * Channels * sizeof(short));
+		return samples;
+	}
+}
+
+int main()
+{
+	// -23 dBFS の 997Hz の正弦波 (20 秒)
+	const int frames = static_cast<int>(20LL * VideoRate / VideoScale);
+	Source& source = GetSource();
+	source.Samples.resize(static_cast<std::size_t>(GetFrameStart(frames)) * Channels);
+	const double amplitude = std::pow(10.0, -23.0 / 20) * 32767;
+	for (std::size_t i = 0; i < source.Samples.size() / Channels; ++i) {
+		const short value = static_cast<short>(std::lrint(amplitude * std::sin(2 * 3.14159265358979323846 * 997 * i / AudioRate)));
+		source.Samples[i * Channels] = value;
+		source.Samples[i * Channels + 1] = value;
+	}
+
+	Utility::LoudnessMeter direct(Channels, AudioRate);
+	direct.Add(source.Samples.data(), static_cast<int>(source.Samples.size() / Channels));
+
+	CallbackFunctionSet functions = {};
+	functions.GetFileInfo = GetFileInfo;
+	functions.GetAudioFiltering = GetAudioFiltering;
+	FilterPluginTable filter = {};
+	filter.pCallbackFunctionSet = &functions;
+
+	// まとまりの大きさが 1 フレームより小さい場合と大きい場合、スレッドプールの有無
+	for (const int batchSamples : { 1, 1000, 1 << 18 }) {
+		for (Utility::ThreadPool* pPool : { static_cast<Utility::ThreadPool*>(nullptr), &Utility::ThreadPool::GetDefault() }) {
+			source.Calls = 0;
+			source.NullCalls = 0;
+			Utility::LoudnessMeter meter(Channels, AudioRate);
+			AU_CHECK(MeasureLoudness(&filter, nullptr, 0, frames - 1, &meter, nullptr, pPool, batchSamples));
+			AU_CHECK(source.Calls == frames);
+			AU_CHECK(source.NullCalls == 0);
+			AU_CHECK(meter.GetIntegrated() == direct.GetIntegrated());
+			AU_CHECK(meter.GetTruePeak() == direct.GetTruePeak());
+			AU_CHECK(std::abs(meter.GetIntegrated() + 23.0) < 0.1);
+		}
+	}
+
+	// progress が false を返すと中断します
+	{
+		Utility::LoudnessMeter meter(Channels, AudioRate);
+		AU_CHECK(!MeasureLoudness(&filter, nullptr, 0, frames - 1, &meter, [](int frame) { return frame < 10; }));
+		AU_CHECK(source.LastFrame == 9);
+	}
+
+	Utility::ThreadPool::GetDefault().Shutdown();
+	return Test::Finish("LoudnessScanTest");
+}
@@ -0,0 +1,187 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// PixelExpr のテスト
+// レベル補正・チャンネルミキサー・トーンカーブなどを連結した処理の結果を、このファイルの float のスカラー実装と比較します。
+// 処理が並べた順に実行されること、SSSE3 で読み書きする経路と 1 画素ずつ分離する経路が一致すること、飽和と NaN の扱いを確認します。
+// 併せて、処理を個別に適用する場合と連結して 1 回で適用する場合の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Filter/PixelExpr.h"
+#include <algorithm>    // std::min, std::max
+#include <cmath>        // std::nearbyint, std::sqrt, std::fabs
+#include <cstdlib>      // std::abs
+#include <cstring>      // std::memcmp
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+using namespace AviUtl::Filter::PixelExpr;
+
+namespace
+{
+	short Round(float value)
+	{
+		value = (std::max)(value, -32768.0f);
+		value = (std::min)(value, 32767.0f);
+		return static_cast<short>(std::nearbyint(value));
+	}
+
+	bool SameImage(const std::vector<Pixel_YC>& a, const std::vector<Pixel_YC>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), sizeof(Pixel_YC) * a.size()) == 0;
+	}
+
+	std::vector<Pixel_YC> MakeImage(std::size_t count, Test::Random& random)
+	{
+		std::vector<Pixel_YC> image(count);
+		for (Pixel_YC& p : image) {
+			p.Y = static_cast<short>(random.Next());
+			p.Cb = static_cast<short>(random.Next());
+			p.Cr = static_cast<short>(random.Next());
+		}
+		return image;
+	}
+
+	/// <summary>
+	/// 連結した処理をスカラー実装と比較します
+	/// <para>コンパイラが積和演算にまとめる場合があるため、丸めた結果の ±1 を許容します。</para>
+	/// </summary>
+	void TestReference(Test::Random& random)
+	{
+		const float gain = 1.37f;
+		const auto levels = Assign(Y, Clamp((Y - Constant<256>()) * Param(gain), Constant<0>(), 4096));
+		const auto mixer = AssignYC(Y, Cb * Constant<9, 10>() + Cr * 0.05f, Cr * Constant<11, 10>() - Cb * 0.1f);
+		const auto curve = Assign(Y, Mix(Y, Sqrt(Y * 4096.0f), Constant<1, 4>()));
+		const auto misc = Fuse(Assign(Cb, Abs(-Cb) * 0.5f), Assign(Cr, Max(Min(Cr, 1000), -1000) / 2));
+		const auto chain = Fuse(levels, mixer, curve, misc);
+
+		for (const int width : { 1, 5, 8, 13, 37 }) {
+			for (const int height : { 1, 4, 7 }) {
+				const int pitch = width + 3;
+				const std::vector<Pixel_YC> image = MakeImage(static_cast<std::size_t>(pitch) * height, random);
+				std::vector<Pixel_YC> applied = image;
+				std::vector<Pixel_YC> separated = image;
+				AU_CHECK(Apply(applied.data(), pitch * static_cast<int>(sizeof(Pixel_YC)), width, height, Test::ExecMultiThread, chain));
+				for (int y = 0; y < height; ++y) {
+					PixelExpr::Detail::RunRow(separated.data() + static_cast<std::size_t>(pitch) * y, width, chain, false);
+				}
+				AU_CHECK(SameImage(applied, separated));
+
+				int mismatches = 0;
+				for (int y = 0; y < height; ++y) {
+					for (int x = 0; x < pitch; ++x) {
+						const std::size_t i = static_cast<std::size_t>(y) * pitch + x;
+						const Pixel_YC& source = image[i];
+						const Pixel_YC& actual = applied[i];
+						if (x >= width) {
+							// 幅を超える画素は変更しない
+							mismatches += std::memcmp(&source, &actual, sizeof(Pixel_YC)) != 0 ? 1 : 0;
+							continue;
+						}
+						float yv = source.Y;
+						float cb = source.Cb;
+						float cr = source.Cr;
+						yv = (std::min)((std::max)((yv - 256.0f) * gain, 0.0f), 4096.0f);
+						const float mixedCb = cb * 0.9f + cr * 0.05f;
+						const float mixedCr = cr * 1.1f - cb * 0.1f;
+						cb = mixedCb;
+						cr = mixedCr;
+						yv = yv + (std::sqrt((std::max)(yv * 4096.0f, 0.0f)) - yv) * 0.25f;
+						cb = std::fabs(-cb) * 0.5f;
+						cr = (std::max)((std::min)(cr, 1000.0f), -1000.0f) / 2.0f;
+						if (std::abs(Round(yv) - actual.Y) > 1 || std::abs(Round(cb) - actual.Cb) > 1 || std::abs(Round(cr) - actual.Cr) > 1) {
+							++mismatches;
+						}
+					}
+				}
+				AU_CHECK(mismatches == 0);
+			}
+		}
+	}
+
+	/// <summary>
+	/// 処理の順序、空の連結、飽和と NaN を確認します
+	/// </summary>
+	void TestStatements(Test::Random& random)
+	{
+		std::vector<Pixel_YC> image(8);
+		for (Pixel_YC& p : image) {
+			p.Y = 100;
+			p.Cb = 10;
+			p.Cr = -10;
+		}
+		const int lineSize = 8 * static_cast<int>(sizeof(Pixel_YC));
+
+		// 後の処理は前の処理の結果を参照する ((100 + 1) * 2)、入れ子の連結も同じ順
+		std::vector<Pixel_YC> ordered = image;
+		AU_CHECK(Apply(ordered.data(), lineSize, 8, 1, nullptr, Fuse(Assign(Y, Y + 1.0f), Fuse(Assign(Y, Y * 2.0f), Assign(Cb, Y)))));
+		AU_CHECK(ordered[0].Y == 202 && ordered[0].Cb == 202 && ordered[7].Y == 202);
+
+		// AssignYC は代入前の値で評価する
+		std::vector<Pixel_YC> swapped = image;
+		AU_CHECK(Apply(swapped.data(), lineSize, 8, 1, nullptr, AssignYC(Y, Cr, Cb)));
+		AU_CHECK(swapped[3].Y == 100 && swapped[3].Cb == -10 && swapped[3].Cr == 10);
+
+		// 空の連結は何もしない
+		std::vector<Pixel_YC> unchanged = MakeImage(13, random);
+		const std::vector<Pixel_YC> original = unchanged;
+		AU_CHECK(Apply(unchanged.data(), 13 * static_cast<int>(sizeof(Pixel_YC)), 13, 1, Test::ExecMultiThread, Fuse()));
+		AU_CHECK(SameImage(unchanged, original));
+
+		// 飽和、NaN は -32768
+		std::vector<Pixel_YC> saturated(8);
+		for (Pixel_YC& p : saturated) {
+			p.Y = 30000;
+			p.Cb = -30000;
+			p.Cr = 0;
+		}
+		AU_CHECK(Apply(saturated.data(), lineSize, 8, 1, nullptr, Fuse(Assign(Y, Y * 100.0f), Assign(Cb, Cb * 100.0f), Assign(Cr, Cr / 0.0f))));
+		AU_CHECK(saturated[0].Y == 32767 && saturated[0].Cb == -32768 && saturated[0].Cr == -32768);
+
+		// 範囲外の引数は失敗します
+		AU_CHECK(!Apply(static_cast<Pixel_YC*>(nullptr), lineSize, 8, 1, nullptr, Assign(Y, Y)));
+		AU_CHECK(!Apply(image.data(), lineSize, 0, 1, nullptr, Assign(Y, Y)));
+	}
+
+	/// <summary>
+	/// 1920x1080 で、4 つの処理を個別に適用する場合と連結して適用する場合の処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		const int width = 1920;
+		const int height = 1080;
+		const int lineSize = width * static_cast<int>(sizeof(Pixel_YC));
+		std::vector<Pixel_YC> image(static_cast<std::size_t>(width) * height);
+		for (Pixel_YC& p : image) {
+			p.Y = static_cast<short>(random.Range(0, 4096));
+			p.Cb = static_cast<short>(random.Range(-2048, 2048));
+			p.Cr = static_cast<short>(random.Range(-2048, 2048));
+		}
+		const auto levels = Assign(Y, Clamp((Y - Constant<256>()) * Param(1.1f), Constant<0>(), 4096));
+		const auto mixer = AssignYC(Y, Cb * Constant<9, 10>() + Cr * 0.05f, Cr * Constant<11, 10>() - Cb * 0.1f);
+		const auto curve = Assign(Y, Mix(Y, Sqrt(Y * 4096.0f), Constant<1, 4>()));
+		const auto clamp = Fuse(Assign(Cb, Clamp(Cb, -2048, 2048)), Assign(Cr, Clamp(Cr, -2048, 2048)));
+
+		std::printf("throughput (1920x1080, 1 thread), 4 passes / fused: %.2f / %.2f ms\n",
+			Test::Measure([&]() {
+				Apply(image.data(), lineSize, width, height, nullptr, levels);
+				Apply(image.data(), lineSize, width, height, nullptr, mixer);
+				Apply(image.data(), lineSize, width, height, nullptr, curve);
+				Apply(image.data(), lineSize, width, height, nullptr, clamp);
+			}),
+			Test::Measure([&]() { Apply(image.data(), lineSize, width, height, nullptr, Fuse(levels, mixer, curve, clamp)); }));
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	TestReference(random);
+	TestStatements(random);
+	Benchmark(random);
+
+	return Test::Finish("PixelExprTest");
+}
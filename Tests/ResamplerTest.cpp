@@ -0,0 +1,298 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// Resampler のテスト
+// 重みテーブルを倍精度の参照実装と比較し (入力が補間関数の範囲より短い場合を含む)、
+// Resize() の結果をテーブルから求めた値と、拡大時は ResizeYC() と同じ呼び出し方の双線形補間とも比較します。
+// 併せて、ResizeYC() 相当のスカラー実装と Resampler の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Filter/Resampler.h"
+#include <cmath>        // std::abs, std::ceil, std::floor, std::lround
+#include <cstdlib>      // std::abs
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+
+namespace
+{
+	const ResampleKernel Kernels[] = { ResampleKernel::Bilinear, ResampleKernel::Bicubic, ResampleKernel::Lanczos3, ResampleKernel::Area };
+	const char* const KernelNames[] = { "Bilinear", "Bicubic", "Lanczos3", "Area" };
+
+	/// <summary>
+	/// 補間関数 (ResampleWeightTable と独立した参照実装)
+	/// </summary>
+	double Evaluate(ResampleKernel kernel, double x)
+	{
+		const double pi = 3.14159265358979323846;
+		x = std::abs(x);
+		switch (kernel) {
+		case ResampleKernel::Bicubic:
+			return x < 1 ? 1.5 * x * x * x - 2.5 * x * x + 1 : x < 2 ? -0.5 * x * x * x + 2.5 * x * x - 4 * x + 2 : 0;
+		case ResampleKernel::Lanczos3:
+			return x < 1e-8 ? 1 : x < 3 ? 3 * std::sin(pi * x) * std::sin(pi * x / 3) / (pi * pi * x * x) : 0;
+		default:
+			return x < 1 ? 1 - x : 0;
+		}
+	}
+
+	/// <summary>
+	/// 出力位置 d の、入力の各画素に対する正規化した重みを求めます
+	/// <para>範囲外の画素は端の画素に畳み込みます。補間関数の範囲より十分広く評価します。</para>
+	/// </summary>
+	std::vector<double> ReferenceWeights(ResampleKernel kernel, int srcLength, int dstLength, int d)
+	{
+		const double scale = static_cast<double>(srcLength) / dstLength;
+		const double filterScale = scale > 1 ? scale : 1;
+		const double support = kernel == ResampleKernel::Area ? scale / 2 + 1 : (kernel == ResampleKernel::Bilinear ? 1 : kernel == ResampleKernel::Bicubic ? 2 : 3) * filterScale;
+		const double center = (d + 0.5) * scale - 0.5;
+
+		std::vector<double> weights(srcLength, 0.0);
+		double total = 0;
+		for (int i = static_cast<int>(std::floor(center - support)) - 2; i <= static_cast<int>(std::ceil(center + support)) + 2; ++i) {
+			double weight;
+			if (kernel == ResampleKernel::Area) {
+				const double left = (std::max)(d * scale, static_cast<double>(i));
+				const double right = (std::min)((d + 1) * scale, static_cast<double>(i + 1));
+				weight = (std::max)(right - left, 0.0);
+			}
+			else {
+				weight = Evaluate(kernel, (i - center) / filterScale);
+			}
+			weights[(std::max)(0, (std::min)(i, srcLength - 1))] += weight;
+			total += weight;
+		}
+		for (double& weight : weights) {
+			weight /= total;
+		}
+		return weights;
+	}
+
+	/// <summary>
+	/// 重みテーブルの出力位置 d の重みを、入力の各画素に展開します
+	/// </summary>
+	std::vector<int> ExpandWeights(const ResampleWeightTable& table, int srcLength, int d)
+	{
+		std::vector<int> weights(srcLength, 0);
+		for (int k = 0; k < table.GetTaps(); ++k) {
+			weights[table.GetStart(d) + k] += table.GetWeights(d)[k];
+		}
+		return weights;
+	}
+
+	void TestWeightTable(ResampleKernel kernel, int srcLength, int dstLength)
+	{
+		ResampleWeightTable table;
+		table.Build(kernel, srcLength, dstLength);
+		AU_CHECK(table.GetTaps() >= 1 && table.GetTaps() <= srcLength);
+
+		int maxError = 0;
+		int maxAsymmetry = 0;
+		for (int d = 0; d < dstLength; ++d) {
+			AU_CHECK(table.GetStart(d) >= 0 && table.GetStart(d) + table.GetTaps() <= srcLength);
+			const std::vector<int> weights = ExpandWeights(table, srcLength, d);
+			const std::vector<double> reference = ReferenceWeights(kernel, srcLength, dstLength, d);
+			const std::vector<int> mirrored = ExpandWeights(table, srcLength, dstLength - 1 - d);
+			int sum = 0;
+			for (int s = 0; s < srcLength; ++s) {
+				sum += weights[s];
+				maxError = (std::max)(maxError, std::abs(weights[s] - static_cast<int>(std::lround(reference[s] * ResampleWeightTable::WeightOne))));
+				maxAsymmetry = (std::max)(maxAsymmetry, std::abs(weights[s] - mirrored[srcLength - 1 - s]));
+			}
+			AU_CHECK(sum == ResampleWeightTable::WeightOne);
+		}
+		// 丸め誤差は合計の補正を含めても数単位に収まります
+		if (maxError > 4 || maxAsymmetry > 4) {
+			std::printf("  %s %d -> %d: error %d, asymmetry %d\n", KernelNames[static_cast<int>(kernel)], srcLength, dstLength, maxError, maxAsymmetry);
+		}
+		AU_CHECK(maxError <= 4);
+		AU_CHECK(maxAsymmetry <= 4);
+	}
+
+	/// <summary>
+	/// CallbackFunctionSet::ResizeYC() と同じ引数の双線形補間 (画素の中心を合わせ、範囲外は端の画素)
+	/// <para>AviUtl 本体の実装はホスト環境に無いため、拡大時の比較と処理時間の基準として使用します。</para>
+	/// </summary>
+	void ReferenceResizeYC(Pixel_YC* pYC, int width, int height, const Pixel_YC* pYcSrc, int srcX, int srcY, int srcWidth, int srcHeight, int lineSize)
+	{
+		const int stride = lineSize / Pixel_YC::Size;
+		const double scaleX = static_cast<double>(srcWidth) / width;
+		const double scaleY = static_cast<double>(srcHeight) / height;
+		for (int y = 0; y < height; ++y) {
+			const double fy = (std::max)(0.0, (std::min)((y + 0.5) * scaleY - 0.5, srcHeight - 1.0));
+			const int y0 = static_cast<int>(fy);
+			const int y1 = (std::min)(y0 + 1, srcHeight - 1);
+			for (int x = 0; x < width; ++x) {
+				const double fx = (std::max)(0.0, (std::min)((x + 0.5) * scaleX - 0.5, srcWidth - 1.0));
+				const int x0 = static_cast<int>(fx);
+				const int x1 = (std::min)(x0 + 1, srcWidth - 1);
+				const Pixel_YC* p00 = pYcSrc + (srcY + y0) * stride + srcX + x0;
+				const Pixel_YC* p01 = pYcSrc + (srcY + y0) * stride + srcX + x1;
+				const Pixel_YC* p10 = pYcSrc + (srcY + y1) * stride + srcX + x0;
+				const Pixel_YC* p11 = pYcSrc + (srcY + y1) * stride + srcX + x1;
+				const double ax = fx - x0;
+				const double ay = fy - y0;
+				Pixel_YC& dst = pYC[y * stride + x];
+				for (int c = 0; c < 3; ++c) {
+					const double top = p00->YCbCr[c] + (p01->YCbCr[c] - p00->YCbCr[c]) * ax;
+					const double bottom = p10->YCbCr[c] + (p11->YCbCr[c] - p10->YCbCr[c]) * ax;
+					dst.YCbCr[c] = static_cast<short>(std::lround(top + (bottom - top) * ay));
+				}
+			}
+		}
+	}
+
+	std::vector<Pixel_YC> MakeFrame(int width, int height, Test::Random& random)
+	{
+		std::vector<Pixel_YC> frame(static_cast<std::size_t>(width) * height);
+		for (Pixel_YC& pixel : frame) {
+			pixel.Y = static_cast<short>(random.Range(0, 4096));
+			pixel.Cb = static_cast<short>(random.Range(-2048, 2048));
+			pixel.Cr = static_cast<short>(random.Range(-2048, 2048));
+		}
+		return frame;
+	}
+
+	/// <summary>
+	/// Resize() の結果を、同じ重みテーブルから倍精度で求めた値と比較します
+	/// </summary>
+	void TestResize(ResampleKernel kernel, int srcWidth, int srcHeight, int width, int height, Test::Random& random)
+	{
+		const int srcStride = srcWidth + 13;
+		const int dstStride = width + 5;
+		const std::vector<Pixel_YC> src = MakeFrame(srcStride, srcHeight + 9, random);
+		std::vector<Pixel_YC> dst(static_cast<std::size_t>(dstStride) * height);
+		std::vector<Pixel_YC> single(dst.size());
+
+		Resampler resampler(kernel);
+		AU_CHECK(resampler.Resize(dst.data(), dstStride * Pixel_YC::Size, width, height, src.data(), srcStride * Pixel_YC::Size, 7, 4, srcWidth, srcHeight, Test::ExecMultiThread));
+		AU_CHECK(resampler.Resize(single.data(), dstStride * Pixel_YC::Size, width, height, src.data(), srcStride * Pixel_YC::Size, 7, 4, srcWidth, srcHeight));
+
+		ResampleWeightTable horizontal, vertical;
+		horizontal.Build(kernel, srcWidth, width);
+		vertical.Build(kernel, srcHeight, height);
+		int maxError = 0;
+		bool sameAsSingle = true;
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				const Pixel_YC& actual = dst[static_cast<std::size_t>(y) * dstStride + x];
+				const Pixel_YC& other = single[static_cast<std::size_t>(y) * dstStride + x];
+				for (int c = 0; c < 3; ++c) {
+					double sum = 0;
+					for (int j = 0; j < vertical.GetTaps(); ++j) {
+						double row = 0;
+						for (int i = 0; i < horizontal.GetTaps(); ++i) {
+							const Pixel_YC& pixel = src[static_cast<std::size_t>(vertical.GetStart(y) + j + 4) * srcStride + horizontal.GetStart(x) + i + 7];
+							row += pixel.YCbCr[c] * horizontal.GetWeights(x)[i] / static_cast<double>(ResampleWeightTable::WeightOne);
+						}
+						sum += row * vertical.GetWeights(y)[j] / ResampleWeightTable::WeightOne;
+					}
+					const long expected = (std::max)(-32768L, (std::min)(std::lround(sum), 32767L));
+					maxError = (std::max)(maxError, static_cast<int>(std::abs(expected - actual.YCbCr[c])));
+					sameAsSingle = sameAsSingle && actual.YCbCr[c] == other.YCbCr[c];
+				}
+			}
+		}
+		// 縦方向の結果を 16bit に丸めてから横方向を補間するため、数単位の誤差を許容します
+		AU_CHECK(maxError <= 3);
+		AU_CHECK(sameAsSingle);
+	}
+
+	/// <summary>
+	/// 拡大時の双線形補間が ResizeYC() と同じ呼び出し方の参照実装と一致するか確認します
+	/// </summary>
+	void TestResizeYC(int srcWidth, int srcHeight, int width, int height, Test::Random& random)
+	{
+		const int stride = (std::max)(srcWidth, width) + 8;
+		const std::vector<Pixel_YC> src = MakeFrame(stride, srcHeight + 6, random);
+		std::vector<Pixel_YC> expected(static_cast<std::size_t>(stride) * height);
+		std::vector<Pixel_YC> actual(expected.size());
+		ReferenceResizeYC(expected.data(), width, height, src.data(), 5, 3, srcWidth, srcHeight, stride * Pixel_YC::Size);
+
+		Resampler resampler(ResampleKernel::Bilinear);
+		AU_CHECK(resampler.Resize(actual.data(), stride * Pixel_YC::Size, width, height, src.data(), stride * Pixel_YC::Size, 5, 3, srcWidth, srcHeight));
+		int maxError = 0;
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				for (int c = 0; c < 3; ++c) {
+					maxError = (std::max)(maxError, std::abs(expected[static_cast<std::size_t>(y) * stride + x].YCbCr[c] - actual[static_cast<std::size_t>(y) * stride + x].YCbCr[c]));
+				}
+			}
+		}
+		AU_CHECK(maxError <= 2);
+	}
+
+	/// <summary>
+	/// ResizeYC() 相当のスカラー実装と Resampler の処理時間を出力します
+	/// </summary>
+	void Benchmark(int srcWidth, int srcHeight, int width, int height, Test::Random& random)
+	{
+		const int stride = (std::max)(srcWidth, width);
+		const std::vector<Pixel_YC> src = MakeFrame(stride, srcHeight, random);
+		std::vector<Pixel_YC> dst(static_cast<std::size_t>(stride) * height);
+		const int lineSize = stride * Pixel_YC::Size;
+
+		std::printf("  %dx%d -> %dx%d: ResizeYC (scalar bilinear) %.2f ms", srcWidth, srcHeight, width, height,
+			Test::Measure([&]() { ReferenceResizeYC(dst.data(), width, height, src.data(), 0, 0, srcWidth, srcHeight, lineSize); }, 3));
+		for (int k = 0; k < 4; ++k) {
+			Resampler resampler(Kernels[k]);
+			const double single = Test::Measure([&]() { resampler.Resize(dst.data(), lineSize, width, height, src.data(), lineSize, 0, 0, srcWidth, srcHeight); }, 3);
+			const double multi = Test::Measure([&]() { resampler.Resize(dst.data(), lineSize, width, height, src.data(), lineSize, 0, 0, srcWidth, srcHeight, Test::ExecMultiThread); }, 3);
+			std::printf(", %s %.2f / %.2f ms", KernelNames[k], single, multi);
+		}
+		std::printf(" (1 / %d threads)\n", Test::GetThreadNum());
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	// 入力が補間関数の範囲より短い場合を含む長さの組み合わせ
+	const int lengths[][2] = {
+		{ 1, 1 }, { 1, 7 }, { 2, 1 }, { 3, 1 }, { 5, 10 }, { 8, 2 }, { 4, 3 }, { 7, 3 }, { 6, 13 },
+		{ 16, 16 }, { 17, 5 }, { 100, 33 }, { 33, 100 }, { 1920, 1280 }, { 720, 1080 },
+	};
+	for (const ResampleKernel kernel : Kernels) {
+		for (const auto& length : lengths) {
+			TestWeightTable(kernel, length[0], length[1]);
+		}
+	}
+
+	// 半分に縮小する場合は、左右対称の補間関数で 2 画素に等しく分配されます
+	{
+		ResampleWeightTable table;
+		table.Build(ResampleKernel::Lanczos3, 2, 1);
+		AU_CHECK(table.GetTaps() == 2 && table.GetWeights(0)[0] == ResampleWeightTable::WeightOne / 2 && table.GetWeights(0)[1] == ResampleWeightTable::WeightOne / 2);
+
+		// 3 -> 1 は中央の画素を中心に左右対称になります
+		table.Build(ResampleKernel::Bicubic, 3, 1);
+		const std::vector<int> weights = ExpandWeights(table, 3, 0);
+		AU_CHECK(std::abs(weights[0] - weights[2]) <= 1 && weights[1] > 0);
+
+		// 8 -> 2 の左側の出力は先頭の画素だけでなく、入力の左半分全体を参照します
+		table.Build(ResampleKernel::Lanczos3, 8, 2);
+		const std::vector<int> left = ExpandWeights(table, 8, 0);
+		AU_CHECK(left[1] > 0 && left[2] > 0 && left[3] > 0);
+	}
+
+	for (const ResampleKernel kernel : Kernels) {
+		TestResize(kernel, 123, 77, 123, 77, random);
+		TestResize(kernel, 123, 77, 301, 150, random);
+		TestResize(kernel, 301, 150, 64, 41, random);
+		TestResize(kernel, 3, 2, 17, 9, random);
+		TestResize(kernel, 40, 30, 1, 1, random);
+	}
+
+	TestResizeYC(64, 48, 160, 100, random);
+	TestResizeYC(33, 17, 33, 17, random);
+	TestResizeYC(5, 3, 41, 29, random);
+
+	std::printf("throughput:\n");
+	Benchmark(1920, 1080, 1280, 720, random);
+	Benchmark(1280, 720, 1920, 1080, random);
+
+	return Test::Finish("ResamplerTest");
+}
@@ -0,0 +1,104 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// Sha1 のテスト
+// FIPS 180 のテストベクタ (100 万文字の 'a' は不揃いな長さに分けて追加) のハッシュ値を確認し、
+// SHA 拡張命令が使用可能な CPU では、拡張命令なしの処理とランダムなデータで結果が一致することを確認します。
+// 併せて、それぞれの処理速度を出力します。
+
+#include "TestCommon.h"
+#include "../Utility/Sha1.h"
+#include <algorithm>    // std::min
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Utility;
+
+namespace
+{
+	/// <summary>
+	/// データを chunks の長さ (繰り返し) に分けて追加したハッシュ値を求めます
+	/// </summary>
+	std::string Hash(bool useSha, const void* pData, std::size_t size, const std::vector<std::size_t>& chunks)
+	{
+		Sha1 sha1(useSha);
+		const unsigned char* p = static_cast<const unsigned char*>(pData);
+		for (std::size_t offset = 0, i = 0; offset < size; ++i) {
+			const std::size_t chunk = (std::min)(chunks[i % chunks.size()], size - offset);
+			sha1.Update(p + offset, chunk);
+			offset += chunk;
+		}
+		return Sha1::ToHex(sha1.Finish());
+	}
+
+	void TestVectors(bool useSha)
+	{
+		const std::vector<std::size_t> whole = { ~std::size_t(0) };
+		const std::string message448 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+		const std::string message896 = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+		AU_CHECK(Hash(useSha, "", 0, whole) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+		AU_CHECK(Hash(useSha, "abc", 3, whole) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+		AU_CHECK(Hash(useSha, message448.data(), message448.size(), whole) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+		AU_CHECK(Hash(useSha, message896.data(), message896.size(), whole) == "a49b2446a02c645bf419f995b67091253a04a259");
+		AU_CHECK(Hash(useSha, message448.data(), message448.size(), { 1, 2, 3 }) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+		// バッファの端数、ちょうど 1 ブロック、ブロックをまたぐ長さを混ぜて追加します
+		const std::string million(1000000, 'a');
+		AU_CHECK(Hash(useSha, million.data(), million.size(), whole) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+		AU_CHECK(Hash(useSha, million.data(), million.size(), { 1, 63, 64, 65, 127, 1000, 7, 4096, 55, 56, 57 }) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+		// Reset() 後は最初から計算し直す
+		Sha1 sha1(useSha);
+		sha1.Update("xyz", 3);
+		sha1.Reset();
+		sha1.Update("abc", 3);
+		AU_CHECK(Sha1::ToHex(sha1.Finish()) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+	}
+
+	void TestParity(Test::Random& random)
+	{
+		for (int round = 0; round < 500; ++round) {
+			std::vector<unsigned char> data(static_cast<std::size_t>(random.Range(0, round < 300 ? 300 : 20000)));
+			for (unsigned char& value : data) {
+				value = static_cast<unsigned char>(random.Next());
+			}
+			std::vector<std::size_t> chunks(static_cast<std::size_t>(random.Range(1, 4)));
+			for (std::size_t& chunk : chunks) {
+				chunk = static_cast<std::size_t>(random.Range(1, 200));
+			}
+			AU_CHECK(Hash(true, data.data(), data.size(), chunks) == Hash(false, data.data(), data.size(), { data.size() + 1 }));
+		}
+	}
+
+	/// <summary>
+	/// 64MB のハッシュ値を求める処理時間を出力します
+	/// </summary>
+	void Benchmark(bool hasSha)
+	{
+		const std::vector<unsigned char> data(64 * 1024 * 1024, 0x5A);
+		const std::vector<std::size_t> whole = { data.size() };
+		const double scalar = Test::Measure([&]() { Hash(false, data.data(), data.size(), whole); }, 3);
+		const double sha = hasSha ? Test::Measure([&]() { Hash(true, data.data(), data.size(), whole); }, 3) : 0.0;
+		std::printf("64MB: scalar / SHA: %.2f / %.2f ms (%.0f / %.0f MB/s)\n", scalar, sha, 64 * 1000.0 / scalar, hasSha ? 64 * 1000.0 / sha : 0.0);
+	}
+}
+
+int main()
+{
+	Test::Random random;
+	const bool hasSha = Simd::Has(Simd::Feature::SHA | Simd::Feature::SSE41);
+	if (!hasSha) {
+		std::printf("SHA extensions are not available; skipped the SHA comparison\n");
+	}
+
+	TestVectors(false);
+	if (hasSha) {
+		TestVectors(true);
+		TestParity(random);
+	}
+	Benchmark(hasSha);
+
+	return Test::Finish("Sha1Test");
+}
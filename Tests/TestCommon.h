@@ -0,0 +1,135 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <chrono>       // std::chrono
+#include <cstdint>      // std::uint32_t
+#include <cstdio>       // std::printf
+#include <thread>       // std::thread
+#include <vector>       // std::vector
+
+/// <summary>
+/// 条件を検査し、失敗したら位置と式を出力します
+/// </summary>
+#define AU_CHECK(expr) \
+	((expr) ? static_cast<void>(0) : ::AviUtl::Test::Fail(__FILE__, __LINE__, #expr))
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ホスト環境で実行するテスト
+	/// </summary>
+	namespace Test
+	{
+		/// <summary>
+		/// 失敗した検査の数
+		/// </summary>
+		inline int& GetFailureCount()
+		{
+			static int count = 0;
+			return count;
+		}
+
+		/// <summary>
+		/// 失敗を記録します
+		/// </summary>
+		inline void Fail(const char* pFile, int line, const char* pExpr)
+		{
+			std::printf("%s(%d): check failed: %s\n", pFile, line, pExpr);
+			++GetFailureCount();
+		}
+
+		/// <summary>
+		/// 結果を出力して main() の戻り値を返します
+		/// </summary>
+		inline int Finish(const char* pName)
+		{
+			const int failures = GetFailureCount();
+			std::printf("%s: %s (%d failures)\n", pName, failures == 0 ? "passed" : "FAILED", failures);
+			return failures == 0 ? 0 : 1;
+		}
+
+		/// <summary>
+		/// 再現可能な擬似乱数 (xorshift32)
+		/// </summary>
+		class Random final
+		{
+		public:
+			explicit Random(std::uint32_t seed = 2463534242u) : m_state(seed != 0 ? seed : 1) {}
+
+			std::uint32_t Next()
+			{
+				m_state ^= m_state << 13;
+				m_state ^= m_state >> 17;
+				m_state ^= m_state << 5;
+				return m_state;
+			}
+
+			/// <summary>
+			/// [minimum, maximum] の整数を返します
+			/// </summary>
+			int Range(int minimum, int maximum)
+			{
+				return minimum + static_cast<int>(Next() % static_cast<std::uint32_t>(maximum - minimum + 1));
+			}
+
+		private:
+			std::uint32_t m_state;
+		};
+
+		/// <summary>
+		/// ExecMultiThread() の代わりに使用するスレッド数
+		/// </summary>
+		inline int& GetThreadNum()
+		{
+			static int threadNum = 4;
+			return threadNum;
+		}
+
+		/// <summary>
+		/// ExecMultiThread() と同じ呼び出し方で、GetThreadNum() 個のスレッドで処理を実行します
+		/// </summary>
+		inline int ExecMultiThread(void (*pFunc)(int threadId, int threadNum, void* pParam1, void* pParam2), void* pParam1, void* pParam2)
+		{
+			const int threadNum = GetThreadNum();
+			std::vector<std::thread> threads;
+			for (int i = 1; i < threadNum; ++i) {
+				threads.emplace_back(pFunc, i, threadNum, pParam1, pParam2);
+			}
+			pFunc(0, threadNum, pParam1, pParam2);
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+			return 1;
+		}
+
+		/// <summary>
+		/// 処理時間を計測します
+		/// </summary>
+		/// <param name="func">計測する処理</param>
+		/// <param name="repeat">繰り返す回数</param>
+		/// <returns>
+		/// 1回あたりの時間 (ミリ秒、最短値)
+		/// </returns>
+		template<typename Func>
+		double Measure(Func&& func, int repeat = 5)
+		{
+			double best = 0.0;
+			for (int i = 0; i < repeat; ++i) {
+				const auto begin = std::chrono::steady_clock::now();
+				func();
+				const auto end = std::chrono::steady_clock::now();
+				const double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+				if (i == 0 || ms < best) {
+					best = ms;
+				}
+			}
+			return best;
+		}
+	}
+}
@@ -0,0 +1,164 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// TextRenderer のテスト
+// GDI を使用しないラスタライザで、レイアウト、行のキャッシュ、フォントの共有、合成 (SSE2 と端数の処理) を確認します。
+
+#include "TestCommon.h"
+#include "../Filter/TextRenderer.h"
+#include <memory>       // std::shared_ptr
+#include <string>       // std::wstring
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Filter;
+
+namespace
+{
+	/// <summary>
+	/// 文字ごとに決まった矩形を返すラスタライザ
+	/// <para>'#' は 3 × 4 の不透明、'.' は 3 × 4 の半透明、空白は幅のみ、それ以外は失敗します。</para>
+	/// </summary>
+	class BoxRasterizer final : public GlyphRasterizer
+	{
+	public:
+		explicit BoxRasterizer(int* pCount) : m_pCount(pCount) {}
+
+		bool Rasterize(unsigned int codepoint, Glyph* pGlyph) override
+		{
+			++*m_pCount;
+			pGlyph->Advance = 4;
+			pGlyph->OffsetX = 0;
+			pGlyph->OffsetY = 5;
+			if (codepoint == L' ') {
+				pGlyph->Width = 0;
+				pGlyph->Height = 0;
+				pGlyph->Coverage.clear();
+				return true;
+			}
+			if (codepoint != L'#' && codepoint != L'.') {
+				return false;
+			}
+			pGlyph->Width = 3;
+			pGlyph->Height = 4;
+			pGlyph->Coverage.assign(12, static_cast<unsigned char>(codepoint == L'#' ? 255 : 128));
+			return true;
+		}
+
+		int GetAscent() const override { return 6; }
+
+		int GetLineHeight() const override { return 8; }
+
+	private:
+		int* m_pCount;
+	};
+
+	/// <summary>
+	/// 行の不透明度から合成結果を求めます (TextFont::Draw() の端数の処理と同じ式)
+	/// </summary>
+	short Blend(short dst, short src, int alpha, int opacity)
+	{
+		const int a = (alpha * opacity) >> 12;
+		return static_cast<short>((dst * (4096 - a) + src * a + 2048) >> 12);
+	}
+}
+
+int main()
+{
+	int rasterized = 0;
+	TextFont font(std::unique_ptr<GlyphRasterizer>(new BoxRasterizer(&rasterized)));
+
+	// レイアウト
+	const std::shared_ptr<const TextLine> line = font.Layout(L"# .#");
+	AU_CHECK(line->Width == 16 && line->Height == 8);
+	for (int y = 0; y < line->Height; ++y) {
+		for (int x = 0; x < line->Width; ++x) {
+			const int column = x % 4;
+			const int glyph = x / 4;
+			const bool inside = y >= 1 && y < 5 && column < 3 && glyph != 1;
+			const short expected = !inside ? 0 : glyph == 2 ? static_cast<short>((128 * 4096 + 127) / 255) : 4096;
+			AU_CHECK(line->Alpha[static_cast<std::size_t>(y) * line->Width + x] == expected);
+		}
+	}
+
+	// 同じ文字列はキャッシュから返し、同じ文字はラスタライズし直しません
+	AU_CHECK(font.Layout(L"# .#") == line);
+	const int count = rasterized;
+	font.Layout(L"#.#.");
+	AU_CHECK(rasterized == count);
+
+	// ラスタライズできない文字は飛ばします
+	AU_CHECK(font.Layout(L"#x#")->Width == 8);
+
+	// 行数を超えた古い行は破棄されます
+	font.SetLineCacheSize(1);
+	font.Layout(L"##");
+	AU_CHECK(font.Layout(L"# .#") != line);
+
+	// 合成: 1 行目は 8 画素単位の SSE2、2 行目は端数の処理、左端と上端はクリッピング
+	{
+		const int width = 40;
+		const int height = 24;
+		const int stride = width + 3;
+		std::vector<Pixel_YC> frame(static_cast<std::size_t>(stride) * height);
+		Test::Random random;
+		for (Pixel_YC& pixel : frame) {
+			pixel.Y = static_cast<short>(random.Range(0, 4096));
+			pixel.Cb = static_cast<short>(random.Range(-2048, 2048));
+			pixel.Cr = static_cast<short>(random.Range(-2048, 2048));
+		}
+		const std::vector<Pixel_YC> original = frame;
+		const Pixel_YC color = { 3000, -500, 700 };
+		const int transparent = 1000;
+		const int left = -2;
+		const int top = -1;
+
+		int textWidth = 0, textHeight = 0;
+		font.Draw(frame.data(), stride * Pixel_YC::Size, width, height, left, top, L"#.#.#.#.\r\n#.", color, transparent, &textWidth, &textHeight);
+		AU_CHECK(textWidth == 32 && textHeight == 16);
+
+		const std::shared_ptr<const TextLine> lines[] = { font.Layout(L"#.#.#.#."), font.Layout(L"#.") };
+		bool matched = true;
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				Pixel_YC expected = original[static_cast<std::size_t>(y) * stride + x];
+				const int row = y - top;
+				const int index = row / 8;
+				if (index < 2 && x - left < lines[index]->Width) {
+					const short alpha = lines[index]->Alpha[static_cast<std::size_t>(row % 8) * lines[index]->Width + (x - left)];
+					if (alpha != 0) {
+						expected.Y = Blend(expected.Y, color.Y, alpha, 4096 - transparent);
+						expected.Cb = Blend(expected.Cb, color.Cb, alpha, 4096 - transparent);
+						expected.Cr = Blend(expected.Cr, color.Cr, alpha, 4096 - transparent);
+					}
+				}
+				const Pixel_YC& actual = frame[static_cast<std::size_t>(y) * stride + x];
+				if (actual.Y != expected.Y || actual.Cb != expected.Cb || actual.Cr != expected.Cr) {
+					matched = false;
+				}
+			}
+		}
+		AU_CHECK(matched);
+
+		// 描画先が nullptr ならサイズだけを返します
+		font.Draw(nullptr, 0, 0, 0, 0, 0, L"##", color, 0, &textWidth, &textHeight);
+		AU_CHECK(textWidth == 8 && textHeight == 8);
+	}
+
+	// 同じキーのフォントは使用中の間だけ共有されます
+	{
+		int sharedCount = 0;
+		const auto create = [&]() { return new BoxRasterizer(&sharedCount); };
+		std::shared_ptr<TextFont> a = TextFont::GetShared(L"box|8", create);
+		std::shared_ptr<TextFont> b = TextFont::GetShared(L"box|8", create);
+		std::shared_ptr<TextFont> c = TextFont::GetShared(L"box|9", create);
+		AU_CHECK(a == b && a != c);
+		a.reset();
+		b.reset();
+		std::shared_ptr<TextFont> d = TextFont::GetShared(L"box|8", create);
+		AU_CHECK(d != nullptr && d != c);
+	}
+
+	return Test::Finish("TextRendererTest");
+}
@@ -0,0 +1,293 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+// YCPacker のテスト
+// P010 / v210 の符号が Unpack() -> Pack() の往復でバイト単位で元に戻ることを確認します。
+// P016 / 4:4:4 16bit で Pixel_YC (Y 0～4096, Cb/Cr ±2048) が Pack() -> Unpack() の往復で元の値に戻ることを確認します。
+// 行ごとの変換の SSSE3 版とスカラー版、スレッドプールの有無で結果が一致するか比較し、1920x1080 の処理時間を出力します。
+
+#include "TestCommon.h"
+#include "../Output/YCPacker.h"
+#include <algorithm>    // std::min
+#include <cstring>      // std::memcpy
+#include <vector>       // std::vector
+
+using namespace AviUtl;
+using namespace AviUtl::Output::YCPacker;
+using Filter::Pixel_YC;
+
+namespace
+{
+	const PackRange Ranges[] = { PackRange::Limited, PackRange::Full };
+	const ChromaSiting Sitings[] = { ChromaSiting::Left, ChromaSiting::Center, ChromaSiting::TopLeft };
+
+	/// <summary>
+	/// 10bit の符号の範囲 (リミテッドレンジは規格内の値)
+	/// </summary>
+	int RandomCode(Test::Random& random, PackRange range, bool luma)
+	{
+		return range == PackRange::Full ? random.Range(0, 1023) : random.Range(64, luma ? 940 : 960);
+	}
+
+	/// <summary>
+	/// 10bit の符号の画像を作成します
+	/// <para>flatChroma なら画像全体で色差を同じ値にします。</para>
+	/// </summary>
+	std::vector<unsigned char> MakeCodes(PackedFormat format, int width, int height, PackRange range, bool flatChroma, Test::Random& random)
+	{
+		std::vector<unsigned char> frame(GetFrameSize(format, width, height));
+		const std::size_t pitch = GetPitch(format, width);
+		const int flatCb = RandomCode(random, range, false);
+		const int flatCr = RandomCode(random, range, false);
+		const auto chroma = [&](int flat) { return flatChroma ? flat : RandomCode(random, range, false); };
+
+		if (format == PackedFormat::P010) {
+			for (int y = 0; y < height; ++y) {
+				unsigned short* pY = reinterpret_cast<unsigned short*>(frame.data() + pitch * y);
+				for (int x = 0; x < width; ++x) {
+					pY[x] = static_cast<unsigned short>(RandomCode(random, range, true) << 6);
+				}
+			}
+			for (int y = 0; y < height / 2; ++y) {
+				unsigned short* pUV = reinterpret_cast<unsigned short*>(frame.data() + pitch * (height + y));
+				for (int k = 0; k < width / 2; ++k) {
+					pUV[k * 2 + 0] = static_cast<unsigned short>(chroma(flatCb) << 6);
+					pUV[k * 2 + 1] = static_cast<unsigned short>(chroma(flatCr) << 6);
+				}
+			}
+			return frame;
+		}
+
+		// v210: Cb0 Y0 Cr0 | Y1 Cb1 Y2 | Cr1 Y3 Cb2 | Y4 Cr2 Y5 (幅を超える部分と行末は 0)
+		for (int y = 0; y < height; ++y) {
+			for (int g = 0; g * 6 < width; ++g) {
+				unsigned int values[12] = {};
+				for (int j = 0; j < 6 && g * 6 + j < width; ++j) {
+					values[j * 2 + 1] = RandomCode(random, range, true);
+				}
+				for (int j = 0; j < 3 && g * 3 + j < width / 2; ++j) {
+					values[j * 4] = chroma(flatCb);
+					values[j * 4 + 2] = chroma(flatCr);
+				}
+				unsigned int words[4];
+				for (int i = 0; i < 4; ++i) {
+					words[i] = values[i * 3] | (values[i * 3 + 1] << 10) | (values[i * 3 + 2] << 20);
+				}
+				std::memcpy(frame.data() + pitch * y + g * 16, words, sizeof(words));
+			}
+		}
+		return frame;
+	}
+
+	/// <summary>
+	/// P010 / v210 の符号が Unpack() -> Pack() で元に戻ることを確認します
+	/// <para>Unpack() は色差を複製して拡大するため、2 画素を平均する Center はどの色差でも元に戻ります。</para>
+	/// <para>[1, 2, 1] で間引く Left / TopLeft は、色差が一様な画像で確認します。</para>
+	/// </summary>
+	void TestCodeRoundTrip(Test::Random& random)
+	{
+		Utility::ThreadPool pool(4);
+		for (const PackedFormat format : { PackedFormat::P010, PackedFormat::V210 }) {
+			for (const PackRange range : Ranges) {
+				for (const ChromaSiting siting : Sitings) {
+					for (const int width : { 2, 6, 14, 16, 48, 50, 96, 130 }) {
+						for (const int height : { 2, 4, 34, 40 }) {
+							const std::vector<unsigned char> codes = MakeCodes(format, width, height, range, siting != ChromaSiting::Center, random);
+							std::vector<Pixel_YC> yc(static_cast<std::size_t>(width) * height);
+							AU_CHECK(Unpack(codes.data(), format, width, height, yc.data(), width * static_cast<int>(sizeof(Pixel_YC)), range));
+
+							PackOptions options;
+							options.Range = range;
+							options.Siting = siting;
+							std::vector<unsigned char> packed(codes.size(), 0xCD);
+							AU_CHECK(Pack(yc.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height, format, packed.data(), options, &pool));
+							AU_CHECK(packed == codes);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// P016 / 4:4:4 16bit で Pixel_YC の値が Pack() -> Unpack() で元に戻ることを確認します
+	/// <para>フルレンジは Pixel_YC の 16 倍のため、Y = 4096 と C = 2048 は 65535 に丸められます。</para>
+	/// </summary>
+	void TestValueRoundTrip()
+	{
+		for (const PackedFormat format : { PackedFormat::P016, PackedFormat::Yuv444P16 }) {
+			for (const PackRange range : Ranges) {
+				const int maxY = range == PackRange::Full ? 4095 : 4096;
+				const int maxC = range == PackRange::Full ? 2047 : 2048;
+				// Y は全ての値、色差は 2x2 画素ごとに同じ値で -2048～maxC を並べます
+				const int width = 4098;
+				const int height = 4;
+				std::vector<Pixel_YC> src(static_cast<std::size_t>(width) * height);
+				for (int y = 0; y < height; ++y) {
+					for (int x = 0; x < width; ++x) {
+						Pixel_YC& p = src[static_cast<std::size_t>(y) * width + x];
+						const int c = -2048 + (x / 2 + y / 2 * (width / 2)) % (maxC + 2049);
+						p.Y = static_cast<short>((std::min)(x, maxY));
+						p.Cb = static_cast<short>(c);
+						p.Cr = static_cast<short>(maxC - 2048 - c);
+					}
+				}
+
+				PackOptions options;
+				options.Range = range;
+				options.Siting = ChromaSiting::Center;
+				std::vector<unsigned char> packed(GetFrameSize(format, width, height));
+				AU_CHECK(Pack(src.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height, format, packed.data(), options));
+				std::vector<Pixel_YC> back(src.size());
+				AU_CHECK(Unpack(packed.data(), format, width, height, back.data(), width * static_cast<int>(sizeof(Pixel_YC)), range));
+
+				int mismatches = 0;
+				for (std::size_t i = 0; i < src.size(); ++i) {
+					if (src[i].Y != back[i].Y || src[i].Cb != back[i].Cb || src[i].Cr != back[i].Cr) {
+						++mismatches;
+					}
+				}
+				AU_CHECK(mismatches == 0);
+			}
+		}
+	}
+
+	/// <summary>
+	/// 行ごとの変換の SSSE3 版とスカラー版を比較します
+	/// </summary>
+	void TestSimd(Test::Random& random)
+	{
+		if (!Utility::Simd::Has(Utility::Simd::Feature::SSSE3)) {
+			std::printf("SSSE3 is not available; skipped the SIMD comparison\n");
+			return;
+		}
+		for (const int bits : { 10, 16 }) {
+			const int codeShift = bits == 10 ? 6 : 0;
+			for (const PackRange range : Ranges) {
+				const Detail::Scales scales = Detail::GetScales(bits, range);
+				for (int width = 2; width < 72; width += 2) {
+					// 飽和を確認するため範囲外の値と short の最大値・最小値を含めます
+					std::vector<Pixel_YC> rows[3];
+					for (std::vector<Pixel_YC>& row : rows) {
+						row.resize(width);
+						for (Pixel_YC& p : row) {
+							const int kind = random.Range(0, 15);
+							p.Y = static_cast<short>(kind == 0 ? 32767 : kind == 1 ? -32768 : random.Range(-800, 5200));
+							p.Cb = static_cast<short>(kind == 0 ? -32768 : random.Range(-2500, 2500));
+							p.Cr = static_cast<short>(kind == 1 ? 32767 : random.Range(-2500, 2500));
+						}
+					}
+
+					std::vector<unsigned short> scalar[2] = { std::vector<unsigned short>(width), std::vector<unsigned short>(width) };
+					std::vector<unsigned short> simd[2] = { std::vector<unsigned short>(width), std::vector<unsigned short>(width) };
+					Detail::LumaRow(rows[0].data(), simd[0].data(), width, scales.Y, codeShift, true);
+					Detail::LumaRow(rows[0].data(), scalar[0].data(), width, scales.Y, codeShift, false);
+					AU_CHECK(simd[0] == scalar[0]);
+
+					Detail::ChromaRow444(rows[0].data(), simd[0].data(), simd[1].data(), width, scales.C, true);
+					Detail::ChromaRow444(rows[0].data(), scalar[0].data(), scalar[1].data(), width, scales.C, false);
+					AU_CHECK(simd[0] == scalar[0] && simd[1] == scalar[1]);
+
+					std::vector<unsigned short> interleavedSimd(width);
+					std::vector<unsigned short> interleavedScalar(width);
+					Detail::InterleaveRow(scalar[0].data(), scalar[1].data(), interleavedSimd.data(), width / 2, true);
+					Detail::InterleaveRow(scalar[0].data(), scalar[1].data(), interleavedScalar.data(), width / 2, false);
+					AU_CHECK(interleavedSimd == interleavedScalar);
+
+					for (const ChromaSiting siting : Sitings) {
+						for (const bool vertical : { false, true }) {
+							const Pixel_YC* pRow1 = vertical ? rows[1].data() : nullptr;
+							std::vector<short> tempSimd(static_cast<std::size_t>(width + 2) * 2);
+							std::vector<short> tempScalar(tempSimd.size());
+							Detail::VerticalChroma(rows[2].data(), rows[0].data(), pRow1, tempSimd.data(), tempSimd.data() + width + 2, width, siting, true);
+							Detail::VerticalChroma(rows[2].data(), rows[0].data(), pRow1, tempScalar.data(), tempScalar.data() + width + 2, width, siting, false);
+							AU_CHECK(tempSimd == tempScalar);
+
+							std::vector<unsigned short> codesSimd(width / 2);
+							std::vector<unsigned short> codesScalar(width / 2);
+							Detail::HorizontalChroma(tempScalar.data(), codesSimd.data(), width / 2, siting, scales.C, codeShift, true);
+							Detail::HorizontalChroma(tempScalar.data(), codesScalar.data(), width / 2, siting, scales.C, codeShift, false);
+							AU_CHECK(codesSimd == codesScalar);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// スレッドプールの有無で Pack() の結果が一致することを確認します
+	/// </summary>
+	void TestPool(Test::Random& random)
+	{
+		Utility::ThreadPool pool(4);
+		for (const PackedFormat format : { PackedFormat::P010, PackedFormat::P016, PackedFormat::V210, PackedFormat::Yuv444P16 }) {
+			for (const ChromaSiting siting : Sitings) {
+				const int width = 2 * random.Range(1, 80);
+				const int height = 2 * random.Range(1, 60);
+				const int lineSize = (width + random.Range(0, 4)) * static_cast<int>(sizeof(Pixel_YC));
+				std::vector<Pixel_YC> src(static_cast<std::size_t>(lineSize / sizeof(Pixel_YC)) * height);
+				for (Pixel_YC& p : src) {
+					p.Y = static_cast<short>(random.Range(0, 4096));
+					p.Cb = static_cast<short>(random.Range(-2048, 2048));
+					p.Cr = static_cast<short>(random.Range(-2048, 2048));
+				}
+				PackOptions options;
+				options.Siting = siting;
+				options.Range = random.Range(0, 1) != 0 ? PackRange::Full : PackRange::Limited;
+				std::vector<unsigned char> sequential(GetFrameSize(format, width, height), 0xCD);
+				std::vector<unsigned char> parallel(sequential.size(), 0xAB);
+				AU_CHECK(Pack(src.data(), lineSize, width, height, format, sequential.data(), options));
+				AU_CHECK(Pack(src.data(), lineSize, width, height, format, parallel.data(), options, &pool));
+				AU_CHECK(parallel == sequential);
+			}
+		}
+
+		// 4:2:0 は幅と高さ、4:2:2 は幅が偶数でなければ失敗します
+		Pixel_YC pixel[9] = {};
+		unsigned char buffer[512] = {};
+		AU_CHECK(!Pack(pixel, 3 * static_cast<int>(sizeof(Pixel_YC)), 3, 2, PackedFormat::P010, buffer));
+		AU_CHECK(!Pack(pixel, 2 * static_cast<int>(sizeof(Pixel_YC)), 2, 3, PackedFormat::P016, buffer));
+		AU_CHECK(!Pack(pixel, 3 * static_cast<int>(sizeof(Pixel_YC)), 3, 1, PackedFormat::V210, buffer));
+		AU_CHECK(Pack(pixel, 3 * static_cast<int>(sizeof(Pixel_YC)), 3, 3, PackedFormat::Yuv444P16, buffer));
+	}
+
+	/// <summary>
+	/// 1920x1080 の処理時間を出力します
+	/// </summary>
+	void Benchmark(Test::Random& random)
+	{
+		const int width = 1920;
+		const int height = 1080;
+		std::vector<Pixel_YC> src(static_cast<std::size_t>(width) * height);
+		for (Pixel_YC& p : src) {
+			p.Y = static_cast<short>(random.Range(0, 4096));
+			p.Cb = static_cast<short>(random.Range(-2048, 2048));
+			p.Cr = static_cast<short>(random.Range(-2048, 2048));
+		}
+		Utility::ThreadPool pool(4);
+		const char* names[] = { "P010", "P016", "v210", "4:4:4 16bit" };
+		std::printf("throughput (1920x1080), sequential / 4 threads:\n");
+		for (int i = 0; i < 4; ++i) {
+			const PackedFormat format = static_cast<PackedFormat>(i);
+			std::vector<unsigned char> dst(GetFrameSize(format, width, height));
+			std::printf("  %-11s %.2f / %.2f ms\n", names[i],
+				Test::Measure([&]() { Pack(src.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height, format, dst.data()); }),
+				Test::Measure([&]() { Pack(src.data(), width * static_cast<int>(sizeof(Pixel_YC)), width, height, format, dst.data(), PackOptions(), &pool); }));
+		}
+	}
+}
+
+int main()
+{
+	Test::Random random;
+
+	TestCodeRoundTrip(random);
+	TestValueRoundTrip();
+	TestSimd(random);
+	TestPool(random);
+	Benchmark(random);
+
+	return Test::Finish("YCPackerTest");
+}
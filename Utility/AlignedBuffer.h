@@ -0,0 +1,131 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <malloc.h>     // _aligned_malloc, _aligned_free
+#include <cstddef>      // std::size_t
+#include <new>          // std::bad_alloc
+#include <type_traits>  // std::is_trivially_copyable
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// アライメントを指定して確保するバッファ
+		/// <para>SIMD の整列ロード/ストアで使用します。要素は初期化しません。</para>
+		/// </summary>
+		/// <typeparam name="T">要素の型 (トリビアルにコピー可能な型のみ)</typeparam>
+		template<class T>
+		class AlignedBuffer final
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Error: AlignedBuffer requires a trivially copyable type.");
+
+		public:
+			/// <summary>
+			/// 既定のアライメント (キャッシュライン、AVX2 の 32byte を含みます)
+			/// </summary>
+			enum : std::size_t { DefaultAlignment = 64 };
+
+			AlignedBuffer() = default;
+
+			/// <summary>
+			/// バッファを確保します
+			/// <para>確保に失敗した場合は std::bad_alloc を送出します。</para>
+			/// </summary>
+			/// <param name="count">要素数</param>
+			/// <param name="alignment">アライメント (2 の累乗)</param>
+			explicit AlignedBuffer(std::size_t count, std::size_t alignment = DefaultAlignment)
+			{
+				Allocate(count, alignment);
+			}
+
+			~AlignedBuffer() { Free(); }
+
+			AlignedBuffer(const AlignedBuffer&) = delete;
+			AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+			AlignedBuffer(AlignedBuffer&& other) noexcept
+				: m_pData(other.m_pData), m_count(other.m_count)
+			{
+				other.m_pData = nullptr;
+				other.m_count = 0;
+			}
+
+			AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+			{
+				if (this != &other) {
+					Free();
+					m_pData = other.m_pData;
+					m_count = other.m_count;
+					other.m_pData = nullptr;
+					other.m_count = 0;
+				}
+				return *this;
+			}
+
+			/// <summary>
+			/// バッファを確保し直します (内容は引き継ぎません)
+			/// </summary>
+			/// <param name="count">要素数</param>
+			/// <param name="alignment">アライメント (2 の累乗)</param>
+			void Allocate(std::size_t count, std::size_t alignment = DefaultAlignment)
+			{
+				Free();
+				if (count == 0) {
+					return;
+				}
+				if (count > static_cast<std::size_t>(-1) / sizeof(T)) {
+					throw std::bad_alloc();
+				}
+				m_pData = static_cast<T*>(::_aligned_malloc(count * sizeof(T), alignment));
+				if (m_pData == nullptr) {
+					throw std::bad_alloc();
+				}
+				m_count = count;
+			}
+
+			/// <summary>
+			/// バッファを解放します
+			/// </summary>
+			void Free()
+			{
+				if (m_pData != nullptr) {
+					::_aligned_free(m_pData);
+					m_pData = nullptr;
+				}
+				m_count = 0;
+			}
+
+			T* GetData() { return m_pData; }
+			const T* GetData() const { return m_pData; }
+
+			/// <summary>
+			/// 要素数を取得します
+			/// </summary>
+			std::size_t GetCount() const { return m_count; }
+
+			/// <summary>
+			/// バイト数を取得します
+			/// </summary>
+			std::size_t GetSize() const { return m_count * sizeof(T); }
+
+			bool IsEmpty() const { return m_pData == nullptr; }
+
+			T& operator[](std::size_t index) { return m_pData[index]; }
+			const T& operator[](std::size_t index) const { return m_pData[index]; }
+
+		private:
+			T* m_pData = nullptr;
+			std::size_t m_count = 0;
+		};
+	}
+}
@@ -0,0 +1,320 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "ThreadPool.h"
+#include <condition_variable>   // std::condition_variable
+#include <cstring>              // std::memcpy
+#include <functional>           // std::function
+#include <iterator>             // std::next
+#include <map>                  // std::map
+#include <memory>               // std::shared_ptr, std::make_shared
+#include <mutex>                // std::mutex, std::lock_guard, std::unique_lock
+#include <utility>              // std::move
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// PCM16 音声のブロックキャッシュ
+		/// <para>デコードした音声を固定長のアライメントされたブロックに保持し、任意の [start, start + length) をブロックから呼び出し元のバッファへ 1 回のコピーで返します。</para>
+		/// <para>読み込みの方向 (順方向/逆方向) を判定し、その方向のブロックを先読みします。</para>
+		/// <para>Read() は複数のスレッドから呼び出せます。ローダーの呼び出しは常に 1 つずつ行います。</para>
+		/// </summary>
+		class AudioBlockCache final
+		{
+		public:
+			/// <summary>
+			/// 音声を読み込む関数
+			/// </summary>
+			/// <param name="start">読み込み開始サンプル番号</param>
+			/// <param name="length">読み込むサンプル数</param>
+			/// <param name="pBuffer">読み込み先 (サンプル数 × チャンネル数 の short)</param>
+			/// <returns>
+			/// 読み込んだサンプル数
+			/// </returns>
+			using Loader = std::function<int(long long start, int length, short* pBuffer)>;
+
+			/// <summary>
+			/// 既定値
+			/// </summary>
+			enum : int {
+				/// <summary>
+				/// 1 ブロックのサンプル数
+				/// </summary>
+				DefaultBlockSamples = 16384,
+
+				/// <summary>
+				/// 保持するブロック数
+				/// </summary>
+				DefaultMaxBlocks = 64,
+
+				/// <summary>
+				/// 先読みするブロック数
+				/// </summary>
+				DefaultPrefetchBlocks = 2,
+			};
+
+			/// <summary>
+			/// キャッシュを作成します
+			/// </summary>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="totalSamples">総サンプル数</param>
+			/// <param name="loader">音声を読み込む関数</param>
+			/// <param name="pPool">先読みに使用するスレッドプール (nullptr なら、読み込みの続きとして同じスレッドで先読みします)</param>
+			/// <param name="blockSamples">1 ブロックのサンプル数</param>
+			/// <param name="maxBlocks">保持するブロック数</param>
+			/// <param name="prefetchBlocks">先読みするブロック数</param>
+			AudioBlockCache(int channels, long long totalSamples, Loader loader, ThreadPool* pPool = nullptr,
+				int blockSamples = DefaultBlockSamples, int maxBlocks = DefaultMaxBlocks, int prefetchBlocks = DefaultPrefetchBlocks)
+				: m_pState(std::make_shared<State>())
+			{
+				m_pState->Load = std::move(loader);
+				m_pState->Channels = channels > 0 ? channels : 1;
+				m_pState->Total = totalSamples > 0 ? totalSamples : 0;
+				m_pState->BlockSamples = blockSamples > 0 ? blockSamples : DefaultBlockSamples;
+				m_pState->MaxBlocks = maxBlocks > prefetchBlocks + 1 ? maxBlocks : prefetchBlocks + 2;
+				m_pState->PrefetchBlocks = prefetchBlocks > 0 ? prefetchBlocks : 0;
+				m_pPool = pPool;
+			}
+
+			~AudioBlockCache()
+			{
+				// 実行中の読み込みが終わるまで待ちます (ローダーが参照する呼び出し元の状態を守るため)
+				std::unique_lock<std::mutex> lock(m_pState->Mutex);
+				m_pState->Closed = true;
+				m_pState->Condition.wait(lock, [this]() { return m_pState->Loading == 0; });
+			}
+
+			AudioBlockCache(const AudioBlockCache&) = delete;
+			AudioBlockCache& operator=(const AudioBlockCache&) = delete;
+
+			/// <summary>
+			/// チャンネル数を取得します
+			/// </summary>
+			int GetChannels() const { return m_pState->Channels; }
+
+			/// <summary>
+			/// 総サンプル数を取得します
+			/// </summary>
+			long long GetTotalSamples() const { return m_pState->Total; }
+
+			/// <summary>
+			/// 音声を読み込みます
+			/// </summary>
+			/// <param name="start">読み込み開始サンプル番号</param>
+			/// <param name="length">読み込むサンプル数</param>
+			/// <param name="pBuffer">読み込み先 (サンプル数 × チャンネル数 の PCM16)</param>
+			/// <returns>
+			/// 読み込んだサンプル数
+			/// </returns>
+			int Read(long long start, int length, void* pBuffer)
+			{
+				State& state = *m_pState;
+				if (length <= 0 || start < 0 || start >= state.Total) {
+					return 0;
+				}
+				if (length > state.Total - start) {
+					length = static_cast<int>(state.Total - start);
+				}
+
+				int direction;
+				{
+					std::lock_guard<std::mutex> lock(state.Mutex);
+					if (start != state.LastStart) {
+						state.Direction = start < state.LastStart ? -1 : 1;
+					}
+					state.LastStart = start;
+					direction = state.Direction;
+				}
+
+				short* pDst = static_cast<short*>(pBuffer);
+				const int channels = state.Channels;
+				int copied = 0;
+				long long index = start / state.BlockSamples;
+				while (copied < length) {
+					const long long position = start + copied;
+					index = position / state.BlockSamples;
+					const int offset = static_cast<int>(position - index * state.BlockSamples);
+
+					std::shared_ptr<const Block> pBlock = GetBlock(m_pState, index, true);
+					if (pBlock == nullptr || pBlock->Samples <= offset) {
+						break;
+					}
+					const int count = (pBlock->Samples - offset < length - copied) ? pBlock->Samples - offset : length - copied;
+					std::memcpy(pDst + static_cast<std::size_t>(copied) * channels, pBlock->Data.GetData() + static_cast<std::size_t>(offset) * channels,
+						static_cast<std::size_t>(count) * channels * sizeof(short));
+					copied += count;
+				}
+
+				Prefetch(index, direction);
+				return copied;
+			}
+
+			/// <summary>
+			/// 全てのブロックを破棄します
+			/// </summary>
+			void Clear()
+			{
+				std::lock_guard<std::mutex> lock(m_pState->Mutex);
+				for (auto it = m_pState->Blocks.begin(); it != m_pState->Blocks.end();) {
+					// 読み込み中のブロックは、待っているスレッドのために残します
+					it = it->second->Ready ? m_pState->Blocks.erase(it) : std::next(it);
+				}
+			}
+
+		private:
+			/// <summary>
+			/// ブロック
+			/// </summary>
+			struct Block final
+			{
+				AlignedBuffer<short> Data;
+				int Samples = 0;
+				bool Ready = false;
+				unsigned long long LastUse = 0;
+			};
+
+			/// <summary>
+			/// 先読みタスクと共有する状態
+			/// </summary>
+			struct State final
+			{
+				std::mutex Mutex;
+				std::condition_variable Condition;
+				std::map<long long, std::shared_ptr<Block>> Blocks;
+				int Loading = 0;
+				bool Closed = false;
+				unsigned long long Clock = 0;
+				long long LastStart = 0;
+				int Direction = 1;
+
+				std::mutex LoaderMutex;
+				Loader Load;
+				int Channels = 1;
+				long long Total = 0;
+				int BlockSamples = DefaultBlockSamples;
+				int MaxBlocks = DefaultMaxBlocks;
+				int PrefetchBlocks = DefaultPrefetchBlocks;
+			};
+
+			/// <summary>
+			/// ブロックを取得します (無ければ読み込みます)
+			/// </summary>
+			/// <param name="pState">共有状態</param>
+			/// <param name="index">ブロック番号</param>
+			/// <param name="wait">true なら他のスレッドが読み込み中のブロックを待ちます (false なら nullptr を返します)</param>
+			static std::shared_ptr<const Block> GetBlock(const std::shared_ptr<State>& pState, long long index, bool wait)
+			{
+				State& state = *pState;
+				std::shared_ptr<Block> pBlock;
+				{
+					std::unique_lock<std::mutex> lock(state.Mutex);
+					auto it = state.Blocks.find(index);
+					if (it != state.Blocks.end()) {
+						pBlock = it->second;
+						if (!pBlock->Ready) {
+							if (!wait) {
+								return nullptr;
+							}
+							state.Condition.wait(lock, [&]() { return pBlock->Ready; });
+						}
+						pBlock->LastUse = ++state.Clock;
+						return pBlock;
+					}
+					if (state.Closed) {
+						return nullptr;
+					}
+					pBlock = std::make_shared<Block>();
+					state.Blocks.emplace(index, pBlock);
+					++state.Loading;
+				}
+
+				// ブロックの範囲を読み込みます (状態のロックは解放し、ローダーだけを排他します)
+				int samples = 0;
+				try {
+					const long long begin = index * state.BlockSamples;
+					const long long rest = state.Total - begin;
+					const int length = rest < state.BlockSamples ? static_cast<int>(rest) : state.BlockSamples;
+					if (length > 0) {
+						pBlock->Data.Allocate(static_cast<std::size_t>(length) * state.Channels);
+						std::lock_guard<std::mutex> loaderLock(state.LoaderMutex);
+						samples = state.Load(begin, length, pBlock->Data.GetData());
+						if (samples < 0 || samples > length) {
+							samples = 0;
+						}
+					}
+				}
+				catch (...) {
+					samples = 0;
+				}
+
+				std::lock_guard<std::mutex> lock(state.Mutex);
+				pBlock->Samples = samples;
+				pBlock->Ready = true;
+				pBlock->LastUse = ++state.Clock;
+				if (samples == 0) {
+					// 失敗したブロックは残さず、次の要求で読み込み直します
+					state.Blocks.erase(index);
+				}
+				--state.Loading;
+				Evict(state);
+				state.Condition.notify_all();
+				return pBlock;
+			}
+
+			/// <summary>
+			/// 保持するブロック数を超えた分を、最も古く使われたものから破棄します
+			/// </summary>
+			static void Evict(State& state)
+			{
+				while (static_cast<int>(state.Blocks.size()) > state.MaxBlocks) {
+					auto victim = state.Blocks.end();
+					for (auto it = state.Blocks.begin(); it != state.Blocks.end(); ++it) {
+						if (it->second->Ready && (victim == state.Blocks.end() || it->second->LastUse < victim->second->LastUse)) {
+							victim = it;
+						}
+					}
+					if (victim == state.Blocks.end()) {
+						break;
+					}
+					state.Blocks.erase(victim);
+				}
+			}
+
+			/// <summary>
+			/// 読み込みの方向にブロックを先読みします
+			/// </summary>
+			void Prefetch(long long index, int direction)
+			{
+				const State& state = *m_pState;
+				for (int i = 1; i <= state.PrefetchBlocks; ++i) {
+					const long long next = index + static_cast<long long>(i) * direction;
+					if (next < 0 || next * state.BlockSamples >= state.Total) {
+						break;
+					}
+					if (m_pPool != nullptr) {
+						std::shared_ptr<State> pState = m_pState;
+						m_pPool->Submit([pState, next]() { GetBlock(pState, next, false); });
+					}
+					else {
+						GetBlock(m_pState, next, false);
+					}
+				}
+			}
+
+			std::shared_ptr<State> m_pState;
+			ThreadPool* m_pPool = nullptr;
+		};
+	}
+}
@@ -0,0 +1,549 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "Simd.h"
+#include <algorithm>    // std::min, std::max
+#include <cmath>        // std::lrint, std::sqrt
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// インターリーブされた 16bit PCM (FilterProcInfo::pAudio など) の音声処理
+		/// <para>ゲインや重みは 4096 を 1.0 とする固定小数点数で指定し、結果は 16bit に飽和させます。</para>
+		/// <para>チャンネル数が 1, 2, 4, 8 の場合は SSE2 で処理し、それ以外はスカラーで処理します (結果は同じです)。</para>
+		/// </summary>
+		namespace AudioKernel
+		{
+			enum : int {
+				/// <summary>
+				/// ゲイン・重みの 1.0 に相当する値
+				/// </summary>
+				Unity = 4096,
+
+				/// <summary>
+				/// MixMatrix() で扱える最大チャンネル数
+				/// </summary>
+				MaxChannels = 8,
+			};
+
+			/// <summary>
+			/// チャンネルごとの音量の計測結果
+			/// <para>Measure() を続けて呼び出すと、結果が累積されます。</para>
+			/// </summary>
+			struct Level final
+			{
+				/// <summary>
+				/// ピーク値の絶対値 (0 ～ 32768)
+				/// </summary>
+				int Peak = 0;
+
+				/// <summary>
+				/// サンプルの二乗和
+				/// </summary>
+				unsigned long long SumSquares = 0;
+
+				/// <summary>
+				/// 計測したサンプル数
+				/// </summary>
+				unsigned long long Count = 0;
+
+				/// <summary>
+				/// 二乗平均平方根 (0.0 ～ 1.0)
+				/// </summary>
+				double GetRms() const { return Count > 0 ? std::sqrt(static_cast<double>(SumSquares) / Count) / 32768.0 : 0.0; }
+			};
+
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				/// <summary>
+				/// SSE2 で処理できるチャンネル数か (8 サンプルの中でチャンネルの並びが変わらないもの)
+				/// </summary>
+				inline bool IsVectorChannels(int channels)
+				{
+					return channels == 1 || channels == 2 || channels == 4 || channels == 8;
+				}
+
+				inline short Saturate(int value)
+				{
+					return static_cast<short>((std::min)((std::max)(value, -32768), 32767));
+				}
+
+				/// <summary>
+				/// 16bit の 2 つの値を 32bit の各要素に交互に並べます (_mm_madd_epi16 の係数用)
+				/// </summary>
+				inline __m128i SetPair(short lo, short hi)
+				{
+					return _mm_set1_epi32(static_cast<int>((static_cast<unsigned int>(static_cast<unsigned short>(hi)) << 16) | static_cast<unsigned short>(lo)));
+				}
+
+				/// <summary>
+				/// 16bit 8 要素の積を 4096 で割って丸め、16bit に飽和させます
+				/// </summary>
+				inline __m128i MulQ12(__m128i x, __m128i gain)
+				{
+					const __m128i lo = _mm_mullo_epi16(x, gain);
+					const __m128i hi = _mm_mulhi_epi16(x, gain);
+					const __m128i round = _mm_set1_epi32(Unity / 2);
+					const __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 12);
+					const __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 12);
+					return _mm_packs_epi32(p0, p1);
+				}
+
+				/// <summary>
+				/// フレームごとに直線的に変化する値 (ゲインや重み)
+				/// <para>フレーム f の値は start + (end - start) × f / frames を丸めたものです (誤差は 1 以内)。</para>
+				/// <para>値は下位 32bit を小数部とする 64bit の固定小数点数で保持するため、フレーム数が多くても次の呼び出しの先頭の値と段差が生じず、ベクトルとスカラーで同じ値になります。</para>
+				/// </summary>
+				class Ramp final
+				{
+				public:
+					Ramp(int startValue, int endValue, int frames)
+						: m_base(static_cast<long long>(startValue) * One + One / 2)
+						, m_step(frames > 0 ? static_cast<long long>(endValue - startValue) * One / frames : 0)
+					{
+					}
+
+					/// <summary>
+					/// 指定したフレームの値を取得します
+					/// </summary>
+					int Get(int frame) const { return static_cast<int>((m_base + m_step * frame) >> 32); }
+
+					/// <summary>
+					/// 先頭フレームから 8 サンプル分の値を取得するための準備をします
+					/// </summary>
+					/// <param name="channels">チャンネル数 (1, 2, 4, 8)</param>
+					/// <param name="values">8 サンプル分の値 (64bit × 2 を 4 つ)</param>
+					/// <param name="increment">8 サンプルで進む値</param>
+					void Begin(int channels, __m128i (&values)[4], __m128i& increment) const
+					{
+						for (int k = 0; k < 8; k += 2) {
+							values[k / 2] = _mm_set_epi64x(m_base + m_step * ((k + 1) / channels), m_base + m_step * (k / channels));
+						}
+						const long long step = m_step * (8 / channels);
+						increment = _mm_set_epi64x(step, step);
+					}
+
+					/// <summary>
+					/// 8 サンプル分の値を 16bit で取得し、次の 8 サンプルへ進めます
+					/// </summary>
+					static __m128i Next(__m128i (&values)[4], __m128i increment)
+					{
+						// 各 64bit の上位 32bit が整数部
+						const __m128i lo = _mm_unpacklo_epi64(_mm_shuffle_epi32(values[0], _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_epi32(values[1], _MM_SHUFFLE(3, 1, 3, 1)));
+						const __m128i hi = _mm_unpacklo_epi64(_mm_shuffle_epi32(values[2], _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_epi32(values[3], _MM_SHUFFLE(3, 1, 3, 1)));
+						for (__m128i& value : values) {
+							value = _mm_add_epi64(value, increment);
+						}
+						return _mm_packs_epi32(lo, hi);
+					}
+
+				private:
+					static constexpr long long One = 1ll << 32;
+
+					long long m_base;
+					long long m_step;
+				};
+			}
+
+			/// <summary>
+			/// 一定のゲインを掛けます
+			/// </summary>
+			/// <param name="pData">サンプル (インターリーブ)</param>
+			/// <param name="count">サンプル数 (フレーム数 × チャンネル数)</param>
+			/// <param name="gain">ゲイン (4096 で 1.0、-32768 ～ 32767)</param>
+			inline void Gain(short* pData, int count, int gain)
+			{
+				gain = (std::min)((std::max)(gain, -32768), 32767);
+				const __m128i g = _mm_set1_epi16(static_cast<short>(gain));
+				int i = 0;
+				for (; i + 8 <= count; i += 8) {
+					__m128i* p = reinterpret_cast<__m128i*>(pData + i);
+					_mm_storeu_si128(p, Detail::MulQ12(_mm_loadu_si128(p), g));
+				}
+				for (; i < count; ++i) {
+					pData[i] = Detail::Saturate((pData[i] * gain + Unity / 2) >> 12);
+				}
+			}
+
+			/// <summary>
+			/// ゲインを掛けて加算します (ミックス)
+			/// </summary>
+			/// <param name="pDst">加算先のサンプル</param>
+			/// <param name="pSrc">加算するサンプル</param>
+			/// <param name="count">サンプル数 (フレーム数 × チャンネル数)</param>
+			/// <param name="gain">加算するサンプルのゲイン (4096 で 1.0)</param>
+			inline void MixAdd(short* pDst, const short* pSrc, int count, int gain = Unity)
+			{
+				gain = (std::min)((std::max)(gain, -32768), 32767);
+				const __m128i g = _mm_set1_epi16(static_cast<short>(gain));
+				int i = 0;
+				for (; i + 8 <= count; i += 8) {
+					__m128i* p = reinterpret_cast<__m128i*>(pDst + i);
+					const __m128i src = Detail::MulQ12(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i)), g);
+					_mm_storeu_si128(p, _mm_adds_epi16(_mm_loadu_si128(p), src));
+				}
+				for (; i < count; ++i) {
+					pDst[i] = Detail::Saturate(pDst[i] + Detail::Saturate((pSrc[i] * gain + Unity / 2) >> 12));
+				}
+			}
+
+			/// <summary>
+			/// フレームごとに直線的に変化するゲインを掛けます (フェードイン / フェードアウト)
+			/// </summary>
+			/// <param name="pData">サンプル (インターリーブ)</param>
+			/// <param name="frames">フレーム数</param>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="startGain">先頭フレームのゲイン (4096 で 1.0)</param>
+			/// <param name="endGain">最終フレームの次のフレームのゲイン (連続して呼び出す場合の次の startGain)</param>
+			inline void Fade(short* pData, int frames, int channels, int startGain, int endGain)
+			{
+				if (frames <= 0 || channels <= 0) {
+					return;
+				}
+				startGain = (std::min)((std::max)(startGain, -32768), 32767);
+				endGain = (std::min)((std::max)(endGain, -32768), 32767);
+				const Detail::Ramp ramp(startGain, endGain, frames);
+				const int count = frames * channels;
+
+				int i = 0;
+				if (Detail::IsVectorChannels(channels)) {
+					__m128i values[4], increment;
+					ramp.Begin(channels, values, increment);
+					for (; i + 8 <= count; i += 8) {
+						__m128i* p = reinterpret_cast<__m128i*>(pData + i);
+						_mm_storeu_si128(p, Detail::MulQ12(_mm_loadu_si128(p), Detail::Ramp::Next(values, increment)));
+					}
+				}
+				for (; i < count; ++i) {
+					pData[i] = Detail::Saturate((pData[i] * ramp.Get(i / channels) + Unity / 2) >> 12);
+				}
+			}
+
+			/// <summary>
+			/// 2 つの音声をクロスフェードします
+			/// <para>出力 = A × (4096 - 重み) + B × 重み</para>
+			/// </summary>
+			/// <param name="pDst">出力先のサンプル (pA または pB と同じでも構いません)</param>
+			/// <param name="pA">音声 A</param>
+			/// <param name="pB">音声 B</param>
+			/// <param name="frames">フレーム数</param>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="startWeight">先頭フレームの B の重み (0 ～ 4096)</param>
+			/// <param name="endWeight">最終フレームの次のフレームの B の重み (0 ～ 4096)</param>
+			inline void CrossFade(short* pDst, const short* pA, const short* pB, int frames, int channels, int startWeight, int endWeight)
+			{
+				if (frames <= 0 || channels <= 0) {
+					return;
+				}
+				startWeight = (std::min)((std::max)(startWeight, 0), static_cast<int>(Unity));
+				endWeight = (std::min)((std::max)(endWeight, 0), static_cast<int>(Unity));
+				const Detail::Ramp ramp(startWeight, endWeight, frames);
+				const int count = frames * channels;
+
+				int i = 0;
+				if (Detail::IsVectorChannels(channels)) {
+					const __m128i unity = _mm_set1_epi16(Unity);
+					const __m128i round = _mm_set1_epi32(Unity / 2);
+					__m128i values[4], increment;
+					ramp.Begin(channels, values, increment);
+					for (; i + 8 <= count; i += 8) {
+						const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pA + i));
+						const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pB + i));
+						const __m128i w = Detail::Ramp::Next(values, increment);
+						const __m128i iw = _mm_sub_epi16(unity, w);
+						const __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), _mm_unpacklo_epi16(iw, w)), round), 12);
+						const __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), _mm_unpackhi_epi16(iw, w)), round), 12);
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_packs_epi32(lo, hi));
+					}
+				}
+				for (; i < count; ++i) {
+					const int w = ramp.Get(i / channels);
+					pDst[i] = Detail::Saturate((pA[i] * (Unity - w) + pB[i] * w + Unity / 2) >> 12);
+				}
+			}
+
+			/// <summary>
+			/// チャンネルを行列で混合します (ダウンミックス・アップミックス・パンなど)
+			/// <para>出力チャンネル d = Σ 入力チャンネル s × pMatrix[d × srcChannels + s]</para>
+			/// <para>2ch → 2ch、1ch → 2ch、2ch → 1ch は SSE2 で処理します。パンは 2ch → 2ch の行列で表せます。</para>
+			/// </summary>
+			/// <param name="pDst">出力先のサンプル (チャンネル数が同じ場合は pSrc と同じでも構いません)</param>
+			/// <param name="dstChannels">出力のチャンネル数 (1 ～ MaxChannels)</param>
+			/// <param name="pSrc">入力のサンプル</param>
+			/// <param name="srcChannels">入力のチャンネル数 (1 ～ MaxChannels)</param>
+			/// <param name="frames">フレーム数</param>
+			/// <param name="pMatrix">係数 (dstChannels × srcChannels 個、4096 で 1.0、出力チャンネルごとの絶対値の和は 32767 以下)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool MixMatrix(short* pDst, int dstChannels, const short* pSrc, int srcChannels, int frames, const short* pMatrix)
+			{
+				if (dstChannels <= 0 || dstChannels > MaxChannels || srcChannels <= 0 || srcChannels > MaxChannels) {
+					return false;
+				}
+
+				int frame = 0;
+				const __m128i round = _mm_set1_epi32(Unity / 2);
+				if (srcChannels == 2 && dstChannels == 2) {
+					const __m128i m0 = Detail::SetPair(pMatrix[0], pMatrix[1]);
+					const __m128i m1 = Detail::SetPair(pMatrix[2], pMatrix[3]);
+					for (; frame + 4 <= frames; frame += 4) {
+						const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + frame * 2));
+						const __m128i l = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, m0), round), 12);
+						const __m128i r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, m1), round), 12);
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + frame * 2), _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r)));
+					}
+				}
+				else if (srcChannels == 1 && dstChannels == 2) {
+					const __m128i m = Detail::SetPair(pMatrix[0], pMatrix[1]);
+					for (; frame + 8 <= frames; frame += 8) {
+						const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + frame));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + frame * 2), Detail::MulQ12(_mm_unpacklo_epi16(x, x), m));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + frame * 2 + 8), Detail::MulQ12(_mm_unpackhi_epi16(x, x), m));
+					}
+				}
+				else if (srcChannels == 2 && dstChannels == 1) {
+					const __m128i m = Detail::SetPair(pMatrix[0], pMatrix[1]);
+					for (; frame + 8 <= frames; frame += 8) {
+						const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + frame * 2));
+						const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + frame * 2 + 8));
+						const __m128i s0 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x0, m), round), 12);
+						const __m128i s1 = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x1, m), round), 12);
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + frame), _mm_packs_epi32(s0, s1));
+					}
+				}
+
+				int sums[MaxChannels];
+				for (; frame < frames; ++frame) {
+					const short* pIn = pSrc + frame * srcChannels;
+					for (int d = 0; d < dstChannels; ++d) {
+						int sum = 0;
+						for (int s = 0; s < srcChannels; ++s) {
+							sum += pIn[s] * pMatrix[d * srcChannels + s];
+						}
+						sums[d] = sum;
+					}
+					short* pOut = pDst + frame * dstChannels;
+					for (int d = 0; d < dstChannels; ++d) {
+						pOut[d] = Detail::Saturate((sums[d] + Unity / 2) >> 12);
+					}
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// チャンネルごとのピーク値と二乗和を計測します
+			/// </summary>
+			/// <param name="pData">サンプル (インターリーブ)</param>
+			/// <param name="frames">フレーム数</param>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="pLevels">計測結果を累積する配列 (channels 個)</param>
+			inline void Measure(const short* pData, int frames, int channels, Level* pLevels)
+			{
+				if (frames <= 0 || channels <= 0) {
+					return;
+				}
+				const int count = frames * channels;
+
+				int i = 0;
+				if (Detail::IsVectorChannels(channels) && count >= 8) {
+					const __m128i zero = _mm_setzero_si128();
+					__m128i maxValue = _mm_set1_epi16(-32768);
+					__m128i minValue = _mm_set1_epi16(32767);
+					__m128i sum[4] = { zero, zero, zero, zero };
+					for (; i + 8 <= count; i += 8) {
+						const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + i));
+						maxValue = _mm_max_epi16(maxValue, x);
+						minValue = _mm_min_epi16(minValue, x);
+
+						// 二乗は 2^30 以下に収まるため、32bit で求めてから 64bit に広げて加算する
+						const __m128i lo = _mm_mullo_epi16(x, x);
+						const __m128i hi = _mm_mulhi_epi16(x, x);
+						const __m128i s0 = _mm_unpacklo_epi16(lo, hi);
+						const __m128i s1 = _mm_unpackhi_epi16(lo, hi);
+						sum[0] = _mm_add_epi64(sum[0], _mm_unpacklo_epi32(s0, zero));
+						sum[1] = _mm_add_epi64(sum[1], _mm_unpackhi_epi32(s0, zero));
+						sum[2] = _mm_add_epi64(sum[2], _mm_unpacklo_epi32(s1, zero));
+						sum[3] = _mm_add_epi64(sum[3], _mm_unpackhi_epi32(s1, zero));
+					}
+
+					alignas(16) short maxLanes[8];
+					alignas(16) short minLanes[8];
+					alignas(16) unsigned long long sumLanes[8];
+					_mm_store_si128(reinterpret_cast<__m128i*>(maxLanes), maxValue);
+					_mm_store_si128(reinterpret_cast<__m128i*>(minLanes), minValue);
+					for (int k = 0; k < 4; ++k) {
+						_mm_store_si128(reinterpret_cast<__m128i*>(sumLanes + k * 2), sum[k]);
+					}
+					for (int k = 0; k < 8; ++k) {
+						Level& level = pLevels[k % channels];
+						level.Peak = (std::max)(level.Peak, (std::max)(static_cast<int>(maxLanes[k]), -static_cast<int>(minLanes[k])));
+						level.SumSquares += sumLanes[k];
+					}
+					for (int c = 0; c < channels; ++c) {
+						pLevels[c].Count += static_cast<unsigned long long>(i / channels);
+					}
+				}
+
+				for (; i < count; ++i) {
+					Level& level = pLevels[i % channels];
+					const int value = pData[i];
+					level.Peak = (std::max)(level.Peak, value < 0 ? -value : value);
+					level.SumSquares += static_cast<unsigned long long>(value * value);
+					level.Count += 1;
+				}
+			}
+
+			/// <summary>
+			/// インターリーブされたサンプルを、チャンネルごとの float 配列 (-1.0 ～ 1.0) に分離します
+			/// <para>float で処理を続けて行う場合に、変換を 1 回にまとめるために使用します。</para>
+			/// </summary>
+			/// <param name="pSrc">サンプル (インターリーブ)</param>
+			/// <param name="frames">フレーム数</param>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="ppDst">チャンネルごとの出力先 (channels 個、それぞれ frames 要素)</param>
+			inline void Deinterleave(const short* pSrc, int frames, int channels, float* const* ppDst)
+			{
+				const float scale = 1.0f / 32768.0f;
+				const __m128 s = _mm_set1_ps(scale);
+				int frame = 0;
+				if (channels == 1) {
+					for (; frame + 8 <= frames; frame += 8) {
+						const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + frame));
+						_mm_storeu_ps(ppDst[0] + frame, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), s));
+						_mm_storeu_ps(ppDst[0] + frame + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), s));
+					}
+				}
+				else if (channels == 2) {
+					for (; frame + 4 <= frames; frame += 4) {
+						const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + frame * 2));
+						_mm_storeu_ps(ppDst[0] + frame, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16)), s));
+						_mm_storeu_ps(ppDst[1] + frame, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(x, 16)), s));
+					}
+				}
+				for (; frame < frames; ++frame) {
+					for (int c = 0; c < channels; ++c) {
+						ppDst[c][frame] = pSrc[frame * channels + c] * scale;
+					}
+				}
+			}
+
+			/// <summary>
+			/// チャンネルごとの float 配列 (-1.0 ～ 1.0) を、インターリーブされたサンプルに戻します (範囲外は飽和させます)
+			/// </summary>
+			/// <param name="ppSrc">チャンネルごとの入力 (channels 個、それぞれ frames 要素)</param>
+			/// <param name="frames">フレーム数</param>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="pDst">出力先のサンプル (インターリーブ)</param>
+			inline void Interleave(const float* const* ppSrc, int frames, int channels, short* pDst)
+			{
+				const __m128 s = _mm_set1_ps(32768.0f);
+				const __m128 lower = _mm_set1_ps(-32768.0f);
+				const __m128 upper = _mm_set1_ps(32767.0f);
+				int frame = 0;
+				if (channels == 1) {
+					for (; frame + 8 <= frames; frame += 8) {
+						const __m128i v0 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(ppSrc[0] + frame), s), lower), upper));
+						const __m128i v1 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(ppSrc[0] + frame + 4), s), lower), upper));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + frame), _mm_packs_epi32(v0, v1));
+					}
+				}
+				else if (channels == 2) {
+					for (; frame + 4 <= frames; frame += 4) {
+						const __m128i l = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(ppSrc[0] + frame), s), lower), upper));
+						const __m128i r = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(ppSrc[1] + frame), s), lower), upper));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + frame * 2), _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r)));
+					}
+				}
+				for (; frame < frames; ++frame) {
+					for (int c = 0; c < channels; ++c) {
+						const float value = (std::min)((std::max)(ppSrc[c][frame] * 32768.0f, -32768.0f), 32767.0f);
+						pDst[frame * channels + c] = static_cast<short>(std::lrint(value));
+					}
+				}
+			}
+
+			/// <summary>
+			/// 直流成分を取り除く 1 次のハイパスフィルタ
+			/// <para>チャンネルごとに状態を保持するため、続きのサンプルを続けて処理できます。</para>
+			/// <para>漸化式のため時間方向には並列化できず、チャンネルごとにスカラーで処理します。</para>
+			/// </summary>
+			class DcFilter final
+			{
+			public:
+				/// <summary>
+				/// コンストラクタ
+				/// </summary>
+				/// <param name="channels">チャンネル数</param>
+				/// <param name="sampleRate">サンプリングレート</param>
+				/// <param name="cutoff">遮断周波数 (Hz)</param>
+				DcFilter(int channels, int sampleRate, double cutoff = 10.0)
+					: m_states((std::max)(channels, 1))
+				{
+					const double pi = 3.14159265358979323846;
+					m_pole = static_cast<float>(1.0 - 2.0 * pi * cutoff / (std::max)(sampleRate, 1));
+				}
+
+				/// <summary>
+				/// 状態を初期化します (シークした場合などに呼び出してください)
+				/// </summary>
+				void Reset()
+				{
+					for (auto& state : m_states) {
+						state = State();
+					}
+				}
+
+				/// <summary>
+				/// 直流成分を取り除きます
+				/// </summary>
+				/// <param name="pData">サンプル (インターリーブ)</param>
+				/// <param name="frames">フレーム数</param>
+				void Process(short* pData, int frames)
+				{
+					const int channels = static_cast<int>(m_states.size());
+					for (int c = 0; c < channels; ++c) {
+						State& state = m_states[c];
+						float x1 = state.Input;
+						float y1 = state.Output;
+						short* p = pData + c;
+						for (int frame = 0; frame < frames; ++frame, p += channels) {
+							const float x = *p;
+							const float y = x - x1 + m_pole * y1;
+							x1 = x;
+							y1 = y;
+							*p = Detail::Saturate(static_cast<int>(std::lrint(y)));
+						}
+						state.Input = x1;
+						state.Output = y1;
+					}
+				}
+
+			private:
+				struct State final
+				{
+					float Input = 0.0f;
+					float Output = 0.0f;
+				};
+
+				std::vector<State> m_states;
+				float m_pole;
+			};
+		}
+	}
+}
@@ -0,0 +1,628 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "FourCC.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>    // std::min, std::max, std::fill
+#include <atomic>       // std::atomic
+#include <chrono>       // std::chrono::seconds
+#include <cmath>        // std::sqrt
+#include <cstring>      // std::memcpy
+#include <functional>   // std::function
+#include <future>       // std::future
+#include <mutex>        // std::mutex, std::lock_guard
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 波形表示用の音声のピークインデックス
+		/// <para>256 / 4096 / 65536 サンプルごとの最小値・最大値・二乗和を階層的に保持し、任意の表示倍率の波形を表示幅 (ピクセル数) に比例した計算量で取得します。</para>
+		/// <para>構築は 65536 サンプル (チャンク) 単位で行い、音声の一部が変わった場合は Invalidate() した範囲のチャンクだけを作り直します。</para>
+		/// <para>構築したインデックスは Save() / Load() でプロジェクトに保存できます (ProjectSave / ProjectLoad から呼び出してください)。</para>
+		/// </summary>
+		class AudioPeakIndex final
+		{
+		public:
+			/// <summary>
+			/// 音声を読み込む関数
+			/// </summary>
+			/// <param name="start">読み込み開始サンプル番号</param>
+			/// <param name="length">読み込むサンプル数</param>
+			/// <param name="pBuffer">読み込み先 (サンプル数 × チャンネル数 の short)</param>
+			/// <returns>
+			/// 読み込んだサンプル数
+			/// </returns>
+			using Loader = std::function<int(long long start, int length, short* pBuffer)>;
+
+			enum : int {
+				/// <summary>
+				/// 最も細かい階層の 1 バケットのサンプル数
+				/// </summary>
+				BucketSamples = 256,
+
+				/// <summary>
+				/// 1 つ上の階層のバケットにまとめる数
+				/// </summary>
+				LevelRatio = 16,
+
+				/// <summary>
+				/// 階層数 (256 / 4096 / 65536 サンプル)
+				/// </summary>
+				LevelCount = 3,
+
+				/// <summary>
+				/// 構築と更新の単位 (最も粗い階層の 1 バケット) のサンプル数
+				/// </summary>
+				ChunkSamples = BucketSamples * LevelRatio * LevelRatio,
+			};
+
+			/// <summary>
+			/// 1 ピクセル分の波形
+			/// </summary>
+			struct Peak final
+			{
+				/// <summary>
+				/// 最小値
+				/// </summary>
+				short Min = 0;
+
+				/// <summary>
+				/// 最大値
+				/// </summary>
+				short Max = 0;
+
+				/// <summary>
+				/// 実効値
+				/// </summary>
+				float Rms = 0.0f;
+			};
+
+			/// <summary>
+			/// インデックスを作成します (全てのチャンクが未構築の状態になります)
+			/// </summary>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="totalSamples">総サンプル数</param>
+			/// <param name="loader">音声を読み込む関数</param>
+			/// <param name="pPool">StartBuild() で使用するスレッドプール (nullptr なら StartBuild() は呼び出し元のスレッドで構築します)</param>
+			AudioPeakIndex(int channels, long long totalSamples, Loader loader, ThreadPool* pPool = nullptr)
+				: m_channels(channels > 0 ? channels : 1), m_load(std::move(loader)), m_pPool(pPool)
+			{
+				Resize(totalSamples);
+			}
+
+			~AudioPeakIndex()
+			{
+				// 構築中のタスクはこのオブジェクトを参照するため、終わるまで待ちます
+				Cancel();
+			}
+
+			AudioPeakIndex(const AudioPeakIndex&) = delete;
+			AudioPeakIndex& operator=(const AudioPeakIndex&) = delete;
+
+			/// <summary>
+			/// チャンネル数を取得します
+			/// </summary>
+			int GetChannels() const { return m_channels; }
+
+			/// <summary>
+			/// 総サンプル数を取得します
+			/// </summary>
+			long long GetTotalSamples() const { return m_total; }
+
+			/// <summary>
+			/// 総サンプル数を変更し、全てのチャンクを未構築にします
+			/// </summary>
+			/// <param name="totalSamples">総サンプル数</param>
+			void Reset(long long totalSamples)
+			{
+				Cancel();
+				Resize(totalSamples);
+			}
+
+			/// <summary>
+			/// 音声が変わった範囲を未構築にします
+			/// <para>構築中のチャンクに重なる場合、そのチャンクの結果は破棄されて作り直されます。</para>
+			/// </summary>
+			/// <param name="start">開始サンプル番号</param>
+			/// <param name="length">サンプル数</param>
+			void Invalidate(long long start, long long length)
+			{
+				if (length <= 0) {
+					return;
+				}
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const long long first = (std::max)(start, 0ll) / ChunkSamples;
+				const long long last = (std::min)((start + length - 1) / ChunkSamples, static_cast<long long>(m_states.size()) - 1);
+				for (long long chunk = first; chunk <= last; ++chunk) {
+					if (m_states[chunk] == ChunkState::Clean) {
+						--m_cleanCount;
+					}
+					m_states[chunk] = ChunkState::Dirty;
+					++m_generations[chunk];
+				}
+				if (first < m_cursor) {
+					m_cursor = first;
+				}
+			}
+
+			/// <summary>
+			/// 未構築のチャンクを呼び出し元のスレッドで構築します
+			/// <para>ローダーがメインスレッドからしか呼び出せない場合 (GetAudioFiltered など) は、タイマーなどから少しずつ呼び出してください。</para>
+			/// </summary>
+			/// <param name="maxChunks">構築する最大チャンク数</param>
+			/// <returns>
+			/// true なら全てのチャンクを構築済み
+			/// </returns>
+			bool Update(int maxChunks = 1)
+			{
+				std::vector<short> buffer;
+				for (int i = 0; i < maxChunks && BuildNext(&buffer); ++i) {
+				}
+				return IsComplete();
+			}
+
+			/// <summary>
+			/// 未構築のチャンクをバックグラウンドで構築します
+			/// <para>ローダーがワーカースレッドから呼び出せる場合に使用します。構築中に呼び出しても何もしません。</para>
+			/// </summary>
+			void StartBuild()
+			{
+				if (m_pPool == nullptr) {
+					while (BuildNext(&m_buffer)) {
+					}
+					return;
+				}
+				if (m_task.valid() && m_task.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+					return;
+				}
+				m_stop = false;
+				m_task = m_pPool->Submit([this]() {
+					std::vector<short> buffer;
+					while (!m_stop && BuildNext(&buffer)) {
+					}
+				});
+			}
+
+			/// <summary>
+			/// バックグラウンドの構築を中断し、終わるまで待機します
+			/// </summary>
+			void Cancel()
+			{
+				m_stop = true;
+				if (m_task.valid()) {
+					m_task.wait();
+					m_task = std::future<void>();
+				}
+				m_stop = false;
+			}
+
+			/// <summary>
+			/// 全てのチャンクを構築済みか調べます
+			/// </summary>
+			bool IsComplete() const
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_cleanCount == m_states.size();
+			}
+
+			/// <summary>
+			/// 構築済みのチャンクの割合 (0.0 ～ 1.0) を取得します
+			/// </summary>
+			double GetProgress() const
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_states.empty() ? 1.0 : static_cast<double>(m_cleanCount) / m_states.size();
+			}
+
+			/// <summary>
+			/// 範囲を表示幅で等分し、1 ピクセルごとの波形を取得します
+			/// <para>1 ピクセルの幅以下で最も粗い階層を使用します。1 ピクセルが 256 サンプル未満の場合は 256 サンプル単位の値になります。</para>
+			/// </summary>
+			/// <param name="channel">チャンネル番号</param>
+			/// <param name="start">開始サンプル番号</param>
+			/// <param name="end">終了サンプル番号 (含まない)</param>
+			/// <param name="pixels">表示幅 (ピクセル数)</param>
+			/// <param name="pPeaks">ピクセル数分の格納先 (未構築の範囲は 0)</param>
+			/// <returns>
+			/// true なら範囲内の全てのチャンクが構築済み
+			/// </returns>
+			bool Query(int channel, long long start, long long end, int pixels, Peak* pPeaks) const
+			{
+				if (pixels <= 0 || channel < 0 || channel >= m_channels) {
+					return false;
+				}
+				start = (std::max)(start, 0ll);
+				end = (std::min)(end, m_total);
+				if (end <= start) {
+					std::fill(pPeaks, pPeaks + pixels, Peak());
+					return true;
+				}
+
+				const long long samplesPerPixel = (end - start) / pixels;
+				int level = 0;
+				while (level + 1 < LevelCount && GetBucketSamples(level + 1) <= samplesPerPixel) {
+					++level;
+				}
+				const long long bucketSamples = GetBucketSamples(level);
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const std::vector<Bucket>& buckets = m_levels[level];
+				const long long bucketCount = static_cast<long long>(buckets.size()) / m_channels;
+				bool complete = true;
+				for (int p = 0; p < pixels; ++p) {
+					const long long s0 = start + (end - start) * p / pixels;
+					const long long s1 = start + (end - start) * (p + 1) / pixels;
+					const long long b0 = s0 / bucketSamples;
+					const long long b1 = (std::min)((std::max)((s1 + bucketSamples - 1) / bucketSamples, b0 + 1), bucketCount);
+
+					Peak peak;
+					double sumSquares = 0.0;
+					long long samples = 0;
+					bool first = true;
+					for (long long b = b0; b < b1; ++b) {
+						const long long bucketStart = b * bucketSamples;
+						if (m_states[bucketStart / ChunkSamples] != ChunkState::Clean) {
+							complete = false;
+							continue;
+						}
+						const Bucket& bucket = buckets[b * m_channels + channel];
+						peak.Min = first ? bucket.Min : (std::min)(peak.Min, bucket.Min);
+						peak.Max = first ? bucket.Max : (std::max)(peak.Max, bucket.Max);
+						first = false;
+						sumSquares += bucket.SumSquares;
+						samples += (std::min)(bucketSamples, m_total - bucketStart);
+					}
+					peak.Rms = samples > 0 ? static_cast<float>(std::sqrt(sumSquares / samples)) : 0.0f;
+					pPeaks[p] = peak;
+				}
+				return complete;
+			}
+
+			/// <summary>
+			/// 構築済みのインデックスを保存します (ProjectSave と同じ呼び出し方です)
+			/// <para>最も細かい階層と構築済みのチャンクだけを保存し、上の階層は読み込み時に計算します。</para>
+			/// <para>バイト数を取得した後にバックグラウンドの構築で増えたチャンクは、格納先に収まる分だけ保存します。</para>
+			/// </summary>
+			/// <param name="pData">格納先 (nullptr ならバイト数のみ返す)</param>
+			/// <param name="pSize">格納先のバイト数 (pData が nullptr なら無視) を渡し、保存したバイト数を返すポインタ</param>
+			/// <returns>
+			/// true なら保存するデータがある
+			/// </returns>
+			bool Save(void* pData, int* pSize) const
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const std::size_t chunkBytes = sizeof(Bucket) * (ChunkSamples / BucketSamples) * m_channels;
+				const std::size_t headerBytes = sizeof(SaveHeader) + m_states.size();
+				std::size_t saveCount = m_cleanCount;
+				if (pData != nullptr) {
+					const std::size_t capacity = (*pSize > 0) ? static_cast<std::size_t>(*pSize) : 0;
+					saveCount = (capacity >= headerBytes) ? (std::min)(saveCount, (capacity - headerBytes) / chunkBytes) : 0;
+				}
+				const std::size_t size = headerBytes + chunkBytes * saveCount;
+				if (saveCount == 0 || size > 0x7FFFFFFF) {
+					*pSize = 0;
+					return false;
+				}
+				*pSize = static_cast<int>(size);
+				if (pData == nullptr) {
+					return true;
+				}
+
+				unsigned char* p = static_cast<unsigned char*>(pData);
+				SaveHeader header = {};
+				header.Magic = SaveMagic;
+				header.Version = SaveVersion;
+				header.Channels = m_channels;
+				header.Chunks = static_cast<unsigned long>(m_states.size());
+				header.TotalSamples = m_total;
+				std::memcpy(p, &header, sizeof(header));
+				p += sizeof(header);
+				std::size_t flagged = 0;
+				for (std::size_t chunk = 0; chunk < m_states.size(); ++chunk) {
+					const bool save = (m_states[chunk] == ChunkState::Clean && flagged < saveCount);
+					flagged += save ? 1 : 0;
+					*p++ = save ? 1 : 0;
+				}
+				std::size_t written = 0;
+				for (std::size_t chunk = 0; chunk < m_states.size() && written < saveCount; ++chunk) {
+					if (m_states[chunk] == ChunkState::Clean) {
+						std::memcpy(p, m_levels[0].data() + chunk * (ChunkSamples / BucketSamples) * m_channels, chunkBytes);
+						p += chunkBytes;
+						++written;
+					}
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// Save() で保存したインデックスを読み込みます (ProjectLoad から呼び出してください)
+			/// <para>チャンネル数と総サンプル数が一致しない場合は読み込みません。保存後に変わった範囲は Invalidate() してください。</para>
+			/// </summary>
+			/// <param name="pData">データ</param>
+			/// <param name="size">バイト数</param>
+			/// <returns>
+			/// true なら読み込んだ
+			/// </returns>
+			bool Load(const void* pData, int size)
+			{
+				SaveHeader header = {};
+				if (pData == nullptr || size < static_cast<int>(sizeof(header))) {
+					return false;
+				}
+				const unsigned char* p = static_cast<const unsigned char*>(pData);
+				std::memcpy(&header, p, sizeof(header));
+				if (header.Magic != SaveMagic || header.Version != SaveVersion || header.Channels != static_cast<unsigned long>(m_channels)
+					|| header.TotalSamples != m_total || header.Chunks != m_states.size()) {
+					return false;
+				}
+				p += sizeof(header);
+
+				const std::size_t chunkBytes = sizeof(Bucket) * (ChunkSamples / BucketSamples) * m_channels;
+				std::size_t clean = 0;
+				for (std::size_t chunk = 0; chunk < header.Chunks; ++chunk) {
+					clean += (p[chunk] != 0) ? 1 : 0;
+				}
+				if (static_cast<std::size_t>(size) != sizeof(header) + header.Chunks + chunkBytes * clean) {
+					return false;
+				}
+
+				Cancel();
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const unsigned char* pBuckets = p + header.Chunks;
+				m_cleanCount = 0;
+				for (std::size_t chunk = 0; chunk < header.Chunks; ++chunk) {
+					++m_generations[chunk];
+					if (p[chunk] == 0) {
+						m_states[chunk] = ChunkState::Dirty;
+						continue;
+					}
+					std::memcpy(m_levels[0].data() + chunk * (ChunkSamples / BucketSamples) * m_channels, pBuckets, chunkBytes);
+					pBuckets += chunkBytes;
+					BuildUpperLevels(static_cast<long long>(chunk));
+					m_states[chunk] = ChunkState::Clean;
+					++m_cleanCount;
+				}
+				m_cursor = 0;
+				return true;
+			}
+
+		private:
+			/// <summary>
+			/// 1 バケット・1 チャンネル分の値
+			/// </summary>
+			struct Bucket final
+			{
+				short Min;
+				short Max;
+				float SumSquares;
+			};
+
+			/// <summary>
+			/// チャンクの状態
+			/// </summary>
+			enum class ChunkState : unsigned char {
+				Dirty = 0,
+				Building = 1,
+				Clean = 2,
+			};
+
+			/// <summary>
+			/// 保存データのヘッダ
+			/// </summary>
+			struct SaveHeader final
+			{
+				unsigned long Magic;
+				unsigned long Version;
+				unsigned long Channels;
+				unsigned long Chunks;
+				long long TotalSamples;
+			};
+
+			static constexpr unsigned long SaveMagic = FourCC::Make('P', 'E', 'A', 'K');
+			static constexpr unsigned long SaveVersion = 1;
+
+			static long long GetBucketSamples(int level)
+			{
+				long long samples = BucketSamples;
+				for (int i = 0; i < level; ++i) {
+					samples *= LevelRatio;
+				}
+				return samples;
+			}
+
+			void Resize(long long totalSamples)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_total = totalSamples > 0 ? totalSamples : 0;
+				const std::size_t chunks = static_cast<std::size_t>((m_total + ChunkSamples - 1) / ChunkSamples);
+				m_states.assign(chunks, ChunkState::Dirty);
+				m_generations.assign(chunks, 0);
+				for (int level = 0; level < LevelCount; ++level) {
+					const std::size_t perChunk = static_cast<std::size_t>(ChunkSamples / GetBucketSamples(level));
+					m_levels[level].assign(chunks * perChunk * m_channels, Bucket());
+				}
+				m_cleanCount = 0;
+				m_cursor = 0;
+			}
+
+			/// <summary>
+			/// 未構築のチャンクを 1 つ構築します
+			/// </summary>
+			/// <returns>
+			/// false なら未構築のチャンクがない
+			/// </returns>
+			bool BuildNext(std::vector<short>* pBuffer)
+			{
+				long long chunk = -1;
+				unsigned int generation = 0;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					const long long chunks = static_cast<long long>(m_states.size());
+					for (long long i = 0; i < chunks; ++i) {
+						const long long index = (m_cursor + i) % chunks;
+						if (m_states[index] == ChunkState::Dirty) {
+							chunk = index;
+							break;
+						}
+					}
+					if (chunk < 0) {
+						return false;
+					}
+					m_states[chunk] = ChunkState::Building;
+					generation = m_generations[chunk];
+					m_cursor = chunk + 1;
+				}
+
+				// 読み込みと集計はロックの外で行う
+				const long long start = chunk * ChunkSamples;
+				const int length = static_cast<int>((std::min)(static_cast<long long>(ChunkSamples), m_total - start));
+				pBuffer->resize(static_cast<std::size_t>(ChunkSamples) * m_channels);
+				int read = m_load ? m_load(start, length, pBuffer->data()) : 0;
+				read = (std::max)((std::min)(read, length), 0);
+				std::fill(pBuffer->begin() + static_cast<std::ptrdiff_t>(read) * m_channels, pBuffer->begin() + static_cast<std::ptrdiff_t>(length) * m_channels, short(0));
+
+				const int bucketsPerChunk = ChunkSamples / BucketSamples;
+				Bucket buckets[(ChunkSamples / BucketSamples) * 8];
+				std::vector<Bucket> heapBuckets;
+				Bucket* pBuckets = buckets;
+				if (m_channels > 8) {
+					heapBuckets.resize(static_cast<std::size_t>(bucketsPerChunk) * m_channels);
+					pBuckets = heapBuckets.data();
+				}
+				for (int b = 0; b < bucketsPerChunk; ++b) {
+					const int frames = (std::max)((std::min)(static_cast<int>(BucketSamples), length - b * BucketSamples), 0);
+					Measure(pBuffer->data() + static_cast<std::size_t>(b) * BucketSamples * m_channels, frames, m_channels, pBuckets + static_cast<std::size_t>(b) * m_channels);
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (chunk >= static_cast<long long>(m_states.size()) || m_generations[chunk] != generation) {
+					// 構築中に Invalidate() された (状態は Dirty に戻っている)
+					return true;
+				}
+				std::memcpy(m_levels[0].data() + static_cast<std::size_t>(chunk) * bucketsPerChunk * m_channels, pBuckets, sizeof(Bucket) * bucketsPerChunk * m_channels);
+				BuildUpperLevels(chunk);
+				m_states[chunk] = ChunkState::Clean;
+				++m_cleanCount;
+				return true;
+			}
+
+			/// <summary>
+			/// チャンク内の上の階層を、1 つ下の階層から計算します
+			/// </summary>
+			void BuildUpperLevels(long long chunk)
+			{
+				for (int level = 1; level < LevelCount; ++level) {
+					const std::size_t count = static_cast<std::size_t>(ChunkSamples / GetBucketSamples(level));
+					const Bucket* pLower = m_levels[level - 1].data() + static_cast<std::size_t>(chunk) * count * LevelRatio * m_channels;
+					Bucket* pUpper = m_levels[level].data() + static_cast<std::size_t>(chunk) * count * m_channels;
+					for (std::size_t u = 0; u < count; ++u) {
+						for (int c = 0; c < m_channels; ++c) {
+							Bucket bucket = pLower[u * LevelRatio * m_channels + c];
+							for (int i = 1; i < LevelRatio; ++i) {
+								const Bucket& lower = pLower[(u * LevelRatio + i) * m_channels + c];
+								bucket.Min = (std::min)(bucket.Min, lower.Min);
+								bucket.Max = (std::max)(bucket.Max, lower.Max);
+								bucket.SumSquares += lower.SumSquares;
+							}
+							pUpper[u * m_channels + c] = bucket;
+						}
+					}
+				}
+			}
+
+			/// <summary>
+			/// 1 バケット分の最小値・最大値・二乗和をチャンネルごとに求めます
+			/// </summary>
+			static void Measure(const short* pSamples, int frames, int channels, Bucket* pBuckets)
+			{
+				if (frames <= 0) {
+					for (int c = 0; c < channels; ++c) {
+						pBuckets[c] = Bucket();
+					}
+					return;
+				}
+
+				const int count = frames * channels;
+				int i = 0;
+				short mins[8], maxs[8];
+				float sums[8];
+				const bool vector = (channels == 1 || channels == 2 || channels == 4 || channels == 8);
+				if (vector && count >= 8) {
+					__m128i mn = _mm_set1_epi16(32767);
+					__m128i mx = _mm_set1_epi16(-32768);
+					__m128 s0 = _mm_setzero_ps();
+					__m128 s1 = _mm_setzero_ps();
+					for (; i + 8 <= count; i += 8) {
+						const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples + i));
+						mn = _mm_min_epi16(mn, x);
+						mx = _mm_max_epi16(mx, x);
+						const __m128i lo = _mm_mullo_epi16(x, x);
+						const __m128i hi = _mm_mulhi_epi16(x, x);
+						s0 = _mm_add_ps(s0, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, hi)));
+						s1 = _mm_add_ps(s1, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, hi)));
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(mins), mn);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), mx);
+					_mm_storeu_ps(sums, s0);
+					_mm_storeu_ps(sums + 4, s1);
+				}
+				else {
+					std::fill(mins, mins + 8, short(32767));
+					std::fill(maxs, maxs + 8, short(-32768));
+					std::fill(sums, sums + 8, 0.0f);
+				}
+
+				// ベクトルのレーン k はチャンネル k % channels に対応する
+				for (int c = 0; c < channels; ++c) {
+					Bucket& bucket = pBuckets[c];
+					bucket.Min = 32767;
+					bucket.Max = -32768;
+					bucket.SumSquares = 0.0f;
+					if (vector) {
+						for (int k = c; k < 8; k += channels) {
+							bucket.Min = (std::min)(bucket.Min, mins[k]);
+							bucket.Max = (std::max)(bucket.Max, maxs[k]);
+							bucket.SumSquares += sums[k];
+						}
+					}
+					for (int j = i + ((c - i % channels) + channels) % channels; j < count; j += channels) {
+						const short value = pSamples[j];
+						bucket.Min = (std::min)(bucket.Min, value);
+						bucket.Max = (std::max)(bucket.Max, value);
+						bucket.SumSquares += static_cast<float>(value) * value;
+					}
+				}
+			}
+
+			const int m_channels;
+			Loader m_load;
+			ThreadPool* m_pPool;
+
+			mutable std::mutex m_mutex;
+			long long m_total = 0;
+			std::vector<ChunkState> m_states;
+			std::vector<unsigned int> m_generations;
+			std::vector<Bucket> m_levels[LevelCount];
+			std::size_t m_cleanCount = 0;
+			long long m_cursor = 0;
+
+			std::atomic<bool> m_stop{ false };
+			std::future<void> m_task;
+			std::vector<short> m_buffer;
+		};
+	}
+}
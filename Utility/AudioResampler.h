@@ -0,0 +1,490 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "AudioKernel.h"
+#include <algorithm>    // std::min, std::max
+#include <cmath>        // std::sin, std::sqrt, std::ceil
+#include <cstddef>      // std::ptrdiff_t
+#include <functional>   // std::function
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 音声のサンプリングレート変換 (窓関数付き sinc によるポリフェーズフィルタ)
+		/// <para>入力を Push() し、変換できた分を Pull() で取り出します。呼び出しをまたいで履歴を保持するため、分割して渡しても連続した結果になります。</para>
+		/// <para>変換比 (約分後の出力レート) が位相数の上限以下なら正確な位相で、それを超える場合は最も近い位相で補間します。</para>
+		/// </summary>
+		class AudioResampler final
+		{
+		public:
+			/// <summary>
+			/// 品質の定数
+			/// </summary>
+			enum class Quality : int {
+				/// <summary>
+				/// 低品質 (16 タップ、プレビュー向け)
+				/// </summary>
+				Fast = 0,
+
+				/// <summary>
+				/// 標準 (32 タップ)
+				/// </summary>
+				Normal = 1,
+
+				/// <summary>
+				/// 高品質 (64 タップ、出力向け)
+				/// </summary>
+				High = 2,
+			};
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="srcRate">入力のサンプリングレート</param>
+			/// <param name="dstRate">出力のサンプリングレート</param>
+			/// <param name="quality">品質</param>
+			AudioResampler(int channels, int srcRate, int dstRate, Quality quality = Quality::Normal)
+				: m_channels((std::max)(channels, 1))
+			{
+				srcRate = (std::max)(srcRate, 1);
+				dstRate = (std::max)(dstRate, 1);
+				const long long divisor = Gcd(srcRate, dstRate);
+				m_up = dstRate / divisor;
+				m_down = srcRate / divisor;
+				BuildFilter(quality);
+				m_history.resize(m_channels);
+				Reset();
+			}
+
+			/// <summary>
+			/// チャンネル数を取得します
+			/// </summary>
+			int GetChannels() const { return m_channels; }
+
+			/// <summary>
+			/// フィルタのタップ数を取得します
+			/// </summary>
+			int GetTaps() const { return m_taps; }
+
+			/// <summary>
+			/// 入力のフレーム位置を、出力のフレーム位置に換算します (切り捨て)
+			/// </summary>
+			long long ToDestination(long long srcFrame) const { return srcFrame * m_up / m_down; }
+
+			/// <summary>
+			/// 出力のフレーム位置を、入力のフレーム位置に換算します (切り捨て)
+			/// </summary>
+			long long ToSource(long long dstFrame) const { return dstFrame * m_down / m_up; }
+
+			/// <summary>
+			/// 状態を初期化します (入力の先頭より前は無音として扱います)
+			/// </summary>
+			void Reset()
+			{
+				Seek(0);
+			}
+
+			/// <summary>
+			/// 出力のフレーム位置を移動し、履歴を破棄します
+			/// <para>続けて、戻り値の入力フレーム位置から Push() してください (負の位置は無音を渡します)。</para>
+			/// </summary>
+			/// <param name="dstFrame">次に Pull() する出力のフレーム位置</param>
+			/// <returns>
+			/// 次に Push() する入力のフレーム位置
+			/// </returns>
+			long long Seek(long long dstFrame)
+			{
+				const long long position = dstFrame * m_down;
+				m_sourceIndex = position / m_up;
+				m_phase = position % m_up;
+				m_bufferStart = m_sourceIndex - m_taps / 2 + 1;
+				for (auto& history : m_history) {
+					history.clear();
+				}
+				return m_bufferStart;
+			}
+
+			/// <summary>
+			/// 入力を追加します (float、チャンネル別)
+			/// </summary>
+			/// <param name="ppSrc">チャンネルごとの入力 (nullptr なら無音)</param>
+			/// <param name="frames">フレーム数</param>
+			void Push(const float* const* ppSrc, int frames)
+			{
+				if (frames <= 0) {
+					return;
+				}
+				Compact();
+				for (int c = 0; c < m_channels; ++c) {
+					std::vector<float>& history = m_history[c];
+					if (ppSrc != nullptr) {
+						history.insert(history.end(), ppSrc[c], ppSrc[c] + frames);
+					}
+					else {
+						history.resize(history.size() + frames, 0.0f);
+					}
+				}
+			}
+
+			/// <summary>
+			/// 入力を追加します (16bit PCM、インターリーブ)
+			/// </summary>
+			/// <param name="pSrc">入力 (nullptr なら無音)</param>
+			/// <param name="frames">フレーム数</param>
+			void Push(const short* pSrc, int frames)
+			{
+				if (frames <= 0) {
+					return;
+				}
+				if (pSrc == nullptr) {
+					Push(static_cast<const float* const*>(nullptr), frames);
+					return;
+				}
+				Compact();
+				std::vector<float*> planes(m_channels);
+				for (int c = 0; c < m_channels; ++c) {
+					std::vector<float>& history = m_history[c];
+					history.resize(history.size() + frames);
+					planes[c] = history.data() + history.size() - frames;
+				}
+				AudioKernel::Deinterleave(pSrc, frames, m_channels, planes.data());
+			}
+
+			/// <summary>
+			/// 現在の入力で取り出せる出力のフレーム数を取得します
+			/// </summary>
+			int GetAvailable() const
+			{
+				const long long end = m_bufferStart + static_cast<long long>(m_history[0].size());
+				// 出力 n には入力 [ip - taps/2 + 1, ip + taps/2] が必要
+				const long long lastSource = end - m_taps / 2 - 1;
+				if (lastSource < m_sourceIndex) {
+					return 0;
+				}
+				const long long available = ((lastSource - m_sourceIndex + 1) * m_up - m_phase + m_down - 1) / m_down;
+				return static_cast<int>((std::min)(available, 0x7FFFFFFFll));
+			}
+
+			/// <summary>
+			/// 変換した出力を取り出します (float、チャンネル別)
+			/// </summary>
+			/// <param name="ppDst">チャンネルごとの出力先</param>
+			/// <param name="maxFrames">取り出す最大フレーム数</param>
+			/// <returns>
+			/// 取り出したフレーム数
+			/// </returns>
+			int Pull(float* const* ppDst, int maxFrames)
+			{
+				const int frames = (std::min)(maxFrames, GetAvailable());
+				for (int n = 0; n < frames; ++n) {
+					const std::size_t offset = static_cast<std::size_t>(m_sourceIndex - m_taps / 2 + 1 - m_bufferStart);
+					const float* pCoefficients = m_coefficients.GetData() + GetTable() * m_taps;
+					for (int c = 0; c < m_channels; ++c) {
+						ppDst[c][n] = Dot(m_history[c].data() + offset, pCoefficients, m_taps);
+					}
+					Advance();
+				}
+				return frames;
+			}
+
+			/// <summary>
+			/// 変換した出力を取り出します (16bit PCM、インターリーブ)
+			/// </summary>
+			/// <param name="pDst">出力先</param>
+			/// <param name="maxFrames">取り出す最大フレーム数</param>
+			/// <returns>
+			/// 取り出したフレーム数
+			/// </returns>
+			int Pull(short* pDst, int maxFrames)
+			{
+				const int frames = (std::min)(maxFrames, GetAvailable());
+				if (frames <= 0) {
+					return 0;
+				}
+				if (m_planes.size() < static_cast<std::size_t>(m_channels) * frames) {
+					m_planes.resize(static_cast<std::size_t>(m_channels) * frames);
+				}
+				std::vector<float*> planes(m_channels);
+				for (int c = 0; c < m_channels; ++c) {
+					planes[c] = m_planes.data() + static_cast<std::size_t>(c) * frames;
+				}
+				Pull(planes.data(), frames);
+				AudioKernel::Interleave(planes.data(), frames, m_channels, pDst);
+				return frames;
+			}
+
+		private:
+			enum : int {
+				/// <summary>
+				/// 係数テーブルの位相数の上限
+				/// </summary>
+				MaxPhases = 1024,
+			};
+
+			static long long Gcd(long long a, long long b)
+			{
+				while (b != 0) {
+					const long long t = a % b;
+					a = b;
+					b = t;
+				}
+				return a;
+			}
+
+			/// <summary>
+			/// 0 次の第 1 種変形ベッセル関数 (カイザー窓用)
+			/// </summary>
+			static double BesselI0(double x)
+			{
+				double sum = 1.0;
+				double term = 1.0;
+				for (int k = 1; k < 32; ++k) {
+					term *= (x / (2.0 * k)) * (x / (2.0 * k));
+					sum += term;
+					if (term < sum * 1e-12) {
+						break;
+					}
+				}
+				return sum;
+			}
+
+			/// <summary>
+			/// 位相ごとの係数テーブルを作成します
+			/// </summary>
+			void BuildFilter(Quality quality)
+			{
+				int baseTaps = 32;
+				double beta = 8.0;
+				double rolloff = 0.94;
+				switch (quality) {
+				case Quality::Fast:
+					baseTaps = 16;
+					beta = 6.0;
+					rolloff = 0.90;
+					break;
+				case Quality::High:
+					baseTaps = 64;
+					beta = 10.0;
+					rolloff = 0.96;
+					break;
+				default:
+					break;
+				}
+
+				// 間引く場合は遮断周波数を下げ、その分タップ数を増やす
+				const double cutoff = rolloff * (std::min)(1.0, static_cast<double>(m_up) / m_down);
+				m_taps = static_cast<int>(std::ceil(baseTaps * rolloff / cutoff));
+				m_taps = (std::min)((m_taps + 7) & ~7, 1024);
+				m_tables = static_cast<int>((std::min)(m_up, static_cast<long long>(MaxPhases)));
+
+				// 最も近い位相で補間する場合は、次の入力の位相 0 に丸められる出力のために位相 1.0 のテーブルを追加する
+				// (窓の端の係数は 0 になるため、位相 1.0 の係数は次の入力の位相 0 の係数を 1 つずらしたものと同じ)
+				const int count = (m_tables < m_up) ? m_tables + 1 : m_tables;
+				const double pi = 3.14159265358979323846;
+				const int half = m_taps / 2;
+				const double window = BesselI0(beta);
+				m_coefficients.Allocate(static_cast<std::size_t>(count) * m_taps);
+				for (int table = 0; table < count; ++table) {
+					const double fraction = static_cast<double>(table) / m_tables;
+					float* pCoefficients = m_coefficients.GetData() + table * m_taps;
+					double sum = 0.0;
+					for (int k = 0; k < m_taps; ++k) {
+						const double distance = (k - half + 1) - fraction;
+						const double x = distance * cutoff;
+						const double sinc = (x == 0.0) ? 1.0 : std::sin(pi * x) / (pi * x);
+						const double ratio = distance / half;
+						const double w = (ratio <= -1.0 || ratio >= 1.0) ? 0.0 : BesselI0(beta * std::sqrt(1.0 - ratio * ratio)) / window;
+						const double value = sinc * w;
+						pCoefficients[k] = static_cast<float>(value);
+						sum += value;
+					}
+					// 直流のゲインを 1 にする
+					for (int k = 0; k < m_taps; ++k) {
+						pCoefficients[k] = static_cast<float>(pCoefficients[k] / sum);
+					}
+				}
+			}
+
+			/// <summary>
+			/// 現在の位相で使用する係数テーブルの番号を取得します
+			/// <para>最も近い位相で補間する場合、位相 1.0 (次の入力の位相 0 と同じ) に丸められると m_tables を返します。</para>
+			/// </summary>
+			int GetTable() const
+			{
+				if (m_tables == m_up) {
+					return static_cast<int>(m_phase);
+				}
+				return static_cast<int>((m_phase * m_tables + m_up / 2) / m_up);
+			}
+
+			/// <summary>
+			/// 出力を 1 フレーム進めます
+			/// </summary>
+			void Advance()
+			{
+				m_phase += m_down;
+				if (m_phase >= m_up) {
+					m_sourceIndex += m_phase / m_up;
+					m_phase %= m_up;
+				}
+			}
+
+			/// <summary>
+			/// 不要になった古い入力を捨てます
+			/// </summary>
+			void Compact()
+			{
+				const long long needed = m_sourceIndex - m_taps / 2 + 1;
+				const long long drop = (std::min)(needed - m_bufferStart, static_cast<long long>(m_history[0].size()));
+				if (drop <= 0 || drop < static_cast<long long>(m_history[0].size()) / 2) {
+					return;
+				}
+				for (auto& history : m_history) {
+					history.erase(history.begin(), history.begin() + static_cast<std::ptrdiff_t>(drop));
+				}
+				m_bufferStart += drop;
+			}
+
+			/// <summary>
+			/// 内積を求めます (タップ数は 8 の倍数)
+			/// </summary>
+			static float Dot(const float* pSamples, const float* pCoefficients, int taps)
+			{
+				__m128 sum0 = _mm_setzero_ps();
+				__m128 sum1 = _mm_setzero_ps();
+				for (int k = 0; k < taps; k += 8) {
+					sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(pSamples + k), _mm_load_ps(pCoefficients + k)));
+					sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(pSamples + k + 4), _mm_load_ps(pCoefficients + k + 4)));
+				}
+				sum0 = _mm_add_ps(sum0, sum1);
+				sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+				sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+				return _mm_cvtss_f32(sum0);
+			}
+
+			int m_channels;
+			long long m_up = 1;
+			long long m_down = 1;
+			int m_taps = 0;
+			int m_tables = 0;
+			AlignedBuffer<float> m_coefficients;
+
+			std::vector<std::vector<float>> m_history;
+			long long m_bufferStart = 0;
+			long long m_sourceIndex = 0;
+			long long m_phase = 0;
+			std::vector<float> m_planes;
+		};
+
+		/// <summary>
+		/// AudioResampler を使用して、別のサンプリングレートの音声を ReadAudio と同じ形式で読み込むための補助
+		/// <para>前回の続きの位置から読み込む場合は、変換の状態を引き継いで必要な分の入力だけを読み込みます。</para>
+		/// </summary>
+		class AudioResampleReader final
+		{
+		public:
+			/// <summary>
+			/// 元の音声を読み込む関数 (読み込んだフレーム数を返す)
+			/// </summary>
+			using Loader = std::function<int(long long start, int length, short* pBuffer)>;
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="loader">元の音声を読み込む関数</param>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="srcRate">元の音声のサンプリングレート</param>
+			/// <param name="dstRate">読み込む音声のサンプリングレート</param>
+			/// <param name="quality">品質</param>
+			AudioResampleReader(Loader loader, int channels, int srcRate, int dstRate, AudioResampler::Quality quality = AudioResampler::Quality::Normal)
+				: m_loader(std::move(loader)), m_resampler(channels, srcRate, dstRate, quality)
+			{
+				m_nextSource = m_resampler.Seek(0);
+			}
+
+			/// <summary>
+			/// 変換後の音声を読み込みます
+			/// </summary>
+			/// <param name="start">読み込み開始フレーム (変換後)</param>
+			/// <param name="length">読み込むフレーム数</param>
+			/// <param name="pBuffer">格納先 (16bit PCM、インターリーブ)</param>
+			/// <returns>
+			/// 読み込んだフレーム数
+			/// </returns>
+			int Read(long long start, int length, short* pBuffer)
+			{
+				if (start != m_nextDestination) {
+					m_nextSource = m_resampler.Seek(start);
+					m_nextDestination = start;
+					m_ended = false;
+				}
+
+				const int channels = m_resampler.GetChannels();
+				int produced = 0;
+				while (produced < length) {
+					produced += m_resampler.Pull(pBuffer + static_cast<std::size_t>(produced) * channels, length - produced);
+					if (produced >= length) {
+						break;
+					}
+					if (m_ended) {
+						break;
+					}
+
+					// 残りの出力に必要な分だけ入力を読み込む
+					const long long needed = m_resampler.ToSource(length - produced) + m_resampler.GetTaps() + 1;
+					const int request = static_cast<int>((std::min)(needed, static_cast<long long>(ChunkFrames)));
+					if (m_nextSource < 0) {
+						const int silence = static_cast<int>((std::min)(-m_nextSource, static_cast<long long>(request)));
+						m_resampler.Push(static_cast<const short*>(nullptr), silence);
+						m_nextSource += silence;
+						continue;
+					}
+
+					m_buffer.resize(static_cast<std::size_t>(request) * channels);
+					const int read = m_loader(m_nextSource, request, m_buffer.data());
+					if (read > 0) {
+						m_resampler.Push(m_buffer.data(), read);
+						m_nextSource += read;
+					}
+					if (read < request) {
+						// 末尾の後ろは無音として、残りの出力を取り出せるようにする
+						m_resampler.Push(static_cast<const short*>(nullptr), m_resampler.GetTaps());
+						m_ended = true;
+					}
+				}
+				m_nextDestination = start + produced;
+				return produced;
+			}
+
+		private:
+			enum : int {
+				/// <summary>
+				/// 1 回に読み込む入力の最大フレーム数
+				/// </summary>
+				ChunkFrames = 16384,
+			};
+
+			Loader m_loader;
+			AudioResampler m_resampler;
+			long long m_nextDestination = 0;
+			long long m_nextSource = 0;
+			bool m_ended = false;
+			std::vector<short> m_buffer;
+		};
+	}
+}
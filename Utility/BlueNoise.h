@@ -0,0 +1,186 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <algorithm>    // std::min
+#include <cmath>        // std::exp
+#include <cstddef>      // std::size_t
+#include <random>       // std::mt19937
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// ブルーノイズの閾値テーブル (順序ディザ用)
+		/// <para>void-and-cluster 法で、縦横に繰り返して並べても継ぎ目の出ない Size x Size の順位表を作成します。</para>
+		/// <para>初回の Get() で作成し (数十ミリ秒)、以降は同じテーブルを共有します。乱数の種は固定のため、毎回同じテーブルになります。</para>
+		/// </summary>
+		class BlueNoise final
+		{
+		public:
+			/// <summary>
+			/// テーブルの大きさ
+			/// </summary>
+			enum : int {
+				/// <summary>
+				/// 一辺の画素数
+				/// </summary>
+				Size = 64,
+
+				/// <summary>
+				/// 画素数 (順位は 0 ～ Count-1)
+				/// </summary>
+				Count = Size * Size,
+			};
+
+			BlueNoise(const BlueNoise&) = delete;
+			BlueNoise& operator=(const BlueNoise&) = delete;
+
+			/// <summary>
+			/// 共有のテーブルを取得します
+			/// </summary>
+			/// <returns>
+			/// テーブルの参照
+			/// </returns>
+			static const BlueNoise& Get()
+			{
+				static const BlueNoise noise;
+				return noise;
+			}
+
+			/// <summary>
+			/// 指定した位置の順位を取得します (座標は Size で折り返します)
+			/// </summary>
+			/// <param name="x">横位置</param>
+			/// <param name="y">縦位置</param>
+			/// <returns>
+			/// 順位 (0 ～ Count-1)
+			/// </returns>
+			int GetRank(int x, int y) const
+			{
+				return m_rank[static_cast<std::size_t>(y & (Size - 1)) * Size * 2 + (x & (Size - 1))];
+			}
+
+			/// <summary>
+			/// 1 行分の順位を取得します
+			/// <para>各行は横に 2 回繰り返して保持しているため、先頭から x (0 ～ Size-1) 進めた位置から Size 個を連続して読めます。</para>
+			/// </summary>
+			/// <param name="y">縦位置 (Size で折り返します)</param>
+			/// <returns>
+			/// 順位の配列 (Size * 2 個)
+			/// </returns>
+			const unsigned short* GetRow(int y) const
+			{
+				return &m_rank[static_cast<std::size_t>(y & (Size - 1)) * Size * 2];
+			}
+
+		private:
+			BlueNoise()
+				: m_rank(static_cast<std::size_t>(Count) * 2)
+			{
+				// トーラス上のガウス関数 (σ = 1.5) で各点の密度を求める
+				const float sigma = 1.5f;
+				std::vector<float> kernel(Count);
+				for (int y = 0; y < Size; ++y) {
+					for (int x = 0; x < Size; ++x) {
+						const int dx = (std::min)(x, Size - x);
+						const int dy = (std::min)(y, Size - y);
+						kernel[y * Size + x] = std::exp(-static_cast<float>(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+					}
+				}
+
+				std::vector<unsigned char> pattern(Count);
+				std::vector<float> energy(Count);
+				const auto toggle = [&](int index, bool set) {
+					pattern[index] = set ? 1 : 0;
+					const float sign = set ? 1.0f : -1.0f;
+					const int px = index % Size;
+					const int py = index / Size;
+					for (int y = 0; y < Size; ++y) {
+						const float* pKernel = &kernel[((y - py) & (Size - 1)) * Size];
+						float* pEnergy = &energy[y * Size];
+						for (int x = 0; x < Size; ++x) {
+							pEnergy[x] += sign * pKernel[(x - px) & (Size - 1)];
+						}
+					}
+				};
+				// 最も密な点 (1 の中で密度が最大)
+				const auto tightestCluster = [&]() {
+					int best = -1;
+					for (int i = 0; i < Count; ++i) {
+						if (pattern[i] != 0 && (best < 0 || energy[i] > energy[best])) {
+							best = i;
+						}
+					}
+					return best;
+				};
+				// 最も疎な点 (0 の中で密度が最小)
+				const auto largestVoid = [&]() {
+					int best = -1;
+					for (int i = 0; i < Count; ++i) {
+						if (pattern[i] == 0 && (best < 0 || energy[i] < energy[best])) {
+							best = i;
+						}
+					}
+					return best;
+				};
+
+				// 初期パターン: 乱数で 1/10 の点を置き、最も密な点を最も疎な位置へ移せなくなるまで均す
+				const int initial = Count / 10;
+				std::mt19937 random(0x5EED);
+				for (int n = 0; n < initial;) {
+					const int index = static_cast<int>(random() % Count);
+					if (pattern[index] == 0) {
+						toggle(index, true);
+						++n;
+					}
+				}
+				for (;;) {
+					const int cluster = tightestCluster();
+					toggle(cluster, false);
+					const int hole = largestVoid();
+					toggle(hole, true);
+					if (hole == cluster) {
+						break;
+					}
+				}
+				const std::vector<unsigned char> initialPattern = pattern;
+				const std::vector<float> initialEnergy = energy;
+
+				std::vector<int> rank(Count);
+				// 初期パターンの点を、密な順に取り除きながら大きい順位から振る
+				for (int r = initial - 1; r >= 0; --r) {
+					const int cluster = tightestCluster();
+					toggle(cluster, false);
+					rank[cluster] = r;
+				}
+				// 残りの点を、疎な位置から順に埋めながら振る
+				pattern = initialPattern;
+				energy = initialEnergy;
+				for (int r = initial; r < Count; ++r) {
+					const int hole = largestVoid();
+					toggle(hole, true);
+					rank[hole] = r;
+				}
+
+				for (int y = 0; y < Size; ++y) {
+					for (int x = 0; x < Size * 2; ++x) {
+						m_rank[static_cast<std::size_t>(y) * Size * 2 + x] = static_cast<unsigned short>(rank[y * Size + (x & (Size - 1))]);
+					}
+				}
+			}
+
+			std::vector<unsigned short> m_rank;
+		};
+	}
+}
@@ -0,0 +1,381 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "Simd.h"
+#include <cmath>        // std::cos, std::sin
+#include <iterator>     // std::next
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr, std::weak_ptr, std::make_shared
+#include <mutex>        // std::mutex, std::lock_guard
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 複素 FFT の計算プラン (回転因子とビット反転の表)
+		/// <para>データは実部と虚部を別々の配列に持つ形式です。基数 4 のバタフライを SSE で 4 組ずつ処理します。</para>
+		/// <para>プランは作成後に変更されないため、複数のスレッドから同時に使用できます。同じサイズのプランは Get() で共有します。</para>
+		/// </summary>
+		class FftPlan final
+		{
+		public:
+			/// <summary>
+			/// 同じサイズのプランを共有して取得します
+			/// </summary>
+			/// <param name="size">点数 (4 以上の 2 の累乗)</param>
+			/// <returns>
+			/// プラン (サイズが不正なら nullptr)
+			/// </returns>
+			static std::shared_ptr<const FftPlan> Get(int size)
+			{
+				if (!IsValidSize(size)) {
+					return nullptr;
+				}
+
+				std::lock_guard<std::mutex> lock(GetPoolMutex());
+				auto& pool = GetPool();
+				for (auto it = pool.begin(); it != pool.end();) {
+					it = it->second.expired() ? pool.erase(it) : std::next(it);
+				}
+				std::shared_ptr<const FftPlan> pPlan = pool[size].lock();
+				if (pPlan == nullptr) {
+					pPlan = std::make_shared<const FftPlan>(size);
+					pool[size] = pPlan;
+				}
+				return pPlan;
+			}
+
+			/// <summary>
+			/// 点数が 4 以上の 2 の累乗か調べます
+			/// </summary>
+			static bool IsValidSize(int size)
+			{
+				return size >= 4 && (size & (size - 1)) == 0;
+			}
+
+			/// <summary>
+			/// コンストラクタ (通常は Get() を使用してください)
+			/// </summary>
+			/// <param name="size">点数 (4 以上の 2 の累乗)</param>
+			explicit FftPlan(int size)
+				: m_size(size)
+			{
+				while ((1 << m_log2) < size) {
+					++m_log2;
+				}
+
+				for (int i = 0; i < size; ++i) {
+					int reversed = 0;
+					for (int bit = 0; bit < m_log2; ++bit) {
+						reversed |= ((i >> bit) & 1) << (m_log2 - 1 - bit);
+					}
+					if (i < reversed) {
+						m_swaps.push_back(i);
+						m_swaps.push_back(reversed);
+					}
+				}
+
+				// 基数 4 の段ごとに w^k, w^2k, w^3k (w = exp(-2πi / 4q)) を実部・虚部別に並べる
+				std::size_t count = 0;
+				for (int q = FirstQuarter(); q < size; q *= 4) {
+					count += static_cast<std::size_t>(q) * 6;
+				}
+				m_twiddles.Allocate(count);
+				const double pi = 3.14159265358979323846;
+				float* p = m_twiddles.GetData();
+				for (int q = FirstQuarter(); q < size; q *= 4) {
+					for (int k = 0; k < q; ++k) {
+						for (int r = 1; r <= 3; ++r) {
+							const double angle = -2.0 * pi * r * k / (4.0 * q);
+							p[(r - 1) * 2 * q + k] = static_cast<float>(std::cos(angle));
+							p[(r - 1) * 2 * q + q + k] = static_cast<float>(std::sin(angle));
+						}
+					}
+					p += q * 6;
+				}
+			}
+
+			FftPlan(const FftPlan&) = delete;
+			FftPlan& operator=(const FftPlan&) = delete;
+
+			/// <summary>
+			/// 点数を取得します
+			/// </summary>
+			int GetSize() const { return m_size; }
+
+			/// <summary>
+			/// 順変換します (正規化しません)
+			/// </summary>
+			/// <param name="pReal">実部 (点数分、変換結果で上書きされます)</param>
+			/// <param name="pImag">虚部 (点数分、変換結果で上書きされます)</param>
+			void Forward(float* pReal, float* pImag) const
+			{
+				for (std::size_t i = 0; i < m_swaps.size(); i += 2) {
+					const int a = m_swaps[i];
+					const int b = m_swaps[i + 1];
+					const float real = pReal[a];
+					const float imag = pImag[a];
+					pReal[a] = pReal[b];
+					pImag[a] = pImag[b];
+					pReal[b] = real;
+					pImag[b] = imag;
+				}
+
+				if (m_log2 & 1) {
+					for (int i = 0; i < m_size; i += 2) {
+						const float ar = pReal[i], ai = pImag[i];
+						const float br = pReal[i + 1], bi = pImag[i + 1];
+						pReal[i] = ar + br;
+						pImag[i] = ai + bi;
+						pReal[i + 1] = ar - br;
+						pImag[i + 1] = ai - bi;
+					}
+				}
+
+				const float* pTwiddles = m_twiddles.GetData();
+				for (int q = FirstQuarter(); q < m_size; q *= 4) {
+					if (q >= 4) {
+						Radix4Sse(pReal, pImag, q, pTwiddles);
+					}
+					else {
+						Radix4(pReal, pImag, q, pTwiddles);
+					}
+					pTwiddles += q * 6;
+				}
+			}
+
+			/// <summary>
+			/// 逆変換します (正規化しないため、順変換と組み合わせると点数倍になります)
+			/// </summary>
+			/// <param name="pReal">実部 (点数分、変換結果で上書きされます)</param>
+			/// <param name="pImag">虚部 (点数分、変換結果で上書きされます)</param>
+			void Inverse(float* pReal, float* pImag) const
+			{
+				// 実部と虚部を入れ替えて順変換すると、共役を取った逆変換と同じになる
+				Forward(pImag, pReal);
+			}
+
+		private:
+			/// <summary>
+			/// 最初の基数 4 の段の 1/4 長 (段数が奇数なら先に基数 2 の段を 1 つ行う)
+			/// </summary>
+			int FirstQuarter() const { return (m_log2 & 1) ? 2 : 1; }
+
+			/// <summary>
+			/// 基数 4 の段を処理します
+			/// </summary>
+			void Radix4(float* pReal, float* pImag, int q, const float* pTwiddles) const
+			{
+				for (int base = 0; base < m_size; base += q * 4) {
+					for (int k = 0; k < q; ++k) {
+						const int i0 = base + k;
+						const int i1 = i0 + q;
+						const int i2 = i1 + q;
+						const int i3 = i2 + q;
+						const float w1r = pTwiddles[k], w1i = pTwiddles[q + k];
+						const float w2r = pTwiddles[q * 2 + k], w2i = pTwiddles[q * 3 + k];
+						const float w3r = pTwiddles[q * 4 + k], w3i = pTwiddles[q * 5 + k];
+
+						// ビット反転順のため、i1 が 2 番目、i2 が 1 番目の部分列になる
+						const float ar = pReal[i0], ai = pImag[i0];
+						const float br = pReal[i1] * w2r - pImag[i1] * w2i, bi = pReal[i1] * w2i + pImag[i1] * w2r;
+						const float cr = pReal[i2] * w1r - pImag[i2] * w1i, ci = pReal[i2] * w1i + pImag[i2] * w1r;
+						const float dr = pReal[i3] * w3r - pImag[i3] * w3i, di = pReal[i3] * w3i + pImag[i3] * w3r;
+
+						const float t0r = ar + br, t0i = ai + bi;
+						const float t1r = ar - br, t1i = ai - bi;
+						const float t2r = cr + dr, t2i = ci + di;
+						const float t3r = cr - dr, t3i = ci - di;
+						pReal[i0] = t0r + t2r;
+						pImag[i0] = t0i + t2i;
+						pReal[i1] = t1r + t3i;
+						pImag[i1] = t1i - t3r;
+						pReal[i2] = t0r - t2r;
+						pImag[i2] = t0i - t2i;
+						pReal[i3] = t1r - t3i;
+						pImag[i3] = t1i + t3r;
+					}
+				}
+			}
+
+			/// <summary>
+			/// 基数 4 の段を処理します (SSE、q は 4 の倍数)
+			/// </summary>
+			void Radix4Sse(float* pReal, float* pImag, int q, const float* pTwiddles) const
+			{
+				for (int base = 0; base < m_size; base += q * 4) {
+					for (int k = 0; k < q; k += 4) {
+						const int i0 = base + k;
+						const int i1 = i0 + q;
+						const int i2 = i1 + q;
+						const int i3 = i2 + q;
+
+						const __m128 ar = _mm_loadu_ps(pReal + i0), ai = _mm_loadu_ps(pImag + i0);
+						__m128 br, bi, cr, ci, dr, di;
+						Multiply(_mm_loadu_ps(pReal + i1), _mm_loadu_ps(pImag + i1), _mm_loadu_ps(pTwiddles + q * 2 + k), _mm_loadu_ps(pTwiddles + q * 3 + k), &br, &bi);
+						Multiply(_mm_loadu_ps(pReal + i2), _mm_loadu_ps(pImag + i2), _mm_loadu_ps(pTwiddles + k), _mm_loadu_ps(pTwiddles + q + k), &cr, &ci);
+						Multiply(_mm_loadu_ps(pReal + i3), _mm_loadu_ps(pImag + i3), _mm_loadu_ps(pTwiddles + q * 4 + k), _mm_loadu_ps(pTwiddles + q * 5 + k), &dr, &di);
+
+						const __m128 t0r = _mm_add_ps(ar, br), t0i = _mm_add_ps(ai, bi);
+						const __m128 t1r = _mm_sub_ps(ar, br), t1i = _mm_sub_ps(ai, bi);
+						const __m128 t2r = _mm_add_ps(cr, dr), t2i = _mm_add_ps(ci, di);
+						const __m128 t3r = _mm_sub_ps(cr, dr), t3i = _mm_sub_ps(ci, di);
+						_mm_storeu_ps(pReal + i0, _mm_add_ps(t0r, t2r));
+						_mm_storeu_ps(pImag + i0, _mm_add_ps(t0i, t2i));
+						_mm_storeu_ps(pReal + i1, _mm_add_ps(t1r, t3i));
+						_mm_storeu_ps(pImag + i1, _mm_sub_ps(t1i, t3r));
+						_mm_storeu_ps(pReal + i2, _mm_sub_ps(t0r, t2r));
+						_mm_storeu_ps(pImag + i2, _mm_sub_ps(t0i, t2i));
+						_mm_storeu_ps(pReal + i3, _mm_sub_ps(t1r, t3i));
+						_mm_storeu_ps(pImag + i3, _mm_add_ps(t1i, t3r));
+					}
+				}
+			}
+
+			/// <summary>
+			/// 複素数の積を求めます (4 組)
+			/// </summary>
+			static void Multiply(__m128 xr, __m128 xi, __m128 wr, __m128 wi, __m128* pReal, __m128* pImag)
+			{
+				*pReal = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+				*pImag = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+			}
+
+			static std::map<int, std::weak_ptr<const FftPlan>>& GetPool()
+			{
+				static std::map<int, std::weak_ptr<const FftPlan>> pool;
+				return pool;
+			}
+
+			static std::mutex& GetPoolMutex()
+			{
+				static std::mutex mutex;
+				return mutex;
+			}
+
+			int m_size;
+			int m_log2 = 0;
+			std::vector<int> m_swaps;
+			AlignedBuffer<float> m_twiddles;
+		};
+
+		/// <summary>
+		/// 実数入力の FFT
+		/// <para>N 点の実数列を N/2 点の複素 FFT で変換し、0 〜 N/2 の N/2 + 1 個のビンを出力します。</para>
+		/// <para>作業用のバッファを持つため、スレッドごと (チャンネルごと) に別のインスタンスを使用してください。変換時にメモリは確保しません。</para>
+		/// </summary>
+		class RealFft final
+		{
+		public:
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="size">点数 (8 以上の 2 の累乗)</param>
+			explicit RealFft(int size)
+				: m_size(size), m_pPlan(FftPlan::Get(size / 2))
+			{
+				const int half = size / 2;
+				m_real.Allocate(half);
+				m_imag.Allocate(half);
+				m_twiddles.Allocate(static_cast<std::size_t>(half) * 2 + 2);
+				const double pi = 3.14159265358979323846;
+				for (int k = 0; k <= half; ++k) {
+					const double angle = -2.0 * pi * k / size;
+					m_twiddles[k * 2] = static_cast<float>(std::cos(angle));
+					m_twiddles[k * 2 + 1] = static_cast<float>(std::sin(angle));
+				}
+			}
+
+			RealFft(const RealFft&) = delete;
+			RealFft& operator=(const RealFft&) = delete;
+
+			/// <summary>
+			/// 点数を取得します
+			/// </summary>
+			int GetSize() const { return m_size; }
+
+			/// <summary>
+			/// ビン数 (点数 / 2 + 1) を取得します
+			/// </summary>
+			int GetBins() const { return m_size / 2 + 1; }
+
+			/// <summary>
+			/// 順変換します (正規化しません)
+			/// </summary>
+			/// <param name="pInput">入力 (点数分)</param>
+			/// <param name="pReal">実部の出力先 (ビン数分)</param>
+			/// <param name="pImag">虚部の出力先 (ビン数分)</param>
+			void Forward(const float* pInput, float* pReal, float* pImag)
+			{
+				const int half = m_size / 2;
+				float* zr = m_real.GetData();
+				float* zi = m_imag.GetData();
+				for (int n = 0; n < half; ++n) {
+					zr[n] = pInput[n * 2];
+					zi[n] = pInput[n * 2 + 1];
+				}
+				m_pPlan->Forward(zr, zi);
+
+				// Z = FFT(偶数番目 + i 奇数番目) を偶数・奇数番目の FFT (E, O) に分けて合成する
+				for (int k = 0; k <= half; ++k) {
+					const int a = k & (half - 1);
+					const int b = (half - k) & (half - 1);
+					const float er = (zr[a] + zr[b]) * 0.5f, ei = (zi[a] - zi[b]) * 0.5f;
+					const float or_ = (zi[a] + zi[b]) * 0.5f, oi = (zr[b] - zr[a]) * 0.5f;
+					const float wr = m_twiddles[k * 2], wi = m_twiddles[k * 2 + 1];
+					pReal[k] = er + or_ * wr - oi * wi;
+					pImag[k] = ei + or_ * wi + oi * wr;
+				}
+			}
+
+			/// <summary>
+			/// 逆変換します (1 / 点数で正規化するため、順変換と組み合わせると元に戻ります)
+			/// </summary>
+			/// <param name="pReal">実部 (ビン数分)</param>
+			/// <param name="pImag">虚部 (ビン数分、0 と N/2 の虚部は無視します)</param>
+			/// <param name="pOutput">出力先 (点数分)</param>
+			void Inverse(const float* pReal, const float* pImag, float* pOutput)
+			{
+				const int half = m_size / 2;
+				const float scale = 1.0f / m_size;
+				float* zr = m_real.GetData();
+				float* zi = m_imag.GetData();
+				for (int k = 0; k < half; ++k) {
+					const int b = half - k;
+					const float xr = pReal[k], xi = (k == 0) ? 0.0f : pImag[k];
+					const float yr = pReal[b], yi = (b == half) ? 0.0f : -pImag[b];
+					const float er = xr + yr, ei = xi + yi;
+					const float dr = xr - yr, di = xi - yi;
+					const float wr = m_twiddles[k * 2], wi = -m_twiddles[k * 2 + 1];
+					const float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+					zr[k] = (er - oi) * scale;
+					zi[k] = (ei + or_) * scale;
+				}
+				m_pPlan->Inverse(zr, zi);
+				for (int n = 0; n < half; ++n) {
+					pOutput[n * 2] = zr[n];
+					pOutput[n * 2 + 1] = zi[n];
+				}
+			}
+
+		private:
+			int m_size;
+			std::shared_ptr<const FftPlan> m_pPlan;
+			AlignedBuffer<float> m_real;
+			AlignedBuffer<float> m_imag;
+			AlignedBuffer<float> m_twiddles;
+		};
+	}
+}
@@ -0,0 +1,453 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <windows.h>
+#include <cstddef>      // std::size_t
+#include <string>       // std::string, std::wstring
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 同じファイルを指す名前を同じ文字列にするため、絶対パスにして小文字にします
+		/// <para>ハンドルやデコーダーをファイル単位で共有する際のキーとして使用します。</para>
+		/// <para>CP932 の2バイト目を書き換えないよう、UTF-16 に変換してから小文字にし、UTF-8 で返します。</para>
+		/// </summary>
+		/// <param name="pFileName">ファイル名</param>
+		/// <returns>
+		/// 正規化したファイル名 (UTF-8)
+		/// </returns>
+		inline std::string GetFileKey(const char* pFileName)
+		{
+			const int nameLength = ::MultiByteToWideChar(CP_ACP, 0, pFileName, -1, nullptr, 0);
+			if (nameLength <= 0) {
+				return std::string(pFileName);
+			}
+			std::vector<wchar_t> name(nameLength);
+			::MultiByteToWideChar(CP_ACP, 0, pFileName, -1, name.data(), nameLength);
+
+			std::vector<wchar_t> path(MAX_PATH);
+			DWORD length = ::GetFullPathNameW(name.data(), static_cast<DWORD>(path.size()), path.data(), nullptr);
+			if (length >= path.size()) {
+				path.resize(length + 1);
+				length = ::GetFullPathNameW(name.data(), static_cast<DWORD>(path.size()), path.data(), nullptr);
+			}
+			std::wstring key = length > 0 && length < path.size() ? std::wstring(path.data(), length) : std::wstring(name.data());
+			if (key.empty()) {
+				return std::string();
+			}
+			::CharLowerBuffW(&key[0], static_cast<DWORD>(key.size()));
+			for (wchar_t& c : key) {
+				if (c == L'/') {
+					c = L'\\';
+				}
+			}
+
+			const int keyLength = ::WideCharToMultiByte(CP_UTF8, 0, key.data(), static_cast<int>(key.size()), nullptr, 0, nullptr, nullptr);
+			std::string result(keyLength, '\0');
+			if (keyLength > 0) {
+				::WideCharToMultiByte(CP_UTF8, 0, key.data(), static_cast<int>(key.size()), &result[0], keyLength, nullptr, nullptr);
+			}
+			return result;
+		}
+
+		/// <summary>
+		/// ファイルの同一性判定に使用する情報
+		/// <para>索引やハッシュのキャッシュが、元ファイルから作成されたものか判定するために使用します。</para>
+		/// </summary>
+		struct FileStamp final
+		{
+			/// <summary>
+			/// ファイルサイズ
+			/// </summary>
+			unsigned long long Size;
+
+			/// <summary>
+			/// 最終更新日時 (FILETIME)
+			/// </summary>
+			unsigned long long WriteTime;
+
+			bool operator==(const FileStamp& other) const { return Size == other.Size && WriteTime == other.WriteTime; }
+			bool operator!=(const FileStamp& other) const { return !(*this == other); }
+		};
+
+		/// <summary>
+		/// ファイルのサイズと最終更新日時を取得します
+		/// </summary>
+		/// <param name="pFileName">ファイル名</param>
+		/// <param name="pStamp">取得した情報を格納するポインタ</param>
+		/// <returns>
+		/// true なら成功
+		/// </returns>
+		inline bool GetFileStamp(const char* pFileName, FileStamp* pStamp)
+		{
+			WIN32_FILE_ATTRIBUTE_DATA data = {};
+			if (!::GetFileAttributesExA(pFileName, GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+				return false;
+			}
+			pStamp->Size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			pStamp->WriteTime = (static_cast<unsigned long long>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+			return true;
+		}
+
+		/// <summary>
+		/// ファイル全体を読み込みます
+		/// <para>シーケンシャルアクセスを指定し、大きな単位でまとめて読み込みます。</para>
+		/// </summary>
+		/// <param name="pFileName">ファイル名</param>
+		/// <param name="pData">読み込んだデータを格納するポインタ (容量は再利用されます)</param>
+		/// <returns>
+		/// true なら成功
+		/// </returns>
+		inline bool ReadFileAll(const char* pFileName, std::vector<unsigned char>* pData)
+		{
+			HANDLE hFile = ::CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (hFile == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+
+			LARGE_INTEGER size = {};
+			bool succeeded = ::GetFileSizeEx(hFile, &size) && size.QuadPart >= 0 && size.QuadPart < 0x7FFFFFFF;
+			if (succeeded) {
+				pData->resize(static_cast<std::size_t>(size.QuadPart));
+				std::size_t position = 0;
+				while (position < pData->size() && succeeded) {
+					const std::size_t rest = pData->size() - position;
+					const DWORD request = rest > 0x1000000 ? 0x1000000 : static_cast<DWORD>(rest);
+					DWORD read = 0;
+					succeeded = ::ReadFile(hFile, pData->data() + position, request, &read, nullptr) && read > 0;
+					position += read;
+				}
+			}
+			::CloseHandle(hFile);
+			return succeeded;
+		}
+
+		/// <summary>
+		/// 一時ファイルに書き込んでから置き換えることで、ファイルを原子的に書き込みます
+		/// <para>書き込み途中で中断しても、読み込み側が壊れたファイルを見ることはありません。</para>
+		/// </summary>
+		/// <param name="pFileName">書き込むファイル名</param>
+		/// <param name="pData">書き込むデータ</param>
+		/// <param name="size">書き込むバイト数</param>
+		/// <returns>
+		/// true なら成功
+		/// </returns>
+		inline bool WriteFileAtomically(const char* pFileName, const void* pData, std::size_t size)
+		{
+			const std::string temporary = std::string(pFileName) + ".tmp";
+			HANDLE hFile = ::CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (hFile == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+
+			const unsigned char* p = static_cast<const unsigned char*>(pData);
+			bool succeeded = true;
+			while (size > 0 && succeeded) {
+				const DWORD request = size > 0x1000000 ? 0x1000000 : static_cast<DWORD>(size);
+				DWORD written = 0;
+				succeeded = ::WriteFile(hFile, p, request, &written, nullptr) && written == request;
+				p += written;
+				size -= written;
+			}
+			::CloseHandle(hFile);
+
+			if (!succeeded || !::MoveFileExA(temporary.c_str(), pFileName, MOVEFILE_REPLACE_EXISTING)) {
+				::DeleteFileA(temporary.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// メモリマップしたファイルの一部分 (ビュー)
+		/// <para>破棄時にアンマップされます。コピーは出来ず、ムーブのみ可能です。</para>
+		/// </summary>
+		class MappedView final
+		{
+		public:
+			MappedView() = default;
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="pBase">MapViewOfFile が返したアドレス</param>
+			/// <param name="delta">要求したオフセットとビュー先頭との差 (アロケーション粒度への切り捨て分)</param>
+			/// <param name="size">要求したサイズ</param>
+			MappedView(void* pBase, std::size_t delta, std::size_t size)
+				: m_pBase(pBase), m_delta(delta), m_size(size) {}
+
+			MappedView(const MappedView&) = delete;
+			MappedView& operator=(const MappedView&) = delete;
+
+			MappedView(MappedView&& other)
+				: m_pBase(other.m_pBase), m_delta(other.m_delta), m_size(other.m_size)
+			{
+				other.m_pBase = nullptr;
+				other.m_size = 0;
+			}
+
+			MappedView& operator=(MappedView&& other)
+			{
+				if (this != &other) {
+					Reset();
+					m_pBase = other.m_pBase;
+					m_delta = other.m_delta;
+					m_size = other.m_size;
+					other.m_pBase = nullptr;
+					other.m_size = 0;
+				}
+				return *this;
+			}
+
+			~MappedView() { Reset(); }
+
+			/// <summary>
+			/// ビューをアンマップします
+			/// </summary>
+			void Reset()
+			{
+				if (m_pBase != nullptr) {
+					::UnmapViewOfFile(m_pBase);
+					m_pBase = nullptr;
+				}
+				m_size = 0;
+			}
+
+			/// <summary>
+			/// 要求したオフセット位置のデータへのポインタ (NULLなら未マップ)
+			/// </summary>
+			const unsigned char* GetData() const
+			{
+				return m_pBase != nullptr ? static_cast<const unsigned char*>(m_pBase) + m_delta : nullptr;
+			}
+
+			/// <summary>
+			/// 要求したサイズ
+			/// </summary>
+			std::size_t GetSize() const { return m_size; }
+
+			/// <summary>
+			/// マップ済みか
+			/// </summary>
+			bool IsValid() const { return m_pBase != nullptr; }
+
+		private:
+			void* m_pBase = nullptr;
+			std::size_t m_delta = 0;
+			std::size_t m_size = 0;
+		};
+
+		/// <summary>
+		/// 読み込み専用でメモリマップするファイル
+		/// <para>x86 環境ではアドレス空間が限られるため、ファイル全体ではなく必要な範囲をビューとしてマップします。</para>
+		/// </summary>
+		class MappedFile final
+		{
+		public:
+			MappedFile() = default;
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			MappedFile(MappedFile&& other)
+				: m_hFile(other.m_hFile), m_hMapping(other.m_hMapping), m_size(other.m_size)
+			{
+				other.m_hFile = INVALID_HANDLE_VALUE;
+				other.m_hMapping = nullptr;
+				other.m_size = 0;
+			}
+
+			MappedFile& operator=(MappedFile&& other)
+			{
+				if (this != &other) {
+					Close();
+					m_hFile = other.m_hFile;
+					m_hMapping = other.m_hMapping;
+					m_size = other.m_size;
+					other.m_hFile = INVALID_HANDLE_VALUE;
+					other.m_hMapping = nullptr;
+					other.m_size = 0;
+				}
+				return *this;
+			}
+
+			~MappedFile() { Close(); }
+
+			/// <summary>
+			/// ファイルを開いてファイルマッピングを作成します
+			/// </summary>
+			/// <param name="pFileName">ファイル名</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			bool Open(const char* pFileName)
+			{
+				Close();
+
+				m_hFile = ::CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+					nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+				if (m_hFile == INVALID_HANDLE_VALUE) {
+					return false;
+				}
+
+				LARGE_INTEGER size = {};
+				if (!::GetFileSizeEx(m_hFile, &size) || size.QuadPart <= 0) {
+					Close();
+					return false;
+				}
+				m_size = static_cast<unsigned long long>(size.QuadPart);
+
+				m_hMapping = ::CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (m_hMapping == nullptr) {
+					Close();
+					return false;
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// ファイルを閉じます
+			/// <para>作成済みのビューはファイルを閉じた後も有効です。</para>
+			/// </summary>
+			void Close()
+			{
+				if (m_hMapping != nullptr) {
+					::CloseHandle(m_hMapping);
+					m_hMapping = nullptr;
+				}
+				if (m_hFile != INVALID_HANDLE_VALUE) {
+					::CloseHandle(m_hFile);
+					m_hFile = INVALID_HANDLE_VALUE;
+				}
+				m_size = 0;
+			}
+
+			/// <summary>
+			/// ファイルを開いているか
+			/// </summary>
+			bool IsOpen() const { return m_hMapping != nullptr; }
+
+			/// <summary>
+			/// ファイルサイズ
+			/// </summary>
+			unsigned long long GetSize() const { return m_size; }
+
+			/// <summary>
+			/// 指定した範囲をマップします
+			/// <para>範囲がファイル末尾を超える場合は、末尾までに切り詰めます。</para>
+			/// </summary>
+			/// <param name="offset">ファイル先頭からのオフセット</param>
+			/// <param name="size">マップするバイト数</param>
+			/// <returns>
+			/// ビュー (失敗した場合は IsValid() が false)
+			/// </returns>
+			MappedView Map(unsigned long long offset, std::size_t size) const
+			{
+				if (!IsOpen() || offset >= m_size || size == 0) {
+					return MappedView();
+				}
+				if (size > m_size - offset) {
+					size = static_cast<std::size_t>(m_size - offset);
+				}
+
+				const unsigned long long granularity = GetAllocationGranularity();
+				const unsigned long long base = offset - (offset % granularity);
+				const std::size_t delta = static_cast<std::size_t>(offset - base);
+
+				void* pBase = ::MapViewOfFile(m_hMapping, FILE_MAP_READ,
+					static_cast<DWORD>(base >> 32), static_cast<DWORD>(base & 0xFFFFFFFFull), delta + size);
+				if (pBase == nullptr) {
+					return MappedView();
+				}
+				return MappedView(pBase, delta, size);
+			}
+
+			/// <summary>
+			/// ビューのオフセットに使用するアロケーション粒度を取得します
+			/// </summary>
+			static unsigned long long GetAllocationGranularity()
+			{
+				static const unsigned long long granularity = []() {
+					SYSTEM_INFO info = {};
+					::GetSystemInfo(&info);
+					return static_cast<unsigned long long>(info.dwAllocationGranularity);
+				}();
+				return granularity;
+			}
+
+		private:
+			HANDLE m_hFile = INVALID_HANDLE_VALUE;
+			HANDLE m_hMapping = nullptr;
+			unsigned long long m_size = 0;
+		};
+
+		/// <summary>
+		/// MappedFile 上を移動する固定サイズのマップ窓
+		/// <para>要求範囲が現在の窓に収まっていれば再マップせずにポインタを返すため、連続アクセスでのマップ回数を抑えます。</para>
+		/// </summary>
+		class MappedWindow final
+		{
+		public:
+			/// <summary>
+			/// 既定の窓サイズ (4MB)
+			/// <para>x86 のプロセスではアドレス空間が 2GB 程度しかなく、窓はファイルを開いている間保持されるため、小さめにしています。</para>
+			/// </summary>
+			enum : std::size_t { DefaultWindowSize = 4 * 1024 * 1024 };
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="windowSize">窓サイズ (要求範囲の方が大きい場合は要求範囲に合わせます)</param>
+			explicit MappedWindow(std::size_t windowSize = DefaultWindowSize)
+				: m_windowSize(windowSize) {}
+
+			/// <summary>
+			/// 指定した範囲のデータへのポインタを取得します
+			/// <para>ポインタは次に Get() または Reset() を呼ぶまで有効です。</para>
+			/// </summary>
+			/// <param name="file">マップ元のファイル</param>
+			/// <param name="offset">ファイル先頭からのオフセット</param>
+			/// <param name="size">必要なバイト数</param>
+			/// <returns>
+			/// データへのポインタ (NULLなら失敗、またはファイル末尾を超える範囲)
+			/// </returns>
+			const unsigned char* Get(const MappedFile& file, unsigned long long offset, std::size_t size)
+			{
+				if (offset + size > file.GetSize()) {
+					return nullptr;
+				}
+				if (!m_view.IsValid() || offset < m_offset || offset + size > m_offset + m_view.GetSize()) {
+					m_view = file.Map(offset, size > m_windowSize ? size : m_windowSize);
+					m_offset = offset;
+					if (!m_view.IsValid() || m_view.GetSize() < size) {
+						m_view.Reset();
+						return nullptr;
+					}
+				}
+				return m_view.GetData() + static_cast<std::size_t>(offset - m_offset);
+			}
+
+			/// <summary>
+			/// 窓をアンマップします
+			/// </summary>
+			void Reset() { m_view.Reset(); }
+
+		private:
+			MappedView m_view;
+			unsigned long long m_offset = 0;
+			std::size_t m_windowSize;
+		};
+	}
+}
@@ -0,0 +1,72 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// FOURCC 定義
+		/// <para>BitmapInfoHeader::biCompression や GetVideoEx() の format に指定する値です。</para>
+		/// </summary>
+		namespace FourCC
+		{
+			/// <summary>
+			/// 4文字から FOURCC を作成します (mmioFOURCC と互換)
+			/// </summary>
+			/// <param name="c0">1文字目</param>
+			/// <param name="c1">2文字目</param>
+			/// <param name="c2">3文字目</param>
+			/// <param name="c3">4文字目</param>
+			/// <returns>
+			/// FOURCC
+			/// </returns>
+			constexpr unsigned long Make(char c0, char c1, char c2, char c3)
+			{
+				return static_cast<unsigned long>(static_cast<unsigned char>(c0))
+					| (static_cast<unsigned long>(static_cast<unsigned char>(c1)) << 8)
+					| (static_cast<unsigned long>(static_cast<unsigned char>(c2)) << 16)
+					| (static_cast<unsigned long>(static_cast<unsigned char>(c3)) << 24);
+			}
+
+			/// <summary>
+			/// RGB24bit (BI_RGB)
+			/// </summary>
+			constexpr unsigned long RGB = 0;
+
+			/// <summary>
+			/// YUY2
+			/// </summary>
+			constexpr unsigned long YUY2 = Make('Y', 'U', 'Y', '2');
+
+			/// <summary>
+			/// Pixel_YC 形式 ('Y''C''4''8')
+			/// </summary>
+			constexpr unsigned long YC48 = Make('Y', 'C', '4', '8');
+
+			/// <summary>
+			/// P010 (10bit 4:2:0、Y 平面 + UV 交互平面、上位ビット詰め)
+			/// </summary>
+			constexpr unsigned long P010 = Make('P', '0', '1', '0');
+
+			/// <summary>
+			/// P016 (16bit 4:2:0、Y 平面 + UV 交互平面)
+			/// </summary>
+			constexpr unsigned long P016 = Make('P', '0', '1', '6');
+
+			/// <summary>
+			/// v210 (10bit 4:2:2、6 画素を 32bit x 4 に格納)
+			/// </summary>
+			constexpr unsigned long V210 = Make('v', '2', '1', '0');
+		}
+	}
+}
@@ -0,0 +1,234 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <cstddef>      // std::size_t
+#include <map>          // std::map
+#include <memory>       // std::shared_ptr
+#include <utility>      // std::move
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// デコード済みフレームのキャッシュ
+		/// <para>容量 (バイト数) を超えると、登録されたどのカーソルからも最も遠いフレームから破棄します。</para>
+		/// <para>複数の読み手が別々の位置を読んでも、互いの周辺のフレームを追い出し合わないようにするためのものです。</para>
+		/// <para>容量が 0 ならキャッシュを使用せず、Insert() しても何も保持しません。</para>
+		/// <para>スレッドセーフではありません。呼び出し側で排他してください。</para>
+		/// </summary>
+		class FrameCache final
+		{
+		public:
+			/// <summary>
+			/// フレームのデータ
+			/// </summary>
+			using Frame = std::shared_ptr<const std::vector<unsigned char>>;
+
+			/// <summary>
+			/// 既定の容量 (256MB)
+			/// </summary>
+			enum : std::size_t { DefaultCapacity = 256 * 1024 * 1024 };
+
+			explicit FrameCache(std::size_t capacity = DefaultCapacity)
+				: m_capacity(capacity)
+			{
+			}
+
+			/// <summary>
+			/// 容量を設定します (超えている分はすぐに破棄します)
+			/// </summary>
+			void SetCapacity(std::size_t capacity)
+			{
+				m_capacity = capacity;
+				Evict();
+			}
+
+			/// <summary>
+			/// 容量を取得します
+			/// </summary>
+			std::size_t GetCapacity() const { return m_capacity; }
+
+			/// <summary>
+			/// 使用中のバイト数を取得します
+			/// </summary>
+			std::size_t GetUsage() const { return m_usage; }
+
+			/// <summary>
+			/// キャッシュしているフレーム数を取得します
+			/// </summary>
+			std::size_t GetCount() const { return m_frames.size(); }
+
+			/// <summary>
+			/// フレームを検索します
+			/// </summary>
+			/// <param name="frame">フレーム番号</param>
+			/// <returns>
+			/// フレームのデータ (無ければ nullptr)
+			/// </returns>
+			Frame Find(int frame)
+			{
+				auto it = m_frames.find(frame);
+				if (it == m_frames.end()) {
+					return nullptr;
+				}
+				it->second.LastUse = ++m_clock;
+				return it->second.Data;
+			}
+
+			/// <summary>
+			/// フレームを追加します (既にあれば置き換えます)
+			/// <para>容量が 0 なら何もしません。</para>
+			/// </summary>
+			/// <param name="frame">フレーム番号</param>
+			/// <param name="data">フレームのデータ</param>
+			void Insert(int frame, Frame data)
+			{
+				if (data == nullptr || m_capacity == 0) {
+					return;
+				}
+				Erase(frame);
+				m_usage += data->size();
+				m_frames[frame] = Entry{ std::move(data), ++m_clock };
+				Evict();
+			}
+
+			/// <summary>
+			/// フレームを破棄します
+			/// </summary>
+			void Erase(int frame)
+			{
+				auto it = m_frames.find(frame);
+				if (it != m_frames.end()) {
+					m_usage -= it->second.Data->size();
+					m_frames.erase(it);
+				}
+			}
+
+			/// <summary>
+			/// 全てのフレームを破棄します
+			/// </summary>
+			void Clear()
+			{
+				m_frames.clear();
+				m_usage = 0;
+			}
+
+			/// <summary>
+			/// カーソル (読み手の現在位置) を追加します
+			/// </summary>
+			/// <returns>
+			/// カーソルの識別子
+			/// </returns>
+			int AddCursor()
+			{
+				const int id = ++m_lastCursorId;
+				m_cursors[id] = -1;
+				return id;
+			}
+
+			/// <summary>
+			/// カーソルを削除します
+			/// </summary>
+			void RemoveCursor(int id) { m_cursors.erase(id); }
+
+			/// <summary>
+			/// カーソルの位置を更新します
+			/// </summary>
+			/// <param name="id">カーソルの識別子</param>
+			/// <param name="frame">読み手が最後に読んだフレーム番号</param>
+			void SetCursor(int id, int frame)
+			{
+				auto it = m_cursors.find(id);
+				if (it != m_cursors.end()) {
+					it->second = frame;
+				}
+			}
+
+			/// <summary>
+			/// カーソルの位置を取得します
+			/// </summary>
+			/// <returns>
+			/// 最後に読んだフレーム番号 (まだ読んでいなければ -1)
+			/// </returns>
+			int GetCursor(int id) const
+			{
+				auto it = m_cursors.find(id);
+				return it != m_cursors.end() ? it->second : -1;
+			}
+
+		private:
+			struct Entry final
+			{
+				Frame Data;
+				unsigned long long LastUse;
+			};
+
+			/// <summary>
+			/// 最も近いカーソルまでの距離を取得します (カーソルが無ければ 0)
+			/// </summary>
+			long long GetDistance(int frame) const
+			{
+				long long nearest = -1;
+				for (const auto& cursor : m_cursors) {
+					if (cursor.second < 0) {
+						continue;
+					}
+					const long long distance = frame > cursor.second ? static_cast<long long>(frame) - cursor.second : static_cast<long long>(cursor.second) - frame;
+					if (nearest < 0 || distance < nearest) {
+						nearest = distance;
+					}
+				}
+				return nearest < 0 ? 0 : nearest;
+			}
+
+			/// <summary>
+			/// 容量を超えている間、最も遠い (同じなら最も古い) フレームを破棄します
+			/// <para>直近に追加したフレームは 1 つだけなら容量を超えていても残します。容量が 0 なら全て破棄します。</para>
+			/// </summary>
+			void Evict()
+			{
+				if (m_capacity == 0) {
+					Clear();
+					return;
+				}
+				while (m_usage > m_capacity && m_frames.size() > 1) {
+					auto victim = m_frames.end();
+					long long victimDistance = -1;
+					for (auto it = m_frames.begin(); it != m_frames.end(); ++it) {
+						if (it->second.LastUse == m_clock) {
+							continue;
+						}
+						const long long distance = GetDistance(it->first);
+						if (distance > victimDistance || (distance == victimDistance && it->second.LastUse < victim->second.LastUse)) {
+							victim = it;
+							victimDistance = distance;
+						}
+					}
+					if (victim == m_frames.end()) {
+						break;
+					}
+					m_usage -= victim->second.Data->size();
+					m_frames.erase(victim);
+				}
+			}
+
+			std::map<int, Entry> m_frames;
+			std::map<int, int> m_cursors;
+			std::size_t m_capacity;
+			std::size_t m_usage = 0;
+			unsigned long long m_clock = 0;
+			int m_lastCursorId = 0;
+		};
+	}
+}
@@ -0,0 +1,259 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include "File.h"
+#include "Sha1.h"
+#include <windows.h>
+#include <cstdio>       // std::snprintf, std::sscanf
+#include <cstring>      // std::strcmp, std::strlen
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 実行中の aviutl.exe のバージョン判定
+		/// <para>実行ファイルの SHA-1 を Constants::FileHash::AviUtl と照合してバージョンを判定します。</para>
+		/// <para>ハッシュ値はファイル名・サイズ・最終更新日時をキーとしてキャッシュファイルに保存し、次回以降の起動ではハッシュ計算を省略します。</para>
+		/// </summary>
+		class HostVersion final
+		{
+		public:
+			/// <summary>
+			/// 動作設定
+			/// </summary>
+			struct Settings final
+			{
+				/// <summary>
+				/// キャッシュファイル名 (空なら実行ファイル名に ".sha1" を付けたもの)
+				/// </summary>
+				std::string CacheFileName;
+
+				/// <summary>
+				/// false ならキャッシュファイルを使用しない
+				/// </summary>
+				bool UseCache = true;
+			};
+
+			/// <summary>
+			/// 動作設定を取得します
+			/// <para>Get() を初めて呼び出す前に変更してください。</para>
+			/// </summary>
+			/// <returns>
+			/// 動作設定の参照
+			/// </returns>
+			static Settings& GetSettings()
+			{
+				static Settings settings;
+				return settings;
+			}
+
+			/// <summary>
+			/// 実行中のホスト (aviutl.exe) のバージョンを取得します
+			/// <para>初回呼び出し時に判定し、以降は同じ結果を返します。</para>
+			/// </summary>
+			static const HostVersion& Get()
+			{
+				static const HostVersion version = []() {
+					HostVersion result;
+					char fileName[MAX_PATH] = {};
+					const DWORD length = ::GetModuleFileNameA(nullptr, fileName, MAX_PATH);
+					if (length > 0 && length < MAX_PATH) {
+						const Settings& settings = GetSettings();
+						const std::string cacheFileName = settings.CacheFileName.empty() ? std::string(fileName) + ".sha1" : settings.CacheFileName;
+						result.Detect(fileName, settings.UseCache ? cacheFileName.c_str() : nullptr);
+					}
+					return result;
+				}();
+				return version;
+			}
+
+			/// <summary>
+			/// 指定したファイルのバージョンを判定します
+			/// </summary>
+			/// <param name="pFileName">aviutl.exe のファイル名</param>
+			/// <param name="pCacheFileName">キャッシュファイル名 (nullptr ならキャッシュを使用しない)</param>
+			/// <returns>
+			/// true ならハッシュ値を取得できた (既知のバージョンかは IsKnown() で判定します)
+			/// </returns>
+			bool Detect(const char* pFileName, const char* pCacheFileName)
+			{
+				m_hash.clear();
+				m_index = -1;
+
+				FileStamp stamp = {};
+				if (!GetFileStamp(pFileName, &stamp)) {
+					return false;
+				}
+				const std::string key = GetFileKey(pFileName);
+
+				if (pCacheFileName == nullptr || !LoadCache(pCacheFileName, key, stamp)) {
+					if (!ComputeHash(pFileName, &m_hash)) {
+						return false;
+					}
+					if (pCacheFileName != nullptr) {
+						SaveCache(pCacheFileName, key, stamp);
+					}
+				}
+
+				const std::size_t count = sizeof(Constants::FileHash::AviUtl) / sizeof(Constants::FileHash::AviUtl[0]);
+				for (std::size_t i = 0; i < count; ++i) {
+					if (m_hash == Constants::FileHash::AviUtl[i].second) {
+						m_index = static_cast<int>(i);
+						break;
+					}
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// SHA-1 ハッシュ値 (小文字の16進数文字列、取得できなかった場合は空)
+			/// </summary>
+			const std::string& GetHash() const { return m_hash; }
+
+			/// <summary>
+			/// Constants::FileHash::AviUtl に含まれるバージョンか
+			/// </summary>
+			bool IsKnown() const { return m_index >= 0; }
+
+			/// <summary>
+			/// Constants::FileHash::AviUtl のインデックス (未知のバージョンなら -1)
+			/// </summary>
+			int GetIndex() const { return m_index; }
+
+			/// <summary>
+			/// バージョン名 ("1.10" など、未知のバージョンなら nullptr)
+			/// </summary>
+			const char* GetVersion() const { return IsKnown() ? Constants::FileHash::AviUtl[m_index].first : nullptr; }
+
+			/// <summary>
+			/// 指定したバージョン以降か調べます
+			/// <para>バージョンに依存する機能を切り替える際に使用します。未知のバージョンでは false を返すため、SystemInfo::Build と併用してください。</para>
+			/// </summary>
+			/// <param name="pVersion">Constants::FileHash::AviUtl に含まれるバージョン名 ("1.00" など)</param>
+			/// <returns>
+			/// true なら指定したバージョン以降
+			/// </returns>
+			bool IsAtLeast(const char* pVersion) const
+			{
+				if (!IsKnown()) {
+					return false;
+				}
+				for (int i = 0; i <= m_index; ++i) {
+					if (std::strcmp(Constants::FileHash::AviUtl[i].first, pVersion) == 0) {
+						return true;
+					}
+				}
+				return false;
+			}
+
+			/// <summary>
+			/// ファイルの SHA-1 ハッシュ値を計算します
+			/// <para>ファイルをメモリマップし、一定サイズのビュー単位で読み込みます。</para>
+			/// </summary>
+			/// <param name="pFileName">ファイル名</param>
+			/// <param name="pHash">ハッシュ値 (小文字の16進数文字列) を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			static bool ComputeHash(const char* pFileName, std::string* pHash)
+			{
+				enum : std::size_t { ViewSize = 16 * 1024 * 1024 };
+
+				MappedFile file;
+				if (!file.Open(pFileName)) {
+					return false;
+				}
+
+				Sha1 sha1;
+				for (unsigned long long offset = 0; offset < file.GetSize(); offset += ViewSize) {
+					const MappedView view = file.Map(offset, ViewSize);
+					if (!view.IsValid()) {
+						return false;
+					}
+					sha1.Update(view.GetData(), view.GetSize());
+				}
+				*pHash = Sha1::ToHex(sha1.Finish());
+				return true;
+			}
+
+		private:
+			/// <summary>
+			/// キャッシュファイルから一致するハッシュ値を読み込みます
+			/// <para>1 行に 1 ファイル分を "ファイル名\tサイズ\t最終更新日時\tハッシュ値" の形式で保存しています。</para>
+			/// </summary>
+			bool LoadCache(const char* pCacheFileName, const std::string& key, const FileStamp& stamp)
+			{
+				std::vector<unsigned char> data;
+				if (!ReadFileAll(pCacheFileName, &data)) {
+					return false;
+				}
+
+				std::string line;
+				for (std::size_t begin = 0; begin < data.size();) {
+					std::size_t end = begin;
+					while (end < data.size() && data[end] != '\n') {
+						++end;
+					}
+					line.assign(data.begin() + begin, data.begin() + end);
+					begin = end + 1;
+
+					const std::size_t tab = line.find('\t');
+					if (tab == std::string::npos || line.compare(0, tab, key) != 0) {
+						continue;
+					}
+					FileStamp cached = {};
+					char hash[41] = {};
+					if (std::sscanf(line.c_str() + tab + 1, "%llu\t%llu\t%40s", &cached.Size, &cached.WriteTime, hash) == 3
+						&& cached == stamp && std::strlen(hash) == 40) {
+						m_hash = hash;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			/// <summary>
+			/// キャッシュファイルにハッシュ値を保存します (同じファイル名の行は置き換えます)
+			/// </summary>
+			void SaveCache(const char* pCacheFileName, const std::string& key, const FileStamp& stamp) const
+			{
+				std::string text;
+				std::vector<unsigned char> data;
+				if (ReadFileAll(pCacheFileName, &data)) {
+					for (std::size_t begin = 0; begin < data.size();) {
+						std::size_t end = begin;
+						while (end < data.size() && data[end] != '\n') {
+							++end;
+						}
+						const std::string line(data.begin() + begin, data.begin() + end);
+						begin = end + 1;
+						if (!line.empty() && line.compare(0, line.find('\t'), key) != 0) {
+							text += line + '\n';
+						}
+					}
+				}
+
+				char buffer[128] = {};
+				std::snprintf(buffer, sizeof(buffer), "\t%llu\t%llu\t", stamp.Size, stamp.WriteTime);
+				text += key + buffer + m_hash + '\n';
+				WriteFileAtomically(pCacheFileName, text.data(), text.size());
+			}
+
+			std::string m_hash;
+			int m_index = -1;
+		};
+	}
+}
@@ -0,0 +1,717 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "Inflate.h"
+#include <algorithm>    // std::min, std::max
+#include <cstddef>      // std::size_t
+#include <cstring>      // std::memcmp, std::memcpy
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// デコードした画像
+		/// </summary>
+		struct DecodedImage final
+		{
+			/// <summary>
+			/// 幅
+			/// </summary>
+			int Width = 0;
+
+			/// <summary>
+			/// 高さ
+			/// </summary>
+			int Height = 0;
+
+			/// <summary>
+			/// 画素 (BGRA 各8bit、上の行から順に隙間なく格納)
+			/// </summary>
+			std::vector<unsigned char> Pixels;
+
+			/// <summary>
+			/// true なら有効なアルファ値を持つ
+			/// </summary>
+			bool HasAlpha = false;
+		};
+
+		/// <summary>
+		/// 画像のデコード
+		/// <para>BMP / TGA / PNG に対応します。外部ライブラリや GDI+ に依存しないため、スレッドから並列に呼び出せます。</para>
+		/// <para>メモリ上のデータのみを扱い、標準ライブラリ以外に依存しません。ファイルからの読み込みは ImageFile.h の LoadFile() を使用します。</para>
+		/// </summary>
+		namespace ImageDecoder
+		{
+			/// <summary>
+			/// 内部実装
+			/// </summary>
+			namespace Detail
+			{
+				inline unsigned int ReadLE16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+				inline unsigned int ReadLE32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<unsigned int>(p[3]) << 24); }
+				inline unsigned int ReadBE16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+				inline unsigned int ReadBE32(const unsigned char* p) { return (static_cast<unsigned int>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+				/// <summary>
+				/// 画像のサイズを確認して画素バッファを確保します
+				/// </summary>
+				inline bool Allocate(DecodedImage* pImage, long long width, long long height)
+				{
+					// 不正なヘッダによる巨大な確保を防ぎます (最大 2^28 画素)
+					if (width <= 0 || height <= 0 || width > 65535 || height > 65535 || width * height > (1ll << 28)) {
+						return false;
+					}
+					pImage->Width = static_cast<int>(width);
+					pImage->Height = static_cast<int>(height);
+					pImage->Pixels.assign(static_cast<std::size_t>(width * height) * 4, 0);
+					pImage->HasAlpha = false;
+					return true;
+				}
+
+				/// <summary>
+				/// ビットマスクで表された成分を 8bit に変換します
+				/// </summary>
+				inline unsigned char ExtractMasked(unsigned int value, unsigned int mask)
+				{
+					if (mask == 0) {
+						return 0;
+					}
+					int shift = 0;
+					while ((mask & 1) == 0) {
+						mask >>= 1;
+						++shift;
+					}
+					const unsigned int component = (value >> shift) & mask;
+					return static_cast<unsigned char>((component * 255 + mask / 2) / mask);
+				}
+
+				/// <summary>
+				/// PNG の 1 行のフィルタを解除します
+				/// </summary>
+				/// <param name="pRow">フィルタ種別の次から始まる行</param>
+				/// <param name="pPrevious">前の行 (先頭行なら nullptr)</param>
+				/// <param name="rowSize">行のバイト数</param>
+				/// <param name="pixelSize">1画素のバイト数 (1 未満は 1)</param>
+				/// <param name="filter">フィルタ種別</param>
+				inline bool Unfilter(unsigned char* pRow, const unsigned char* pPrevious, std::size_t rowSize, std::size_t pixelSize, int filter)
+				{
+					switch (filter) {
+					case 0:
+						break;
+					case 1:
+						for (std::size_t i = pixelSize; i < rowSize; ++i) {
+							pRow[i] = static_cast<unsigned char>(pRow[i] + pRow[i - pixelSize]);
+						}
+						break;
+					case 2:
+						if (pPrevious != nullptr) {
+							for (std::size_t i = 0; i < rowSize; ++i) {
+								pRow[i] = static_cast<unsigned char>(pRow[i] + pPrevious[i]);
+							}
+						}
+						break;
+					case 3:
+						for (std::size_t i = 0; i < rowSize; ++i) {
+							const int left = i >= pixelSize ? pRow[i - pixelSize] : 0;
+							const int up = pPrevious != nullptr ? pPrevious[i] : 0;
+							pRow[i] = static_cast<unsigned char>(pRow[i] + ((left + up) >> 1));
+						}
+						break;
+					case 4:
+						for (std::size_t i = 0; i < rowSize; ++i) {
+							const int a = i >= pixelSize ? pRow[i - pixelSize] : 0;
+							const int b = pPrevious != nullptr ? pPrevious[i] : 0;
+							const int c = i >= pixelSize && pPrevious != nullptr ? pPrevious[i - pixelSize] : 0;
+							const int p = a + b - c;
+							const int pa = p > a ? p - a : a - p;
+							const int pb = p > b ? p - b : b - p;
+							const int pc = p > c ? p - c : c - p;
+							const int predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+							pRow[i] = static_cast<unsigned char>(pRow[i] + predictor);
+						}
+						break;
+					default:
+						return false;
+					}
+					return true;
+				}
+			}
+
+			/// <summary>
+			/// BMP をデコードします
+			/// <para>1 / 4 / 8 / 16 / 24 / 32bit の非圧縮 (BI_RGB / BI_BITFIELDS) に対応します。</para>
+			/// </summary>
+			/// <param name="pData">ファイルの内容</param>
+			/// <param name="size">ファイルのバイト数</param>
+			/// <param name="pImage">デコードした画像を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool DecodeBmp(const unsigned char* pData, std::size_t size, DecodedImage* pImage)
+			{
+				using namespace Detail;
+
+				if (size < 14 + 12 || pData[0] != 'B' || pData[1] != 'M') {
+					return false;
+				}
+				const std::size_t bitsOffset = ReadLE32(pData + 10);
+				const std::size_t headerSize = ReadLE32(pData + 14);
+				if (headerSize < 12 || 14 + headerSize > size) {
+					return false;
+				}
+				const unsigned char* pHeader = pData + 14;
+
+				long long width, height;
+				int bitCount;
+				unsigned int compression = 0;
+				std::size_t colorNum = 0;
+				std::size_t paletteEntrySize = 4;
+				if (headerSize == 12) {
+					// BITMAPCOREHEADER
+					width = ReadLE16(pHeader + 4);
+					height = static_cast<short>(ReadLE16(pHeader + 6));
+					bitCount = static_cast<int>(ReadLE16(pHeader + 10));
+					paletteEntrySize = 3;
+				}
+				else {
+					if (headerSize < 40) {
+						return false;
+					}
+					width = static_cast<int>(ReadLE32(pHeader + 4));
+					height = static_cast<int>(ReadLE32(pHeader + 8));
+					bitCount = static_cast<int>(ReadLE16(pHeader + 14));
+					compression = ReadLE32(pHeader + 16);
+					colorNum = ReadLE32(pHeader + 32);
+				}
+
+				const bool topDown = height < 0;
+				if (topDown) {
+					height = -height;
+				}
+
+				// ビットマスク (BI_BITFIELDS = 3 / BI_ALPHABITFIELDS = 6)
+				unsigned int masks[4] = {};
+				std::size_t paletteOffset = 14 + headerSize;
+				if (compression == 3 || compression == 6) {
+					const std::size_t maskNum = compression == 6 ? 4 : 3;
+					const unsigned char* pMask = pHeader + 40;
+					if (headerSize != 40 && headerSize < 40 + maskNum * 4) {
+						return false;
+					}
+					if (headerSize == 40) {
+						// マスクはヘッダの直後に置かれます
+						paletteOffset += maskNum * 4;
+						if (paletteOffset > size) {
+							return false;
+						}
+					}
+					for (std::size_t i = 0; i < maskNum; ++i) {
+						masks[i] = ReadLE32(pMask + i * 4);
+					}
+					if (headerSize >= 56 && compression == 3) {
+						// BITMAPV4HEADER 以降はアルファマスクも含みます
+						masks[3] = ReadLE32(pMask + 12);
+					}
+					if (bitCount != 16 && bitCount != 32) {
+						return false;
+					}
+				}
+				else if (compression != 0) {
+					// RLE / JPEG / PNG 埋め込みは未対応
+					return false;
+				}
+				else if (bitCount == 16) {
+					masks[0] = 0x7C00;
+					masks[1] = 0x03E0;
+					masks[2] = 0x001F;
+				}
+
+				if (bitCount != 1 && bitCount != 4 && bitCount != 8 && bitCount != 16 && bitCount != 24 && bitCount != 32) {
+					return false;
+				}
+				if (!Allocate(pImage, width, height)) {
+					return false;
+				}
+
+				// パレット
+				unsigned char palette[256][4] = {};
+				if (bitCount <= 8) {
+					const std::size_t maxColors = static_cast<std::size_t>(1) << bitCount;
+					if (colorNum == 0 || colorNum > maxColors) {
+						colorNum = maxColors;
+					}
+					if (paletteOffset + colorNum * paletteEntrySize > size) {
+						return false;
+					}
+					for (std::size_t i = 0; i < colorNum; ++i) {
+						const unsigned char* pEntry = pData + paletteOffset + i * paletteEntrySize;
+						palette[i][0] = pEntry[0];
+						palette[i][1] = pEntry[1];
+						palette[i][2] = pEntry[2];
+						palette[i][3] = 255;
+					}
+				}
+
+				const std::size_t stride = ((static_cast<std::size_t>(width) * bitCount + 31) / 32) * 4;
+				if (bitsOffset > size || (size - bitsOffset) / stride < static_cast<std::size_t>(height)) {
+					return false;
+				}
+
+				// BI_RGB の 32bit はアルファが全て 0 なら不透明として扱います
+				bool useAlpha = masks[3] != 0;
+				if (bitCount == 32 && compression == 0) {
+					for (long long y = 0; y < height && !useAlpha; ++y) {
+						const unsigned char* pSrc = pData + bitsOffset + y * stride;
+						for (long long x = 0; x < width; ++x) {
+							if (pSrc[x * 4 + 3] != 0) {
+								useAlpha = true;
+								break;
+							}
+						}
+					}
+				}
+				pImage->HasAlpha = useAlpha;
+
+				for (long long y = 0; y < height; ++y) {
+					const unsigned char* pSrc = pData + bitsOffset + (topDown ? y : height - 1 - y) * stride;
+					unsigned char* pDst = pImage->Pixels.data() + static_cast<std::size_t>(y * width) * 4;
+					for (long long x = 0; x < width; ++x, pDst += 4) {
+						switch (bitCount) {
+						case 1:
+						case 4:
+						case 8:
+						{
+							const std::size_t bit = static_cast<std::size_t>(x) * bitCount;
+							const unsigned int index = (pSrc[bit / 8] >> (8 - bitCount - bit % 8)) & ((1u << bitCount) - 1);
+							std::memcpy(pDst, palette[index], 4);
+							break;
+						}
+						case 16:
+						case 32:
+						{
+							if (bitCount == 32 && compression == 0) {
+								pDst[0] = pSrc[x * 4 + 0];
+								pDst[1] = pSrc[x * 4 + 1];
+								pDst[2] = pSrc[x * 4 + 2];
+								pDst[3] = useAlpha ? pSrc[x * 4 + 3] : 255;
+								break;
+							}
+							const unsigned int value = bitCount == 16 ? ReadLE16(pSrc + x * 2) : ReadLE32(pSrc + x * 4);
+							pDst[0] = ExtractMasked(value, masks[2]);
+							pDst[1] = ExtractMasked(value, masks[1]);
+							pDst[2] = ExtractMasked(value, masks[0]);
+							pDst[3] = useAlpha ? ExtractMasked(value, masks[3]) : 255;
+							break;
+						}
+						default:
+							pDst[0] = pSrc[x * 3 + 0];
+							pDst[1] = pSrc[x * 3 + 1];
+							pDst[2] = pSrc[x * 3 + 2];
+							pDst[3] = 255;
+							break;
+						}
+					}
+				}
+				return true;
+			}
+
+			/// <summary>
+			/// TGA をデコードします
+			/// <para>カラーマップ / トゥルーカラー / グレースケールと、それぞれの RLE 圧縮に対応します。</para>
+			/// </summary>
+			/// <param name="pData">ファイルの内容</param>
+			/// <param name="size">ファイルのバイト数</param>
+			/// <param name="pImage">デコードした画像を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool DecodeTga(const unsigned char* pData, std::size_t size, DecodedImage* pImage)
+			{
+				using namespace Detail;
+
+				if (size < 18) {
+					return false;
+				}
+				const std::size_t idLength = pData[0];
+				const int colorMapType = pData[1];
+				const int imageType = pData[2];
+				const std::size_t mapFirst = ReadLE16(pData + 3);
+				const std::size_t mapLength = ReadLE16(pData + 5);
+				const int mapDepth = pData[7];
+				const long long width = ReadLE16(pData + 12);
+				const long long height = ReadLE16(pData + 14);
+				const int depth = pData[16];
+				const int descriptor = pData[17];
+
+				const int baseType = imageType & ~8;
+				const bool rle = (imageType & 8) != 0;
+				if (baseType != 1 && baseType != 2 && baseType != 3) {
+					return false;
+				}
+				if (baseType == 1 ? (colorMapType != 1 || depth != 8) : baseType == 2 ? (depth != 15 && depth != 16 && depth != 24 && depth != 32) : depth != 8) {
+					return false;
+				}
+				if (!Allocate(pImage, width, height)) {
+					return false;
+				}
+
+				// 1画素を BGRA に変換します
+				const auto toBgra = [](const unsigned char* pSrc, int bits, unsigned char* pDst)
+				{
+					switch (bits) {
+					case 8:
+						pDst[0] = pDst[1] = pDst[2] = pSrc[0];
+						pDst[3] = 255;
+						break;
+					case 15:
+					case 16:
+					{
+						const unsigned int value = ReadLE16(pSrc);
+						pDst[0] = static_cast<unsigned char>(((value & 0x1F) * 255 + 15) / 31);
+						pDst[1] = static_cast<unsigned char>((((value >> 5) & 0x1F) * 255 + 15) / 31);
+						pDst[2] = static_cast<unsigned char>((((value >> 10) & 0x1F) * 255 + 15) / 31);
+						pDst[3] = 255;
+						break;
+					}
+					case 24:
+						pDst[0] = pSrc[0];
+						pDst[1] = pSrc[1];
+						pDst[2] = pSrc[2];
+						pDst[3] = 255;
+						break;
+					default:
+						std::memcpy(pDst, pSrc, 4);
+						break;
+					}
+				};
+
+				std::size_t offset = 18 + idLength;
+
+				// カラーマップ
+				std::vector<unsigned char> colorMap;
+				if (colorMapType == 1) {
+					const std::size_t entrySize = (mapDepth + 7) / 8;
+					if (mapDepth != 15 && mapDepth != 16 && mapDepth != 24 && mapDepth != 32) {
+						return false;
+					}
+					if (offset + mapLength * entrySize > size) {
+						return false;
+					}
+					if (baseType == 1) {
+						colorMap.resize((mapFirst + mapLength) * 4, 0);
+						for (std::size_t i = 0; i < mapLength; ++i) {
+							toBgra(pData + offset + i * entrySize, mapDepth, colorMap.data() + (mapFirst + i) * 4);
+						}
+					}
+					offset += mapLength * entrySize;
+				}
+
+				const std::size_t pixelSize = (depth + 7) / 8;
+				const std::size_t pixelNum = static_cast<std::size_t>(width * height);
+				const bool useAlpha = (baseType == 1 ? mapDepth : depth) == 32 && (descriptor & 0x0F) != 0;
+				const bool rightToLeft = (descriptor & 0x10) != 0;
+				const bool topDown = (descriptor & 0x20) != 0;
+
+				// 画素の読み込み位置 (RLE は繰り返しパケットの間、同じ画素を指します)
+				std::size_t packetRest = 0;
+				bool packetRepeat = false;
+				const unsigned char* pPixel = nullptr;
+				for (std::size_t i = 0; i < pixelNum; ++i) {
+					if (rle) {
+						if (packetRest == 0) {
+							if (offset >= size) {
+								return false;
+							}
+							const unsigned char packet = pData[offset++];
+							packetRepeat = (packet & 0x80) != 0;
+							packetRest = (packet & 0x7F) + 1;
+							pPixel = nullptr;
+						}
+						if (!packetRepeat || pPixel == nullptr) {
+							if (offset + pixelSize > size) {
+								return false;
+							}
+							pPixel = pData + offset;
+							offset += pixelSize;
+						}
+						--packetRest;
+					}
+					else {
+						if (offset + pixelSize > size) {
+							return false;
+						}
+						pPixel = pData + offset;
+						offset += pixelSize;
+					}
+
+					const std::size_t x = i % static_cast<std::size_t>(width);
+					const std::size_t y = i / static_cast<std::size_t>(width);
+					const std::size_t dstX = rightToLeft ? static_cast<std::size_t>(width) - 1 - x : x;
+					const std::size_t dstY = topDown ? y : static_cast<std::size_t>(height) - 1 - y;
+					unsigned char* pDst = pImage->Pixels.data() + (dstY * static_cast<std::size_t>(width) + dstX) * 4;
+					if (baseType == 1) {
+						const std::size_t index = pPixel[0];
+						if ((index + 1) * 4 > colorMap.size()) {
+							return false;
+						}
+						std::memcpy(pDst, colorMap.data() + index * 4, 4);
+					}
+					else {
+						toBgra(pPixel, depth, pDst);
+					}
+					if (!useAlpha) {
+						pDst[3] = 255;
+					}
+				}
+				pImage->HasAlpha = useAlpha;
+				return true;
+			}
+
+			/// <summary>
+			/// PNG をデコードします
+			/// <para>全てのカラータイプとビット深度、インターレース (Adam7) に対応します。16bit は上位 8bit を使用します。</para>
+			/// </summary>
+			/// <param name="pData">ファイルの内容</param>
+			/// <param name="size">ファイルのバイト数</param>
+			/// <param name="pImage">デコードした画像を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool DecodePng(const unsigned char* pData, std::size_t size, DecodedImage* pImage)
+			{
+				using namespace Detail;
+
+				static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+				if (size < 8 || std::memcmp(pData, signature, 8) != 0) {
+					return false;
+				}
+
+				long long width = 0, height = 0;
+				int bitDepth = 0, colorType = -1, interlace = 0;
+				unsigned char palette[256][4] = {};
+				std::size_t paletteNum = 0;
+				bool hasTransparentKey = false;
+				unsigned int transparentKey[3] = {};
+				bool hasPaletteAlpha = false;
+				std::vector<unsigned char> compressed;
+
+				// チャンク
+				std::size_t offset = 8;
+				bool end = false;
+				while (!end) {
+					if (size - offset < 12) {
+						return false;
+					}
+					const std::size_t length = ReadBE32(pData + offset);
+					const unsigned char* pType = pData + offset + 4;
+					const unsigned char* pChunk = pData + offset + 8;
+					if (length > size - offset - 12) {
+						return false;
+					}
+					offset += 12 + length;
+
+					if (std::memcmp(pType, "IHDR", 4) == 0) {
+						if (length < 13) {
+							return false;
+						}
+						width = ReadBE32(pChunk);
+						height = ReadBE32(pChunk + 4);
+						bitDepth = pChunk[8];
+						colorType = pChunk[9];
+						interlace = pChunk[12];
+						if (pChunk[10] != 0 || pChunk[11] != 0 || interlace > 1) {
+							return false;
+						}
+					}
+					else if (std::memcmp(pType, "PLTE", 4) == 0) {
+						paletteNum = (std::min)(length / 3, static_cast<std::size_t>(256));
+						for (std::size_t i = 0; i < paletteNum; ++i) {
+							palette[i][0] = pChunk[i * 3 + 2];
+							palette[i][1] = pChunk[i * 3 + 1];
+							palette[i][2] = pChunk[i * 3 + 0];
+							palette[i][3] = 255;
+						}
+					}
+					else if (std::memcmp(pType, "tRNS", 4) == 0) {
+						if (colorType == 3) {
+							for (std::size_t i = 0; i < length && i < 256; ++i) {
+								palette[i][3] = pChunk[i];
+							}
+							hasPaletteAlpha = length > 0;
+						}
+						else if (colorType == 0 && length >= 2) {
+							transparentKey[0] = ReadBE16(pChunk);
+							hasTransparentKey = true;
+						}
+						else if (colorType == 2 && length >= 6) {
+							transparentKey[0] = ReadBE16(pChunk);
+							transparentKey[1] = ReadBE16(pChunk + 2);
+							transparentKey[2] = ReadBE16(pChunk + 4);
+							hasTransparentKey = true;
+						}
+					}
+					else if (std::memcmp(pType, "IDAT", 4) == 0) {
+						compressed.insert(compressed.end(), pChunk, pChunk + length);
+					}
+					else if (std::memcmp(pType, "IEND", 4) == 0) {
+						end = true;
+					}
+					else if ((pType[0] & 0x20) == 0) {
+						// 未知の必須チャンク
+						return false;
+					}
+				}
+
+				int channels;
+				switch (colorType) {
+				case 0: channels = 1; break;
+				case 2: channels = 3; break;
+				case 3: channels = 1; break;
+				case 4: channels = 2; break;
+				case 6: channels = 4; break;
+				default: return false;
+				}
+				const bool validDepth = colorType == 0 ? (bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16)
+					: colorType == 3 ? (bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8)
+					: (bitDepth == 8 || bitDepth == 16);
+				if (!validDepth || (colorType == 3 && paletteNum == 0)) {
+					return false;
+				}
+				if (!Allocate(pImage, width, height)) {
+					return false;
+				}
+
+				// インターレースのパス (開始位置と間隔)
+				static const int passes[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+				static const int progressive[1][4] = { { 0, 0, 1, 1 } };
+				const int (*pPasses)[4] = interlace != 0 ? passes : progressive;
+				const int passNum = interlace != 0 ? 7 : 1;
+
+				const std::size_t bitsPerPixel = static_cast<std::size_t>(channels) * bitDepth;
+				const std::size_t pixelSize = (std::max)(bitsPerPixel / 8, static_cast<std::size_t>(1));
+				std::size_t expectedSize = 0;
+				for (int pass = 0; pass < passNum; ++pass) {
+					const long long passWidth = (width - pPasses[pass][0] + pPasses[pass][2] - 1) / pPasses[pass][2];
+					const long long passHeight = (height - pPasses[pass][1] + pPasses[pass][3] - 1) / pPasses[pass][3];
+					if (passWidth > 0 && passHeight > 0) {
+						expectedSize += static_cast<std::size_t>(passHeight) * (1 + (static_cast<std::size_t>(passWidth) * bitsPerPixel + 7) / 8);
+					}
+				}
+
+				std::vector<unsigned char> raw;
+				if (!Inflater::InflateZlib(compressed.data(), compressed.size(), &raw, expectedSize) || raw.size() < expectedSize) {
+					return false;
+				}
+
+				const unsigned int maxSample = (1u << bitDepth) - 1;
+				const bool useAlpha = colorType == 4 || colorType == 6 || hasTransparentKey || hasPaletteAlpha;
+				unsigned char* pRaw = raw.data();
+				for (int pass = 0; pass < passNum; ++pass) {
+					const long long passWidth = (width - pPasses[pass][0] + pPasses[pass][2] - 1) / pPasses[pass][2];
+					const long long passHeight = (height - pPasses[pass][1] + pPasses[pass][3] - 1) / pPasses[pass][3];
+					if (passWidth <= 0 || passHeight <= 0) {
+						continue;
+					}
+					const std::size_t rowSize = (static_cast<std::size_t>(passWidth) * bitsPerPixel + 7) / 8;
+					const unsigned char* pPrevious = nullptr;
+					for (long long y = 0; y < passHeight; ++y) {
+						unsigned char* pRow = pRaw + 1;
+						if (!Unfilter(pRow, pPrevious, rowSize, pixelSize, pRaw[0])) {
+							return false;
+						}
+
+						const long long dstY = pPasses[pass][1] + y * pPasses[pass][3];
+						for (long long x = 0; x < passWidth; ++x) {
+							const long long dstX = pPasses[pass][0] + x * pPasses[pass][2];
+							unsigned char* pDst = pImage->Pixels.data() + static_cast<std::size_t>(dstY * width + dstX) * 4;
+
+							// 各サンプルの値 (ビット深度のまま) と 8bit に変換した値
+							unsigned int samples[4] = {};
+							for (int c = 0; c < channels; ++c) {
+								const std::size_t index = static_cast<std::size_t>(x) * channels + c;
+								if (bitDepth == 16) {
+									samples[c] = ReadBE16(pRow + index * 2);
+								}
+								else if (bitDepth == 8) {
+									samples[c] = pRow[index];
+								}
+								else {
+									const std::size_t bit = index * bitDepth;
+									samples[c] = (pRow[bit / 8] >> (8 - bitDepth - bit % 8)) & maxSample;
+								}
+							}
+							const auto to8 = [&](unsigned int sample) {
+								return static_cast<unsigned char>(bitDepth == 16 ? sample >> 8 : sample * 255 / maxSample);
+							};
+
+							switch (colorType) {
+							case 0:
+								pDst[0] = pDst[1] = pDst[2] = to8(samples[0]);
+								pDst[3] = hasTransparentKey && samples[0] == transparentKey[0] ? 0 : 255;
+								break;
+							case 2:
+								pDst[0] = to8(samples[2]);
+								pDst[1] = to8(samples[1]);
+								pDst[2] = to8(samples[0]);
+								pDst[3] = hasTransparentKey && samples[0] == transparentKey[0] && samples[1] == transparentKey[1] && samples[2] == transparentKey[2] ? 0 : 255;
+								break;
+							case 3:
+								if (samples[0] >= paletteNum) {
+									return false;
+								}
+								std::memcpy(pDst, palette[samples[0]], 4);
+								break;
+							case 4:
+								pDst[0] = pDst[1] = pDst[2] = to8(samples[0]);
+								pDst[3] = to8(samples[1]);
+								break;
+							default:
+								pDst[0] = to8(samples[2]);
+								pDst[1] = to8(samples[1]);
+								pDst[2] = to8(samples[0]);
+								pDst[3] = to8(samples[3]);
+								break;
+							}
+						}
+						pPrevious = pRow;
+						pRaw += 1 + rowSize;
+					}
+				}
+				pImage->HasAlpha = useAlpha;
+				return true;
+			}
+
+			/// <summary>
+			/// 先頭のシグネチャから形式を判定して画像をデコードします
+			/// </summary>
+			/// <param name="pData">ファイルの内容</param>
+			/// <param name="size">ファイルのバイト数</param>
+			/// <param name="pImage">デコードした画像を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool Decode(const unsigned char* pData, std::size_t size, DecodedImage* pImage)
+			{
+				if (size >= 8 && pData[0] == 0x89 && pData[1] == 'P' && pData[2] == 'N' && pData[3] == 'G') {
+					return DecodePng(pData, size, pImage);
+				}
+				if (size >= 2 && pData[0] == 'B' && pData[1] == 'M') {
+					return DecodeBmp(pData, size, pImage);
+				}
+				// TGA にはシグネチャが無いため最後に試します
+				return DecodeTga(pData, size, pImage);
+			}
+		}
+	}
+}
@@ -0,0 +1,44 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "File.h"
+#include "ImageDecoder.h"
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 画像のデコード
+		/// </summary>
+		namespace ImageDecoder
+		{
+			/// <summary>
+			/// 画像ファイルを読み込んでデコードします
+			/// </summary>
+			/// <param name="pFileName">ファイル名</param>
+			/// <param name="pImage">デコードした画像を格納するポインタ</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			inline bool LoadFile(const char* pFileName, DecodedImage* pImage)
+			{
+				std::vector<unsigned char> data;
+				if (!ReadFileAll(pFileName, &data) || data.empty()) {
+					return false;
+				}
+				return Decode(data.data(), data.size(), pImage);
+			}
+		}
+	}
+}
@@ -0,0 +1,441 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <array>        // std::array
+#include <cstddef>      // std::size_t
+#include <cstring>      // std::memcpy
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// Deflate (RFC 1951) / zlib (RFC 1950) 形式の展開
+		/// <para>PNG などの画像デコードに使用します。外部ライブラリに依存しません。</para>
+		/// </summary>
+		class Inflater final
+		{
+		public:
+			/// <summary>
+			/// zlib 形式のデータを展開します
+			/// <para>Adler-32 チェックサムは検証しません。</para>
+			/// </summary>
+			/// <param name="pSrc">圧縮データ</param>
+			/// <param name="srcSize">圧縮データのバイト数</param>
+			/// <param name="pDst">展開したデータを格納するポインタ (既存の内容は破棄されます)</param>
+			/// <param name="expectedSize">展開後のバイト数の見込み (0 なら不明)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			static bool InflateZlib(const unsigned char* pSrc, std::size_t srcSize, std::vector<unsigned char>* pDst, std::size_t expectedSize = 0)
+			{
+				// CM = 8 (deflate), CINFO <= 7, FCHECK, プリセット辞書なし
+				if (srcSize < 2 || (pSrc[0] & 0x0F) != 8 || (pSrc[0] >> 4) > 7
+					|| ((pSrc[0] << 8) | pSrc[1]) % 31 != 0 || (pSrc[1] & 0x20) != 0) {
+					return false;
+				}
+				return Inflate(pSrc + 2, srcSize - 2, pDst, expectedSize);
+			}
+
+			/// <summary>
+			/// Deflate 形式のデータを展開します
+			/// </summary>
+			/// <param name="pSrc">圧縮データ</param>
+			/// <param name="srcSize">圧縮データのバイト数</param>
+			/// <param name="pDst">展開したデータを格納するポインタ (既存の内容は破棄されます)</param>
+			/// <param name="expectedSize">展開後のバイト数の見込み (0 なら不明)</param>
+			/// <returns>
+			/// true なら成功
+			/// </returns>
+			static bool Inflate(const unsigned char* pSrc, std::size_t srcSize, std::vector<unsigned char>* pDst, std::size_t expectedSize = 0)
+			{
+				State state(pSrc, srcSize, pDst, expectedSize);
+				return state.Run();
+			}
+
+		private:
+			/// <summary>
+			/// ハフマン符号表
+			/// <para>FastBits 以下の符号は表引きし、それより長い符号は正準符号として 1bit ずつ復号します。</para>
+			/// </summary>
+			struct Huffman final
+			{
+				enum { MaxBits = 15, MaxSymbols = 288, FastBits = 10 };
+
+				/// <summary>
+				/// 符号長ごとの符号数
+				/// </summary>
+				std::array<unsigned short, MaxBits + 1> Count;
+
+				/// <summary>
+				/// 符号順に並べたシンボル
+				/// </summary>
+				std::array<unsigned short, MaxSymbols> Symbol;
+
+				/// <summary>
+				/// 高速復号表 ((シンボル &lt;&lt; 4) | 符号長、0 なら低速復号)
+				/// </summary>
+				std::array<unsigned short, 1 << FastBits> Fast;
+
+				/// <summary>
+				/// 符号長の配列から符号表を作成します
+				/// </summary>
+				bool Build(const unsigned char* pLengths, int symbolNum)
+				{
+					Count.fill(0);
+					Fast.fill(0);
+					for (int i = 0; i < symbolNum; ++i) {
+						++Count[pLengths[i]];
+					}
+					if (Count[0] == symbolNum) {
+						// 符号が無い (距離符号が使われないブロックなど)
+						return true;
+					}
+
+					// 過剰な符号割り当ては不正 (不完全な符号は許容)
+					int left = 1;
+					for (int length = 1; length <= MaxBits; ++length) {
+						left = (left << 1) - Count[length];
+						if (left < 0) {
+							return false;
+						}
+					}
+
+					std::array<unsigned short, MaxBits + 1> offset = {};
+					std::array<unsigned short, MaxBits + 1> nextCode = {};
+					for (int length = 1; length < MaxBits; ++length) {
+						offset[length + 1] = static_cast<unsigned short>(offset[length] + Count[length]);
+					}
+					unsigned short code = 0;
+					for (int length = 1; length <= MaxBits; ++length) {
+						nextCode[length] = code;
+						code = static_cast<unsigned short>((code + Count[length]) << 1);
+					}
+
+					for (int symbol = 0; symbol < symbolNum; ++symbol) {
+						const int length = pLengths[symbol];
+						if (length == 0) {
+							continue;
+						}
+						Symbol[offset[length]++] = static_cast<unsigned short>(symbol);
+
+						if (length <= FastBits) {
+							// 符号はMSBから格納されるため、LSBから読むビット列で引けるよう反転します
+							int reversed = 0;
+							int value = nextCode[length];
+							for (int bit = 0; bit < length; ++bit) {
+								reversed = (reversed << 1) | ((value >> bit) & 1);
+							}
+							for (int index = reversed; index < (1 << FastBits); index += 1 << length) {
+								Fast[index] = static_cast<unsigned short>((symbol << 4) | length);
+							}
+						}
+						++nextCode[length];
+					}
+					return true;
+				}
+			};
+
+			/// <summary>
+			/// 展開処理の状態
+			/// </summary>
+			class State final
+			{
+			public:
+				State(const unsigned char* pSrc, std::size_t srcSize, std::vector<unsigned char>* pDst, std::size_t expectedSize)
+					: m_pSrc(pSrc), m_srcSize(srcSize), m_out(*pDst)
+				{
+					m_out.resize(expectedSize > 0 ? expectedSize : srcSize * 4 + 1024);
+				}
+
+				bool Run()
+				{
+					bool last = false;
+					while (!last) {
+						last = GetBits(1) != 0;
+						bool succeeded;
+						switch (GetBits(2)) {
+						case 0: succeeded = Stored(); break;
+						case 1: succeeded = Fixed(); break;
+						case 2: succeeded = Dynamic(); break;
+						default: succeeded = false; break;
+						}
+						if (!succeeded || m_error) {
+							return false;
+						}
+					}
+					m_out.resize(m_outPos);
+					return true;
+				}
+
+			private:
+				/// <summary>
+				/// ビットバッファに n bit 以上を補充します (入力の終端以降は 0 を補います)
+				/// </summary>
+				void Need(int n)
+				{
+					while (m_bitCount < n) {
+						unsigned long long byte = 0;
+						if (m_srcPos < m_srcSize) {
+							byte = m_pSrc[m_srcPos++];
+						}
+						else {
+							m_padBits += 8;
+						}
+						m_bits |= byte << m_bitCount;
+						m_bitCount += 8;
+					}
+				}
+
+				void Consume(int n)
+				{
+					m_bits >>= n;
+					m_bitCount -= n;
+					if (m_bitCount < m_padBits) {
+						// 入力の終端を超えて読んだ
+						m_error = true;
+						m_padBits = m_bitCount;
+					}
+				}
+
+				unsigned int GetBits(int n)
+				{
+					if (n == 0) {
+						return 0;
+					}
+					Need(n);
+					const unsigned int value = static_cast<unsigned int>(m_bits & ((1ull << n) - 1));
+					Consume(n);
+					return value;
+				}
+
+				int Decode(const Huffman& huffman)
+				{
+					Need(Huffman::MaxBits);
+					const unsigned short entry = huffman.Fast[m_bits & ((1 << Huffman::FastBits) - 1)];
+					if (entry != 0) {
+						Consume(entry & 15);
+						return entry >> 4;
+					}
+
+					int code = 0;
+					int first = 0;
+					int index = 0;
+					for (int length = 1; length <= Huffman::MaxBits; ++length) {
+						code |= static_cast<int>(GetBits(1));
+						const int count = huffman.Count[length];
+						if (code - count < first) {
+							return huffman.Symbol[index + (code - first)];
+						}
+						index += count;
+						first = (first + count) << 1;
+						code <<= 1;
+					}
+					return -1;
+				}
+
+				bool Reserve(std::size_t size)
+				{
+					if (m_outPos + size > m_out.size()) {
+						std::size_t capacity = m_out.size() * 2;
+						if (capacity < m_outPos + size) {
+							capacity = m_outPos + size;
+						}
+						m_out.resize(capacity);
+					}
+					return true;
+				}
+
+				bool Stored()
+				{
+					// バイト境界に揃える
+					Consume(m_bitCount & 7);
+					const unsigned int length = GetBits(16);
+					const unsigned int complement = GetBits(16);
+					if (m_error || (length ^ 0xFFFF) != complement) {
+						return false;
+					}
+					Reserve(length);
+
+					// ビットバッファに残っているバイトから使用します
+					unsigned int rest = length;
+					while (rest > 0 && m_bitCount - m_padBits >= 8) {
+						m_out[m_outPos++] = static_cast<unsigned char>(GetBits(8));
+						--rest;
+					}
+					if (m_srcSize - m_srcPos < rest) {
+						return false;
+					}
+					std::memcpy(m_out.data() + m_outPos, m_pSrc + m_srcPos, rest);
+					m_outPos += rest;
+					m_srcPos += rest;
+					return true;
+				}
+
+				bool Codes(const Huffman& literal, const Huffman& distance)
+				{
+					static const unsigned short lengthBase[29] = {
+						3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+					static const unsigned char lengthExtra[29] = {
+						0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+					static const unsigned short distanceBase[30] = {
+						1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+						1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+					static const unsigned char distanceExtra[30] = {
+						0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+					for (;;) {
+						int symbol = Decode(literal);
+						if (symbol < 0 || m_error) {
+							return false;
+						}
+						if (symbol < 256) {
+							Reserve(1);
+							m_out[m_outPos++] = static_cast<unsigned char>(symbol);
+							continue;
+						}
+						if (symbol == 256) {
+							return true;
+						}
+
+						symbol -= 257;
+						if (symbol >= 29) {
+							return false;
+						}
+						const std::size_t length = lengthBase[symbol] + GetBits(lengthExtra[symbol]);
+
+						symbol = Decode(distance);
+						if (symbol < 0 || symbol >= 30) {
+							return false;
+						}
+						const std::size_t dist = distanceBase[symbol] + GetBits(distanceExtra[symbol]);
+						if (dist > m_outPos || m_error) {
+							return false;
+						}
+
+						Reserve(length);
+						unsigned char* pDst = m_out.data() + m_outPos;
+						const unsigned char* pFrom = pDst - dist;
+						if (dist >= length) {
+							std::memcpy(pDst, pFrom, length);
+						}
+						else {
+							// 重なりがある場合は 1 byte ずつ (直前の出力を繰り返す)
+							for (std::size_t i = 0; i < length; ++i) {
+								pDst[i] = pFrom[i];
+							}
+						}
+						m_outPos += length;
+					}
+				}
+
+				bool Fixed()
+				{
+					static const struct Table final {
+						Huffman Literal;
+						Huffman Distance;
+						Table()
+						{
+							unsigned char lengths[Huffman::MaxSymbols];
+							int symbol = 0;
+							for (; symbol < 144; ++symbol) { lengths[symbol] = 8; }
+							for (; symbol < 256; ++symbol) { lengths[symbol] = 9; }
+							for (; symbol < 280; ++symbol) { lengths[symbol] = 7; }
+							for (; symbol < 288; ++symbol) { lengths[symbol] = 8; }
+							Literal.Build(lengths, 288);
+							for (symbol = 0; symbol < 30; ++symbol) { lengths[symbol] = 5; }
+							Distance.Build(lengths, 30);
+						}
+					} table;
+					return Codes(table.Literal, table.Distance);
+				}
+
+				bool Dynamic()
+				{
+					static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+					const int literalNum = static_cast<int>(GetBits(5)) + 257;
+					const int distanceNum = static_cast<int>(GetBits(5)) + 1;
+					const int codeNum = static_cast<int>(GetBits(4)) + 4;
+					if (literalNum > 286 || distanceNum > 30) {
+						return false;
+					}
+
+					unsigned char lengths[286 + 30] = {};
+					for (int i = 0; i < codeNum; ++i) {
+						lengths[order[i]] = static_cast<unsigned char>(GetBits(3));
+					}
+					Huffman lengthCode;
+					if (!lengthCode.Build(lengths, 19)) {
+						return false;
+					}
+
+					int index = 0;
+					while (index < literalNum + distanceNum) {
+						const int symbol = Decode(lengthCode);
+						if (symbol < 0 || m_error) {
+							return false;
+						}
+						if (symbol < 16) {
+							lengths[index++] = static_cast<unsigned char>(symbol);
+							continue;
+						}
+
+						unsigned char value = 0;
+						int repeat;
+						if (symbol == 16) {
+							if (index == 0) {
+								return false;
+							}
+							value = lengths[index - 1];
+							repeat = 3 + static_cast<int>(GetBits(2));
+						}
+						else if (symbol == 17) {
+							repeat = 3 + static_cast<int>(GetBits(3));
+						}
+						else {
+							repeat = 11 + static_cast<int>(GetBits(7));
+						}
+						if (index + repeat > literalNum + distanceNum) {
+							return false;
+						}
+						while (repeat-- > 0) {
+							lengths[index++] = value;
+						}
+					}
+					if (lengths[256] == 0) {
+						// ブロック終端の符号が無い
+						return false;
+					}
+
+					Huffman literal;
+					Huffman distance;
+					if (!literal.Build(lengths, literalNum) || !distance.Build(lengths + literalNum, distanceNum)) {
+						return false;
+					}
+					return Codes(literal, distance);
+				}
+
+				const unsigned char* m_pSrc;
+				std::size_t m_srcSize;
+				std::size_t m_srcPos = 0;
+				unsigned long long m_bits = 0;
+				int m_bitCount = 0;
+				int m_padBits = 0;
+				bool m_error = false;
+				std::vector<unsigned char>& m_out;
+				std::size_t m_outPos = 0;
+			};
+		};
+	}
+}
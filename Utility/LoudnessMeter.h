@@ -0,0 +1,454 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "AudioKernel.h"
+#include "ThreadPool.h"
+#include <algorithm>    // std::min, std::max, std::sort, std::fill, std::copy, std::remove_if
+#include <cmath>        // std::tan, std::pow, std::log10, std::sin, std::sqrt
+#include <limits>       // std::numeric_limits
+#include <vector>       // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// EBU R128 (ITU-R BS.1770-4) のラウドネス測定
+		/// <para>16bit PCM を Add() で順に渡し、統合ラウドネス (LUFS)、ラウドネスレンジ (LU)、トゥルーピーク (dBTP) を取得します。</para>
+		/// <para>K 特性フィルタとトゥルーピーク (4 倍オーバーサンプリング) はチャンネルごとに独立しているため、スレッドプールを指定するとチャンネル単位で並列に処理します。</para>
+		/// <para>1 回の Add() で渡すサンプル数が多いほど、並列化の効率が上がります (1 秒以上を推奨します)。</para>
+		/// </summary>
+		class LoudnessMeter final
+		{
+		public:
+			/// <summary>
+			/// コンストラクタ
+			/// <para>6 チャンネルの場合は 5.1ch (L, R, C, LFE, Ls, Rs) として、LFE を除外しサラウンドに 1.41 の重みを付けます。</para>
+			/// </summary>
+			/// <param name="channels">チャンネル数</param>
+			/// <param name="sampleRate">サンプリングレート</param>
+			/// <param name="pPool">チャンネルごとの処理に使用するスレッドプール (nullptr なら呼び出し元のスレッドで処理します)</param>
+			LoudnessMeter(int channels, int sampleRate, ThreadPool* pPool = nullptr)
+				: m_channels((std::max)(channels, 1)), m_sampleRate((std::max)(sampleRate, 1)), m_pPool(pPool)
+			{
+				m_subBlockSamples = (std::max)((m_sampleRate + 5) / 10, 1);
+				BuildKWeighting();
+				BuildTruePeakFilter();
+				m_states.resize(m_channels);
+				for (int c = 0; c < m_channels; ++c) {
+					m_states[c].Weight = (m_channels == 6) ? ((c == 3) ? 0.0 : (c >= 4 ? 1.41 : 1.0)) : 1.0;
+				}
+				Reset();
+			}
+
+			LoudnessMeter(const LoudnessMeter&) = delete;
+			LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+
+			/// <summary>
+			/// チャンネルの重みを設定します (LFE は 0、サラウンドは 1.41)
+			/// </summary>
+			void SetChannelWeight(int channel, double weight)
+			{
+				if (channel >= 0 && channel < m_channels) {
+					m_states[channel].Weight = weight;
+				}
+			}
+
+			/// <summary>
+			/// 測定結果とフィルタの状態を初期化します
+			/// </summary>
+			void Reset()
+			{
+				for (Channel& state : m_states) {
+					std::fill(state.Filter, state.Filter + 4, 0.0);
+					state.SubBlockSum = 0.0;
+					state.History.assign(TruePeakTaps - 1, 0.0f);
+					state.TruePeak = 0.0f;
+					state.SamplePeak = 0.0f;
+				}
+				m_subBlockPosition = 0;
+				m_recent.assign(ShortTermSubBlocks, 0.0);
+				m_recentCount = 0;
+				m_momentary.clear();
+				m_shortTerm.clear();
+			}
+
+			/// <summary>
+			/// 音声を追加します
+			/// </summary>
+			/// <param name="pSamples">16bit PCM (インターリーブ)</param>
+			/// <param name="frames">フレーム数</param>
+			void Add(const short* pSamples, int frames)
+			{
+				if (frames <= 0) {
+					return;
+				}
+
+				// チャンネルごとに、トゥルーピーク用の履歴の後ろへ float で並べる
+				std::vector<float*> planes(m_channels);
+				for (int c = 0; c < m_channels; ++c) {
+					Channel& state = m_states[c];
+					state.Samples.resize(TruePeakTaps - 1 + static_cast<std::size_t>(frames));
+					std::copy(state.History.begin(), state.History.end(), state.Samples.begin());
+					planes[c] = state.Samples.data() + TruePeakTaps - 1;
+					state.Completed.clear();
+					state.Completed.reserve(frames / m_subBlockSamples + 1);
+				}
+				AudioKernel::Deinterleave(pSamples, frames, m_channels, planes.data());
+
+				const int position = m_subBlockPosition;
+				if (m_pPool != nullptr && m_channels > 1) {
+					m_pPool->ParallelFor(m_channels, [this, frames, position](int c) { ProcessChannel(m_states[c], frames, position); });
+				}
+				else {
+					for (Channel& state : m_states) {
+						ProcessChannel(state, frames, position);
+					}
+				}
+				m_subBlockPosition = (position + frames) % m_subBlockSamples;
+
+				// 100ms ごとのエネルギーをチャンネルの重み付きで合計し、ゲート用のブロックを作る
+				const std::size_t completed = m_states[0].Completed.size();
+				for (std::size_t i = 0; i < completed; ++i) {
+					double energy = 0.0;
+					for (const Channel& state : m_states) {
+						energy += state.Weight * state.Completed[i];
+					}
+					AddSubBlock(energy / m_subBlockSamples);
+				}
+			}
+
+			/// <summary>
+			/// 統合ラウドネス (LUFS) を取得します (測定できない場合は -∞)
+			/// </summary>
+			double GetIntegrated() const
+			{
+				return GatedLoudness(m_momentary, -10.0);
+			}
+
+			/// <summary>
+			/// ラウドネスレンジ (LU) を取得します
+			/// </summary>
+			double GetLoudnessRange() const
+			{
+				const double absoluteEnergy = ToEnergy(AbsoluteGate);
+				std::vector<double> gated;
+				double sum = 0.0;
+				for (const double energy : m_shortTerm) {
+					if (energy > absoluteEnergy) {
+						gated.push_back(energy);
+						sum += energy;
+					}
+				}
+				if (gated.empty()) {
+					return 0.0;
+				}
+				const double relativeEnergy = ToEnergy(ToLoudness(sum / gated.size()) - 20.0);
+				gated.erase(std::remove_if(gated.begin(), gated.end(), [relativeEnergy](double energy) { return energy <= relativeEnergy; }), gated.end());
+				if (gated.empty()) {
+					return 0.0;
+				}
+				std::sort(gated.begin(), gated.end());
+				const std::size_t last = gated.size() - 1;
+				const double low = gated[static_cast<std::size_t>(last * 0.10 + 0.5)];
+				const double high = gated[static_cast<std::size_t>(last * 0.95 + 0.5)];
+				return ToLoudness(high) - ToLoudness(low);
+			}
+
+			/// <summary>
+			/// 直近 400ms のラウドネス (LUFS) を取得します
+			/// </summary>
+			double GetMomentary() const
+			{
+				return m_momentary.empty() ? -std::numeric_limits<double>::infinity() : ToLoudness(m_momentary.back());
+			}
+
+			/// <summary>
+			/// 直近 3 秒のラウドネス (LUFS) を取得します
+			/// </summary>
+			double GetShortTerm() const
+			{
+				return m_shortTerm.empty() ? -std::numeric_limits<double>::infinity() : ToLoudness(m_shortTerm.back());
+			}
+
+			/// <summary>
+			/// トゥルーピーク (dBTP) を取得します
+			/// </summary>
+			/// <param name="channel">チャンネル番号 (負なら全チャンネルの最大)</param>
+			double GetTruePeak(int channel = -1) const
+			{
+				float peak = 0.0f;
+				for (int c = 0; c < m_channels; ++c) {
+					if (channel < 0 || channel == c) {
+						peak = (std::max)(peak, (std::max)(m_states[c].TruePeak, m_states[c].SamplePeak));
+					}
+				}
+				return 20.0 * std::log10(static_cast<double>(peak));
+			}
+
+			/// <summary>
+			/// サンプルピーク (dBFS) を取得します
+			/// </summary>
+			/// <param name="channel">チャンネル番号 (負なら全チャンネルの最大)</param>
+			double GetSamplePeak(int channel = -1) const
+			{
+				float peak = 0.0f;
+				for (int c = 0; c < m_channels; ++c) {
+					if (channel < 0 || channel == c) {
+						peak = (std::max)(peak, m_states[c].SamplePeak);
+					}
+				}
+				return 20.0 * std::log10(static_cast<double>(peak));
+			}
+
+		private:
+			enum : int {
+				/// <summary>
+				/// トゥルーピーク用の補間フィルタの 1 位相あたりのタップ数
+				/// </summary>
+				TruePeakTaps = 12,
+
+				/// <summary>
+				/// 瞬時ラウドネスのブロック長 (100ms 単位)
+				/// </summary>
+				MomentarySubBlocks = 4,
+
+				/// <summary>
+				/// 短時間ラウドネスのブロック長 (100ms 単位)
+				/// </summary>
+				ShortTermSubBlocks = 30,
+			};
+
+			/// <summary>
+			/// 絶対ゲート (LUFS)
+			/// </summary>
+			static constexpr double AbsoluteGate = -70.0;
+
+			/// <summary>
+			/// チャンネルごとの状態
+			/// </summary>
+			struct Channel final
+			{
+				double Weight = 1.0;
+				double Filter[4] = {};
+				double SubBlockSum = 0.0;
+				std::vector<float> History;
+				std::vector<float> Samples;
+				std::vector<double> Completed;
+				float TruePeak = 0.0f;
+				float SamplePeak = 0.0f;
+			};
+
+			static double ToLoudness(double energy)
+			{
+				return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -std::numeric_limits<double>::infinity();
+			}
+
+			static double ToEnergy(double loudness)
+			{
+				return std::pow(10.0, (loudness + 0.691) / 10.0);
+			}
+
+			/// <summary>
+			/// 絶対ゲートと相対ゲートを適用したラウドネスを求めます
+			/// </summary>
+			static double GatedLoudness(const std::vector<double>& blocks, double relativeGate)
+			{
+				const double absoluteEnergy = ToEnergy(AbsoluteGate);
+				double sum = 0.0;
+				std::size_t count = 0;
+				for (const double energy : blocks) {
+					if (energy > absoluteEnergy) {
+						sum += energy;
+						++count;
+					}
+				}
+				if (count == 0) {
+					return -std::numeric_limits<double>::infinity();
+				}
+				const double relativeEnergy = ToEnergy(ToLoudness(sum / count) + relativeGate);
+				sum = 0.0;
+				count = 0;
+				for (const double energy : blocks) {
+					if (energy > absoluteEnergy && energy > relativeEnergy) {
+						sum += energy;
+						++count;
+					}
+				}
+				return count > 0 ? ToLoudness(sum / count) : -std::numeric_limits<double>::infinity();
+			}
+
+			/// <summary>
+			/// K 特性フィルタ (高域シェルフ + 高域通過) の係数をサンプリングレートに合わせて求めます
+			/// </summary>
+			void BuildKWeighting()
+			{
+				const double pi = 3.14159265358979323846;
+				{
+					const double f0 = 1681.974450955533;
+					const double gain = 3.999843853973347;
+					const double q = 0.7071752369554196;
+					const double k = std::tan(pi * f0 / m_sampleRate);
+					const double vh = std::pow(10.0, gain / 20.0);
+					const double vb = std::pow(vh, 0.4996667741545416);
+					const double a0 = 1.0 + k / q + k * k;
+					m_shelf[0] = (vh + vb * k / q + k * k) / a0;
+					m_shelf[1] = 2.0 * (k * k - vh) / a0;
+					m_shelf[2] = (vh - vb * k / q + k * k) / a0;
+					m_shelf[3] = 2.0 * (k * k - 1.0) / a0;
+					m_shelf[4] = (1.0 - k / q + k * k) / a0;
+				}
+				{
+					const double f0 = 38.13547087602444;
+					const double q = 0.5003270373238773;
+					const double k = std::tan(pi * f0 / m_sampleRate);
+					const double a0 = 1.0 + k / q + k * k;
+					m_highPass[0] = 2.0 * (k * k - 1.0) / a0;
+					m_highPass[1] = (1.0 - k / q + k * k) / a0;
+				}
+			}
+
+			/// <summary>
+			/// 4 倍オーバーサンプリングの補間フィルタ (カイザー窓付き sinc) を求めます
+			/// <para>4 つの位相の係数を 1 つのベクトルにまとめ、1 回の積和で 4 点を補間します。</para>
+			/// </summary>
+			void BuildTruePeakFilter()
+			{
+				const double pi = 3.14159265358979323846;
+				const double beta = 8.0;
+				const auto bessel = [](double x) {
+					double sum = 1.0, term = 1.0;
+					for (int k = 1; k < 32; ++k) {
+						term *= (x / (2.0 * k)) * (x / (2.0 * k));
+						sum += term;
+					}
+					return sum;
+				};
+				const int half = TruePeakTaps / 2;
+				for (int phase = 0; phase < 4; ++phase) {
+					double sum = 0.0;
+					double taps[TruePeakTaps];
+					for (int k = 0; k < TruePeakTaps; ++k) {
+						const double x = (k - half + 1) - phase / 4.0;
+						const double sinc = (x == 0.0) ? 1.0 : std::sin(pi * x) / (pi * x);
+						const double ratio = x / half;
+						const double window = (ratio <= -1.0 || ratio >= 1.0) ? 0.0 : bessel(beta * std::sqrt(1.0 - ratio * ratio)) / bessel(beta);
+						taps[k] = sinc * window;
+						sum += taps[k];
+					}
+					for (int k = 0; k < TruePeakTaps; ++k) {
+						m_truePeak[k * 4 + phase] = static_cast<float>(taps[k] / sum);
+					}
+				}
+			}
+
+			/// <summary>
+			/// 1 チャンネル分の K 特性フィルタ・100ms ごとのエネルギー・ピークを求めます
+			/// </summary>
+			void ProcessChannel(Channel& state, int frames, int position) const
+			{
+				const float* pSamples = state.Samples.data();
+				const float* pNew = pSamples + TruePeakTaps - 1;
+
+				// K 特性フィルタ (転置直接形 II、再帰のため倍精度のスカラー処理)
+				double s1 = state.Filter[0], s2 = state.Filter[1], h1 = state.Filter[2], h2 = state.Filter[3];
+				double sum = state.SubBlockSum;
+				for (int i = 0; i < frames; ++i) {
+					const double x = pNew[i];
+					const double y = m_shelf[0] * x + s1;
+					s1 = m_shelf[1] * x - m_shelf[3] * y + s2;
+					s2 = m_shelf[2] * x - m_shelf[4] * y;
+					const double z = y + h1;
+					h1 = -2.0 * y - m_highPass[0] * z + h2;
+					h2 = y - m_highPass[1] * z;
+					sum += z * z;
+					if (++position == m_subBlockSamples) {
+						state.Completed.push_back(sum);
+						sum = 0.0;
+						position = 0;
+					}
+				}
+				state.Filter[0] = s1;
+				state.Filter[1] = s2;
+				state.Filter[2] = h1;
+				state.Filter[3] = h2;
+				state.SubBlockSum = sum;
+
+				// トゥルーピーク (履歴を含めた各位置から 12 タップで 4 位相を同時に補間)
+				const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+				__m128 peak = _mm_setzero_ps();
+				__m128 samplePeak = _mm_setzero_ps();
+				int i = 0;
+				for (; i < frames; ++i) {
+					__m128 acc = _mm_setzero_ps();
+					for (int k = 0; k < TruePeakTaps; ++k) {
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pSamples[i + k]), _mm_loadu_ps(m_truePeak + k * 4)));
+					}
+					peak = _mm_max_ps(peak, _mm_and_ps(acc, mask));
+				}
+				for (i = 0; i + 4 <= frames; i += 4) {
+					samplePeak = _mm_max_ps(samplePeak, _mm_and_ps(_mm_loadu_ps(pNew + i), mask));
+				}
+				float peaks[4], samplePeaks[4];
+				_mm_storeu_ps(peaks, peak);
+				_mm_storeu_ps(samplePeaks, samplePeak);
+				for (int k = 0; k < 4; ++k) {
+					state.TruePeak = (std::max)(state.TruePeak, peaks[k]);
+					state.SamplePeak = (std::max)(state.SamplePeak, samplePeaks[k]);
+				}
+				for (; i < frames; ++i) {
+					state.SamplePeak = (std::max)(state.SamplePeak, pNew[i] < 0.0f ? -pNew[i] : pNew[i]);
+				}
+
+				std::copy(state.Samples.end() - (TruePeakTaps - 1), state.Samples.end(), state.History.begin());
+			}
+
+			/// <summary>
+			/// 100ms 分のエネルギーを追加し、400ms / 3 秒のブロックを作ります
+			/// </summary>
+			void AddSubBlock(double energy)
+			{
+				m_recent[m_recentCount % ShortTermSubBlocks] = energy;
+				++m_recentCount;
+				if (m_recentCount >= MomentarySubBlocks) {
+					double sum = 0.0;
+					for (int i = 1; i <= MomentarySubBlocks; ++i) {
+						sum += m_recent[(m_recentCount - i) % ShortTermSubBlocks];
+					}
+					m_momentary.push_back(sum / MomentarySubBlocks);
+				}
+				if (m_recentCount >= ShortTermSubBlocks) {
+					double sum = 0.0;
+					for (const double value : m_recent) {
+						sum += value;
+					}
+					m_shortTerm.push_back(sum / ShortTermSubBlocks);
+				}
+			}
+
+			const int m_channels;
+			const int m_sampleRate;
+			ThreadPool* m_pPool;
+			int m_subBlockSamples = 0;
+			double m_shelf[5] = {};
+			double m_highPass[2] = {};
+			float m_truePeak[TruePeakTaps * 4] = {};
+
+			std::vector<Channel> m_states;
+			int m_subBlockPosition = 0;
+			std::vector<double> m_recent;
+			long long m_recentCount = 0;
+			std::vector<double> m_momentary;
+			std::vector<double> m_shortTerm;
+		};
+	}
+}
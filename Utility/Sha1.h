@@ -0,0 +1,315 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "Simd.h"
+#include <algorithm>    // std::min
+#include <array>        // std::array
+#include <cstring>      // std::memcpy
+#include <string>       // std::string
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// SHA-1 ハッシュの計算
+		/// <para>SHA 拡張命令が使用可能な CPU では、それを使用してブロックを処理します。</para>
+		/// </summary>
+		class Sha1 final
+		{
+		public:
+			/// <summary>
+			/// ハッシュ値 (20バイト)
+			/// </summary>
+			using Digest = std::array<unsigned char, 20>;
+
+			enum : std::size_t {
+				/// <summary>
+				/// ブロックのバイト数
+				/// </summary>
+				BlockSize = 64,
+			};
+
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="useSha">false なら SHA 拡張命令が使用可能でも使用しません (結果の比較用)</param>
+			explicit Sha1(bool useSha = true)
+				: m_useSha(useSha && Simd::Has(Simd::Feature::SHA | Simd::Feature::SSE41))
+			{
+				Reset();
+			}
+
+			/// <summary>
+			/// 計算を最初からやり直します
+			/// </summary>
+			void Reset()
+			{
+				m_state = { 0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u };
+				m_length = 0;
+				m_bufferSize = 0;
+			}
+
+			/// <summary>
+			/// データを追加します
+			/// </summary>
+			/// <param name="pData">データ</param>
+			/// <param name="size">バイト数</param>
+			void Update(const void* pData, std::size_t size)
+			{
+				const unsigned char* p = static_cast<const unsigned char*>(pData);
+				m_length += size;
+
+				if (m_bufferSize > 0) {
+					const std::size_t fill = (std::min)(size, BlockSize - m_bufferSize);
+					std::memcpy(m_buffer + m_bufferSize, p, fill);
+					m_bufferSize += fill;
+					p += fill;
+					size -= fill;
+					if (m_bufferSize < BlockSize) {
+						return;
+					}
+					ProcessBlocks(m_buffer, 1);
+					m_bufferSize = 0;
+				}
+
+				const std::size_t blocks = size / BlockSize;
+				if (blocks > 0) {
+					ProcessBlocks(p, blocks);
+					p += blocks * BlockSize;
+					size -= blocks * BlockSize;
+				}
+
+				if (size > 0) {
+					std::memcpy(m_buffer, p, size);
+					m_bufferSize = size;
+				}
+			}
+
+			/// <summary>
+			/// 計算を終了してハッシュ値を取得します
+			/// <para>呼び出し後は Reset() するまで Update() できません。</para>
+			/// </summary>
+			/// <returns>
+			/// ハッシュ値
+			/// </returns>
+			Digest Finish()
+			{
+				const unsigned long long bits = m_length * 8;
+				unsigned char padding[BlockSize * 2] = { 0x80 };
+				const std::size_t paddingSize = ((m_bufferSize < 56) ? 56 : 120) - m_bufferSize;
+				for (int i = 0; i < 8; ++i) {
+					padding[paddingSize + i] = static_cast<unsigned char>(bits >> (56 - i * 8));
+				}
+				Update(padding, paddingSize + 8);
+
+				Digest digest = {};
+				for (std::size_t i = 0; i < m_state.size(); ++i) {
+					digest[i * 4 + 0] = static_cast<unsigned char>(m_state[i] >> 24);
+					digest[i * 4 + 1] = static_cast<unsigned char>(m_state[i] >> 16);
+					digest[i * 4 + 2] = static_cast<unsigned char>(m_state[i] >> 8);
+					digest[i * 4 + 3] = static_cast<unsigned char>(m_state[i]);
+				}
+				return digest;
+			}
+
+			/// <summary>
+			/// ハッシュ値を小文字の16進数文字列に変換します
+			/// <para>Constants::FileHash と同じ表記です。</para>
+			/// </summary>
+			/// <param name="digest">ハッシュ値</param>
+			/// <returns>
+			/// 40文字の16進数文字列
+			/// </returns>
+			static std::string ToHex(const Digest& digest)
+			{
+				static const char hex[] = "0123456789abcdef";
+				std::string result(digest.size() * 2, '0');
+				for (std::size_t i = 0; i < digest.size(); ++i) {
+					result[i * 2 + 0] = hex[digest[i] >> 4];
+					result[i * 2 + 1] = hex[digest[i] & 0x0F];
+				}
+				return result;
+			}
+
+		private:
+			/// <summary>
+			/// ブロックを処理します
+			/// </summary>
+			void ProcessBlocks(const unsigned char* p, std::size_t blocks)
+			{
+				if (m_useSha) {
+					ProcessBlocksSha(p, blocks);
+				}
+				else {
+					ProcessBlocksScalar(p, blocks);
+				}
+			}
+
+			/// <summary>
+			/// ブロックを処理します (拡張命令なし)
+			/// </summary>
+			void ProcessBlocksScalar(const unsigned char* p, std::size_t blocks)
+			{
+				for (; blocks > 0; --blocks, p += BlockSize) {
+					unsigned int w[80];
+					for (int i = 0; i < 16; ++i) {
+						w[i] = (static_cast<unsigned int>(p[i * 4]) << 24) | (static_cast<unsigned int>(p[i * 4 + 1]) << 16)
+							| (static_cast<unsigned int>(p[i * 4 + 2]) << 8) | static_cast<unsigned int>(p[i * 4 + 3]);
+					}
+					for (int i = 16; i < 80; ++i) {
+						w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+					}
+
+					unsigned int a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3], e = m_state[4];
+					for (int i = 0; i < 80; ++i) {
+						unsigned int f, k;
+						if (i < 20) {
+							f = (b & c) | (~b & d);
+							k = 0x5A827999u;
+						}
+						else if (i < 40) {
+							f = b ^ c ^ d;
+							k = 0x6ED9EBA1u;
+						}
+						else if (i < 60) {
+							f = (b & c) | (b & d) | (c & d);
+							k = 0x8F1BBCDCu;
+						}
+						else {
+							f = b ^ c ^ d;
+							k = 0xCA62C1D6u;
+						}
+						const unsigned int t = RotateLeft(a, 5) + f + e + k + w[i];
+						e = d;
+						d = c;
+						c = RotateLeft(b, 30);
+						b = a;
+						a = t;
+					}
+					m_state[0] += a;
+					m_state[1] += b;
+					m_state[2] += c;
+					m_state[3] += d;
+					m_state[4] += e;
+				}
+			}
+
+			/// <summary>
+			/// 4 ラウンド分を処理し、後続のメッセージスケジュールを進めます (SHA 拡張命令)
+			/// </summary>
+			/// <param name="abcd">状態 A, B, C, D</param>
+			/// <param name="e">このラウンドで使用する E</param>
+			/// <param name="nextE">次のラウンドで使用する E</param>
+			/// <param name="m0">このラウンドのメッセージ</param>
+			/// <param name="m1">1 つ後のメッセージ</param>
+			/// <param name="m2">2 つ後のメッセージ</param>
+			/// <param name="m3">3 つ後のメッセージ</param>
+			template<int Func>
+			static void Rounds4(__m128i& abcd, __m128i& e, __m128i& nextE, __m128i m0, __m128i& m1, __m128i& m2, __m128i& m3)
+			{
+				e = _mm_sha1nexte_epu32(e, m0);
+				nextE = abcd;
+				m1 = _mm_sha1msg2_epu32(m1, m0);
+				abcd = _mm_sha1rnds4_epu32(abcd, e, Func);
+				m3 = _mm_sha1msg1_epu32(m3, m0);
+				m2 = _mm_xor_si128(m2, m0);
+			}
+
+			/// <summary>
+			/// ブロックを処理します (SHA 拡張命令)
+			/// </summary>
+			void ProcessBlocksSha(const unsigned char* p, std::size_t blocks)
+			{
+				const __m128i mask = _mm_set_epi64x(0x0001020304050607ll, 0x08090A0B0C0D0E0Fll);
+				__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_state.data())), 0x1B);
+				__m128i e0 = _mm_set_epi32(static_cast<int>(m_state[4]), 0, 0, 0);
+
+				for (; blocks > 0; --blocks, p += BlockSize) {
+					const __m128i abcdSave = abcd;
+					const __m128i eSave = e0;
+					__m128i e1;
+
+					__m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0)), mask);
+					__m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), mask);
+					__m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), mask);
+					__m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), mask);
+
+					// 0 - 11
+					e0 = _mm_add_epi32(e0, m0);
+					e1 = abcd;
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+					e1 = _mm_sha1nexte_epu32(e1, m1);
+					e0 = abcd;
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+					m0 = _mm_sha1msg1_epu32(m0, m1);
+
+					e0 = _mm_sha1nexte_epu32(e0, m2);
+					e1 = abcd;
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+					m1 = _mm_sha1msg1_epu32(m1, m2);
+					m0 = _mm_xor_si128(m0, m2);
+
+					// 12 - 67
+					Rounds4<0>(abcd, e1, e0, m3, m0, m1, m2);
+					Rounds4<0>(abcd, e0, e1, m0, m1, m2, m3);
+					Rounds4<1>(abcd, e1, e0, m1, m2, m3, m0);
+					Rounds4<1>(abcd, e0, e1, m2, m3, m0, m1);
+					Rounds4<1>(abcd, e1, e0, m3, m0, m1, m2);
+					Rounds4<1>(abcd, e0, e1, m0, m1, m2, m3);
+					Rounds4<1>(abcd, e1, e0, m1, m2, m3, m0);
+					Rounds4<2>(abcd, e0, e1, m2, m3, m0, m1);
+					Rounds4<2>(abcd, e1, e0, m3, m0, m1, m2);
+					Rounds4<2>(abcd, e0, e1, m0, m1, m2, m3);
+					Rounds4<2>(abcd, e1, e0, m1, m2, m3, m0);
+					Rounds4<2>(abcd, e0, e1, m2, m3, m0, m1);
+					Rounds4<3>(abcd, e1, e0, m3, m0, m1, m2);
+					Rounds4<3>(abcd, e0, e1, m0, m1, m2, m3);
+
+					// 68 - 79
+					e1 = _mm_sha1nexte_epu32(e1, m1);
+					e0 = abcd;
+					m2 = _mm_sha1msg2_epu32(m2, m1);
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+					m3 = _mm_xor_si128(m3, m1);
+
+					e0 = _mm_sha1nexte_epu32(e0, m2);
+					e1 = abcd;
+					m3 = _mm_sha1msg2_epu32(m3, m2);
+					abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+					e1 = _mm_sha1nexte_epu32(e1, m3);
+					e0 = abcd;
+					abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+					e0 = _mm_sha1nexte_epu32(e0, eSave);
+					abcd = _mm_add_epi32(abcd, abcdSave);
+				}
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(m_state.data()), _mm_shuffle_epi32(abcd, 0x1B));
+				m_state[4] = static_cast<unsigned int>(_mm_extract_epi32(e0, 3));
+			}
+
+			static unsigned int RotateLeft(unsigned int value, int shift)
+			{
+				return (value << shift) | (value >> (32 - shift));
+			}
+
+			bool m_useSha;
+			std::array<unsigned int, 5> m_state;
+			unsigned long long m_length;
+			unsigned char m_buffer[BlockSize];
+			std::size_t m_bufferSize;
+		};
+	}
+}
@@ -0,0 +1,169 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include "../AviUtl.h"
+#include <intrin.h>     // __cpuid, _xgetbv, SSE/AVX/SHA intrinsics
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// SIMD 共通処理
+		/// <para>SSE2 は常に使用可能な前提とし、それ以上の命令セットは GetFeature() で判定してから使用します。</para>
+		/// </summary>
+		namespace Simd
+		{
+			/// <summary>
+			/// CPU 拡張命令のフラグ定数
+			/// </summary>
+			enum class Feature : int {
+				/// <summary>
+				/// 拡張命令なし
+				/// </summary>
+				None = 0,
+
+				/// <summary>
+				/// SSE2
+				/// </summary>
+				SSE2 = 1,
+
+				/// <summary>
+				/// SSSE3
+				/// </summary>
+				SSSE3 = 2,
+
+				/// <summary>
+				/// SSE4.1
+				/// </summary>
+				SSE41 = 4,
+
+				/// <summary>
+				/// AVX2 (OS による YMM レジスタ保存を含む)
+				/// </summary>
+				AVX2 = 8,
+
+				/// <summary>
+				/// SHA 拡張命令 (SHA-1 / SHA-256)
+				/// </summary>
+				SHA = 16,
+
+				/// <summary>
+				/// F16C (半精度浮動小数点数との変換、OS による YMM レジスタ保存を含む)
+				/// </summary>
+				F16C = 32,
+			};
+
+			// operators
+			AU_DECLARE_ENUMCLASS_OPERATOR(Feature)
+
+			/// <summary>
+			/// 実行中の CPU が対応している拡張命令を取得します
+			/// <para>初回呼び出し時に CPUID で判定し、以降はキャッシュした値を返します。</para>
+			/// </summary>
+			/// <returns>
+			/// 対応している拡張命令のフラグ
+			/// </returns>
+			inline Feature GetFeature()
+			{
+				static const Feature feature = []() {
+					Feature result = Feature::None;
+					int info[4] = {};
+					__cpuid(info, 0);
+					const int maxLeaf = info[0];
+
+					__cpuid(info, 1);
+					if (info[3] & (1 << 26)) { result |= Feature::SSE2; }
+					if (info[2] & (1 << 9)) { result |= Feature::SSSE3; }
+					if (info[2] & (1 << 19)) { result |= Feature::SSE41; }
+
+					// AVX2 / F16C は OS が YMM レジスタを保存する場合のみ使用可能
+					const bool osxsave = (info[2] & (1 << 27)) != 0;
+					const bool avx = (info[2] & (1 << 28)) != 0;
+					const bool ymm = osxsave && avx && (_xgetbv(0) & 6) == 6;
+					if (ymm && (info[2] & (1 << 29))) { result |= Feature::F16C; }
+					if (maxLeaf >= 7) {
+						__cpuidex(info, 7, 0);
+						if (ymm && (info[1] & (1 << 5))) { result |= Feature::AVX2; }
+						if (info[1] & (1 << 29)) { result |= Feature::SHA; }
+					}
+					return result;
+				}();
+				return feature;
+			}
+
+			/// <summary>
+			/// 指定した拡張命令が使用可能か調べます
+			/// </summary>
+			/// <param name="feature">調べる拡張命令</param>
+			/// <returns>
+			/// true なら使用可能
+			/// </returns>
+			inline bool Has(Feature feature)
+			{
+				return (GetFeature() & feature) == feature;
+			}
+
+			/// <summary>
+			/// Pixel_YC 8画素を Y, Cb, Cr の 3 レジスタに分離して読み込みます (SSSE3)
+			/// </summary>
+			/// <param name="pSrc">読み込む Pixel_YC へのポインタ (アライメント不要)</param>
+			/// <param name="y">輝度 8 要素</param>
+			/// <param name="cb">色差(青) 8 要素</param>
+			/// <param name="cr">色差(赤) 8 要素</param>
+			inline void LoadYC8(const Filter::Pixel_YC* pSrc, __m128i& y, __m128i& cb, __m128i& cr)
+			{
+				const __m128i* p = reinterpret_cast<const __m128i*>(pSrc);
+				const __m128i r0 = _mm_loadu_si128(p + 0); // Y0 U0 V0 Y1 U1 V1 Y2 U2
+				const __m128i r1 = _mm_loadu_si128(p + 1); // V2 Y3 U3 V3 Y4 U4 V4 Y5
+				const __m128i r2 = _mm_loadu_si128(p + 2); // U5 V5 Y6 U6 V6 Y7 U7 V7
+
+				y = _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(r0, _mm_setr_epi8(0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+					_mm_shuffle_epi8(r1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15, -1, -1, -1, -1))),
+					_mm_shuffle_epi8(r2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, 10, 11)));
+				cb = _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(r0, _mm_setr_epi8(2, 3, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+					_mm_shuffle_epi8(r1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 5, 10, 11, -1, -1, -1, -1, -1, -1))),
+					_mm_shuffle_epi8(r2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 6, 7, 12, 13)));
+				cr = _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(r0, _mm_setr_epi8(4, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+					_mm_shuffle_epi8(r1, _mm_setr_epi8(-1, -1, -1, -1, 0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1))),
+					_mm_shuffle_epi8(r2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15)));
+			}
+
+			/// <summary>
+			/// Y, Cb, Cr の 3 レジスタを Pixel_YC 8画素に合成して書き込みます (SSSE3)
+			/// </summary>
+			/// <param name="pDst">書き込む Pixel_YC へのポインタ (アライメント不要)</param>
+			/// <param name="y">輝度 8 要素</param>
+			/// <param name="cb">色差(青) 8 要素</param>
+			/// <param name="cr">色差(赤) 8 要素</param>
+			inline void StoreYC8(Filter::Pixel_YC* pDst, __m128i y, __m128i cb, __m128i cr)
+			{
+				__m128i* p = reinterpret_cast<__m128i*>(pDst);
+				_mm_storeu_si128(p + 0, _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(y, _mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5, -1, -1)),
+					_mm_shuffle_epi8(cb, _mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5))),
+					_mm_shuffle_epi8(cr, _mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1))));
+				_mm_storeu_si128(p + 1, _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, 10, 11)),
+					_mm_shuffle_epi8(cb, _mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1))),
+					_mm_shuffle_epi8(cr, _mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1))));
+				_mm_storeu_si128(p + 2, _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1)),
+					_mm_shuffle_epi8(cb, _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1))),
+					_mm_shuffle_epi8(cr, _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15))));
+			}
+		}
+	}
+}
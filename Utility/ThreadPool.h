@@ -0,0 +1,199 @@
+﻿/// Copyright (c) 2020 namarium
+/// Licensed under the MIT License.
+/// https://github.com/namarium/AviUtl_Plugin_SDK/blob/master/LICENSE
+
+#pragma once
+
+#include <atomic>               // std::atomic
+#include <condition_variable>   // std::condition_variable
+#include <deque>                // std::deque
+#include <functional>           // std::function
+#include <future>               // std::future, std::packaged_task
+#include <memory>               // std::shared_ptr, std::make_shared
+#include <mutex>                // std::mutex, std::unique_lock
+#include <thread>               // std::thread
+#include <utility>              // std::forward, std::move
+#include <vector>               // std::vector
+
+/// <summary>
+/// AviUtl Plugin SDK
+/// </summary>
+namespace AviUtl
+{
+	/// <summary>
+	/// ユーティリティ
+	/// </summary>
+	namespace Utility
+	{
+		/// <summary>
+		/// 固定数のワーカースレッドでタスクを処理するスレッドプール
+		/// <para>FilterProc() 内の処理分割には CallbackFunctionSet::ExecMultiThread を使用し、こちらはバックグラウンド処理 (索引作成や先読み) に使用します。</para>
+		/// <para>※ DLL のアンロード中 (ローダーロック中) にスレッドを join するとデッドロックするため、プラグインの Exit / FilterExit から Shutdown() を呼んでください。</para>
+		/// </summary>
+		class ThreadPool final
+		{
+		public:
+			/// <summary>
+			/// コンストラクタ
+			/// </summary>
+			/// <param name="threadNum">スレッド数 (0 ならCPUの論理コア数)</param>
+			explicit ThreadPool(int threadNum = 0)
+			{
+				if (threadNum <= 0) {
+					threadNum = static_cast<int>(std::thread::hardware_concurrency());
+					if (threadNum <= 0) {
+						threadNum = 1;
+					}
+				}
+				m_threads.reserve(threadNum);
+				for (int i = 0; i < threadNum; ++i) {
+					m_threads.emplace_back([this]() { Worker(); });
+				}
+			}
+
+			ThreadPool(const ThreadPool&) = delete;
+			ThreadPool& operator=(const ThreadPool&) = delete;
+
+			~ThreadPool() { Shutdown(); }
+
+			/// <summary>
+			/// 未処理のタスクを全て処理してから、ワーカースレッドを終了します
+			/// <para>終了後に投入したタスクは呼び出し元のスレッドで実行されます。</para>
+			/// </summary>
+			void Shutdown()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_stop = true;
+				}
+				m_condition.notify_all();
+				for (std::thread& thread : m_threads) {
+					if (thread.joinable()) {
+						thread.join();
+					}
+				}
+				m_threads.clear();
+			}
+
+			/// <summary>
+			/// ワーカースレッド数を取得します
+			/// </summary>
+			int GetThreadNum() const { return static_cast<int>(m_threads.size()); }
+
+			/// <summary>
+			/// タスクを投入します
+			/// </summary>
+			/// <param name="func">実行する関数オブジェクト</param>
+			/// <returns>
+			/// 実行結果を受け取る future
+			/// </returns>
+			template<class Func>
+			auto Submit(Func&& func) -> std::future<decltype(func())>
+			{
+				using Result = decltype(func());
+				auto pTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+				std::future<Result> result = pTask->get_future();
+				if (!Enqueue([pTask]() { (*pTask)(); })) {
+					(*pTask)();
+				}
+				return result;
+			}
+
+			/// <summary>
+			/// 0 ～ count-1 の各インデックスについて関数を並列に呼び出し、全て終わるまで待機します
+			/// <para>呼び出し元のスレッドも処理に参加するため、ワーカースレッドから呼び出してもデッドロックしません。</para>
+			/// </summary>
+			/// <param name="count">呼び出し回数</param>
+			/// <param name="func">void(int index) の関数オブジェクト</param>
+			template<class Func>
+			void ParallelFor(int count, Func&& func)
+			{
+				if (count <= 0) {
+					return;
+				}
+
+				struct State final
+				{
+					std::atomic<int> Next{ 0 };
+					std::atomic<int> Done{ 0 };
+					std::mutex Mutex;
+					std::condition_variable Condition;
+				};
+				auto pState = std::make_shared<State>();
+				const int total = count;
+
+				// 呼び出し元が戻った後に開始したヘルパーは、インデックスを取得できずに終了します
+				auto run = [pState, total, &func]() {
+					for (int index = pState->Next++; index < total; index = pState->Next++) {
+						func(index);
+						if (++pState->Done == total) {
+							std::lock_guard<std::mutex> lock(pState->Mutex);
+							pState->Condition.notify_all();
+						}
+					}
+				};
+
+				const int helperNum = (count - 1 < GetThreadNum()) ? count - 1 : GetThreadNum();
+				for (int i = 0; i < helperNum; ++i) {
+					// 呼び出し元が待機から戻るまで func は有効なので参照で渡せます
+					Enqueue([pState, total, run]() {
+						if (pState->Next.load() < total) {
+							run();
+						}
+					});
+				}
+				run();
+
+				std::unique_lock<std::mutex> lock(pState->Mutex);
+				pState->Condition.wait(lock, [&]() { return pState->Done.load() == total; });
+			}
+
+			/// <summary>
+			/// プロセス内で共有する既定のスレッドプールを取得します
+			/// <para>DLL のアンロード時 (ローダーロック中) にスレッドを join するとデッドロックするため、使用したプラグインは終了時 (Exit) に Shutdown() を呼び出してください。</para>
+			/// </summary>
+			static ThreadPool& GetDefault()
+			{
+				static ThreadPool pool;
+				return pool;
+			}
+
+		private:
+			bool Enqueue(std::function<void()> task)
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (m_stop) {
+						return false;
+					}
+					m_tasks.push_back(std::move(task));
+				}
+				m_condition.notify_one();
+				return true;
+			}
+
+			void Worker()
+			{
+				for (;;) {
+					std::function<void()> task;
+					{
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+						if (m_tasks.empty()) {
+							return;
+						}
+						task = std::move(m_tasks.front());
+						m_tasks.pop_front();
+					}
+					task();
+				}
+			}
+
+			std::vector<std::thread> m_threads;
+			std::deque<std::function<void()>> m_tasks;
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+			bool m_stop = false;
+		};
+	}
+}